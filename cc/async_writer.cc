@@ -0,0 +1,90 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async_writer.h"
+
+#include <utility>
+
+#include "absl/time/clock.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+AsyncWriter::AsyncWriter(int num_threads, int max_queue_size)
+    : max_queue_size_(max_queue_size),
+      queue_depth_(metrics_.GetGauge("writer/queue_depth")),
+      num_writes_(metrics_.GetCounter("writer/num_writes")),
+      num_producer_stalls_(metrics_.GetCounter("writer/num_producer_stalls")),
+      queue_latency_(metrics_.GetHistogram("writer/queue_latency_us")),
+      write_latency_(metrics_.GetHistogram("writer/write_latency_us")) {
+  MG_CHECK(num_threads > 0);
+  MG_CHECK(max_queue_size > 0);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&AsyncWriter::ThreadRun, this);
+  }
+}
+
+AsyncWriter::~AsyncWriter() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+void AsyncWriter::Write(Task task) {
+  absl::MutexLock lock(&mutex_);
+  if (!can_push()) {
+    num_producer_stalls_->Increment();
+    mutex_.Await(absl::Condition(this, &AsyncWriter::can_push));
+  }
+  queue_.push_back({std::move(task), absl::Now()});
+  queue_depth_->Set(queue_.size());
+}
+
+void AsyncWriter::Flush() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(this, &AsyncWriter::idle));
+}
+
+void AsyncWriter::ThreadRun() {
+  for (;;) {
+    QueuedTask queued;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &AsyncWriter::can_pop));
+      // Drain the queue before stopping.
+      if (queue_.empty()) {
+        return;
+      }
+      queued = std::move(queue_.front());
+      queue_.pop_front();
+      queue_depth_->Set(queue_.size());
+      num_running_ += 1;
+    }
+
+    auto start_time = absl::Now();
+    queue_latency_->RecordDuration(start_time - queued.queue_time);
+    queued.task();
+    write_latency_->RecordDuration(absl::Now() - start_time);
+    num_writes_->Increment();
+
+    absl::MutexLock lock(&mutex_);
+    num_running_ -= 1;
+  }
+}
+
+}  // namespace minigo
@@ -0,0 +1,94 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_ASYNC_WRITER_H_
+#define CC_ASYNC_WRITER_H_
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "cc/metrics.h"
+
+namespace minigo {
+
+// Runs write tasks, e.g. writing the training examples and SGFs of a finished
+// game, on a pool of background threads, so that the threads producing the
+// outputs don't wait on compression or remote filesystems.
+// The queue of pending tasks is bounded: Write blocks while it is full, so
+// a slow filesystem throttles the producers instead of buffering an unbounded
+// number of games in memory.
+class AsyncWriter {
+ public:
+  using Task = std::function<void()>;
+
+  // Starts `num_threads` writer threads. At most `max_queue_size` tasks wait
+  // for a writer thread at any time.
+  AsyncWriter(int num_threads, int max_queue_size);
+
+  // Runs all queued tasks before returning.
+  ~AsyncWriter();
+
+  // Queues `task` to be run on a writer thread, blocking while the queue is
+  // full.
+  void Write(Task task);
+
+  // Blocks until all tasks queued so far have finished running.
+  void Flush();
+
+  // Metrics on the queue depth and the latency of the tasks.
+  MetricsRegistry* metrics() { return &metrics_; }
+
+ private:
+  struct QueuedTask {
+    Task task;
+    absl::Time queue_time;
+  };
+
+  void ThreadRun();
+
+  bool can_push() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return static_cast<int>(queue_.size()) < max_queue_size_;
+  }
+  bool can_pop() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return !queue_.empty() || stopping_;
+  }
+  bool idle() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return queue_.empty() && num_running_ == 0;
+  }
+
+  const int max_queue_size_;
+
+  absl::Mutex mutex_;
+  std::deque<QueuedTask> queue_ GUARDED_BY(&mutex_);
+  int num_running_ GUARDED_BY(&mutex_) = 0;
+  bool stopping_ GUARDED_BY(&mutex_) = false;
+
+  MetricsRegistry metrics_;
+  Gauge* queue_depth_;
+  Counter* num_writes_;
+  Counter* num_producer_stalls_;
+  Histogram* queue_latency_;
+  Histogram* write_latency_;
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_ASYNC_WRITER_H_
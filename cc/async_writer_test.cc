@@ -0,0 +1,80 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/async_writer.h"
+
+#include <atomic>
+#include <thread>
+
+#include "absl/synchronization/notification.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(AsyncWriterTest, RunsAllTasks) {
+  std::atomic<int> num_written{0};
+  {
+    AsyncWriter writer(3, 4);
+    for (int i = 0; i < 100; ++i) {
+      writer.Write([&num_written]() { num_written += 1; });
+    }
+    writer.Flush();
+    EXPECT_EQ(100, num_written);
+    EXPECT_EQ(100, writer.metrics()->GetCounter("writer/num_writes")->value());
+    EXPECT_EQ(0, writer.metrics()->GetGauge("writer/queue_depth")->value());
+
+    writer.Write([&num_written]() { num_written += 1; });
+  }
+  // The destructor runs the remaining tasks.
+  EXPECT_EQ(101, num_written);
+}
+
+// Verify that Write blocks while the queue is full.
+TEST(AsyncWriterTest, QueueIsBounded) {
+  AsyncWriter writer(1, 2);
+  absl::Notification blocked;
+  absl::Notification unblock;
+  writer.Write([&]() {
+    blocked.Notify();
+    unblock.WaitForNotification();
+  });
+  blocked.WaitForNotification();
+
+  // The writer thread is busy, so these fill the queue.
+  writer.Write([]() {});
+  writer.Write([]() {});
+  auto* depth = writer.metrics()->GetGauge("writer/queue_depth");
+  auto* stalls = writer.metrics()->GetCounter("writer/num_producer_stalls");
+  EXPECT_EQ(2, depth->value());
+  EXPECT_EQ(0, stalls->value());
+
+  absl::Notification written;
+  std::thread producer([&]() {
+    writer.Write([]() {});
+    written.Notify();
+  });
+  EXPECT_FALSE(written.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+
+  unblock.Notify();
+  written.WaitForNotification();
+  producer.join();
+  writer.Flush();
+  EXPECT_EQ(1, stalls->value());
+  EXPECT_EQ(4, writer.metrics()->GetCounter("writer/num_writes")->value());
+}
+
+}  // namespace
+}  // namespace minigo
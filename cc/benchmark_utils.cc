@@ -0,0 +1,33 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/benchmark_utils.h"
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+std::vector<int> ParseIntList(absl::string_view str) {
+  std::vector<int> result;
+  for (auto part : absl::StrSplit(str, ',', absl::SkipEmpty())) {
+    int x;
+    MG_CHECK(absl::SimpleAtoi(part, &x)) << "Can't parse \"" << part << "\"";
+    result.push_back(x);
+  }
+  return result;
+}
+
+}  // namespace minigo
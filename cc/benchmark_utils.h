@@ -0,0 +1,31 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_BENCHMARK_UTILS_H_
+#define CC_BENCHMARK_UTILS_H_
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace minigo {
+
+// Parses a comma-separated list of integers, such as a benchmark flag listing
+// the thread counts or batch sizes to run, e.g. "1,8,16". Dies if an element
+// isn't an integer.
+std::vector<int> ParseIntList(absl::string_view str);
+
+}  // namespace minigo
+
+#endif  // CC_BENCHMARK_UTILS_H_
@@ -0,0 +1,197 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/compact_game.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "cc/check.h"
+#include "cc/position.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr char kMagic[] = "MGG2";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+void PutVarint(uint64_t x, std::string* dst) {
+  while (x >= 0x80) {
+    dst->push_back(static_cast<char>((x & 0x7f) | 0x80));
+    x >>= 7;
+  }
+  dst->push_back(static_cast<char>(x));
+}
+
+void PutFixed(uint32_t x, int num_bytes, std::string* dst) {
+  for (int i = 0; i < num_bytes; ++i) {
+    dst->push_back(static_cast<char>(x >> (8 * i)));
+  }
+}
+
+void PutFloat(float x, std::string* dst) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  PutFixed(bits, 4, dst);
+}
+
+// Reads the values written by the Put functions, returning false once the
+// data runs out.
+class Reader {
+ public:
+  explicit Reader(absl::string_view data) : data_(data) {}
+
+  bool done() const { return data_.empty(); }
+
+  bool GetVarint(uint64_t* x) {
+    *x = 0;
+    for (int shift = 0; shift < 64 && !data_.empty(); shift += 7) {
+      auto byte = static_cast<uint8_t>(data_.front());
+      data_.remove_prefix(1);
+      *x |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool GetFixed(int num_bytes, uint32_t* x) {
+    if (data_.size() < static_cast<size_t>(num_bytes)) {
+      return false;
+    }
+    *x = 0;
+    for (int i = 0; i < num_bytes; ++i) {
+      *x |= static_cast<uint32_t>(static_cast<uint8_t>(data_[i])) << (8 * i);
+    }
+    data_.remove_prefix(num_bytes);
+    return true;
+  }
+
+  bool GetFloat(float* x) {
+    uint32_t bits;
+    if (!GetFixed(4, &bits)) {
+      return false;
+    }
+    memcpy(x, &bits, sizeof(bits));
+    return true;
+  }
+
+  bool GetPrefix(absl::string_view prefix) {
+    if (data_.substr(0, prefix.size()) != prefix) {
+      return false;
+    }
+    data_.remove_prefix(prefix.size());
+    return true;
+  }
+
+ private:
+  absl::string_view data_;
+};
+
+}  // namespace
+
+std::string EncodeCompactGame(const CompactGame& game) {
+  std::string result(kMagic, kMagicSize);
+  PutFixed(kN, 1, &result);
+  PutFloat(game.komi, &result);
+  PutFloat(game.result, &result);
+  PutVarint(game.moves.size(), &result);
+
+  for (const auto& move : game.moves) {
+    const auto& visits = move.search_visits;
+    PutVarint(move.c, &result);
+    PutVarint(visits.counts.size() * 2 + (visits.squash ? 1 : 0), &result);
+    int prev = 0;
+    for (const auto& count : visits.counts) {
+      MG_DCHECK(count.c >= prev);
+      PutVarint(count.c - prev, &result);
+      PutVarint(count.n, &result);
+      prev = count.c;
+    }
+  }
+  return result;
+}
+
+bool DecodeCompactGame(absl::string_view data, CompactGame* game) {
+  Reader reader(data);
+  uint32_t board_size;
+  uint64_t num_moves;
+  if (!reader.GetPrefix({kMagic, kMagicSize}) ||
+      !reader.GetFixed(1, &board_size) || board_size != kN ||
+      !reader.GetFloat(&game->komi) || !reader.GetFloat(&game->result) ||
+      !reader.GetVarint(&num_moves)) {
+    return false;
+  }
+
+  game->moves.clear();
+  for (uint64_t i = 0; i < num_moves; ++i) {
+    uint64_t c, num_counts;
+    if (!reader.GetVarint(&c) || c >= kNumMoves ||
+        !reader.GetVarint(&num_counts) || num_counts / 2 > kNumMoves) {
+      return false;
+    }
+    game->moves.emplace_back();
+    auto& move = game->moves.back();
+    move.c = static_cast<uint16_t>(c);
+    auto& visits = move.search_visits;
+    visits.squash = (num_counts & 1) != 0;
+    visits.counts.resize(num_counts / 2);
+    uint64_t prev = 0;
+    for (auto& count : visits.counts) {
+      uint64_t delta, n;
+      if (!reader.GetVarint(&delta) || prev + delta >= kNumMoves ||
+          !reader.GetVarint(&n) || n > UINT32_MAX) {
+        return false;
+      }
+      prev += delta;
+      count.c = static_cast<uint16_t>(prev);
+      count.n = static_cast<uint32_t>(n);
+    }
+  }
+  return reader.done();
+}
+
+void ReplayCompactGame(const CompactGame& game,
+                       absl::Span<const int> move_indices,
+                       const CompactGameExampleFn& fn) {
+  BoardVisitor bv;
+  GroupVisitor gv;
+  Position position(&bv, &gv, Color::kBlack);
+
+  // The stones before the last kMoveHistory moves, indexed by move number
+  // modulo kMoveHistory.
+  std::array<Position::Stones, DualNet::kMoveHistory> recent_stones;
+  std::vector<const Position::Stones*> history;
+  DualNet::BoardFeatures features;
+
+  int num_moves = static_cast<int>(game.moves.size());
+  auto next = move_indices.begin();
+  for (int i = 0; i < num_moves && next != move_indices.end(); ++i) {
+    recent_stones[i % DualNet::kMoveHistory] = position.stones();
+    if (*next == i) {
+      history.clear();
+      for (int j = 0; j < DualNet::kMoveHistory && j <= i; ++j) {
+        history.push_back(&recent_stones[(i - j) % DualNet::kMoveHistory]);
+      }
+      DualNet::SetFeatures(history, position.to_play(), &features);
+      fn(i, features, game.moves[i].search_visits.ToSearchPi(), game.result);
+      ++next;
+    }
+    position.PlayMove(game.moves[i].c);
+  }
+}
+
+}  // namespace minigo
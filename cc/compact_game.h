@@ -0,0 +1,83 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_COMPACT_GAME_H_
+#define CC_COMPACT_GAME_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "cc/constants.h"
+#include "cc/coord.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/search_visits.h"
+
+namespace minigo {
+
+// A selfplay game in a compact form that its training examples can be
+// reconstructed from: the moves played, the search visit counts before each
+// move, and the outcome. The board features of each example are recreated by
+// replaying the moves from an empty board, so a game takes a few kilobytes
+// instead of the ~7.5kB per move of the equivalent 19x19 tf.Examples.
+struct CompactGame {
+  struct Move {
+    Coord c = Coord::kPass;
+
+    // The visit counts that the search probabilities are computed from.
+    SearchVisits search_visits;
+  };
+
+  float komi = kDefaultKomi;
+
+  // The game's outcome from black's perspective: 1 if black won, -1 if white
+  // won.
+  float result = 0;
+
+  std::vector<Move> moves;
+};
+
+// Encodes `game` in a binary format. The format is little endian:
+//   "MGG2" magic, uint8 board size, float32 komi, float32 result,
+//   varint number of moves, then for each move:
+//     varint coord,
+//     varint number of visit counts * 2 + 1 if the counts are squashed,
+//     then for each visit count:
+//       varint move delta from the previous count, varint count
+std::string EncodeCompactGame(const CompactGame& game);
+
+// Decodes a game written by EncodeCompactGame. Returns false if `data` isn't
+// a valid game for the compiled board size.
+bool DecodeCompactGame(absl::string_view data, CompactGame* game);
+
+// Called with the training example for a move of a replayed game.
+using CompactGameExampleFn =
+    std::function<void(int move_index, const DualNet::BoardFeatures& features,
+                       const std::array<float, kNumMoves>& search_pi,
+                       float outcome)>;
+
+// Replays the moves of `game` from an empty board, calling `fn` with the
+// training example for each move in `move_indices`, which must be sorted.
+// The examples match those that selfplay writes in the tfrecord format.
+void ReplayCompactGame(const CompactGame& game,
+                       absl::Span<const int> move_indices,
+                       const CompactGameExampleFn& fn);
+
+}  // namespace minigo
+
+#endif  // CC_COMPACT_GAME_H_
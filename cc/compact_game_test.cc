@@ -0,0 +1,147 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/compact_game.h"
+
+#include <array>
+#include <vector>
+
+#include "cc/position.h"
+#include "cc/random.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+// Plays a game of random legal moves, ending with two passes. Fills `stones`
+// with the stones on the board before each move.
+CompactGame PlayRandomGame(int num_moves,
+                           std::vector<Position::Stones>* stones) {
+  Random rnd(17);
+  BoardVisitor bv;
+  GroupVisitor gv;
+  Position position(&bv, &gv, Color::kBlack);
+
+  CompactGame game;
+  game.komi = 6.5;
+  game.result = -1;
+  for (int i = 0; i < num_moves + 2; ++i) {
+    Coord c = Coord::kPass;
+    if (i < num_moves) {
+      do {
+        c = rnd.UniformInt(0, kN * kN - 1);
+      } while (!position.IsMoveLegal(c));
+    }
+
+    CompactGame::Move move;
+    move.c = c;
+    if (c == Coord::kPass) {
+      move.search_visits.counts = {{Coord::kPass, 8}};
+    } else {
+      move.search_visits.counts = {{c, 6}, {Coord::kPass, 2}};
+    }
+    move.search_visits.squash = i < 10;
+    game.moves.push_back(move);
+    stones->push_back(position.stones());
+    position.PlayMove(c);
+  }
+  return game;
+}
+
+TEST(CompactGameTest, RoundTrip) {
+  CompactGame game;
+  game.komi = 7.5;
+  game.result = 1;
+  game.moves.resize(3);
+  game.moves[0].c = 0;
+  game.moves[0].search_visits.counts = {{0, 60}, {5, 300}, {Coord::kPass, 1}};
+  game.moves[0].search_visits.squash = true;
+  game.moves[1].c = kN * kN - 1;
+  game.moves[1].search_visits.counts = {{kN * kN - 1, 100000}};
+  game.moves[2].c = Coord::kPass;
+
+  CompactGame decoded;
+  ASSERT_TRUE(DecodeCompactGame(EncodeCompactGame(game), &decoded));
+  EXPECT_EQ(7.5, decoded.komi);
+  EXPECT_EQ(1, decoded.result);
+  ASSERT_EQ(game.moves.size(), decoded.moves.size());
+  for (size_t i = 0; i < game.moves.size(); ++i) {
+    const auto& expected = game.moves[i];
+    const auto& actual = decoded.moves[i];
+    EXPECT_EQ(expected.c, actual.c);
+    EXPECT_EQ(expected.search_visits.squash, actual.search_visits.squash);
+    ASSERT_EQ(expected.search_visits.counts.size(),
+              actual.search_visits.counts.size());
+    for (size_t j = 0; j < expected.search_visits.counts.size(); ++j) {
+      EXPECT_EQ(expected.search_visits.counts[j].c,
+                actual.search_visits.counts[j].c);
+      EXPECT_EQ(expected.search_visits.counts[j].n,
+                actual.search_visits.counts[j].n);
+    }
+  }
+}
+
+TEST(CompactGameTest, RejectsInvalidData) {
+  std::vector<Position::Stones> stones;
+  auto data = EncodeCompactGame(PlayRandomGame(20, &stones));
+  CompactGame game;
+  ASSERT_TRUE(DecodeCompactGame(data, &game));
+
+  EXPECT_FALSE(DecodeCompactGame("", &game));
+  EXPECT_FALSE(DecodeCompactGame(data.substr(0, data.size() - 1), &game));
+  EXPECT_FALSE(DecodeCompactGame(data + "x", &game));
+
+  auto bad_magic = data;
+  bad_magic[0] = 'X';
+  EXPECT_FALSE(DecodeCompactGame(bad_magic, &game));
+
+  auto bad_board_size = data;
+  bad_board_size[4] = kN + 1;
+  EXPECT_FALSE(DecodeCompactGame(bad_board_size, &game));
+}
+
+// Verify that replaying a game produces the same features as the positions
+// that the game was played from.
+TEST(CompactGameTest, Replay) {
+  std::vector<Position::Stones> stones;
+  auto game = PlayRandomGame(30, &stones);
+  CompactGame decoded;
+  ASSERT_TRUE(DecodeCompactGame(EncodeCompactGame(game), &decoded));
+
+  std::vector<int> move_indices = {0, 1, 7, 8, 9, 20, 31};
+  std::vector<int> replayed;
+  DualNet::BoardFeatures expected;
+  std::vector<const Position::Stones*> history;
+  ReplayCompactGame(
+      decoded, move_indices,
+      [&](int i, const DualNet::BoardFeatures& features,
+          const std::array<float, kNumMoves>& search_pi, float outcome) {
+        replayed.push_back(i);
+        history.clear();
+        for (int j = 0; j < DualNet::kMoveHistory && j <= i; ++j) {
+          history.push_back(&stones[i - j]);
+        }
+        auto to_play = i % 2 == 0 ? Color::kBlack : Color::kWhite;
+        DualNet::SetFeatures(history, to_play, &expected);
+        EXPECT_EQ(expected, features) << "move " << i;
+
+        EXPECT_EQ(game.moves[i].search_visits.ToSearchPi(), search_pi);
+        EXPECT_EQ(-1, outcome);
+      });
+  EXPECT_EQ(move_indices, replayed);
+}
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,210 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs two models on every position of a set of SGF games and reports how
+// closely their outputs agree and how fast each model is. This is intended
+// for checking the accuracy lost by a quantized or otherwise approximated
+// model, e.g.:
+//
+//   compare_models --engine=lite --model=float.tflite
+//       --model_two=quantized.tflite games/*.sgf
+//
+// To compare the strength of the two models, play them against each other
+// with `main --mode=eval` using the same flags.
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/check.h"
+#include "cc/constants.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/dual_net/factory.h"
+#include "cc/init.h"
+#include "cc/position.h"
+#include "cc/sgf.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(model, "", "Path to the reference model.");
+DEFINE_string(model_two, "", "Path to the model to compare against it.");
+DEFINE_int32(batch_size, 8, "Number of positions per inference.");
+
+// Required by the remote inference engine.
+DEFINE_int32(virtual_losses, 8,
+             "Number of virtual losses, which sets the remote inference "
+             "batch size.");
+
+namespace minigo {
+namespace {
+
+// Accumulates the differences between the outputs of the two models.
+class Comparison {
+ public:
+  void Add(const DualNet::Output& a, const DualNet::Output& b) {
+    num_positions_ += 1;
+
+    auto best_a = std::max_element(a.policy.begin(), a.policy.end());
+    auto best_b = std::max_element(b.policy.begin(), b.policy.end());
+    if (best_a - a.policy.begin() == best_b - b.policy.begin()) {
+      num_same_best_move_ += 1;
+    }
+
+    double distance = 0;
+    double kl = 0;
+    for (int i = 0; i < kNumMoves; ++i) {
+      distance += std::abs(a.policy[i] - b.policy[i]);
+      if (a.policy[i] > 0) {
+        kl += a.policy[i] *
+              std::log(a.policy[i] / std::max<double>(b.policy[i], 1e-9));
+      }
+    }
+    total_policy_distance_ += distance / 2;
+    total_policy_kl_ += kl;
+
+    double value_error = std::abs(a.value - b.value);
+    total_value_error_ += value_error;
+    max_value_error_ = std::max(max_value_error_, value_error);
+    if ((a.value < 0) == (b.value < 0)) {
+      num_same_value_sign_ += 1;
+    }
+  }
+
+  void Report() const {
+    double n = std::max(1, num_positions_);
+    std::cout << "Positions: " << num_positions_ << "\n"
+              << "Same best move: " << 100 * num_same_best_move_ / n << "%\n"
+              << "Mean policy total variation distance: "
+              << total_policy_distance_ / n << "\n"
+              << "Mean policy KL divergence: " << total_policy_kl_ / n << "\n"
+              << "Mean value error: " << total_value_error_ / n << "\n"
+              << "Max value error: " << max_value_error_ << "\n"
+              << "Same value sign: " << 100 * num_same_value_sign_ / n
+              << "%\n";
+  }
+
+ private:
+  int num_positions_ = 0;
+  int num_same_best_move_ = 0;
+  int num_same_value_sign_ = 0;
+  double total_policy_distance_ = 0;
+  double total_policy_kl_ = 0;
+  double total_value_error_ = 0;
+  double max_value_error_ = 0;
+};
+
+// Returns the features of every position in the main line of the game in
+// `path`, including the final one.
+std::vector<DualNet::BoardFeatures> GetGameFeatures(const std::string& path) {
+  std::ifstream f(path);
+  MG_CHECK(f.is_open()) << "Couldn't read " << path;
+  std::stringstream buffer;
+  buffer << f.rdbuf();
+  sgf::Ast ast;
+  MG_CHECK(ast.Parse(buffer.str())) << "Couldn't parse " << path << ": "
+                                    << ast.error();
+
+  BoardVisitor bv;
+  GroupVisitor gv;
+  Position position(&bv, &gv, Color::kBlack);
+  std::vector<Position::Stones> stones = {position.stones()};
+  std::vector<Color> to_play = {position.to_play()};
+  for (const auto& move : sgf::GetMainLineMoves(ast)) {
+    position.PlayMove(move.c, move.color);
+    stones.push_back(position.stones());
+    to_play.push_back(position.to_play());
+  }
+
+  std::vector<DualNet::BoardFeatures> features(stones.size());
+  std::vector<const Position::Stones*> history;
+  for (size_t i = 0; i < stones.size(); ++i) {
+    history.clear();
+    for (size_t j = 0; j < DualNet::kMoveHistory && j <= i; ++j) {
+      history.push_back(&stones[i - j]);
+    }
+    DualNet::SetFeatures(history, to_play[i], &features[i]);
+  }
+  return features;
+}
+
+// Runs `dual_net` on `features` in batches of FLAGS_batch_size, padding the
+// last batch if necessary, and adds the time taken to `duration`.
+std::vector<DualNet::Output> Run(
+    DualNet* dual_net, const std::vector<DualNet::BoardFeatures>& features,
+    absl::Duration* duration) {
+  std::vector<DualNet::Output> outputs(features.size());
+  std::vector<DualNet::BoardFeatures> batch(FLAGS_batch_size);
+  std::vector<DualNet::Output> batch_outputs(FLAGS_batch_size);
+  for (size_t i = 0; i < features.size(); i += FLAGS_batch_size) {
+    size_t n = std::min<size_t>(FLAGS_batch_size, features.size() - i);
+    for (int j = 0; j < FLAGS_batch_size; ++j) {
+      batch[j] = features[i + std::min<size_t>(j, n - 1)];
+    }
+    auto start = absl::Now();
+    dual_net->RunMany(batch, absl::MakeSpan(batch_outputs), nullptr);
+    *duration += absl::Now() - start;
+    std::copy(batch_outputs.begin(), batch_outputs.begin() + n,
+              outputs.begin() + i);
+  }
+  return outputs;
+}
+
+void CompareModels(const std::vector<std::string>& sgf_paths) {
+  MG_CHECK(!FLAGS_model.empty() && !FLAGS_model_two.empty())
+      << "--model and --model_two must both be set";
+  MG_CHECK(FLAGS_batch_size > 0);
+  MG_CHECK(!sgf_paths.empty()) << "No SGF files given";
+
+  auto factory_a = NewDualNetFactory(FLAGS_model, 1);
+  auto factory_b = NewDualNetFactory(FLAGS_model_two, 1);
+  auto dual_net_a = factory_a->New();
+  auto dual_net_b = factory_b->New();
+
+  Comparison comparison;
+  absl::Duration duration_a;
+  absl::Duration duration_b;
+  int num_positions = 0;
+  for (const auto& path : sgf_paths) {
+    auto features = GetGameFeatures(path);
+    auto outputs_a = Run(dual_net_a.get(), features, &duration_a);
+    auto outputs_b = Run(dual_net_b.get(), features, &duration_b);
+    for (size_t i = 0; i < features.size(); ++i) {
+      comparison.Add(outputs_a[i], outputs_b[i]);
+    }
+    num_positions += features.size();
+  }
+
+  comparison.Report();
+  std::cout << FLAGS_model << ": "
+            << num_positions / absl::ToDoubleSeconds(duration_a)
+            << " positions/s\n"
+            << FLAGS_model_two << ": "
+            << num_positions / absl::ToDoubleSeconds(duration_b)
+            << " positions/s" << std::endl;
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::CompareModels({argv + 1, argv + argc});
+  return 0;
+}
@@ -0,0 +1,95 @@
+#!/bin/bash
+#
+# Compiles a frozen model into C++ with XLA's ahead-of-time compiler, for use
+# by the aot inference engine. Run cc/configure_tensorflow.sh first to build
+# tfcompile. Usage:
+#
+#   BOARD_SIZE=19 ./cc/compile_aot_model.sh saved_models/000256-opossum.pb 8
+#
+# compiles the model for batches of 8 boards. The generated files are written
+# to cc/dual_net/aot_model, from where they are linked into the binaries built
+# with --define=aot=1.
+
+set -e
+
+if [ $# -ne 2 ]; then
+  echo "Usage: $0 MODEL.pb BATCH_SIZE"
+  exit 1
+fi
+
+model_path="$1"
+batch_size="$2"
+board_size="${BOARD_SIZE:-19}"
+num_stone_features=17
+
+script_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+dst_dir="${script_dir}/dual_net/aot_model"
+model_name="$(basename "${model_path}" .pb)"
+mkdir -p "${dst_dir}"
+
+cat > "${dst_dir}/dual_net_model.config.pbtxt" <<EOF
+feed {
+  id { node_name: "pos_tensor" }
+  shape {
+    dim { size: ${batch_size} }
+    dim { size: ${board_size} }
+    dim { size: ${board_size} }
+    dim { size: ${num_stone_features} }
+  }
+  name: "pos_tensor"
+}
+fetch {
+  id { node_name: "policy_output" }
+  name: "policy"
+}
+fetch {
+  id { node_name: "value_output" }
+  name: "value"
+}
+EOF
+
+echo "Compiling ${model_path} for batch size ${batch_size}"
+"${script_dir}/tensorflow/tfcompile" \
+  --graph="${model_path}" \
+  --config="${dst_dir}/dual_net_model.config.pbtxt" \
+  --cpp_class="minigo::aot::DualNetModel" \
+  --target_features="${TARGET_FEATURES:-}" \
+  --out_header="${dst_dir}/dual_net_model.h" \
+  --out_object="${dst_dir}/dual_net_model.o"
+
+cat > "${dst_dir}/dual_net_model_info.h" <<EOF
+// Generated by cc/compile_aot_model.sh. Do not edit.
+
+#ifndef CC_DUAL_NET_AOT_MODEL_DUAL_NET_MODEL_INFO_H_
+#define CC_DUAL_NET_AOT_MODEL_DUAL_NET_MODEL_INFO_H_
+
+namespace minigo {
+namespace aot {
+
+constexpr char kModelName[] = "${model_name}";
+constexpr int kBoardSize = ${board_size};
+constexpr int kBatchSize = ${batch_size};
+
+}  // namespace aot
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_AOT_MODEL_DUAL_NET_MODEL_INFO_H_
+EOF
+
+cat > "${dst_dir}/BUILD" <<EOF
+# Generated by cc/compile_aot_model.sh. Do not edit.
+
+package(default_visibility = ["//cc/dual_net:__pkg__"])
+
+cc_library(
+    name = "aot_model",
+    srcs = ["dual_net_model.o"],
+    hdrs = [
+        "dual_net_model.h",
+        "dual_net_model_info.h",
+    ],
+    deps = ["//cc:xla_aot_runtime"],
+)
+EOF
+
+echo "Wrote ${dst_dir}"
@@ -0,0 +1,181 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/compression.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+namespace {
+
+// The size of the deflate window: the distance that a block can refer back
+// into the data before it.
+constexpr size_t kWindowSize = 32 * 1024;
+
+// Returns the two byte zlib header for a stream compressed at `level`.
+std::string ZlibHeader(int level) {
+  // The compression method is deflate with a 32kB window, and the level is
+  // informational. The check bits make the header a multiple of 31.
+  int flevel;
+  if (level == Z_DEFAULT_COMPRESSION || level == 6) {
+    flevel = 2;
+  } else if (level < 2) {
+    flevel = 0;
+  } else if (level < 6) {
+    flevel = 1;
+  } else {
+    flevel = 3;
+  }
+  int header = (0x78 << 8) | (flevel << 6);
+  header += 31 - header % 31;
+  return {static_cast<char>(header >> 8), static_cast<char>(header & 0xff)};
+}
+
+// Deflates `block` to a raw deflate stream, using `dictionary` as the data
+// that precedes it. Unless `last` is set, the output ends on a byte boundary
+// without a final block, so that the next block's output can be appended to
+// it.
+std::string DeflateBlock(absl::string_view block, absl::string_view dictionary,
+                         int level, bool last) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  MG_CHECK(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                        Z_DEFAULT_STRATEGY) == Z_OK);
+  if (!dictionary.empty()) {
+    MG_CHECK(deflateSetDictionary(
+                 &stream, reinterpret_cast<const Bytef*>(dictionary.data()),
+                 dictionary.size()) == Z_OK);
+  }
+
+  std::string output;
+  output.resize(deflateBound(&stream, block.size()) + 16);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(block.data()));
+  stream.avail_in = block.size();
+  size_t size = 0;
+  for (;;) {
+    stream.next_out = reinterpret_cast<Bytef*>(&output[size]);
+    stream.avail_out = output.size() - size;
+    int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    MG_CHECK(ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR) << ret;
+    size = output.size() - stream.avail_out;
+    if (stream.avail_out != 0) {
+      break;
+    }
+    output.resize(output.size() * 2);
+  }
+  MG_CHECK(stream.avail_in == 0);
+  deflateEnd(&stream);
+  output.resize(size);
+  return output;
+}
+
+}  // namespace
+
+bool ParseCompressionOptions(absl::string_view spec,
+                             CompressionOptions* options) {
+  CompressionOptions result;
+  if (spec == "none") {
+    result.codec = CompressionOptions::Codec::kNone;
+  } else if (absl::ConsumePrefix(&spec, "zlib")) {
+    result.codec = CompressionOptions::Codec::kZlib;
+    if (!spec.empty()) {
+      if (!absl::ConsumePrefix(&spec, ":") ||
+          !absl::SimpleAtoi(spec, &result.level) || result.level < 0 ||
+          result.level > 9) {
+        return false;
+      }
+    }
+  } else {
+    return false;
+  }
+  *options = result;
+  return true;
+}
+
+ParallelZlibCompressor::ParallelZlibCompressor(int num_threads,
+                                               size_t block_size)
+    : block_size_(block_size) {
+  MG_CHECK(num_threads > 0);
+  MG_CHECK(block_size_ > 0);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ParallelZlibCompressor::ThreadRun, this);
+  }
+}
+
+ParallelZlibCompressor::~ParallelZlibCompressor() {
+  // An empty task tells a thread to exit.
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    queue_.Push(nullptr);
+  }
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+std::string ParallelZlibCompressor::Compress(absl::string_view data,
+                                             int level) {
+  size_t num_blocks =
+      std::max<size_t>(1, (data.size() + block_size_ - 1) / block_size_);
+  std::vector<std::string> blocks(num_blocks);
+  absl::BlockingCounter pending(num_blocks);
+  for (size_t i = 0; i < num_blocks; ++i) {
+    queue_.Push([this, data, level, num_blocks, i, &blocks, &pending]() {
+      size_t begin = i * block_size_;
+      size_t window = std::min(begin, kWindowSize);
+      blocks[i] = DeflateBlock(data.substr(begin, block_size_),
+                               data.substr(begin - window, window), level,
+                               i + 1 == num_blocks);
+      pending.DecrementCount();
+    });
+  }
+
+  // Checksum the data while the workers compress it.
+  uLong adler = adler32(0, Z_NULL, 0);
+  for (size_t begin = 0; begin < data.size(); begin += block_size_) {
+    auto block = data.substr(begin, block_size_);
+    adler = adler32(adler, reinterpret_cast<const Bytef*>(block.data()),
+                    block.size());
+  }
+  pending.Wait();
+
+  std::string output = ZlibHeader(level);
+  for (const auto& block : blocks) {
+    output += block;
+  }
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    output += static_cast<char>((adler >> shift) & 0xff);
+  }
+  return output;
+}
+
+void ParallelZlibCompressor::ThreadRun() {
+  for (;;) {
+    auto task = queue_.Pop();
+    if (task == nullptr) {
+      break;
+    }
+    task();
+  }
+}
+
+}  // namespace minigo
@@ -0,0 +1,78 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_COMPRESSION_H_
+#define CC_COMPRESSION_H_
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "cc/thread_safe_queue.h"
+
+namespace minigo {
+
+// How to compress the TFRecord files of training examples.
+struct CompressionOptions {
+  enum class Codec {
+    kNone,
+    kZlib,
+  };
+
+  Codec codec = Codec::kZlib;
+
+  // The zlib compression level: 1 is fastest, 9 compresses best and -1 is
+  // zlib's default, which is currently 6.
+  int level = -1;
+};
+
+// Parses a compression spec: "none", "zlib" or "zlib:<level>". Returns false
+// if `spec` isn't one of these.
+bool ParseCompressionOptions(absl::string_view spec,
+                             CompressionOptions* options);
+
+// Compresses data into a single zlib stream on a pool of worker threads, in
+// the same way as pigz: the data is split into blocks that are deflated
+// independently, each using the 32kB of data before it as its dictionary.
+// Because each block can refer back to the data before it, the output is
+// barely larger than compressing the data serially, and any zlib reader
+// (including TensorFlow's ZLIB RecordReader) can decompress it.
+class ParallelZlibCompressor {
+ public:
+  static constexpr size_t kDefaultBlockSize = 128 * 1024;
+
+  ParallelZlibCompressor(int num_threads,
+                         size_t block_size = kDefaultBlockSize);
+  ~ParallelZlibCompressor();
+
+  // Returns `data` compressed at zlib compression `level`. Blocks until all
+  // of its blocks are compressed. May be called from multiple threads, whose
+  // blocks then share the worker pool.
+  std::string Compress(absl::string_view data, int level);
+
+ private:
+  using Task = std::function<void()>;
+
+  void ThreadRun();
+
+  const size_t block_size_;
+  ThreadSafeQueue<Task> queue_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_COMPRESSION_H_
@@ -0,0 +1,161 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the CPU time and output size of writing selfplay examples with
+// different compression settings, e.g.:
+//
+//   compression_benchmark --output_dir=/tmp/compression
+//       --compression=none,zlib:1,zlib,zlib:9 --compression_threads=0,4
+//       games/*.game
+//
+// The examples are reconstructed from games written with
+// --example_format=compact, and each game is written to a TFRecord file of its
+// own in --output_dir, as selfplay does. The CPU time includes serializing the
+// examples, which is the same for every setting.
+
+#include <time.h>
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/benchmark_utils.h"
+#include "cc/check.h"
+#include "cc/compact_game.h"
+#include "cc/compression.h"
+#include "cc/file/filesystem.h"
+#include "cc/file/path.h"
+#include "cc/init.h"
+#include "cc/tf_utils.h"
+#include "gflags/gflags.h"
+#include "tensorflow/core/platform/env.h"
+
+DEFINE_string(output_dir, "", "Directory to write the TFRecord files to.");
+DEFINE_string(compression, "none,zlib:1,zlib,zlib:9",
+              "Comma separated compression settings to benchmark, as passed "
+              "to selfplay's --example_compression.");
+DEFINE_string(compression_threads, "0,4",
+              "Comma separated numbers of compression threads to benchmark, "
+              "as passed to selfplay's --compression_threads.");
+
+namespace minigo {
+namespace {
+
+// Returns the CPU time used by all threads of the process.
+absl::Duration CpuTime() {
+  timespec ts;
+  MG_CHECK(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0);
+  return absl::DurationFromTimespec(ts);
+}
+
+std::vector<tensorflow::Example> ReplayGame(const std::string& path) {
+  std::string data;
+  TF_CHECK_OK(tf_utils::ReadFile(path, &data));
+  CompactGame game;
+  MG_CHECK(DecodeCompactGame(data, &game)) << "Couldn't decode " << path;
+
+  std::vector<int> indices(game.moves.size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    indices[i] = i;
+  }
+  std::vector<tensorflow::Example> examples;
+  ReplayCompactGame(
+      game, indices,
+      [&examples](int move_index, const DualNet::BoardFeatures& features,
+                  const std::array<float, kNumMoves>& search_pi,
+                  float outcome) {
+        examples.push_back(
+            tf_utils::MakeTfExample(features, search_pi, outcome));
+      });
+  return examples;
+}
+
+void Benchmark(const std::vector<std::string>& paths) {
+  MG_CHECK(!FLAGS_output_dir.empty()) << "--output_dir must be set";
+  MG_CHECK(!paths.empty()) << "No games given";
+  auto specs = absl::StrSplit(FLAGS_compression, ',', absl::SkipEmpty());
+  auto thread_counts = ParseIntList(FLAGS_compression_threads);
+  MG_CHECK(file::RecursivelyCreateDir(FLAGS_output_dir));
+
+  std::vector<std::vector<tensorflow::Example>> games;
+  size_t num_examples = 0;
+  for (const auto& path : paths) {
+    games.push_back(ReplayGame(path));
+    num_examples += games.back().size();
+  }
+  std::cout << games.size() << " games, " << num_examples << " examples\n"
+            << std::setw(12) << "compression" << std::setw(10) << "threads"
+            << std::setw(14) << "cpu ms/game" << std::setw(14)
+            << "wall ms/game" << std::setw(12) << "kB/game" << std::endl;
+
+  for (absl::string_view spec : specs) {
+    CompressionOptions options;
+    MG_CHECK(ParseCompressionOptions(spec, &options))
+        << "Unrecognized compression \"" << spec << "\"";
+    for (int num_threads : thread_counts) {
+      // Uncompressed files are written the same way for any number of
+      // threads.
+      if (options.codec == CompressionOptions::Codec::kNone &&
+          num_threads != thread_counts[0]) {
+        continue;
+      }
+      std::unique_ptr<ParallelZlibCompressor> compressor;
+      if (num_threads > 0) {
+        compressor = absl::make_unique<ParallelZlibCompressor>(num_threads);
+      }
+
+      auto start_cpu = CpuTime();
+      auto start_time = absl::Now();
+      for (size_t i = 0; i < games.size(); ++i) {
+        auto path = file::JoinPath(FLAGS_output_dir,
+                                   absl::StrCat(i, ".tfrecord"));
+        tf_utils::WriteTfExamples(path, games[i], options, compressor.get());
+      }
+      auto cpu = CpuTime() - start_cpu;
+      auto wall = absl::Now() - start_time;
+
+      tensorflow::uint64 num_bytes = 0;
+      for (size_t i = 0; i < games.size(); ++i) {
+        auto path = file::JoinPath(FLAGS_output_dir,
+                                   absl::StrCat(i, ".tfrecord"));
+        tensorflow::uint64 size;
+        TF_CHECK_OK(tensorflow::Env::Default()->GetFileSize(path, &size));
+        num_bytes += size;
+      }
+
+      double n = games.size();
+      std::cout << std::setw(12) << spec << std::setw(10) << num_threads
+                << std::fixed << std::setprecision(2) << std::setw(14)
+                << absl::ToDoubleMilliseconds(cpu) / n << std::setw(14)
+                << absl::ToDoubleMilliseconds(wall) / n << std::setw(12)
+                << num_bytes / 1024.0 / n << std::endl;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Benchmark({argv + 1, argv + argc});
+  return 0;
+}
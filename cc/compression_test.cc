@@ -0,0 +1,119 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/compression.h"
+
+#include <zlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+std::string Uncompress(const std::string& compressed, size_t size) {
+  std::string result(size, '\0');
+  uLongf result_size = size;
+  EXPECT_EQ(Z_OK, uncompress(reinterpret_cast<Bytef*>(&result[0]),
+                             &result_size,
+                             reinterpret_cast<const Bytef*>(compressed.data()),
+                             compressed.size()));
+  result.resize(result_size);
+  return result;
+}
+
+// Returns `size` bytes of compressible data: runs of a few random letters.
+std::string MakeData(size_t size, Random* rnd) {
+  std::string data;
+  while (data.size() < size) {
+    data.append(rnd->UniformInt(1, 20), 'a' + rnd->UniformInt(0, 3));
+  }
+  data.resize(size);
+  return data;
+}
+
+TEST(CompressionTest, ParseCompressionOptions) {
+  CompressionOptions options;
+  ASSERT_TRUE(ParseCompressionOptions("none", &options));
+  EXPECT_EQ(CompressionOptions::Codec::kNone, options.codec);
+
+  ASSERT_TRUE(ParseCompressionOptions("zlib", &options));
+  EXPECT_EQ(CompressionOptions::Codec::kZlib, options.codec);
+  EXPECT_EQ(-1, options.level);
+
+  ASSERT_TRUE(ParseCompressionOptions("zlib:1", &options));
+  EXPECT_EQ(CompressionOptions::Codec::kZlib, options.codec);
+  EXPECT_EQ(1, options.level);
+
+  EXPECT_FALSE(ParseCompressionOptions("zlib:10", &options));
+  EXPECT_FALSE(ParseCompressionOptions("zlib:", &options));
+  EXPECT_FALSE(ParseCompressionOptions("zlib6", &options));
+  EXPECT_FALSE(ParseCompressionOptions("zstd", &options));
+  EXPECT_EQ(1, options.level);
+}
+
+// Verify that the output is a valid zlib stream for inputs that are empty,
+// smaller than a block, and span many blocks.
+TEST(CompressionTest, RoundTrip) {
+  Random rnd(1);
+  ParallelZlibCompressor compressor(3, 1000);
+  for (size_t size : {0, 1, 999, 1000, 1001, 12345, 100000}) {
+    auto data = MakeData(size, &rnd);
+    for (int level : {Z_DEFAULT_COMPRESSION, 0, 1, 9}) {
+      auto compressed = compressor.Compress(data, level);
+      EXPECT_EQ(data, Uncompress(compressed, size)) << size << " " << level;
+    }
+  }
+}
+
+// Verify that priming each block with the data before it keeps the output
+// close to the size of compressing serially.
+TEST(CompressionTest, Size) {
+  Random rnd(1);
+  auto data = MakeData(1000000, &rnd);
+
+  uLongf serial_size = compressBound(data.size());
+  std::string serial(serial_size, '\0');
+  ASSERT_EQ(Z_OK,
+            compress2(reinterpret_cast<Bytef*>(&serial[0]), &serial_size,
+                      reinterpret_cast<const Bytef*>(data.data()),
+                      data.size(), Z_DEFAULT_COMPRESSION));
+
+  ParallelZlibCompressor compressor(4, 64 * 1024);
+  auto parallel = compressor.Compress(data, Z_DEFAULT_COMPRESSION);
+  EXPECT_LT(parallel.size(), serial_size * 1.01);
+}
+
+TEST(CompressionTest, ConcurrentCalls) {
+  ParallelZlibCompressor compressor(2, 1000);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&compressor, i]() {
+      Random rnd(i);
+      for (int j = 0; j < 10; ++j) {
+        auto data = MakeData(5000 + 100 * j, &rnd);
+        EXPECT_EQ(data, Uncompress(compressor.Compress(data, 1), data.size()));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+}  // namespace
+}  // namespace minigo
@@ -69,6 +69,36 @@ echo "Building toco"
 bazel build -c opt --config=opt --copt="${cc_opt_flags}" //tensorflow/contrib/lite/toco:toco
 cp bazel-bin/tensorflow/contrib/lite/toco/toco "${dst_dir}"
 
+echo "Building tfcompile"
+bazel build -c opt --config=opt --copt="${cc_opt_flags}" //tensorflow/compiler/aot:tfcompile
+cp bazel-bin/tensorflow/compiler/aot/tfcompile "${dst_dir}"
+
+# Models compiled by tfcompile call into XLA's CPU runtime for convolutions and
+# matrix multiplies. Bundle the runtime into a single shared library. It is
+# built from inside tensorflow/compiler because the XLA targets are only
+# visible to packages there.
+echo "Building the XLA AOT runtime"
+mkdir -p tensorflow/compiler/minigo
+cat > tensorflow/compiler/minigo/BUILD <<EOF
+cc_binary(
+    name = "libxla_aot_runtime.so",
+    linkshared = 1,
+    deps = [
+        "//tensorflow/compiler/tf2xla:xla_compiled_cpu_function",
+        "//tensorflow/compiler/xla:executable_run_options",
+        "//tensorflow/compiler/xla/service/cpu:runtime_conv2d",
+        "//tensorflow/compiler/xla/service/cpu:runtime_matmul",
+        "//tensorflow/compiler/xla/service/cpu:runtime_single_threaded_conv2d",
+        "//tensorflow/compiler/xla/service/cpu:runtime_single_threaded_matmul",
+    ],
+)
+EOF
+bazel build -c opt --config=opt --copt="${cc_opt_flags}" //tensorflow/compiler/minigo:libxla_aot_runtime.so
+cp bazel-bin/tensorflow/compiler/minigo/libxla_aot_runtime.so "${dst_dir}"
+find tensorflow/compiler -name "*.h" -exec cp --parents {} "${dst_dir}" \;
+(cd bazel-genfiles && find tensorflow/compiler -name "*.pb.h" -exec cp --parents {} "${dst_dir}" \;)
+rm -rf tensorflow/compiler/minigo
+
 echo "Building TF Lite"
 
 # TF lite is broken in the v1.9.0 release. Checkout at the commit that fixed it.
@@ -0,0 +1,59 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/aot_dual_net.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cc/check.h"
+#include "cc/constants.h"
+#include "cc/dual_net/aot_model/dual_net_model_info.h"
+
+namespace minigo {
+
+static_assert(aot::kBoardSize == kN,
+              "The compiled model is for a different board size");
+
+AotDualNet::AotDualNet() = default;
+
+const char* AotDualNet::model_name() { return aot::kModelName; }
+
+void AotDualNet::RunMany(absl::Span<const BoardFeatures> features,
+                         absl::Span<Output> outputs, std::string* model) {
+  MG_DCHECK(features.size() == outputs.size());
+
+  for (size_t begin = 0; begin < features.size(); begin += aot::kBatchSize) {
+    size_t n = std::min<size_t>(aot::kBatchSize, features.size() - begin);
+    memcpy(model_.arg_pos_tensor_data(), features.data() + begin,
+           n * sizeof(BoardFeatures));
+
+    MG_CHECK(model_.Run()) << model_.error_msg();
+
+    const float* policy = model_.result_policy_data();
+    const float* value = model_.result_value_data();
+    for (size_t i = 0; i < n; ++i) {
+      auto& output = outputs[begin + i];
+      memcpy(output.policy.data(), policy + i * kNumMoves,
+             sizeof(output.policy));
+      output.value = value[i];
+    }
+  }
+
+  if (model != nullptr) {
+    *model = aot::kModelName;
+  }
+}
+
+}  // namespace minigo
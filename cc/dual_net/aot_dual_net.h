@@ -0,0 +1,50 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_AOT_DUAL_NET_H_
+#define CC_DUAL_NET_AOT_DUAL_NET_H_
+
+#include <string>
+
+#include "absl/types/span.h"
+#include "cc/dual_net/aot_model/dual_net_model.h"
+#include "cc/dual_net/dual_net.h"
+
+namespace minigo {
+
+// Runs inference with a model that was compiled ahead of time by XLA and
+// linked into the binary (see cc/compile_aot_model.sh). The compiled model has
+// no graph executor, so each call has very little overhead beyond the
+// computation itself, which runs on the calling thread.
+//
+// The model is compiled for a fixed batch size. Batches of other sizes are
+// run in chunks of that size, the last chunk padded with whatever the
+// previous inference left in the input buffer.
+class AotDualNet : public DualNet {
+ public:
+  AotDualNet();
+
+  // Name of the model that was compiled into the binary.
+  static const char* model_name();
+
+  void RunMany(absl::Span<const BoardFeatures> features,
+               absl::Span<Output> outputs, std::string* model) override;
+
+ private:
+  aot::DualNetModel model_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_AOT_DUAL_NET_H_
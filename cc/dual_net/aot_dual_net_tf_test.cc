@@ -0,0 +1,64 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Verifies that AotDualNet produces the same outputs as TfDualNet for the
+// frozen graph that was compiled into the binary:
+//
+//   BOARD_SIZE=9 ./cc/compile_aot_model.sh $MODEL.pb 8
+//   bazel test --define=board_size=9 --define=aot=1 \
+//       //cc/dual_net:aot_dual_net_tf_test --test_arg=--model=$MODEL.pb
+//
+// Tagged manual since it needs TensorFlow, tfcompile and a trained model.
+
+#include <vector>
+
+#include "cc/dual_net/aot_dual_net.h"
+#include "cc/dual_net/dual_net_test_utils.h"
+#include "cc/dual_net/tf_dual_net.h"
+#include "cc/init.h"
+#include "cc/random.h"
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+
+DEFINE_string(model, "", "Path to the frozen graph that was compiled.");
+DEFINE_int32(num_boards, 61,
+             "Number of random boards to compare. The default isn't a "
+             "multiple of the compiled batch size, so that the padded last "
+             "batch is tested too.");
+
+namespace minigo {
+namespace {
+
+TEST(AotDualNetTfTest, MatchesTfDualNet) {
+  ASSERT_FALSE(FLAGS_model.empty()) << "--model must be set";
+
+  Random rnd(1);
+  auto features = RandomBoardFeatures(FLAGS_num_boards, &rnd);
+
+  std::vector<DualNet::Output> expected(features.size());
+  std::vector<DualNet::Output> actual(features.size());
+  TfDualNet(FLAGS_model).RunMany(features, absl::MakeSpan(expected), nullptr);
+  AotDualNet().RunMany(features, absl::MakeSpan(actual), nullptr);
+
+  ExpectOutputsNear(expected, actual, 1e-3);
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  minigo::Init(&argc, &argv);
+  return RUN_ALL_TESTS();
+}
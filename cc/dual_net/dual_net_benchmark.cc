@@ -0,0 +1,295 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the raw throughput of an inference engine, without tree search.
+// For every combination of --threads and --batch_sizes, that many threads
+// each run RunMany on their own DualNet for --seconds seconds, with features
+// of random legal positions, e.g.:
+//
+//   dual_net_benchmark --engine=lite --model=model.tflite
+//       --batch_sizes=1,8,16,32 --threads=1,4
+//
+// Use --engine=fake to measure the overhead of the benchmark itself.
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/benchmark_utils.h"
+#include "cc/check.h"
+#include "cc/constants.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/dual_net/factory.h"
+#include "cc/init.h"
+#include "cc/position.h"
+#include "cc/random.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(model, "", "Path to the model to benchmark.");
+DEFINE_string(batch_sizes, "1,8,16",
+              "Comma separated numbers of positions per inference.");
+DEFINE_string(threads, "1",
+              "Comma separated numbers of threads running inferences in "
+              "parallel, each with its own DualNet.");
+DEFINE_double(seconds, 5, "Number of seconds to run each configuration.");
+DEFINE_int32(num_positions, 1024,
+             "Number of random positions to generate features for.");
+DEFINE_int32(seed, 1, "Random seed for generating the positions.");
+
+// Required by the remote inference engine.
+DEFINE_int32(virtual_losses, 8,
+             "Number of virtual losses, which sets the remote inference "
+             "batch size.");
+
+namespace minigo {
+namespace {
+
+// Returns the features of `num_positions` positions, each reached by playing
+// a random number of random legal moves from the empty board.
+std::vector<DualNet::BoardFeatures> RandomFeatures(int num_positions,
+                                                   Random* rnd) {
+  BoardVisitor bv;
+  GroupVisitor gv;
+  std::vector<DualNet::BoardFeatures> features(num_positions);
+  std::vector<Position::Stones> stones;
+  std::vector<const Position::Stones*> history;
+  for (auto& board : features) {
+    Position position(&bv, &gv, Color::kBlack);
+    stones.clear();
+    stones.push_back(position.stones());
+    int num_moves = rnd->UniformInt(0, kN * kN);
+    for (int i = 0; i < num_moves && !position.is_game_over(); ++i) {
+      Coord c = Coord::kPass;
+      for (int j = 0; j < 10; ++j) {
+        Coord candidate = rnd->UniformInt(0, kN * kN - 1);
+        if (position.IsMoveLegal(candidate)) {
+          c = candidate;
+          break;
+        }
+      }
+      position.PlayMove(c);
+      stones.push_back(position.stones());
+    }
+
+    history.clear();
+    for (size_t j = 0; j < DualNet::kMoveHistory && j < stones.size(); ++j) {
+      history.push_back(&stones[stones.size() - 1 - j]);
+    }
+    DualNet::SetFeatures(history, position.to_play(), &board);
+  }
+  return features;
+}
+
+// Returns the resident set size of the process in MB, or 0 if it can't be
+// read.
+double CurrentMemoryMb() {
+  std::ifstream f("/proc/self/statm");
+  int64_t size, resident;
+  if (!(f >> size >> resident)) {
+    return 0;
+  }
+  return resident * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+// Returns the peak resident set size of the process in MB.
+double PeakMemoryMb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+// Counts latencies in logarithmic buckets that are 2% wide, so that
+// percentiles can be estimated without keeping every sample.
+class LatencyHistogram {
+ public:
+  void Add(absl::Duration latency) {
+    double us = absl::ToDoubleMicroseconds(latency);
+    int i = 0;
+    if (us > 1) {
+      i = std::min<int>(kNumBuckets - 1,
+                        std::ceil(std::log(us) / std::log(kBucketRatio)));
+    }
+    buckets_[i] += 1;
+    count_ += 1;
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kNumBuckets; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+  }
+
+  // Returns the upper bound of the bucket holding the `p`th percentile.
+  absl::Duration Percentile(double p) const {
+    int64_t n = std::ceil(count_ * p / 100);
+    int64_t seen = 0;
+    int i = 0;
+    for (; i < kNumBuckets - 1; ++i) {
+      seen += buckets_[i];
+      if (seen >= n) {
+        break;
+      }
+    }
+    return absl::Microseconds(std::pow(kBucketRatio, i));
+  }
+
+  int64_t count() const { return count_; }
+
+ private:
+  // Covers latencies from 1us to over 5 minutes.
+  static constexpr double kBucketRatio = 1.02;
+  static constexpr int kNumBuckets = 1000;
+
+  std::vector<int64_t> buckets_ = std::vector<int64_t>(kNumBuckets);
+  int64_t count_ = 0;
+};
+
+struct Result {
+  double positions_per_second;
+  absl::Duration p50;
+  absl::Duration p99;
+
+  // Resident memory once the DualNets have been created and warmed up,
+  // relative to before the benchmark started.
+  double memory_mb;
+};
+
+// Runs `num_threads` DualNets in parallel on batches of `batch_size`
+// features, timing every call to RunMany.
+Result Run(DualNetFactory* factory, int num_threads, int batch_size,
+           const std::vector<DualNet::BoardFeatures>& features,
+           double base_memory_mb) {
+  absl::BlockingCounter ready(num_threads);
+  absl::Notification start;
+  absl::Notification stop;
+  std::vector<LatencyHistogram> latencies(num_threads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      auto dual_net = factory->New();
+      std::vector<DualNet::Output> outputs(batch_size);
+
+      // Each thread starts at a different position and steps through all
+      // of them, wrapping around at the end.
+      size_t begin = (i * features.size() / num_threads) % features.size();
+      std::vector<DualNet::BoardFeatures> batch(batch_size);
+      auto next_batch = [&]() {
+        for (auto& board : batch) {
+          board = features[begin];
+          begin = (begin + 1) % features.size();
+        }
+      };
+
+      // Warm up, so that lazy initialization isn't timed.
+      next_batch();
+      dual_net->RunMany(batch, absl::MakeSpan(outputs), nullptr);
+
+      ready.DecrementCount();
+      start.WaitForNotification();
+      while (!stop.HasBeenNotified()) {
+        next_batch();
+        auto call_start = absl::Now();
+        dual_net->RunMany(batch, absl::MakeSpan(outputs), nullptr);
+        latencies[i].Add(absl::Now() - call_start);
+      }
+    });
+  }
+
+  ready.Wait();
+  double memory_mb = CurrentMemoryMb() - base_memory_mb;
+  auto start_time = absl::Now();
+  start.Notify();
+  absl::SleepFor(absl::Seconds(FLAGS_seconds));
+  stop.Notify();
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto elapsed = absl::Now() - start_time;
+
+  LatencyHistogram all;
+  for (const auto& l : latencies) {
+    all.Merge(l);
+  }
+  MG_CHECK(all.count() > 0);
+
+  Result result;
+  result.positions_per_second =
+      all.count() * batch_size / absl::ToDoubleSeconds(elapsed);
+  result.p50 = all.Percentile(50);
+  result.p99 = all.Percentile(99);
+  result.memory_mb = memory_mb;
+  return result;
+}
+
+void Benchmark() {
+  auto batch_sizes = ParseIntList(FLAGS_batch_sizes);
+  auto threads = ParseIntList(FLAGS_threads);
+  MG_CHECK(!batch_sizes.empty() && !threads.empty());
+  for (int x : batch_sizes) {
+    MG_CHECK(x > 0) << "Batch sizes must be positive";
+  }
+  for (int x : threads) {
+    MG_CHECK(x > 0) << "Thread counts must be positive";
+  }
+  MG_CHECK(FLAGS_num_positions > 0);
+
+  Random rnd(FLAGS_seed);
+  auto features = RandomFeatures(FLAGS_num_positions, &rnd);
+  double base_memory_mb = CurrentMemoryMb();
+
+  std::cout << std::setw(8) << "threads" << std::setw(8) << "batch"
+            << std::setw(14) << "positions/s" << std::setw(12) << "p50 ms"
+            << std::setw(12) << "p99 ms" << std::setw(12) << "memory MB"
+            << std::endl;
+  for (int num_threads : threads) {
+    // Engines size their thread pools by the number of parallel games, so
+    // create a factory for each thread count as selfplay would.
+    auto factory = NewDualNetFactory(FLAGS_model, num_threads);
+    for (int batch_size : batch_sizes) {
+      auto result = Run(factory.get(), num_threads, batch_size, features,
+                        base_memory_mb);
+      std::cout << std::setw(8) << num_threads << std::setw(8) << batch_size
+                << std::fixed << std::setprecision(1) << std::setw(14)
+                << result.positions_per_second << std::setprecision(3)
+                << std::setw(12) << absl::ToDoubleMilliseconds(result.p50)
+                << std::setw(12) << absl::ToDoubleMilliseconds(result.p99)
+                << std::setprecision(1) << std::setw(12)
+                << result.memory_mb << std::endl;
+    }
+  }
+  std::cout << "Peak memory: " << PeakMemoryMb() << " MB" << std::endl;
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Benchmark();
+  return 0;
+}
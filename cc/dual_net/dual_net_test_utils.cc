@@ -0,0 +1,52 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/dual_net_test_utils.h"
+
+#include "cc/constants.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+
+std::vector<DualNet::BoardFeatures> RandomBoardFeatures(int num_boards,
+                                                        Random* rnd) {
+  std::vector<DualNet::BoardFeatures> features(num_boards);
+  for (auto& board : features) {
+    float to_play = (*rnd)() < 0.5 ? 1 : 0;
+    for (int i = 0; i < kN * kN; ++i) {
+      for (int j = 0; j < DualNet::kNumStoneFeatures - 1; ++j) {
+        board[i * DualNet::kNumStoneFeatures + j] = (*rnd)() < 0.3 ? 1 : 0;
+      }
+      board[i * DualNet::kNumStoneFeatures + DualNet::kPlayerFeature] =
+          to_play;
+    }
+  }
+  return features;
+}
+
+void ExpectOutputsNear(absl::Span<const DualNet::Output> expected,
+                       absl::Span<const DualNet::Output> actual,
+                       float tolerance) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(expected[i].value, actual[i].value, tolerance)
+        << "board " << i;
+    for (int j = 0; j < kNumMoves; ++j) {
+      ASSERT_NEAR(expected[i].policy[j], actual[i].policy[j], tolerance)
+          << "board " << i << " move " << j;
+    }
+  }
+}
+
+}  // namespace minigo
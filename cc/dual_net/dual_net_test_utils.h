@@ -0,0 +1,40 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_DUAL_NET_TEST_UTILS_H_
+#define CC_DUAL_NET_DUAL_NET_TEST_UTILS_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/random.h"
+
+namespace minigo {
+
+// Returns `num_boards` boards filled with random stones. These aren't legal
+// positions, but they exercise every input plane and every point of the
+// board, which makes them good inputs for comparing two engines.
+std::vector<DualNet::BoardFeatures> RandomBoardFeatures(int num_boards,
+                                                        Random* rnd);
+
+// Expects the policies and values of `actual` to be within `tolerance` of
+// those of `expected`.
+void ExpectOutputsNear(absl::Span<const DualNet::Output> expected,
+                       absl::Span<const DualNet::Output> actual,
+                       float tolerance);
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_DUAL_NET_TEST_UTILS_H_
@@ -1,13 +1,26 @@
 #include "cc/dual_net/factory.h"
 
+#include <algorithm>
+
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
+#include "cc/dual_net/fake_net.h"
+#include "cc/dual_net/native_dual_net.h"
+#include "cc/dual_net/reloading_dual_net.h"
+#include "cc/thread_affinity.h"
 #include "gflags/gflags.h"
 
 #ifdef MG_ENABLE_REMOTE_DUAL_NET
+#include <sys/wait.h>
+#include <cstdlib>
+#include <iostream>
 #include <thread>
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
 #include "cc/dual_net/inference_server.h"
+#include "cc/dual_net/shm_inference_server.h"
+#include "cc/metrics.h"
 #ifndef MG_DEFAULT_ENGINE
 #define MG_DEFAULT_ENGINE "remote"
 #endif  // MG_DEFAULT_ENGINE
@@ -27,6 +40,19 @@
 #endif  // MG_DEFAULT_ENGINE
 #endif  // MG_ENABLE_LITE_DUAL_NET
 
+#ifdef MG_ENABLE_AOT_DUAL_NET
+#include "cc/dual_net/aot_dual_net.h"
+#include "cc/file/path.h"
+#ifndef MG_DEFAULT_ENGINE
+#define MG_DEFAULT_ENGINE "aot"
+#endif  // MG_DEFAULT_ENGINE
+#endif  // MG_ENABLE_AOT_DUAL_NET
+
+// The native engine is always available.
+#ifndef MG_DEFAULT_ENGINE
+#define MG_DEFAULT_ENGINE "native"
+#endif  // MG_DEFAULT_ENGINE
+
 DEFINE_string(engine, MG_DEFAULT_ENGINE,
               "The inference engine to use. Accepted values:"
 #ifdef MG_ENABLE_REMOTE_DUAL_NET
@@ -38,7 +64,10 @@ DEFINE_string(engine, MG_DEFAULT_ENGINE,
 #ifdef MG_ENABLE_LITE_DUAL_NET
               " \"lite\""
 #endif
-);
+#ifdef MG_ENABLE_AOT_DUAL_NET
+              " \"aot\""
+#endif
+              " \"native\" \"fake\"");
 
 DEFINE_string(checkpoint_dir, "",
               "Path to a directory containing TensorFlow model checkpoints. "
@@ -55,6 +84,26 @@ DEFINE_int32(fc_width, 256,
 DEFINE_int32(parallel_tpus, 8,
              "If model=remote, the number of TPU cores to run on in parallel.");
 DEFINE_int32(port, 50051, "The port opened by the InferenceService server.");
+DEFINE_string(shm_name, "",
+              "If set, the remote inference engine exchanges features and "
+              "outputs with the inference worker through the POSIX shared "
+              "memory region with this name (e.g. \"/minigo\") instead of "
+              "over gRPC. Only valid when the inference worker runs on the "
+              "same host.");
+DEFINE_int32(inference_stats_interval, 0,
+             "If non-zero, the remote inference server writes its metrics "
+             "to stderr every inference_stats_interval seconds.");
+DEFINE_int32(inference_worker_timeout, 30,
+             "If the remote inference worker doesn't respond for this many "
+             "seconds, the batches it was running are handed out again and "
+             "the worker is expected to be restarted.");
+DEFINE_int32(inference_threads, 0,
+             "Total number of threads that the tf and lite inference engines "
+             "may use, shared between all parallel games. If zero, one per "
+             "CPU that the process may run on. The tf engine sizes "
+             "TensorFlow's process-wide intra-op thread pool to this, and its "
+             "inter-op pool to the number of parallel games. The lite engine "
+             "divides it equally between the games' interpreters.");
 DECLARE_int32(virtual_losses);
 
 namespace minigo {
@@ -62,10 +111,44 @@ namespace minigo {
 namespace {
 
 #ifdef MG_ENABLE_REMOTE_DUAL_NET
+// inference_worker.py runs two worker threads, so two shared memory slots are
+// enough to keep it busy.
+constexpr int kNumShmSlots = 2;
+
+// A worker that exits within kMinWorkerUptime of starting most likely failed
+// to start, e.g. because of a bad flag or a missing model, and restarting it
+// straight away won't help. Such workers are restarted after exponentially
+// longer delays, and after kMaxFastWorkerFailures of them in a row, selfplay
+// exits with the worker's status.
+constexpr absl::Duration kMinWorkerUptime = absl::Minutes(1);
+constexpr absl::Duration kMinWorkerRestartDelay = absl::Seconds(1);
+constexpr absl::Duration kMaxWorkerRestartDelay = absl::Minutes(1);
+constexpr int kMaxFastWorkerFailures = 5;
+
 class RemoteDualNetFactory : public DualNetFactory {
  public:
   explicit RemoteDualNetFactory(std::string model_path, int parallel_games)
       : DualNetFactory(std::move(model_path)) {
+    // Start the server before the inference worker: when using shared memory,
+    // the worker expects the region to exist as soon as it starts.
+    int games_per_inference = std::max(1, parallel_games / 2);
+    auto worker_timeout = absl::Seconds(FLAGS_inference_worker_timeout);
+    if (FLAGS_shm_name.empty()) {
+      grpc_server_ = absl::make_unique<InferenceServer>(
+          FLAGS_virtual_losses, games_per_inference, FLAGS_port,
+          worker_timeout);
+    } else {
+      shm_server_ = absl::make_unique<ShmInferenceServer>(
+          FLAGS_virtual_losses, games_per_inference, FLAGS_shm_name,
+          kNumShmSlots, worker_timeout);
+    }
+    if (FLAGS_inference_stats_interval > 0) {
+      auto* metrics = grpc_server_ != nullptr ? grpc_server_->metrics()
+                                              : shm_server_->metrics();
+      metrics_dumper_ = absl::make_unique<MetricsDumper>(
+          metrics, absl::Seconds(FLAGS_inference_stats_interval));
+    }
+
     inference_worker_thread_ = std::thread([this]() {
       std::vector<std::string> cmd_parts = {
           absl::StrCat("BOARD_SIZE=", kN),
@@ -78,67 +161,193 @@ class RemoteDualNetFactory : public DualNetFactory {
           absl::StrCat("--conv_width=", FLAGS_conv_width),
           absl::StrCat("--fc_width=", FLAGS_fc_width),
           absl::StrCat("--parallel_tpus=", FLAGS_parallel_tpus),
+          absl::StrCat("--shm_name=", FLAGS_shm_name),
       };
       auto cmd = absl::StrJoin(cmd_parts, " ");
-      FILE* f = popen(cmd.c_str(), "r");
+
+      // Restart the worker if it dies while the server is still running. Any
+      // batches it was running are requeued by the server, so the games only
+      // stall while the new worker starts up.
+      auto restart_delay = kMinWorkerRestartDelay;
+      int num_fast_failures = 0;
       for (;;) {
-        int c = fgetc(f);
-        if (c == EOF) {
+        auto start_time = absl::Now();
+        FILE* f = popen(cmd.c_str(), "r");
+        for (;;) {
+          int c = fgetc(f);
+          if (c == EOF) {
+            break;
+          }
+          fputc(c, stderr);
+        }
+        fputc('\n', stderr);
+        int status = pclose(f);
+        if (stopping_.HasBeenNotified()) {
+          break;
+        }
+
+        int exit_code = 1;
+        if (WIFEXITED(status)) {
+          exit_code = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+          exit_code = 128 + WTERMSIG(status);
+        }
+        if (absl::Now() - start_time < kMinWorkerUptime) {
+          num_fast_failures += 1;
+        } else {
+          num_fast_failures = 0;
+          restart_delay = kMinWorkerRestartDelay;
+        }
+        if (num_fast_failures >= kMaxFastWorkerFailures) {
+          std::cerr << "Inference worker exited with status " << exit_code
+                    << " within " << kMinWorkerUptime << " of starting "
+                    << num_fast_failures << " times in a row, giving up"
+                    << std::endl;
+          std::exit(exit_code != 0 ? exit_code : 1);
+        }
+        std::cerr << "Inference worker exited with status " << exit_code
+                  << ", restarting in " << restart_delay << std::endl;
+        if (stopping_.WaitForNotificationWithTimeout(restart_delay)) {
           break;
         }
-        fputc(c, stderr);
+        restart_delay = std::min(2 * restart_delay, kMaxWorkerRestartDelay);
       }
-      fputc('\n', stderr);
     });
-
-    int games_per_inference = std::max(1, parallel_games / 2);
-    server_ = absl::make_unique<InferenceServer>(
-        FLAGS_virtual_losses, games_per_inference, FLAGS_port);
   }
 
   ~RemoteDualNetFactory() override {
-    server_.reset(nullptr);
+    stopping_.Notify();
+    metrics_dumper_.reset(nullptr);
+    grpc_server_.reset(nullptr);
+    shm_server_.reset(nullptr);
     inference_worker_thread_.join();
   }
 
-  std::unique_ptr<DualNet> New() override { return server_->NewDualNet(); }
+  std::unique_ptr<DualNet> New() override {
+    return grpc_server_ != nullptr ? grpc_server_->NewDualNet()
+                                   : shm_server_->NewDualNet();
+  }
+
+  MetricsRegistry* metrics() override {
+    return grpc_server_ != nullptr ? grpc_server_->metrics()
+                                   : shm_server_->metrics();
+  }
 
  private:
+  absl::Notification stopping_;
   std::thread inference_worker_thread_;
-  std::unique_ptr<InferenceServer> server_;
+  std::unique_ptr<InferenceServer> grpc_server_;
+  std::unique_ptr<ShmInferenceServer> shm_server_;
+  std::unique_ptr<MetricsDumper> metrics_dumper_;
 };
 #endif  // MG_ENABLE_REMOTE_DUAL_NET
 
 #ifdef MG_ENABLE_TF_DUAL_NET
 class TfDualNetFactory : public DualNetFactory {
  public:
-  TfDualNetFactory(std::string model_path)
-      : DualNetFactory(std::move(model_path)) {}
+  // The graph is loaded into a single model that all the DualNets share.
+  // TensorFlow's thread pools are created along with it, so their threads
+  // inherit the affinity of the thread creating the factory rather than that
+  // of a pinned game thread.
+  TfDualNetFactory(std::string model_path,
+                   std::shared_ptr<const TfDualNet::Model> model)
+      : DualNetFactory(std::move(model_path)), model_(std::move(model)) {}
 
   std::unique_ptr<DualNet> New() override {
-    return absl::make_unique<TfDualNet>(model());
+    return absl::make_unique<TfDualNet>(model_);
   }
+
+ private:
+  std::shared_ptr<const TfDualNet::Model> model_;
 };
 #endif  // MG_ENABLE_TF_DUAL_NET
 
 #ifdef MG_ENABLE_LITE_DUAL_NET
 class LiteDualNetFactory : public DualNetFactory {
  public:
-  LiteDualNetFactory(std::string model_path)
-      : DualNetFactory(std::move(model_path)) {}
+  LiteDualNetFactory(std::string model_path,
+                     std::shared_ptr<const tflite::FlatBufferModel> model,
+                     int num_threads)
+      : DualNetFactory(std::move(model_path)),
+        model_(std::move(model)),
+        num_threads_(num_threads) {}
 
   std::unique_ptr<DualNet> New() override {
-    return absl::make_unique<LiteDualNet>(model());
+    return absl::make_unique<LiteDualNet>(model_, model(), num_threads_);
   }
+
+ private:
+  std::shared_ptr<const tflite::FlatBufferModel> model_;
+  const int num_threads_;
 };
 #endif  // MG_ENABLE_LITE_DUAL_NET
 
+#ifdef MG_ENABLE_AOT_DUAL_NET
+class AotDualNetFactory : public DualNetFactory {
+ public:
+  // The model is compiled into the binary, so --model is only checked against
+  // it, to catch running a different model than intended.
+  AotDualNetFactory(std::string model_path)
+      : DualNetFactory(std::move(model_path)) {
+    MG_CHECK(model().empty() ||
+             file::Stem(model()) == AotDualNet::model_name())
+        << "Binary was compiled with model " << AotDualNet::model_name()
+        << ", not " << model();
+  }
+
+  std::unique_ptr<DualNet> New() override {
+    return absl::make_unique<AotDualNet>();
+  }
+};
+#endif  // MG_ENABLE_AOT_DUAL_NET
+
+class NativeDualNetFactory : public DualNetFactory {
+ public:
+  NativeDualNetFactory(std::string model_path,
+                       std::shared_ptr<const NativeModel> model)
+      : DualNetFactory(std::move(model_path)), model_(std::move(model)) {}
+
+  std::unique_ptr<DualNet> New() override {
+    return absl::make_unique<NativeDualNet>(model_, model());
+  }
+
+ private:
+  std::shared_ptr<const NativeModel> model_;
+};
+
+// FakeNet doesn't evaluate a model: every position gets uniform priors and a
+// value of zero. Useful for measuring the overhead around inference.
+class FakeDualNetFactory : public DualNetFactory {
+ public:
+  FakeDualNetFactory(std::string model_path)
+      : DualNetFactory(std::move(model_path)) {}
+
+  std::unique_ptr<DualNet> New() override {
+    return absl::make_unique<FakeNet>();
+  }
+};
+
 }  // namespace
 
 DualNetFactory::~DualNetFactory() = default;
 
 std::unique_ptr<DualNetFactory> NewDualNetFactory(std::string model_path,
                                                   int parallel_games) {
+  std::string error;
+  auto factory =
+      TryNewDualNetFactory(std::move(model_path), parallel_games, &error);
+  MG_CHECK(factory != nullptr) << error;
+  return factory;
+}
+
+std::unique_ptr<DualNetFactory> TryNewDualNetFactory(std::string model_path,
+                                                     int parallel_games,
+                                                     std::string* error) {
+  int inference_threads = FLAGS_inference_threads;
+  if (inference_threads <= 0) {
+    inference_threads = std::max<int>(1, GetAllowedCpus().size());
+  }
+
   if (FLAGS_engine == "remote") {
 #ifdef MG_ENABLE_REMOTE_DUAL_NET
     return absl::make_unique<RemoteDualNetFactory>(std::move(model_path),
@@ -150,7 +359,13 @@ std::unique_ptr<DualNetFactory> NewDualNetFactory(std::string model_path,
 
   if (FLAGS_engine == "tf") {
 #ifdef MG_ENABLE_TF_DUAL_NET
-    return absl::make_unique<TfDualNetFactory>(std::move(model_path));
+    auto model = TfDualNet::TryLoadModel(model_path, inference_threads,
+                                         parallel_games, error);
+    if (model == nullptr) {
+      return nullptr;
+    }
+    return absl::make_unique<TfDualNetFactory>(std::move(model_path),
+                                               std::move(model));
 #else
     MG_FATAL() << "Binary wasn't compiled with tf inference support";
 #endif  // MG_ENABLE_TF_DUAL_NET
@@ -158,14 +373,64 @@ std::unique_ptr<DualNetFactory> NewDualNetFactory(std::string model_path,
 
   if (FLAGS_engine == "lite") {
 #ifdef MG_ENABLE_LITE_DUAL_NET
-    return absl::make_unique<LiteDualNetFactory>(std::move(model_path));
+    auto model = LiteDualNet::TryLoadModel(model_path, error);
+    if (model == nullptr) {
+      return nullptr;
+    }
+    return absl::make_unique<LiteDualNetFactory>(
+        std::move(model_path), std::move(model),
+        std::max(1, inference_threads / std::max(1, parallel_games)));
 #else
     MG_FATAL() << "Binary wasn't compiled with lite inference support";
 #endif  // MG_ENABLE_LITE_DUAL_NET
   }
 
+  if (FLAGS_engine == "aot") {
+#ifdef MG_ENABLE_AOT_DUAL_NET
+    return absl::make_unique<AotDualNetFactory>(std::move(model_path));
+#else
+    MG_FATAL() << "Binary wasn't compiled with aot inference support";
+#endif  // MG_ENABLE_AOT_DUAL_NET
+  }
+
+  if (FLAGS_engine == "native") {
+    std::shared_ptr<const NativeModel> model =
+        NativeModel::TryLoad(FindNativeModel(model_path), error);
+    if (model == nullptr) {
+      return nullptr;
+    }
+    return absl::make_unique<NativeDualNetFactory>(std::move(model_path),
+                                                   std::move(model));
+  }
+
+  if (FLAGS_engine == "fake") {
+    return absl::make_unique<FakeDualNetFactory>(std::move(model_path));
+  }
+
   MG_FATAL() << "Unrecognized inference engine \"" << FLAGS_engine << "\"";
   return nullptr;
 }
 
+std::unique_ptr<DualNetFactory> NewReloadingDualNetFactory(
+    std::string model_path, std::string directory, int parallel_games) {
+  std::string extension;
+  if (FLAGS_engine == "tf") {
+    extension = ".pb";
+  } else if (FLAGS_engine == "lite") {
+    extension = ".tflite";
+  } else if (FLAGS_engine == "native") {
+    extension = ".native";
+  } else {
+    MG_FATAL() << "Engine \"" << FLAGS_engine << "\" can't reload models, "
+               << "use --checkpoint_dir with the remote engine instead";
+  }
+
+  return absl::make_unique<ReloadingDualNetFactory>(
+      std::move(model_path), std::move(directory), std::move(extension),
+      [parallel_games](const std::string& path, std::string* error) {
+        return TryNewDualNetFactory(path, parallel_games, error);
+      },
+      absl::Seconds(5));
+}
+
 }  // namespace minigo
@@ -6,6 +6,7 @@
 #include <utility>
 
 #include "cc/dual_net/dual_net.h"
+#include "cc/metrics.h"
 
 namespace minigo {
 
@@ -14,10 +15,18 @@ class DualNetFactory {
   explicit DualNetFactory(std::string model_path)
       : model_path_(std::move(model_path)) {}
   virtual ~DualNetFactory();
+
+  // Returns a new DualNet for the model. Factories load the model once and
+  // share it between the DualNets they create, so this is cheap, and it may
+  // be called from multiple threads at once.
   virtual std::unique_ptr<DualNet> New() = 0;
 
   const std::string& model() const { return model_path_; }
 
+  // Returns the metrics of the engine's inference batcher, or null if the
+  // engine doesn't batch the inferences of its DualNets together.
+  virtual MetricsRegistry* metrics() { return nullptr; }
+
  private:
   const std::string model_path_;
 };
@@ -25,6 +34,18 @@ class DualNetFactory {
 std::unique_ptr<DualNetFactory> NewDualNetFactory(std::string model_path,
                                                   int parallel_games);
 
+// Like NewDualNetFactory, but returns null and sets `error` if the engine
+// can't load the model, instead of dying.
+std::unique_ptr<DualNetFactory> TryNewDualNetFactory(std::string model_path,
+                                                     int parallel_games,
+                                                     std::string* error);
+
+// Returns a factory for the in-process engine selected by --engine whose
+// DualNets switch to the newest model in `directory` whenever one is written.
+// Starts with `model_path`, or if that's empty, waits for the first model.
+std::unique_ptr<DualNetFactory> NewReloadingDualNetFactory(
+    std::string model_path, std::string directory, int parallel_games);
+
 }  // namespace minigo
 
 #endif  // MINIGO_CC_DUAL_NET_FACTORY_H_
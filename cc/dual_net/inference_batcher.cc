@@ -0,0 +1,256 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/inference_batcher.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/check.h"
+#include "cc/constants.h"
+
+namespace minigo {
+
+namespace {
+
+// How often a client that is waiting for an inference logs that it's stalled.
+constexpr absl::Duration kClientLogInterval = absl::Minutes(1);
+
+// How long a client waits for an inference before terminating the process.
+// Batches sent to a worker that dies are handed out again once it's detected
+// as dead, so this only triggers if no worker is serving the batcher at all.
+constexpr absl::Duration kClientTimeout = absl::Minutes(30);
+
+}  // namespace
+
+class InferenceClient : public DualNet {
+ public:
+  explicit InferenceClient(InferenceBatcher* batcher) : batcher_(batcher) {
+    batcher_->num_clients_->Add(1);
+  }
+
+  ~InferenceClient() override { batcher_->num_clients_->Add(-1); }
+
+  void RunMany(absl::Span<const BoardFeatures> features,
+               absl::Span<Output> outputs, std::string* model) override {
+    MG_CHECK(features.size() <= batcher_->virtual_losses_);
+
+    absl::Notification notification;
+    batcher_->num_requests_->Increment();
+    batcher_->queue_depth_->Add(1);
+    batcher_->request_queue_.Push(
+        {features, outputs, model, &notification, absl::Now()});
+
+    // The transports requeue batches whose worker stopped responding, so a
+    // worker restart only delays the request. Keep waiting, periodically
+    // logging the state of the batcher to help diagnose stalls, and only give
+    // up if no worker comes back at all.
+    auto wait_start = absl::Now();
+    while (!notification.WaitForNotificationWithTimeout(kClientLogInterval)) {
+      auto waited = absl::Now() - wait_start;
+      if (waited >= kClientTimeout) {
+        std::cerr << "== Timed out waiting for inference after " << waited
+                  << "\n"
+                  << batcher_->metrics_.ToString();
+        std::exit(1);
+      }
+      std::cerr << "== Still waiting for inference after " << waited << "\n"
+                << batcher_->metrics_.ToString();
+      batcher_->num_client_stalls_->Increment();
+    }
+  }
+
+ private:
+  InferenceBatcher* batcher_;
+};
+
+namespace {
+
+// Maximum number of batches that have been formed but not yet handed out to a
+// worker. Having a batch ready means that a worker asking for features can
+// start on it immediately, but there's no point forming many small batches
+// ahead of time: while the workers are busy, waiting requests are better
+// spent filling up the next batch.
+constexpr size_t kMaxReadyBatches = 2;
+
+}  // namespace
+
+InferenceBatcher::InferenceBatcher(int virtual_losses, int games_per_inference)
+    : virtual_losses_(virtual_losses),
+      games_per_inference_(games_per_inference),
+      num_clients_(metrics_.GetGauge("inference/num_clients")),
+      num_outstanding_(metrics_.GetGauge("inference/num_outstanding")),
+      queue_depth_(metrics_.GetGauge("inference/queue_depth")),
+      num_ready_batches_(metrics_.GetGauge("inference/num_ready_batches")),
+      num_requests_(metrics_.GetCounter("inference/num_requests")),
+      num_batches_(metrics_.GetCounter("inference/num_batches")),
+      num_requeued_batches_(
+          metrics_.GetCounter("inference/num_requeued_batches")),
+      num_client_stalls_(metrics_.GetCounter("inference/num_client_stalls")),
+      batch_fill_(metrics_.GetHistogram("inference/batch_fill_pct")),
+      assembly_latency_(
+          metrics_.GetHistogram("inference/assembly_latency_us")),
+      ready_latency_(metrics_.GetHistogram("inference/ready_latency_us")),
+      client_latency_(metrics_.GetHistogram("inference/client_latency_us")) {
+  assembly_thread_ = std::thread(&InferenceBatcher::AssembleBatches, this);
+}
+
+InferenceBatcher::~InferenceBatcher() {
+  {
+    absl::MutexLock lock(&ready_batches_mutex_);
+    running_ = false;
+  }
+  assembly_thread_.join();
+}
+
+std::unique_ptr<DualNet> InferenceBatcher::NewDualNet() {
+  return absl::make_unique<InferenceClient>(this);
+}
+
+bool InferenceBatcher::GetBatch(const std::function<bool()>& is_cancelled,
+                                std::vector<RemoteInference>* batch) {
+  auto has_batch = [this]() EXCLUSIVE_LOCKS_REQUIRED(&ready_batches_mutex_) {
+    return !ready_batches_.empty();
+  };
+
+  absl::MutexLock lock(&ready_batches_mutex_);
+  while (!ready_batches_mutex_.AwaitWithTimeout(absl::Condition(&has_batch),
+                                                absl::Milliseconds(50))) {
+    if (is_cancelled()) {
+      return false;
+    }
+  }
+  ready_latency_->RecordDuration(absl::Now() -
+                                 ready_batches_.front().ready_time);
+  *batch = std::move(ready_batches_.front().inferences);
+  ready_batches_.pop_front();
+  num_ready_batches_->Add(-1);
+  return true;
+}
+
+void InferenceBatcher::Requeue(std::vector<RemoteInference> batch) {
+  num_requeued_batches_->Increment();
+  absl::MutexLock lock(&ready_batches_mutex_);
+  ready_batches_.push_front({std::move(batch), absl::Now()});
+  num_ready_batches_->Add(1);
+}
+
+void InferenceBatcher::AssembleBatches() {
+  // Each client is guaranteed to never request more than virtual_losses_
+  // inferences in each RemoteInference. Additionally, each client is only able
+  // to have one pending RemoteInference at a time, and the time between
+  // inference requests is very small (typically less than a millisecond).
+  //
+  // With this in mind, we accumulate RemoteInference requests into a single
+  // batch until one of the following occurs:
+  //  1) It has accumulated one RemoteInference request from every client that
+  //     doesn't already have a request in an earlier batch.
+  //  2) The current batch has grown large enough that we won't be able to fit
+  //     another virtual_losses_ inferences.
+  //
+  // Since a client can terminate (e.g. when a game is complete) while we are in
+  // the middle of forming a batch, we repeatedly pop with a timeout to allow us
+  // to periodically check the current number of clients. Client terminations
+  // are rare, so it doesn't really matter if we hold up one inference batch for
+  // a few tens of milliseconds occasionally.
+  //
+  // We always wait for at least one request, so that the inference workers
+  // don't spin on empty batches while there are no clients.
+  auto timeout = absl::Milliseconds(50);
+  auto has_space = [this]() EXCLUSIVE_LOCKS_REQUIRED(&ready_batches_mutex_) {
+    return !running_ || ready_batches_.size() < kMaxReadyBatches;
+  };
+
+  std::vector<RemoteInference> batch;
+  RemoteInference game;
+  absl::Time start_time;
+  while (running_) {
+    auto num_free_clients = [this]() {
+      return num_clients_->value() - num_outstanding_->value();
+    };
+    while (running_ &&
+           (batch.empty() ||
+            (static_cast<int64_t>(batch.size()) < num_free_clients() &&
+             batch.size() < games_per_inference_))) {
+      if (request_queue_.PopWithTimeout(&game, timeout)) {
+        queue_depth_->Add(-1);
+        if (batch.empty()) {
+          start_time = absl::Now();
+        }
+        batch.push_back(game);
+      }
+    }
+    if (batch.empty()) {
+      continue;
+    }
+    num_outstanding_->Add(batch.size());
+
+    size_t num_inferences = 0;
+    for (const auto& inference : batch) {
+      num_inferences += inference.features.size();
+    }
+    num_batches_->Increment();
+    batch_fill_->Record(100 * num_inferences / batch_size());
+    auto ready_time = absl::Now();
+    assembly_latency_->RecordDuration(ready_time - start_time);
+
+    absl::MutexLock lock(&ready_batches_mutex_);
+    ready_batches_mutex_.Await(absl::Condition(&has_space));
+    ready_batches_.push_back({std::move(batch), ready_time});
+    num_ready_batches_->Add(1);
+    batch.clear();
+  }
+}
+
+void InferenceBatcher::CopyFeatures(absl::Span<const RemoteInference> batch,
+                                    absl::Span<uint8_t> dst) {
+  auto* ptr = dst.data();
+  for (const auto& game : batch) {
+    const auto* src = reinterpret_cast<const float*>(game.features.data());
+    size_t n = game.features.size() * DualNet::kNumBoardFeatures;
+    MG_CHECK(ptr + n <= dst.data() + dst.size());
+    for (size_t i = 0; i < n; ++i) {
+      ptr[i] = src[i] != 0 ? 1 : 0;
+    }
+    ptr += n;
+  }
+  memset(ptr, 0, dst.data() + dst.size() - ptr);
+}
+
+void InferenceBatcher::SetOutputs(const float* policy, const float* value,
+                                  const std::string& model,
+                                  absl::Span<RemoteInference> batch) {
+  num_outstanding_->Add(-static_cast<int64_t>(batch.size()));
+  auto now = absl::Now();
+  for (auto& game : batch) {
+    for (auto& output : game.outputs) {
+      memcpy(output.policy.data(), policy, sizeof(output.policy));
+      output.value = *value++;
+      policy += kNumMoves;
+    }
+    if (game.model != nullptr) {
+      *game.model = model;
+    }
+
+    client_latency_->RecordDuration(now - game.push_time);
+    game.notification->Notify();
+  }
+}
+
+}  // namespace minigo
@@ -0,0 +1,173 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_INFERENCE_BATCHER_H_
+#define CC_DUAL_NET_INFERENCE_BATCHER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/metrics.h"
+#include "cc/thread_safe_queue.h"
+
+namespace minigo {
+
+// A batch of inference requests.
+struct RemoteInference {
+  // A batch of features to run inference on.
+  absl::Span<const DualNet::BoardFeatures> features;
+
+  // Inference output for the batch.
+  absl::Span<DualNet::Output> outputs;
+
+  // Model used for the inference.
+  std::string* model;
+
+  // Notified when the batch is ready.
+  absl::Notification* notification;
+
+  // When the client made the request.
+  absl::Time push_time;
+};
+
+// Accumulates the RemoteInference requests made by many DualNet clients into
+// batches that are sent to an inference worker by one of the remote inference
+// transports (InferenceServer or ShmInferenceServer).
+//
+// Batches are assembled on a dedicated thread and queued until a worker asks
+// for one, so that while workers are busy running inference the next batches
+// are already being formed. A worker asking for a batch never has to wait for
+// another worker's batch to finish forming.
+class InferenceBatcher {
+ public:
+  InferenceBatcher(int virtual_losses, int games_per_inference);
+  ~InferenceBatcher();
+
+  // Return a new DualNet instance whose inference requests are batched by this
+  // InferenceBatcher.
+  std::unique_ptr<DualNet> NewDualNet();
+
+  // Pops the next batch of inference requests. Blocks until a batch is
+  // available. Returns false if `is_cancelled` returns true while waiting.
+  bool GetBatch(const std::function<bool()>& is_cancelled,
+                std::vector<RemoteInference>* batch);
+
+  // Copies the policy & value outputs of a batch returned by GetBatch from
+  // contiguous arrays back to the inference requests and notifies their
+  // clients.
+  void SetOutputs(const float* policy, const float* value,
+                  const std::string& model, absl::Span<RemoteInference> batch);
+
+  // Returns a batch previously returned by GetBatch whose outputs will never
+  // arrive, e.g. because the worker it was sent to died. The batch is handed
+  // out again ahead of any newly formed batches, so that its clients don't
+  // wait any longer than necessary.
+  void Requeue(std::vector<RemoteInference> batch);
+
+  // Maximum number of positions in each batch.
+  size_t batch_size() const { return virtual_losses_ * games_per_inference_; }
+
+  size_t virtual_losses() const { return virtual_losses_; }
+  size_t games_per_inference() const { return games_per_inference_; }
+
+  // Metrics describing the request queue and the batches formed from it.
+  // Transports may add their own metrics to the registry.
+  MetricsRegistry* metrics() { return &metrics_; }
+
+  // Writes the features of all inferences in the batch to `dst` as one byte per
+  // feature. `dst` must be large enough to hold batch_size() board features;
+  // any space not used by the batch is zero-filled.
+  static void CopyFeatures(absl::Span<const RemoteInference> batch,
+                           absl::Span<uint8_t> dst);
+
+ private:
+  friend class InferenceClient;
+
+  // Forms batches from request_queue_ and pushes them onto ready_batches_
+  // until the batcher is destroyed.
+  void AssembleBatches();
+
+  // Guaranteed maximum batch size that each client will send.
+  const size_t virtual_losses_;
+
+  // Target number of RemoteInference requests in each batch.
+  const size_t games_per_inference_;
+
+  MetricsRegistry metrics_;
+
+  Gauge* num_clients_;
+
+  // Number of RemoteInference requests that have been popped off
+  // request_queue_ but whose outputs haven't been set yet. The clients that
+  // made them can't make another request until they are done.
+  Gauge* num_outstanding_;
+
+  Gauge* queue_depth_;
+  Gauge* num_ready_batches_;
+  Counter* num_requests_;
+  Counter* num_batches_;
+  Counter* num_requeued_batches_;
+
+  // Number of times a client has waited more than a minute for its request.
+  Counter* num_client_stalls_;
+
+  // Percentage of batch_size() filled by each batch.
+  Histogram* batch_fill_;
+
+  // Time taken to form each batch, from its first request to it being ready.
+  Histogram* assembly_latency_;
+
+  // Time each batch spent ready before being handed out to a worker.
+  Histogram* ready_latency_;
+
+  // Time between a client pushing a request and being notified of its result.
+  Histogram* client_latency_;
+
+  ThreadSafeQueue<RemoteInference> request_queue_;
+
+  struct ReadyBatch {
+    std::vector<RemoteInference> inferences;
+    absl::Time ready_time;
+  };
+
+  // Batches that are ready to be handed out to a worker by GetBatch.
+  // Requeued batches are pushed onto the front, and may take the size of the
+  // queue over kMaxReadyBatches. While that's the case, AssembleBatches stops
+  // forming new batches: the requests that would have gone into them wait in
+  // request_queue_ and the clients that made them stay blocked until the
+  // workers have caught up.
+  absl::Mutex ready_batches_mutex_;
+  std::deque<ReadyBatch> ready_batches_ GUARDED_BY(&ready_batches_mutex_);
+
+  // Only written while holding ready_batches_mutex_, so that threads waiting
+  // on the mutex notice when it changes.
+  std::atomic<bool> running_{true};
+
+  std::thread assembly_thread_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_INFERENCE_BATCHER_H_
@@ -0,0 +1,156 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the inference throughput of an in-process engine for different
+// numbers of parallel games and inference thread budgets, e.g.:
+//
+//   inference_scaling_benchmark --engine=lite --model=model.tflite
+//       --games=1,4,16 --threads=4,8,16 --pin_threads
+//
+// Each configuration creates a factory as selfplay would and runs one
+// DualNet per game, each on its own thread, for --seconds seconds.
+//
+// TensorFlow sizes its thread pools once per process, so when benchmarking
+// the tf engine, run a separate process for each thread budget.
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/benchmark_utils.h"
+#include "cc/check.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/dual_net/factory.h"
+#include "cc/init.h"
+#include "cc/random.h"
+#include "cc/thread_affinity.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(model, "", "Path to the model to benchmark.");
+DEFINE_string(games, "1,2,4,8",
+              "Comma separated numbers of parallel games to benchmark.");
+DEFINE_string(threads, "0",
+              "Comma separated inference thread budgets to benchmark, as "
+              "passed to --inference_threads.");
+DEFINE_int32(batch_size, 8, "Number of positions per inference.");
+DEFINE_double(seconds, 10, "Number of seconds to run each configuration.");
+DEFINE_bool(pin_threads, false,
+            "If true, pin each game thread to its own group of CPUs, as "
+            "selfplay does.");
+
+// Required by the remote inference engine.
+DEFINE_int32(virtual_losses, 8,
+             "Number of virtual losses, which sets the remote inference "
+             "batch size.");
+
+DECLARE_int32(inference_threads);
+
+namespace minigo {
+namespace {
+
+// Runs `num_games` DualNets in parallel and returns the total number of
+// positions evaluated per second.
+double Run(int num_games, const std::vector<int>& cpus) {
+  auto factory = NewDualNetFactory(FLAGS_model, num_games);
+
+  Random rnd(1);
+  std::vector<DualNet::BoardFeatures> features(FLAGS_batch_size);
+  for (auto& board : features) {
+    for (auto& x : board) {
+      x = rnd() < 0.5 ? 1 : 0;
+    }
+  }
+
+  absl::Mutex mutex;
+  absl::BlockingCounter ready(num_games);
+  absl::Notification start;
+  std::atomic<bool> running{true};
+  std::atomic<int64_t> num_positions{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_games; ++i) {
+    threads.emplace_back([&, i]() {
+      // Pin the thread before creating its DualNet, so that any threads the
+      // engine starts inherit the affinity.
+      if (FLAGS_pin_threads) {
+        MG_CHECK(PinCurrentThread(GetCpuGroup(cpus, num_games, i)));
+      }
+      std::unique_ptr<DualNet> dual_net;
+      {
+        absl::MutexLock lock(&mutex);
+        dual_net = factory->New();
+      }
+      std::vector<DualNet::Output> outputs(features.size());
+
+      ready.DecrementCount();
+      start.WaitForNotification();
+      int64_t n = 0;
+      while (running) {
+        dual_net->RunMany(features, absl::MakeSpan(outputs), nullptr);
+        n += features.size();
+      }
+      num_positions += n;
+    });
+  }
+
+  ready.Wait();
+  auto start_time = absl::Now();
+  start.Notify();
+  absl::SleepFor(absl::Seconds(FLAGS_seconds));
+  running = false;
+  for (auto& t : threads) {
+    t.join();
+  }
+  return num_positions / absl::ToDoubleSeconds(absl::Now() - start_time);
+}
+
+void Benchmark() {
+  MG_CHECK(!FLAGS_model.empty()) << "--model must be set";
+  MG_CHECK(FLAGS_batch_size > 0);
+  auto games = ParseIntList(FLAGS_games);
+  auto threads = ParseIntList(FLAGS_threads);
+  MG_CHECK(!games.empty() && !threads.empty());
+  auto cpus = GetAllowedCpus();
+
+  std::cout << "CPUs: " << absl::StrJoin(cpus, ",") << "\n"
+            << std::setw(8) << "games" << std::setw(10) << "threads"
+            << std::setw(14) << "positions/s" << std::endl;
+  for (int num_threads : threads) {
+    for (int num_games : games) {
+      FLAGS_inference_threads = num_threads;
+      double rate = Run(num_games, cpus);
+      std::cout << std::setw(8) << num_games << std::setw(10) << num_threads
+                << std::setw(14) << std::fixed << std::setprecision(1)
+                << rate << std::endl;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Benchmark();
+  return 0;
+}
@@ -14,18 +14,23 @@
 
 #include "cc/dual_net/inference_server.h"
 
+#include <algorithm>
+#include <array>
 #include <atomic>
-#include <functional>
-#include <future>
+#include <cstring>
+#include <iostream>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
-#include "absl/time/time.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "cc/check.h"
+#include "cc/constants.h"
 #include "grpc++/grpc++.h"
 #include "proto/inference_service.grpc.pb.h"
 
@@ -40,81 +45,56 @@ namespace minigo {
 namespace internal {
 
 // Implementation of the InferenceService.
-// The client InferenceClient pushes inference requests onto
-// InferenceServiceImpl's request queue.
+// Inference requests are accumulated into batches by an InferenceBatcher; the
+// service hands those batches out to inference workers in response to
+// GetFeatures RPCs and notifies the clients once the worker calls PutOutputs.
 class InferenceServiceImpl final : public InferenceService::Service {
  public:
-  InferenceServiceImpl(int virtual_losses, int games_per_inference)
-      : virtual_losses_(virtual_losses),
-        games_per_inference_(games_per_inference),
-        batch_id_(1) {}
+  explicit InferenceServiceImpl(InferenceBatcher* batcher)
+      : batcher_(batcher),
+        worker_latency_(batcher->metrics()->GetHistogram(
+            "inference/worker_latency_us")),
+        num_stale_outputs_(
+            batcher->metrics()->GetCounter("inference/num_stale_outputs")),
+        num_invalid_outputs_(batcher->metrics()->GetCounter(
+            "inference/num_invalid_outputs")) {}
 
   Status GetConfig(ServerContext* context, const GetConfigRequest* request,
                    GetConfigResponse* response) override {
+    Touch(context->peer());
     response->set_board_size(kN);
-    response->set_virtual_losses(virtual_losses_);
-    response->set_games_per_inference(games_per_inference_);
+    response->set_virtual_losses(batcher_->virtual_losses());
+    response->set_games_per_inference(batcher_->games_per_inference());
     return Status::OK;
   }
 
   Status GetFeatures(ServerContext* context, const GetFeaturesRequest* request,
                      GetFeaturesResponse* response) override {
     std::vector<RemoteInference> inferences;
-
-    {
-      // Lock get_features_mutex_ while popping inference requests off the
-      // request_queue_: we want make sure that each request fills up as much
-      // of a batch as possible. If multiple threads all popped inference
-      // requests off the queue in parallel, we'd likely end up with multiple
-      // partially empty batches.
-      absl::MutexLock lock(&get_features_mutex_);
-
-      // Each client is guaranteed to never request more than
-      // virtual_losses_ inferences in each RemoteInference. Additionally,
-      // each client is only able to have one pending RemoteInference at a
-      // time, and the time between inference requests is very small (typically
-      // less than a millisecond).
-      //
-      // With this in mind, the inference server accumulates RemoteInference
-      // requests into a single batch until one of the following occurs:
-      //  1) It has accumulated one RemoteInference request from every client.
-      //  2) The current batch has grown large enough that we won't be able to
-      //     fit another virtual_losses_ inferences.
-      //
-      // Since a client can terminate (e.g. when a game is complete) while the
-      // inference server is in the middle of processing a GetFeatures request,
-      // we repeatedly pop with a timeout to allow us to periodically check the
-      // current number of clients. Client terminations are rare, so it doesn't
-      // really matter if we hold up one inference batch for a few tens of
-      // milliseconds occasionally.
-      auto timeout = absl::Milliseconds(50);
-      RemoteInference game;
-      while (inferences.size() < num_clients_ &&
-             inferences.size() < games_per_inference_) {
-        if (request_queue_.PopWithTimeout(&game, timeout)) {
-          inferences.push_back(game);
-        } else if (context->IsCancelled()) {
-          return Status(StatusCode::CANCELLED, "connection terminated");
-        }
-      }
+    if (!batcher_->GetBatch([context]() { return context->IsCancelled(); },
+                            &inferences)) {
+      return Status(StatusCode::CANCELLED, "connection terminated");
     }
 
-    std::string byte_features(
-        games_per_inference_ * virtual_losses_ * DualNet::kNumBoardFeatures, 0);
-    int i = 0;
-    for (const auto& game : inferences) {
-      for (const auto& features : game.features) {
-        for (float f : features) {
-          byte_features[i++] = f != 0 ? 1 : 0;
-        }
-      }
-    }
+    // Write the features directly into the response's buffer.
+    auto* byte_features = response->mutable_features();
+    byte_features->resize(batcher_->batch_size() * DualNet::kNumBoardFeatures);
+    auto* dst = reinterpret_cast<uint8_t*>(&(*byte_features)[0]);
+    InferenceBatcher::CopyFeatures(
+        inferences, absl::MakeSpan(dst, byte_features->size()));
     response->set_batch_id(batch_id_++);
-    response->set_features(std::move(byte_features));
 
+    // Touch the worker before recording the batch, so that the batch can't be
+    // mistaken for one sent to a worker that has gone quiet.
+    auto peer = context->peer();
+    Touch(peer);
+    auto* shard = GetPendingShard(response->batch_id());
     {
-      absl::MutexLock lock(&pending_inferences_mutex_);
-      pending_inferences_[response->batch_id()] = std::move(inferences);
+      absl::MutexLock lock(&shard->mutex);
+      auto& pending = shard->batches[response->batch_id()];
+      pending.inferences = std::move(inferences);
+      pending.peer = std::move(peer);
+      pending.dispatch_time = absl::Now();
     }
 
     return Status::OK;
@@ -122,109 +102,259 @@ class InferenceServiceImpl final : public InferenceService::Service {
 
   Status PutOutputs(ServerContext* context, const PutOutputsRequest* request,
                     PutOutputsResponse* response) override {
-    std::vector<RemoteInference> inferences;
-    {
-      absl::MutexLock lock(&pending_inferences_mutex_);
-      auto it = pending_inferences_.find(request->batch_id());
-      MG_CHECK(it != pending_inferences_.end());
-      inferences = std::move(it->second);
-      pending_inferences_.erase(it);
-    }
+    Touch(context->peer());
 
-    // Check we got the expected number of values.
+    // Check the outputs' sizes before taking the batch: a worker that sends
+    // malformed outputs must not take the batch down with it.
     // (Note that if the prior GetFeatures response was padded, we may have
-    // more values than batch_.size()).
-    MG_CHECK(request->value().size() ==
-             static_cast<int>(virtual_losses_ * games_per_inference_))
-        << "Expected " << virtual_losses_ << "*" << games_per_inference_
-        << " values, got " << request->value().size();
-
-    // There should be kNumMoves policy values for each inference.
-    MG_CHECK(request->policy().size() ==
-             static_cast<int>(request->value().size() * kNumMoves));
-
-    size_t src_policy_idx = 0;
-    size_t src_value_idx = 0;
-    for (auto& game : inferences) {
-      for (size_t vloss = 0; vloss < game.outputs.size(); ++vloss) {
-        auto& dst_policy = game.outputs[vloss].policy;
-        for (int i = 0; i < kNumMoves; ++i) {
-          dst_policy[i] = request->policy(src_policy_idx++);
-        }
-        game.outputs[vloss].value = request->value(src_value_idx++);
+    // more values than inferences).
+    size_t num_values = batcher_->batch_size();
+    bool packed = !request->packed_policy().empty();
+    std::string error;
+    if (packed) {
+      if (request->packed_policy().size() !=
+              num_values * kNumMoves * sizeof(float) ||
+          request->packed_value().size() != num_values * sizeof(float)) {
+        error = absl::StrCat(
+            "expected ", num_values * kNumMoves, " packed policy values and ",
+            num_values, " packed values, got ",
+            request->packed_policy().size() / sizeof(float), " and ",
+            request->packed_value().size() / sizeof(float));
       }
-      if (game.model != nullptr) {
-        *game.model = request->model_path();
+    } else if (request->policy().size() !=
+                   static_cast<int>(num_values * kNumMoves) ||
+               request->value().size() != static_cast<int>(num_values)) {
+      error = absl::StrCat("expected ", num_values * kNumMoves,
+                           " policy values and ", num_values, " values, got ",
+                           request->policy().size(), " and ",
+                           request->value().size());
+    }
+
+    PendingBatch pending;
+    auto* shard = GetPendingShard(request->batch_id());
+    {
+      absl::MutexLock lock(&shard->mutex);
+      auto it = shard->batches.find(request->batch_id());
+      if (it == shard->batches.end()) {
+        // The worker took too long and the batch was handed out again.
+        num_stale_outputs_->Increment();
+        return Status(StatusCode::NOT_FOUND,
+                      absl::StrCat("batch ", request->batch_id(),
+                                   " isn't pending"));
       }
+      pending = std::move(it->second);
+      shard->batches.erase(it);
+    }
+    if (!error.empty()) {
+      // Hand the batch to another worker straight away, rather than leaving
+      // it for RequeueLostBatches.
+      num_invalid_outputs_->Increment();
+      std::cerr << "Inference worker " << pending.peer
+                << " sent invalid outputs for batch " << request->batch_id()
+                << ", requeuing it: " << error << std::endl;
+      batcher_->Requeue(std::move(pending.inferences));
+      return Status(StatusCode::INVALID_ARGUMENT, error);
+    }
+    auto inference_time = absl::Now() - pending.dispatch_time;
+    worker_latency_->RecordDuration(inference_time);
+
+    // Get pointers to the policy and value outputs, preferring the packed
+    // fields if the worker set them. The packed fields are copied out rather
+    // than read in place, because the string's buffer may not be aligned for
+    // floats.
+    std::vector<float> packed_policy, packed_value;
+    const float* src_policy;
+    const float* src_value;
+    if (packed) {
+      packed_policy.resize(num_values * kNumMoves);
+      packed_value.resize(num_values);
+      memcpy(packed_policy.data(), request->packed_policy().data(),
+             request->packed_policy().size());
+      memcpy(packed_value.data(), request->packed_value().data(),
+             request->packed_value().size());
+      src_policy = packed_policy.data();
+      src_value = packed_value.data();
+    } else {
+      src_policy = request->policy().data();
+      src_value = request->value().data();
+    }
 
-      game.notification->Notify();
+    int64_t num_inferences = 0;
+    for (const auto& game : pending.inferences) {
+      num_inferences += game.features.size();
+    }
+    batcher_->SetOutputs(src_policy, src_value, request->model_path(),
+                         absl::MakeSpan(pending.inferences));
+
+    {
+      absl::MutexLock lock(&worker_stats_mutex_);
+      auto& stats = worker_stats_[pending.peer];
+      stats.peer = pending.peer;
+      stats.num_batches += 1;
+      stats.num_inferences += num_inferences;
+      stats.inference_time += inference_time;
     }
 
     return Status::OK;
   }
 
- private:
-  // Guaranteed maximum batch size that each client will send.
-  const size_t virtual_losses_;
+  Status Heartbeat(ServerContext* context, const HeartbeatRequest* request,
+                   HeartbeatResponse* response) override {
+    Touch(context->peer());
+    return Status::OK;
+  }
 
-  // Target size of the batch sent in response to each GetFeaturesRequest.
-  const size_t games_per_inference_;
+  Status GetStats(ServerContext* context, const GetStatsRequest* request,
+                  GetStatsResponse* response) override {
+    batcher_->metrics()->Visit(
+        [response](const std::string& name, const Counter& counter) {
+          auto* value = response->add_counters();
+          value->set_name(name);
+          value->set_value(counter.value());
+        },
+        [response](const std::string& name, const Gauge& gauge) {
+          auto* value = response->add_gauges();
+          value->set_name(name);
+          value->set_value(gauge.value());
+        },
+        [response](const std::string& name, const Histogram& histogram) {
+          auto* summary = response->add_histograms();
+          summary->set_name(name);
+          summary->set_count(histogram.count());
+          summary->set_mean(histogram.mean());
+          summary->set_p50(histogram.Percentile(0.5));
+          summary->set_p90(histogram.Percentile(0.9));
+          summary->set_p99(histogram.Percentile(0.99));
+          summary->set_p999(histogram.Percentile(0.999));
+          summary->set_max(histogram.max());
+        });
+    for (const auto& stats : GetWorkerStats()) {
+      auto* worker = response->add_workers();
+      worker->set_peer(stats.peer);
+      worker->set_num_batches(stats.num_batches);
+      worker->set_num_inferences(stats.num_inferences);
+      worker->set_inference_seconds(
+          absl::ToDoubleSeconds(stats.inference_time));
+    }
+    return Status::OK;
+  }
 
-  std::atomic<int32_t> batch_id_{1};
-  std::atomic<size_t> num_clients_{0};
+  std::vector<InferenceWorkerStats> GetWorkerStats() {
+    std::vector<InferenceWorkerStats> result;
+    absl::MutexLock lock(&worker_stats_mutex_);
+    for (const auto& kv : worker_stats_) {
+      result.push_back(kv.second);
+    }
+    return result;
+  }
 
-  // After successfully popping the first request off request_queue, GetFeatures
-  // will wait for up to the batch_timeout_ for more inference requests before
-  // replying.
-  absl::Duration batch_timeout_;
+  // Hands the pending batches of every worker that hasn't made an RPC for
+  // `timeout` back to the batcher, so that other workers can run them. If the
+  // worker does eventually send their outputs, PutOutputs rejects them.
+  void RequeueLostBatches(absl::Duration timeout) {
+    std::unordered_map<std::string, absl::Time> last_seen;
+    {
+      absl::MutexLock lock(&last_seen_mutex_);
+      last_seen = last_seen_;
+    }
+    auto now = absl::Now();
+    auto is_lost = [&](const PendingBatch& pending) {
+      // Batches dispatched after we took the snapshot count as contact too.
+      auto last_contact = pending.dispatch_time;
+      auto it = last_seen.find(pending.peer);
+      if (it != last_seen.end()) {
+        last_contact = std::max(last_contact, it->second);
+      }
+      return now - last_contact > timeout;
+    };
+
+    for (auto& shard : pending_shards_) {
+      std::vector<PendingBatch> lost;
+      {
+        absl::MutexLock lock(&shard.mutex);
+        for (auto it = shard.batches.begin(); it != shard.batches.end();) {
+          if (is_lost(it->second)) {
+            lost.push_back(std::move(it->second));
+            it = shard.batches.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+      for (auto& pending : lost) {
+        std::cerr << "Inference worker " << pending.peer
+                  << " hasn't responded for " << timeout
+                  << ", requeuing its batch sent "
+                  << now - pending.dispatch_time << " ago" << std::endl;
+        batcher_->Requeue(std::move(pending.inferences));
+      }
+    }
+  }
 
-  ThreadSafeQueue<RemoteInference> request_queue_;
+ private:
+  // A batch of inferences that has been sent to a worker.
+  struct PendingBatch {
+    std::vector<RemoteInference> inferences;
 
-  // Mutex that is locked while popping inference requests off request_queue_
-  // (see GetFeatures() for why this is needed).
-  absl::Mutex get_features_mutex_;
+    // The worker that the batch was sent to.
+    std::string peer;
+
+    // When the batch was sent.
+    absl::Time dispatch_time;
+  };
+
+  // The pending batches are split into shards by batch ID, so that workers
+  // getting features and putting outputs concurrently rarely contend for the
+  // same lock.
+  struct PendingShard {
+    absl::Mutex mutex;
+    std::unordered_map<int32_t, PendingBatch> batches GUARDED_BY(&mutex);
+  };
+  static constexpr int kNumPendingShards = 16;
+
+  // Records that we've just heard from the worker `peer`.
+  void Touch(const std::string& peer) {
+    absl::MutexLock lock(&last_seen_mutex_);
+    last_seen_[peer] = absl::Now();
+  }
 
-  // Mutex that protects access to pending_inferences_.
-  absl::Mutex pending_inferences_mutex_;
+  PendingShard* GetPendingShard(int32_t batch_id) {
+    auto shard = static_cast<uint32_t>(batch_id) % kNumPendingShards;
+    return &pending_shards_[shard];
+  }
 
-  // Map from batch ID to list of remote inference requests in that batch.
-  std::map<int32_t, std::vector<RemoteInference>> pending_inferences_
-      GUARDED_BY(&pending_inferences_mutex_);
+  InferenceBatcher* batcher_;
 
-  friend class InferenceClient;
-};
+  // Time between sending a batch to a worker and receiving its outputs.
+  Histogram* worker_latency_;
 
-class InferenceClient : public DualNet {
- public:
-  explicit InferenceClient(InferenceServiceImpl* service) : service_(service) {
-    service_->num_clients_++;
-  }
+  // Number of PutOutputs calls for batches that had already been requeued.
+  Counter* num_stale_outputs_;
 
-  ~InferenceClient() { service_->num_clients_--; }
+  // Number of PutOutputs calls whose outputs had the wrong size.
+  Counter* num_invalid_outputs_;
 
-  void RunMany(absl::Span<const BoardFeatures> features,
-               absl::Span<Output> outputs, std::string* model) override {
-    MG_CHECK(features.size() <= service_->virtual_losses_);
+  std::atomic<int32_t> batch_id_{1};
 
-    absl::Notification notification;
-    service_->request_queue_.Push({features, outputs, model, &notification});
-    if (!notification.WaitForNotificationWithTimeout(absl::Minutes(2))) {
-      std::cerr << "== Timed out waiting for notification";
-      std::exit(1);
-    }
-  }
+  std::array<PendingShard, kNumPendingShards> pending_shards_;
 
- private:
-  InferenceServiceImpl* service_;
+  // When each worker last made an RPC.
+  absl::Mutex last_seen_mutex_;
+  std::unordered_map<std::string, absl::Time> last_seen_
+      GUARDED_BY(&last_seen_mutex_);
+
+  absl::Mutex worker_stats_mutex_;
+  std::map<std::string, InferenceWorkerStats> worker_stats_
+      GUARDED_BY(&worker_stats_mutex_);
 };
 
 }  // namespace internal
 
 InferenceServer::InferenceServer(int virtual_losses, int games_per_inference,
-                                 int port) {
+                                 int port, absl::Duration worker_timeout)
+    : batcher_(virtual_losses, games_per_inference) {
   auto server_address = absl::StrCat("0.0.0.0:", port);
-  service_ = absl::make_unique<internal::InferenceServiceImpl>(
-      virtual_losses, games_per_inference);
+  service_ = absl::make_unique<internal::InferenceServiceImpl>(&batcher_);
 
   ServerBuilder builder;
   builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -233,16 +363,38 @@ InferenceServer::InferenceServer(int virtual_losses, int games_per_inference,
   std::cerr << "Inference server listening on port " << port << std::endl;
 
   thread_ = std::thread([this]() { server_->Wait(); });
+
+  reaper_thread_ = std::thread([this, worker_timeout]() {
+    while (!stop_reaper_.WaitForNotificationWithTimeout(worker_timeout / 4)) {
+      service_->RequeueLostBatches(worker_timeout);
+    }
+  });
 }
 
 InferenceServer::~InferenceServer() {
+  stop_reaper_.Notify();
+  reaper_thread_.join();
+
   // Passing gpr_inf_past to Shutdown makes it shutdown immediately.
   server_->Shutdown(gpr_inf_past(GPR_CLOCK_REALTIME));
   thread_.join();
+
+  for (const auto& stats : GetWorkerStats()) {
+    auto seconds = absl::ToDoubleSeconds(stats.inference_time);
+    std::cerr << "Inference worker " << stats.peer << ": "
+              << stats.num_batches << " batches, " << stats.num_inferences
+              << " inferences, "
+              << (seconds > 0 ? stats.num_inferences / seconds : 0)
+              << " inferences/sec" << std::endl;
+  }
 }
 
 std::unique_ptr<DualNet> InferenceServer::NewDualNet() {
-  return absl::make_unique<internal::InferenceClient>(service_.get());
+  return batcher_.NewDualNet();
+}
+
+std::vector<InferenceWorkerStats> InferenceServer::GetWorkerStats() {
+  return service_->GetWorkerStats();
 }
 
 }  // namespace minigo
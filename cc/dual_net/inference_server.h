@@ -16,13 +16,17 @@
 #define CC_DUAL_NET_INFERENCE_SERVER_H_
 
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
 #include "cc/dual_net/dual_net.h"
-#include "cc/thread_safe_queue.h"
+#include "cc/dual_net/inference_batcher.h"
+#include "cc/metrics.h"
 #include "grpc++/server.h"
 
 namespace minigo {
@@ -31,35 +35,52 @@ namespace internal {
 class InferenceServiceImpl;
 }  // namespace internal
 
-// A batch of inference requests.
-struct RemoteInference {
-  // A batch of features to run inference on.
-  absl::Span<const DualNet::BoardFeatures> features;
+// Throughput statistics for one inference worker.
+struct InferenceWorkerStats {
+  // The worker's address, as reported by grpc::ServerContext::peer().
+  std::string peer;
 
-  // Inference output for the batch.
-  absl::Span<DualNet::Output> outputs;
+  // Number of batches the worker has run.
+  int64_t num_batches = 0;
 
-  // Model used for the inference.
-  std::string* model;
+  // Number of positions in those batches, excluding padding.
+  int64_t num_inferences = 0;
 
-  // Notified when the batch is ready.
-  absl::Notification* notification;
+  // Total time between sending the worker a batch of features and receiving
+  // its outputs.
+  absl::Duration inference_time;
 };
 
 class InferenceServer {
  public:
-  InferenceServer(int virtual_losses, int games_per_inference, int port);
+  // Batches sent to a worker that makes no RPCs for `worker_timeout` are
+  // assumed lost and handed out to other workers. Inference workers call the
+  // Heartbeat RPC every second while they're running.
+  InferenceServer(int virtual_losses, int games_per_inference, int port,
+                  absl::Duration worker_timeout);
   ~InferenceServer();
 
   // Return a new DualNet instance whose inference requests are performed
   // by this InferenceServer.
   std::unique_ptr<DualNet> NewDualNet();
 
+  // Returns the throughput statistics of each worker that has sent outputs to
+  // this server.
+  std::vector<InferenceWorkerStats> GetWorkerStats();
+
+  // The server's metrics, as returned by the GetStats RPC.
+  MetricsRegistry* metrics() { return batcher_.metrics(); }
+
  private:
   std::thread thread_;
-  // request_queue_ is owned by the service_ implementation.
+  InferenceBatcher batcher_;
   std::unique_ptr<grpc::Server> server_;
   std::unique_ptr<internal::InferenceServiceImpl> service_;
+
+  // Periodically requeues the batches of workers that have stopped
+  // responding.
+  absl::Notification stop_reaper_;
+  std::thread reaper_thread_;
 };
 
 }  // namespace minigo
@@ -0,0 +1,290 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the throughput of the remote inference protocols: gRPC over loopback
+// and shared memory. A stand-in inference worker running on a separate thread
+// plays the role of inference_worker.py: it fetches features and immediately
+// writes back constant outputs, so the benchmark measures only the cost of
+// batching, marshalling and transporting the data between the two.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "benchmark/benchmark.h"
+#include "cc/constants.h"
+#include "cc/dual_net/inference_server.h"
+#include "cc/dual_net/shm_inference_server.h"
+#include "google/protobuf/arena.h"
+#include "grpc++/create_channel.h"
+#include "grpc++/grpc++.h"
+#include "proto/inference_service.grpc.pb.h"
+
+namespace minigo {
+namespace {
+
+constexpr int kPort = 50052;
+constexpr int kVirtualLosses = 8;
+constexpr absl::Duration kWorkerTimeout = absl::Seconds(30);
+
+// Stand-in for inference_worker.py using the gRPC transport.
+class StandInWorker {
+ public:
+  explicit StandInWorker(bool packed) : packed_(packed) {
+    thread_ = std::thread(&StandInWorker::Run, this);
+  }
+
+  ~StandInWorker() {
+    running_ = false;
+    thread_.join();
+  }
+
+ private:
+  void Run() {
+    InferenceService::Stub stub(
+        grpc::CreateChannel(absl::StrCat("localhost:", kPort),
+                            grpc::InsecureChannelCredentials()));
+
+    GetConfigRequest get_config_request;
+    GetConfigResponse get_config_response;
+    {
+      grpc::ClientContext context;
+      stub.GetConfig(&context, get_config_request, &get_config_response);
+    }
+    int batch_size = get_config_response.virtual_losses() *
+                     get_config_response.games_per_inference();
+    std::vector<float> policy(batch_size * kNumMoves, 1.0f / kNumMoves);
+    std::vector<float> value(batch_size, 0.0f);
+
+    while (running_) {
+      // Allocate the messages for each batch on an arena, like a real worker
+      // written in C++ would.
+      google::protobuf::Arena arena;
+      auto* get_features_request =
+          google::protobuf::Arena::CreateMessage<GetFeaturesRequest>(&arena);
+      auto* get_features_response =
+          google::protobuf::Arena::CreateMessage<GetFeaturesResponse>(&arena);
+      {
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() +
+                             std::chrono::milliseconds(100));
+        auto status = stub.GetFeatures(&context, *get_features_request,
+                                       get_features_response);
+        if (!status.ok()) {
+          // The GetFeatures call times out when the benchmark has finished
+          // running all its inferences.
+          continue;
+        }
+      }
+
+      auto* put_outputs_request =
+          google::protobuf::Arena::CreateMessage<PutOutputsRequest>(&arena);
+      auto* put_outputs_response =
+          google::protobuf::Arena::CreateMessage<PutOutputsResponse>(&arena);
+      put_outputs_request->set_batch_id(get_features_response->batch_id());
+      if (packed_) {
+        put_outputs_request->set_packed_policy(
+            policy.data(), policy.size() * sizeof(float));
+        put_outputs_request->set_packed_value(value.data(),
+                                              value.size() * sizeof(float));
+      } else {
+        for (float p : policy) {
+          put_outputs_request->add_policy(p);
+        }
+        for (float v : value) {
+          put_outputs_request->add_value(v);
+        }
+      }
+      {
+        grpc::ClientContext context;
+        stub.PutOutputs(&context, *put_outputs_request, put_outputs_response);
+      }
+    }
+  }
+
+  const bool packed_;
+  std::atomic<bool> running_{true};
+  std::thread thread_;
+};
+
+// Stand-in for inference_worker.py using the shared memory transport. Runs
+// two worker threads, like inference_worker.py does.
+class ShmStandInWorker {
+ public:
+  explicit ShmStandInWorker(const std::string& name) : worker_(name) {
+    for (int i = 0; i < 2; ++i) {
+      threads_.emplace_back(&ShmStandInWorker::Run, this);
+    }
+  }
+
+  ~ShmStandInWorker() {
+    running_ = false;
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+ private:
+  void Run() {
+    int batch_size = worker_.virtual_losses() * worker_.games_per_inference();
+    std::vector<float> policy(batch_size * kNumMoves, 1.0f / kNumMoves);
+    std::vector<float> value(batch_size, 0.0f);
+    ShmInferenceWorker::Batch batch;
+    while (running_) {
+      if (!worker_.GetFeatures(absl::Milliseconds(100), &batch)) {
+        continue;
+      }
+      worker_.PutOutputs(batch, policy, value, "");
+    }
+  }
+
+  ShmInferenceWorker worker_;
+  std::atomic<bool> running_{true};
+  std::vector<std::thread> threads_;
+};
+
+// Runs one inference per client each iteration, with every client on its own
+// thread, just like SelfPlayer does.
+class ClientThreads {
+ public:
+  ClientThreads(const std::function<std::unique_ptr<DualNet>()>& new_dual_net,
+                int num_clients) {
+    for (int i = 0; i < num_clients; ++i) {
+      threads_.emplace_back(&ClientThreads::Run, this, new_dual_net());
+    }
+  }
+
+  ~ClientThreads() {
+    {
+      absl::MutexLock lock(&mutex_);
+      running_ = false;
+    }
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  // Runs one inference on every client and waits for them all to complete.
+  void RunOnce() {
+    absl::MutexLock lock(&mutex_);
+    num_done_ = 0;
+    generation_ += 1;
+    auto all_done = [this]() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+      return num_done_ == threads_.size();
+    };
+    mutex_.Await(absl::Condition(&all_done));
+  }
+
+ private:
+  void Run(std::unique_ptr<DualNet> client) {
+    std::vector<DualNet::BoardFeatures> features(kVirtualLosses);
+    std::vector<DualNet::Output> outputs(kVirtualLosses);
+    for (auto& f : features) {
+      f.fill(1);
+    }
+
+    int generation = 0;
+    for (;;) {
+      {
+        absl::MutexLock lock(&mutex_);
+        auto ready = [this, generation]() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+          return !running_ || generation_ != generation;
+        };
+        mutex_.Await(absl::Condition(&ready));
+        if (!running_) {
+          return;
+        }
+        generation = generation_;
+      }
+      client->RunMany(features, absl::MakeSpan(outputs), nullptr);
+      {
+        absl::MutexLock lock(&mutex_);
+        num_done_ += 1;
+      }
+    }
+  }
+
+  absl::Mutex mutex_;
+  bool running_ GUARDED_BY(&mutex_) = true;
+  int generation_ GUARDED_BY(&mutex_) = 0;
+  size_t num_done_ GUARDED_BY(&mutex_) = 0;
+  std::vector<std::thread> threads_;
+};
+
+void SetProcessed(int games_per_inference, benchmark::State* state) {
+  state->SetItemsProcessed(state->iterations() * games_per_inference *
+                           kVirtualLosses);
+  state->SetBytesProcessed(
+      state->iterations() * games_per_inference * kVirtualLosses *
+      (DualNet::kNumBoardFeatures + sizeof(DualNet::Output)));
+}
+
+// Arguments: {games_per_inference, packed_outputs}.
+void BM_Inference(benchmark::State& state) {  // NOLINT(runtime/references)
+  int games_per_inference = state.range(0);
+  bool packed = state.range(1) != 0;
+
+  InferenceServer server(kVirtualLosses, games_per_inference, kPort,
+                         kWorkerTimeout);
+  ClientThreads clients([&server]() { return server.NewDualNet(); },
+                        games_per_inference);
+  StandInWorker worker(packed);
+
+  for (auto _ : state) {
+    clients.RunOnce();
+  }
+  SetProcessed(games_per_inference, &state);
+}
+
+BENCHMARK(BM_Inference)
+    ->ArgPair(2, 0)
+    ->ArgPair(2, 1)
+    ->ArgPair(16, 0)
+    ->ArgPair(16, 1)
+    ->ArgPair(64, 0)
+    ->ArgPair(64, 1)
+    ->UseRealTime();
+
+// Arguments: {games_per_inference}.
+void BM_ShmInference(benchmark::State& state) {  // NOLINT(runtime/references)
+  int games_per_inference = state.range(0);
+
+  auto name = absl::StrCat("/minigo_inference_server_benchmark_", getpid());
+  ShmInferenceServer server(kVirtualLosses, games_per_inference, name, 2,
+                            kWorkerTimeout);
+  ClientThreads clients([&server]() { return server.NewDualNet(); },
+                        games_per_inference);
+  ShmStandInWorker worker(name);
+
+  for (auto _ : state) {
+    clients.RunOnce();
+  }
+  SetProcessed(games_per_inference, &state);
+}
+
+BENCHMARK(BM_ShmInference)->Arg(2)->Arg(16)->Arg(64)->UseRealTime();
+
+}  // namespace
+}  // namespace minigo
+
+BENCHMARK_MAIN();
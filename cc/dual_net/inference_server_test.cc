@@ -14,7 +14,9 @@
 
 #include "cc/dual_net/inference_server.h"
 
+#include <map>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "absl/memory/memory.h"
@@ -24,6 +26,7 @@
 #include "cc/random.h"
 #include "gmock/gmock.h"
 #include "grpc++/create_channel.h"
+#include "grpc++/support/channel_arguments.h"
 #include "grpc/status.h"
 #include "gtest/gtest.h"
 #include "proto/inference_service.grpc.pb.h"
@@ -40,13 +43,47 @@ class InferenceServerTest : public ::testing::Test {
     }
     value_ = 0.1;
     dual_net_ = absl::make_unique<FakeNet>(priors_, value_);
+    StartServer(absl::Seconds(30));
+  }
 
-    server_ = absl::make_unique<InferenceServer>(virtual_losses_, games_per_inference_, port_);
+  // (Re)starts the server and creates games_per_inference_ clients.
+  void StartServer(absl::Duration worker_timeout) {
+    clients_.clear();
+    server_.reset();
+    server_ = absl::make_unique<InferenceServer>(
+        virtual_losses_, games_per_inference_, port_, worker_timeout);
     for (int i = 0; i < games_per_inference_; ++i) {
       clients_.push_back(server_->NewDualNet());
     }
   }
 
+  // Creates a stub with its own connection to the server, so that the server
+  // sees it as a separate worker.
+  std::unique_ptr<InferenceService::Stub> NewStub(const std::string& name);
+
+  // Runs a fake inference worker that performs a single inference, sending the
+  // outputs back as packed bytes if `packed` is true.
+  // Unlike the real inference worker, this fake worker doesn't loop, and
+  // doesn't add any RPC ops to the TensorFlow graph. Instead, the RPCs and
+  // proto marshalling is performed manually.
+  void RunFakeWorker(bool packed);
+
+  // Calls GetConfig and checks the response against the server's config.
+  void GetConfig(InferenceService::Stub* stub);
+
+  // Fetches a batch of features.
+  void GetFeatures(InferenceService::Stub* stub,
+                   GetFeaturesResponse* response);
+
+  // Runs dual_net_ on the features and sends the outputs back, expecting the
+  // PutOutputs RPC to return `expected_code`.
+  void PutOutputs(InferenceService::Stub* stub,
+                  const GetFeaturesResponse& features, bool packed,
+                  grpc::StatusCode expected_code = grpc::StatusCode::OK);
+
+  // Runs inference on all clients in parallel and verifies the outputs.
+  void RunClients();
+
   int port_ = 50051;
   int virtual_losses_ = 8;
   int games_per_inference_ = 2;
@@ -59,80 +96,99 @@ class InferenceServerTest : public ::testing::Test {
   std::vector<std::unique_ptr<DualNet>> clients_;
 };
 
-TEST_F(InferenceServerTest, Test) {
-  // Run a fake inference worker on a separate thread.
-  // Unlike the real inference worker, this fake worker doesn't loop, and
-  // doesn't add any RPC ops to the TensorFlow graph. Instead, the RPCs and
-  // proto marshalling is performed manually.
-  std::thread server_thread([this]() {
-    InferenceService::Stub stub(grpc::CreateChannel(
-        absl::StrCat("localhost:", port_), grpc::InsecureChannelCredentials()));
+std::unique_ptr<InferenceService::Stub> InferenceServerTest::NewStub(
+    const std::string& name) {
+  // Channels with different arguments don't share connections.
+  grpc::ChannelArguments args;
+  args.SetString("minigo.test_worker", name);
+  return InferenceService::NewStub(
+      grpc::CreateCustomChannel(absl::StrCat("localhost:", port_),
+                                grpc::InsecureChannelCredentials(), args));
+}
 
-    grpc::Status status;
+void InferenceServerTest::RunFakeWorker(bool packed) {
+  InferenceService::Stub stub(grpc::CreateChannel(
+      absl::StrCat("localhost:", port_), grpc::InsecureChannelCredentials()));
 
-    // Get the server config.
-    GetConfigRequest get_config_request;
-    GetConfigResponse get_config_response;
-    {
-      grpc::ClientContext context;
-      status =
-          stub.GetConfig(&context, get_config_request, &get_config_response);
-      ASSERT_TRUE(status.ok()) << "RPC failed: " << status.error_message()
-                               << ": " << status.error_details();
-    }
+  GetConfig(&stub);
+  GetFeaturesResponse get_features_response;
+  GetFeatures(&stub, &get_features_response);
+  PutOutputs(&stub, get_features_response, packed);
+}
 
-    int board_size = get_config_response.board_size();
-    int vlosses = get_config_response.virtual_losses();
-    int games_per_inference = get_config_response.games_per_inference();
+void InferenceServerTest::GetConfig(InferenceService::Stub* stub) {
+  GetConfigRequest get_config_request;
+  GetConfigResponse get_config_response;
+  grpc::ClientContext context;
+  auto status =
+      stub->GetConfig(&context, get_config_request, &get_config_response);
+  ASSERT_TRUE(status.ok()) << "RPC failed: " << status.error_message() << ": "
+                           << status.error_details();
 
-    ASSERT_EQ(kN, board_size);
-    ASSERT_LT(0, vlosses);
-    ASSERT_LT(0, games_per_inference);
-    int batch_size = vlosses * games_per_inference;
+  ASSERT_EQ(kN, get_config_response.board_size());
+  ASSERT_EQ(virtual_losses_, get_config_response.virtual_losses());
+  ASSERT_EQ(games_per_inference_, get_config_response.games_per_inference());
+}
 
-    // Get the features.
-    GetFeaturesRequest get_features_request;
-    GetFeaturesResponse get_features_response;
-    {
-      grpc::ClientContext context;
-      status = stub.GetFeatures(&context, get_features_request,
-                                &get_features_response);
-      ASSERT_TRUE(status.ok()) << "RPC failed: " << status.error_message()
-                               << ": " << status.error_details();
-    }
-    ASSERT_EQ(batch_size * DualNet::kNumBoardFeatures,
-              get_features_response.features().size());
-
-    // Run the model.
-    const std::string& src = get_features_response.features();
-    std::vector<DualNet::BoardFeatures> features(batch_size);
-    for (int i = 0; i < batch_size; ++i) {
-      for (int j = 0; j < DualNet::kNumBoardFeatures; ++j) {
-        features[i][j] = static_cast<float>(src[i * DualNet::kNumBoardFeatures + j]);
-      }
+void InferenceServerTest::GetFeatures(InferenceService::Stub* stub,
+                                      GetFeaturesResponse* response) {
+  GetFeaturesRequest get_features_request;
+  grpc::ClientContext context;
+  auto status = stub->GetFeatures(&context, get_features_request, response);
+  ASSERT_TRUE(status.ok()) << "RPC failed: " << status.error_message() << ": "
+                           << status.error_details();
+  ASSERT_EQ(virtual_losses_ * games_per_inference_ * DualNet::kNumBoardFeatures,
+            response->features().size());
+}
+
+void InferenceServerTest::PutOutputs(InferenceService::Stub* stub,
+                                     const GetFeaturesResponse& features,
+                                     bool packed,
+                                     grpc::StatusCode expected_code) {
+  int batch_size = virtual_losses_ * games_per_inference_;
+
+  // Run the model.
+  const std::string& src = features.features();
+  std::vector<DualNet::BoardFeatures> board_features(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < DualNet::kNumBoardFeatures; ++j) {
+      board_features[i][j] =
+          static_cast<float>(src[i * DualNet::kNumBoardFeatures + j]);
     }
-    std::vector<DualNet::Output> outputs(batch_size);
-    dual_net_->RunMany(features, absl::MakeSpan(outputs), nullptr);
+  }
+  std::vector<DualNet::Output> outputs(batch_size);
+  dual_net_->RunMany(board_features, absl::MakeSpan(outputs), nullptr);
 
-    // Put the outputs.
-    PutOutputsRequest put_outputs_request;
-    PutOutputsResponse put_outputs_response;
+  // Put the outputs.
+  PutOutputsRequest put_outputs_request;
+  PutOutputsResponse put_outputs_response;
+  if (packed) {
+    auto* policy = put_outputs_request.mutable_packed_policy();
+    auto* value = put_outputs_request.mutable_packed_value();
+    for (const auto& output : outputs) {
+      policy->append(reinterpret_cast<const char*>(output.policy.data()),
+                     sizeof(output.policy));
+      value->append(reinterpret_cast<const char*>(&output.value),
+                    sizeof(output.value));
+    }
+  } else {
     for (const auto& output : outputs) {
       for (int i = 0; i < kNumMoves; ++i) {
         put_outputs_request.add_policy(output.policy[i]);
       }
       put_outputs_request.add_value(output.value);
     }
-    put_outputs_request.set_batch_id(get_features_response.batch_id());
-    {
-      grpc::ClientContext context;
-      status =
-          stub.PutOutputs(&context, put_outputs_request, &put_outputs_response);
-      ASSERT_TRUE(status.ok()) << "RPC failed: " << status.error_message()
-                               << ": " << status.error_details();
-    }
-  });
+  }
+  put_outputs_request.set_batch_id(features.batch_id());
+  grpc::ClientContext context;
+  auto status =
+      stub->PutOutputs(&context, put_outputs_request, &put_outputs_response);
+  ASSERT_EQ(expected_code, status.error_code())
+      << "RPC failed: " << status.error_message() << ": "
+      << status.error_details();
+}
 
+void InferenceServerTest::RunClients() {
   int vlosses = virtual_losses_;
   std::vector<DualNet::BoardFeatures> features(vlosses * clients_.size());
   std::vector<DualNet::Output> outputs(vlosses * clients_.size());
@@ -159,9 +215,165 @@ TEST_F(InferenceServerTest, Test) {
       }
     }
   }
+}
+
+TEST_F(InferenceServerTest, Test) {
+  // Run a fake inference worker on a separate thread.
+  std::thread server_thread([this]() { RunFakeWorker(false); });
+  RunClients();
+  server_thread.join();
+}
 
+TEST_F(InferenceServerTest, TestPackedOutputs) {
+  std::thread server_thread([this]() { RunFakeWorker(true); });
+  RunClients();
   server_thread.join();
 }
 
+TEST_F(InferenceServerTest, TestConcurrentBatches) {
+  // Add a third client: the first batch will hold two of the clients'
+  // requests, and the second batch should be sent as soon as the remaining
+  // client has made its request, without waiting for the first batch to
+  // complete.
+  clients_.push_back(server_->NewDualNet());
+
+  std::thread server_thread([this]() {
+    InferenceService::Stub stub(grpc::CreateChannel(
+        absl::StrCat("localhost:", port_), grpc::InsecureChannelCredentials()));
+    GetConfig(&stub);
+    GetFeaturesResponse first, second;
+    GetFeatures(&stub, &first);
+    GetFeatures(&stub, &second);
+    EXPECT_NE(first.batch_id(), second.batch_id());
+
+    // Complete the batches out of order.
+    PutOutputs(&stub, second, true);
+    PutOutputs(&stub, first, true);
+  });
+  RunClients();
+  server_thread.join();
+
+  auto stats = server_->GetWorkerStats();
+  ASSERT_EQ(1, stats.size());
+  EXPECT_EQ(2, stats[0].num_batches);
+  EXPECT_EQ(3 * virtual_losses_, stats[0].num_inferences);
+}
+
+TEST_F(InferenceServerTest, TestRequeueLostBatch) {
+  StartServer(absl::Milliseconds(200));
+
+  std::thread server_thread([this]() {
+    // The first worker fetches the batch then goes quiet, as if it had died.
+    auto lost_stub = NewStub("lost");
+    GetFeaturesResponse lost;
+    GetFeatures(lost_stub.get(), &lost);
+
+    // The second worker should be handed the same batch once the server
+    // notices that the first worker has stopped responding.
+    auto stub = NewStub("live");
+    GetFeaturesResponse requeued;
+    GetFeatures(stub.get(), &requeued);
+    EXPECT_NE(lost.batch_id(), requeued.batch_id());
+    EXPECT_EQ(lost.features(), requeued.features());
+    PutOutputs(stub.get(), requeued, true);
+
+    // The first worker's outputs arrive too late and are rejected.
+    PutOutputs(lost_stub.get(), lost, true, grpc::StatusCode::NOT_FOUND);
+  });
+  RunClients();
+  server_thread.join();
+
+  auto* metrics = server_->metrics();
+  EXPECT_EQ(1, metrics->GetCounter("inference/num_requeued_batches")->value());
+  EXPECT_EQ(1, metrics->GetCounter("inference/num_stale_outputs")->value());
+  EXPECT_EQ(0, metrics->GetGauge("inference/num_outstanding")->value());
+}
+
+TEST_F(InferenceServerTest, TestRejectInvalidOutputs) {
+  // Add a third client, so that there are two batches.
+  clients_.push_back(server_->NewDualNet());
+
+  std::thread server_thread([this]() {
+    // The first worker sends outputs of the wrong size for both batches, in
+    // the packed fields for one and the repeated fields for the other. They
+    // are rejected without taking down the server.
+    auto bad_stub = NewStub("bad");
+    std::vector<GetFeaturesResponse> bad(2);
+    for (auto& features : bad) {
+      GetFeatures(bad_stub.get(), &features);
+    }
+    for (int i = 0; i < 2; ++i) {
+      PutOutputsRequest request;
+      PutOutputsResponse response;
+      request.set_batch_id(bad[i].batch_id());
+      if (i == 0) {
+        request.set_packed_policy("truncated");
+      } else {
+        request.add_policy(0.5);
+        request.add_value(0.5);
+      }
+      grpc::ClientContext context;
+      auto status = bad_stub->PutOutputs(&context, request, &response);
+      EXPECT_EQ(grpc::StatusCode::INVALID_ARGUMENT, status.error_code());
+    }
+
+    // The batches are handed to the next worker straight away. Requeued
+    // batches go to the front of the queue, so the last one comes first.
+    auto stub = NewStub("good");
+    for (int i = 0; i < 2; ++i) {
+      GetFeaturesResponse requeued;
+      GetFeatures(stub.get(), &requeued);
+      EXPECT_EQ(bad[1 - i].features(), requeued.features());
+      PutOutputs(stub.get(), requeued, i == 0);
+    }
+  });
+  RunClients();
+  server_thread.join();
+
+  auto* metrics = server_->metrics();
+  EXPECT_EQ(2, metrics->GetCounter("inference/num_invalid_outputs")->value());
+  EXPECT_EQ(2, metrics->GetCounter("inference/num_requeued_batches")->value());
+  EXPECT_EQ(0, metrics->GetGauge("inference/num_outstanding")->value());
+}
+
+TEST_F(InferenceServerTest, TestGetStats) {
+  std::thread server_thread([this]() { RunFakeWorker(true); });
+  RunClients();
+  server_thread.join();
+
+  InferenceService::Stub stub(grpc::CreateChannel(
+      absl::StrCat("localhost:", port_), grpc::InsecureChannelCredentials()));
+  GetStatsRequest request;
+  GetStatsResponse response;
+  grpc::ClientContext context;
+  auto status = stub.GetStats(&context, request, &response);
+  ASSERT_TRUE(status.ok()) << "RPC failed: " << status.error_message();
+
+  std::map<std::string, int64_t> values;
+  for (const auto& counter : response.counters()) {
+    values[counter.name()] = counter.value();
+  }
+  for (const auto& gauge : response.gauges()) {
+    values[gauge.name()] = gauge.value();
+  }
+  EXPECT_EQ(2, values["inference/num_requests"]);
+  EXPECT_EQ(1, values["inference/num_batches"]);
+  EXPECT_EQ(2, values["inference/num_clients"]);
+  EXPECT_EQ(0, values["inference/num_outstanding"]);
+  EXPECT_EQ(0, values["inference/queue_depth"]);
+
+  std::map<std::string, HistogramSummary> histograms;
+  for (const auto& histogram : response.histograms()) {
+    histograms[histogram.name()] = histogram;
+  }
+  EXPECT_EQ(2, histograms["inference/client_latency_us"].count());
+  EXPECT_EQ(1, histograms["inference/worker_latency_us"].count());
+  EXPECT_EQ(100, histograms["inference/batch_fill_pct"].max());
+
+  ASSERT_EQ(1, response.workers_size());
+  EXPECT_EQ(1, response.workers(0).num_batches());
+  EXPECT_EQ(2 * virtual_losses_, response.workers(0).num_inferences());
+}
+
 }  // namespace
 }  // namespace minigo
@@ -14,9 +14,12 @@
 
 #include "cc/dual_net/lite_dual_net.h"
 
-#include <sys/sysinfo.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <utility>
 
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "cc/check.h"
 #include "cc/constants.h"
@@ -28,17 +31,60 @@ using tflite::ops::builtin::BuiltinOpResolver;
 
 namespace minigo {
 
-LiteDualNet::LiteDualNet(const std::string& graph_path)
-    : graph_path_(graph_path) {
-  model_ = FlatBufferModel::BuildFromFile(graph_path.c_str());
-  MG_CHECK(model_ != nullptr);
+namespace {
 
-  BuiltinOpResolver resolver;
-  InterpreterBuilder(*model_, resolver)(&interpreter_);
-  MG_CHECK(interpreter_ != nullptr);
+uint8_t Quantize(const TfLiteTensor* tensor, float x) {
+  float q = std::round(x / tensor->params.scale) + tensor->params.zero_point;
+  MG_CHECK(q >= 0 && q <= 255) << x << " is out of range for " << tensor->name;
+  return static_cast<uint8_t>(q);
+}
+
+// Copies `size` values from `tensor` to `dst`, dequantizing them if the
+// tensor is quantized.
+void CopyOutput(const TfLiteTensor* tensor, int offset, int size, float* dst) {
+  if (tensor->type == kTfLiteFloat32) {
+    memcpy(dst, tensor->data.f + offset, size * sizeof(float));
+    return;
+  }
+  const auto* src = tensor->data.uint8 + offset;
+  float scale = tensor->params.scale;
+  int32_t zero_point = tensor->params.zero_point;
+  for (int i = 0; i < size; ++i) {
+    dst[i] = scale * (static_cast<int32_t>(src[i]) - zero_point);
+  }
+}
+
+}  // namespace
+
+std::shared_ptr<const FlatBufferModel> LiteDualNet::LoadModel(
+    const std::string& graph_path) {
+  std::string error;
+  auto model = TryLoadModel(graph_path, &error);
+  MG_CHECK(model != nullptr) << error;
+  return model;
+}
+
+std::shared_ptr<const FlatBufferModel> LiteDualNet::TryLoadModel(
+    const std::string& graph_path, std::string* error) {
+  std::shared_ptr<const FlatBufferModel> model =
+      FlatBufferModel::BuildFromFile(graph_path.c_str());
+  if (model == nullptr) {
+    *error = absl::StrCat("Couldn't load ", graph_path);
+  }
+  return model;
+}
+
+LiteDualNet::LiteDualNet(const std::string& graph_path, int num_threads)
+    : LiteDualNet(LoadModel(graph_path), graph_path, num_threads) {}
 
-  // Let's just use all the processors we can.
-  interpreter_->SetNumThreads(get_nprocs());
+LiteDualNet::LiteDualNet(std::shared_ptr<const FlatBufferModel> model,
+                         std::string graph_path, int num_threads)
+    : model_(std::move(model)),
+      num_threads_(num_threads),
+      graph_path_(std::move(graph_path)) {
+  MG_CHECK(num_threads_ > 0);
+
+  interpreter_ = NewInterpreter();
 
   // Initialize input.
   const auto& inputs = interpreter_->inputs();
@@ -52,6 +98,14 @@ LiteDualNet::LiteDualNet(const std::string& graph_path)
   MG_CHECK(input_tensor->dims->data[1] == kN);
   MG_CHECK(input_tensor->dims->data[2] == kN);
   MG_CHECK(input_tensor->dims->data[3] == DualNet::kNumStoneFeatures);
+  model_batch_size_ = input_tensor->dims->data[0];
+  if (input_tensor->type == kTfLiteUInt8) {
+    quantized_input_ = true;
+    quantized_zero_ = Quantize(input_tensor, 0);
+    quantized_one_ = Quantize(input_tensor, 1);
+  } else {
+    MG_CHECK(input_tensor->type == kTfLiteFloat32) << input_tensor->type;
+  }
 
   // Initialize outputs.
   const auto& outputs = interpreter_->outputs();
@@ -72,33 +126,88 @@ LiteDualNet::LiteDualNet(const std::string& graph_path)
   auto* policy_tensor = interpreter_->tensor(outputs[policy_]);
   MG_CHECK(policy_tensor != nullptr);
   MG_CHECK(policy_tensor->dims->size == 2) << policy_tensor->dims->size;
+  MG_CHECK(policy_tensor->type == kTfLiteFloat32 ||
+           policy_tensor->type == kTfLiteUInt8)
+      << policy_tensor->type;
 
   auto* value_tensor = interpreter_->tensor(outputs[value_]);
   MG_CHECK(value_tensor != nullptr);
   MG_CHECK(value_tensor->dims->size == 1);
+  MG_CHECK(value_tensor->type == kTfLiteFloat32 ||
+           value_tensor->type == kTfLiteUInt8)
+      << value_tensor->type;
 
   MG_CHECK(interpreter_->AllocateTensors() == kTfLiteOk);
 }
 
 LiteDualNet::~LiteDualNet() {}
 
-void LiteDualNet::RunMany(absl::Span<const BoardFeatures> features,
-                          absl::Span<Output> outputs, std::string* model) {
-  int batch_size = static_cast<int>(features.size());
-  auto* input_tensor = interpreter_->tensor(interpreter_->inputs()[0]);
-  MG_CHECK(input_tensor->dims->data[0] == batch_size);
+std::unique_ptr<tflite::Interpreter> LiteDualNet::NewInterpreter() {
+  std::unique_ptr<tflite::Interpreter> interpreter;
+  BuiltinOpResolver resolver;
+  InterpreterBuilder(*model_, resolver)(&interpreter);
+  MG_CHECK(interpreter != nullptr);
 
-  auto* data = interpreter_->typed_input_tensor<float>(0);
-  memcpy(data, features.data(), features.size() * sizeof(BoardFeatures));
+  interpreter->SetNumThreads(num_threads_);
+  return interpreter;
+}
+
+tflite::Interpreter* LiteDualNet::GetInterpreter(int batch_size) {
+  if (batch_size == model_batch_size_ || !resizable_) {
+    return interpreter_.get();
+  }
+
+  ++lru_clock_;
+  for (auto& cached : resized_interpreters_) {
+    if (cached.batch_size == batch_size) {
+      cached.last_used = lru_clock_;
+      return cached.interpreter.get();
+    }
+  }
 
-  MG_CHECK(interpreter_->Invoke() == kTfLiteOk);
+  auto interpreter = NewInterpreter();
+  int input = interpreter->inputs()[0];
+  std::vector<int> dims = {batch_size, kN, kN, kNumStoneFeatures};
+  bool resized = interpreter->ResizeInputTensor(input, dims) == kTfLiteOk &&
+                 interpreter->AllocateTensors() == kTfLiteOk;
+  if (!resized) {
+    // Models converted by toco usually have the batch size they were
+    // converted with baked into their reshape ops.
+    std::cerr << graph_path_ << " doesn't support batch sizes other than "
+              << model_batch_size_ << ", padding batches instead" << std::endl;
+    resizable_ = false;
+    return interpreter_.get();
+  }
 
-  auto* policy_data = interpreter_->typed_output_tensor<float>(policy_);
-  auto* value_data = interpreter_->typed_output_tensor<float>(value_);
-  for (int i = 0; i < batch_size; ++i) {
-    memcpy(outputs[i].policy.data(), policy_data + i * kNumMoves,
-           sizeof(outputs[i].policy));
-    outputs[i].value = value_data[i];
+  if (resized_interpreters_.size() < kMaxResizedInterpreters) {
+    resized_interpreters_.push_back({batch_size, nullptr, 0});
+  }
+  auto& cached = *std::min_element(
+      resized_interpreters_.begin(), resized_interpreters_.end(),
+      [](const CachedInterpreter& a, const CachedInterpreter& b) {
+        return a.last_used < b.last_used;
+      });
+  cached.batch_size = batch_size;
+  cached.interpreter = std::move(interpreter);
+  cached.last_used = lru_clock_;
+  return cached.interpreter.get();
+}
+
+void LiteDualNet::RunMany(absl::Span<const BoardFeatures> features,
+                          absl::Span<Output> outputs, std::string* model) {
+  MG_DCHECK(features.size() == outputs.size());
+  int batch_size = static_cast<int>(features.size());
+  auto* interpreter = GetInterpreter(batch_size);
+  int interpreter_batch_size =
+      interpreter->tensor(interpreter->inputs()[0])->dims->data[0];
+
+  // If the interpreter couldn't be resized to the batch size, run the batch in
+  // chunks of the model's batch size. The last chunk is padded with whatever
+  // the previous inference left in the input tensor.
+  for (int begin = 0; begin < batch_size; begin += interpreter_batch_size) {
+    int end = std::min(batch_size, begin + interpreter_batch_size);
+    Run(interpreter, features.subspan(begin, end - begin),
+        outputs.subspan(begin, end - begin));
   }
 
   if (model != nullptr) {
@@ -106,4 +215,32 @@ void LiteDualNet::RunMany(absl::Span<const BoardFeatures> features,
   }
 }
 
+void LiteDualNet::Run(tflite::Interpreter* interpreter,
+                      absl::Span<const BoardFeatures> features,
+                      absl::Span<Output> outputs) {
+  if (quantized_input_) {
+    // The features are all 0 or 1, so they can be quantized by lookup.
+    auto* data = interpreter->typed_input_tensor<uint8_t>(0);
+    for (const auto& board : features) {
+      for (float x : board) {
+        *data++ = x != 0 ? quantized_one_ : quantized_zero_;
+      }
+    }
+  } else {
+    auto* data = interpreter->typed_input_tensor<float>(0);
+    memcpy(data, features.data(), features.size() * sizeof(BoardFeatures));
+  }
+
+  MG_CHECK(interpreter->Invoke() == kTfLiteOk);
+
+  const auto& output_indices = interpreter->outputs();
+  const auto* policy_tensor = interpreter->tensor(output_indices[policy_]);
+  const auto* value_tensor = interpreter->tensor(output_indices[value_]);
+  for (size_t i = 0; i < features.size(); ++i) {
+    CopyOutput(policy_tensor, i * kNumMoves, kNumMoves,
+               outputs[i].policy.data());
+    CopyOutput(value_tensor, i, 1, &outputs[i].value);
+  }
+}
+
 }  // namespace minigo
@@ -15,6 +15,7 @@
 #ifndef CC_DUAL_NET_LITE_DUAL_NET_H_
 #define CC_DUAL_NET_LITE_DUAL_NET_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -28,21 +29,82 @@
 
 namespace minigo {
 
+// Runs inference with TensorFlow Lite. Both float models and fully quantized
+// uint8 models (converted with --inference_type=QUANTIZED_UINT8) are
+// supported: features are quantized with the input tensor's quantization
+// parameters, and quantized outputs are dequantized.
+//
+// RunMany accepts any batch size. Batches that differ from the size the model
+// was converted with run on interpreters whose input has been resized, which
+// are cached for the most recently used batch sizes. Models that can't be
+// resized run in chunks of their own batch size instead.
+//
+// Each interpreter runs its operations on `num_threads` threads. TensorFlow
+// Lite can't share a thread pool between interpreters, so when running
+// several LiteDualNets in parallel, num_threads should be divided between
+// them to avoid oversubscribing the CPUs.
 class LiteDualNet : public DualNet {
  public:
-  explicit LiteDualNet(const std::string& graph_path);
+  // Loads the model at `graph_path`. The model is immutable and may be shared
+  // by any number of LiteDualNets.
+  static std::shared_ptr<const tflite::FlatBufferModel> LoadModel(
+      const std::string& graph_path);
+
+  // Like LoadModel, but returns null and sets `error` if the file can't be
+  // read, instead of dying.
+  static std::shared_ptr<const tflite::FlatBufferModel> TryLoadModel(
+      const std::string& graph_path, std::string* error);
+
+  LiteDualNet(const std::string& graph_path, int num_threads);
+  LiteDualNet(std::shared_ptr<const tflite::FlatBufferModel> model,
+              std::string graph_path, int num_threads);
   ~LiteDualNet() override;
 
   void RunMany(absl::Span<const BoardFeatures> features,
                absl::Span<Output> outputs, std::string* model) override;
 
  private:
-  std::unique_ptr<tflite::FlatBufferModel> model_;
+  // Maximum number of interpreters kept for batch sizes other than the
+  // model's. Each holds its own activation buffers but shares the weights.
+  static constexpr size_t kMaxResizedInterpreters = 8;
+
+  struct CachedInterpreter {
+    int batch_size;
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    int64_t last_used;
+  };
+
+  std::unique_ptr<tflite::Interpreter> NewInterpreter();
+
+  // Returns an interpreter for `batch_size`, or the model's own interpreter if
+  // the model can't be resized.
+  tflite::Interpreter* GetInterpreter(int batch_size);
+
+  // Runs a batch no larger than the interpreter's input.
+  void Run(tflite::Interpreter* interpreter,
+           absl::Span<const BoardFeatures> features,
+           absl::Span<Output> outputs);
+
+  std::shared_ptr<const tflite::FlatBufferModel> model_;
+  int num_threads_;
+
+  // Interpreter for the batch size that the model was converted with.
   std::unique_ptr<tflite::Interpreter> interpreter_;
+  int model_batch_size_;
+
+  bool resizable_ = true;
+  std::vector<CachedInterpreter> resized_interpreters_;
+  int64_t lru_clock_ = 0;
 
   int policy_;
   int value_;
 
+  // For quantized models, the quantized values of the input features, which
+  // are always 0 or 1.
+  bool quantized_input_ = false;
+  uint8_t quantized_zero_ = 0;
+  uint8_t quantized_one_ = 0;
+
   std::string graph_path_;
 };
 
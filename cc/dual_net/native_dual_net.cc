@@ -0,0 +1,736 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/native_dual_net.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4e4e474d;  // "MGNN" in little-endian order.
+constexpr uint32_t kVersion = 1;
+
+#ifdef __AVX__
+
+// Eight floats in an AVX register.
+typedef float Float8 __attribute__((vector_size(32)));
+
+inline Float8 Broadcast8(float x) { return Float8{x, x, x, x, x, x, x, x}; }
+
+#else  // __AVX__
+
+// Eight floats in a pair of SSE registers. Without AVX, passing or returning a
+// 32-byte vector by value has a different ABI, which GCC warns about with
+// -Wpsabi, so Float8 wraps two 16-byte vectors instead.
+typedef float Float4 __attribute__((vector_size(16)));
+
+struct Float8 {
+  Float4 lo, hi;
+};
+
+inline Float8 operator+(Float8 a, Float8 b) {
+  return {a.lo + b.lo, a.hi + b.hi};
+}
+
+inline Float8 operator-(Float8 a, Float8 b) {
+  return {a.lo - b.lo, a.hi - b.hi};
+}
+
+inline Float8 operator*(Float8 a, Float8 b) {
+  return {a.lo * b.lo, a.hi * b.hi};
+}
+
+inline Float8& operator+=(Float8& a, Float8 b) { return a = a + b; }
+
+inline Float8 Broadcast8(float x) {
+  Float4 v = {x, x, x, x};
+  return {v, v};
+}
+
+#endif  // __AVX__
+
+inline Float8 Load8(const float* p) {
+  Float8 v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void Store8(float* p, Float8 v) { memcpy(p, &v, sizeof(v)); }
+
+// Gemm computes C in tiles of kTileM x kTileN, each held in registers while
+// iterating over a block of kBlockK columns of A. Blocking over k and n keeps
+// the kBlockK x kBlockN panel of B that the tiles read from in the L2 cache.
+constexpr int kTileM = 4;
+constexpr int kTileN = 16;
+constexpr int kBlockK = 128;
+constexpr int kBlockN = 128;
+
+// C[0:kTileM, 0:kTileN] += A[0:kTileM, 0:k] * B[0:k, 0:kTileN].
+void GemmTile(int k, const float* a, int lda, const float* b, int ldb,
+              float* c, int ldc) {
+  Float8 c00 = Load8(c + 0 * ldc), c01 = Load8(c + 0 * ldc + 8);
+  Float8 c10 = Load8(c + 1 * ldc), c11 = Load8(c + 1 * ldc + 8);
+  Float8 c20 = Load8(c + 2 * ldc), c21 = Load8(c + 2 * ldc + 8);
+  Float8 c30 = Load8(c + 3 * ldc), c31 = Load8(c + 3 * ldc + 8);
+  for (int i = 0; i < k; ++i) {
+    Float8 b0 = Load8(b + i * ldb);
+    Float8 b1 = Load8(b + i * ldb + 8);
+    Float8 a0 = Broadcast8(a[0 * lda + i]);
+    c00 += a0 * b0;
+    c01 += a0 * b1;
+    Float8 a1 = Broadcast8(a[1 * lda + i]);
+    c10 += a1 * b0;
+    c11 += a1 * b1;
+    Float8 a2 = Broadcast8(a[2 * lda + i]);
+    c20 += a2 * b0;
+    c21 += a2 * b1;
+    Float8 a3 = Broadcast8(a[3 * lda + i]);
+    c30 += a3 * b0;
+    c31 += a3 * b1;
+  }
+  Store8(c + 0 * ldc, c00);
+  Store8(c + 0 * ldc + 8, c01);
+  Store8(c + 1 * ldc, c10);
+  Store8(c + 1 * ldc + 8, c11);
+  Store8(c + 2 * ldc, c20);
+  Store8(c + 2 * ldc + 8, c21);
+  Store8(c + 3 * ldc, c30);
+  Store8(c + 3 * ldc + 8, c31);
+}
+
+// Unblocked Gemm for the edges of the matrices that don't fill a whole tile.
+void GemmEdge(int m, int n, int k, const float* a, int lda, const float* b,
+              int ldb, float* c, int ldc) {
+  for (int i = 0; i < m; ++i) {
+    for (int p = 0; p < k; ++p) {
+      float x = a[i * lda + p];
+      for (int j = 0; j < n; ++j) {
+        c[i * ldc + j] += x * b[p * ldb + j];
+      }
+    }
+  }
+}
+
+// Sets each of the `m` rows of `c` to `bias`.
+void FillBias(int m, const std::vector<float>& bias, float* c) {
+  for (int i = 0; i < m; ++i) {
+    std::copy(bias.begin(), bias.end(), c + i * bias.size());
+  }
+}
+
+void Relu(float* begin, float* end) {
+  for (auto* x = begin; x != end; ++x) {
+    *x = std::max(*x, 0.0f);
+  }
+}
+
+// Zeroes the border rows of a batch of boards in the padded layout.
+void ZeroBorders(int num_boards, int channels, float* data) {
+  constexpr int kStride = kN + 2;
+  for (int board = 0; board < num_boards; ++board) {
+    auto* rows = data + board * internal::kPaddedSize * channels;
+    std::fill(rows, rows + kStride * channels, 0.0f);
+    std::fill(rows + (kStride - 1) * kStride * channels,
+              rows + kStride * kStride * channels, 0.0f);
+    for (int y = 1; y < kStride - 1; ++y) {
+      std::fill(rows + y * kStride * channels,
+                rows + (y * kStride + 1) * channels, 0.0f);
+      std::fill(rows + (y * kStride + kStride - 1) * channels,
+                rows + (y + 1) * kStride * channels, 0.0f);
+    }
+  }
+}
+
+// Copies the interior rows of a batch of boards in the padded layout to `dst`
+// as [num_boards, kN, kN, channels].
+void CopyInterior(int num_boards, int channels, const float* src, float* dst) {
+  constexpr int kStride = kN + 2;
+  for (int board = 0; board < num_boards; ++board) {
+    for (int y = 0; y < kN; ++y) {
+      const auto* row =
+          src + (board * internal::kPaddedSize + (y + 1) * kStride + 1) *
+                    channels;
+      dst = std::copy(row, row + kN * channels, dst);
+    }
+  }
+}
+
+void Dense(const NativeModel::Dense& dense, int batch_size, const float* input,
+           float* output) {
+  FillBias(batch_size, dense.bias, output);
+  internal::Gemm(batch_size, dense.out, dense.in, input, dense.in,
+                 dense.weights.data(), dense.out, output, dense.out);
+}
+
+void InitConv(int size, int in, int out, NativeModel::Conv* conv) {
+  conv->size = size;
+  conv->in = in;
+  conv->out = out;
+  conv->weights.assign(size * size * in * out, 0);
+  conv->bias.assign(out, 0);
+}
+
+void InitDense(int in, int out, NativeModel::Dense* dense) {
+  dense->in = in;
+  dense->out = out;
+  dense->weights.assign(in * out, 0);
+  dense->bias.assign(out, 0);
+}
+
+// Returns the number of floats that Save writes for a model with the given
+// dimensions.
+uint64_t NumSavedFloats(uint64_t conv_width, uint64_t fc_width,
+                        uint64_t num_res_blocks) {
+  uint64_t w = conv_width;
+  uint64_t input = 9 * DualNet::kNumStoneFeatures * w + w;
+  uint64_t res_blocks = num_res_blocks * 2 * (9 * w * w + w);
+  uint64_t policy = 2 * w + 2 + 2 * kN * kN * kNumMoves + kNumMoves;
+  uint64_t value = w + 1 + kN * kN * fc_width + fc_width + fc_width + 1;
+  return input + res_blocks + policy + value;
+}
+
+// Winograd F(2x2, 3x3) splits each board into kWinogradTiles x kWinogradTiles
+// tiles of 2x2 outputs. When kN is odd, the last row and column of tiles
+// overhang the board by one point.
+constexpr int kWinogradTiles = (kN + 1) / 2;
+constexpr int kTilesPerBoard = kWinogradTiles * kWinogradTiles;
+
+// Number of tiles that WinogradConv transforms and multiplies at a time. The
+// transformed tiles of a block stay in the L2 cache between the input
+// transform, the GEMMs and the output transform.
+constexpr int kWinogradBlock = 64;
+
+// Computes V = B^T D B for a 4x4 input tile D. `T` is float or Float8, to
+// transform one or eight channels at a time.
+template <typename T>
+inline void WinogradInputTransform(const T d[4][4], T v[4][4]) {
+  T t[4][4];
+  for (int j = 0; j < 4; ++j) {
+    t[0][j] = d[0][j] - d[2][j];
+    t[1][j] = d[1][j] + d[2][j];
+    t[2][j] = d[2][j] - d[1][j];
+    t[3][j] = d[1][j] - d[3][j];
+  }
+  for (int i = 0; i < 4; ++i) {
+    v[i][0] = t[i][0] - t[i][2];
+    v[i][1] = t[i][1] + t[i][2];
+    v[i][2] = t[i][2] - t[i][1];
+    v[i][3] = t[i][1] - t[i][3];
+  }
+}
+
+// Computes Y = A^T M A for a 4x4 tile M of products, giving a 2x2 tile of
+// outputs.
+template <typename T>
+inline void WinogradOutputTransform(const T m[4][4], T y[2][2]) {
+  T t[2][4];
+  for (int j = 0; j < 4; ++j) {
+    t[0][j] = m[0][j] + m[1][j] + m[2][j];
+    t[1][j] = m[1][j] - m[2][j] - m[3][j];
+  }
+  for (int i = 0; i < 2; ++i) {
+    y[i][0] = t[i][0] + t[i][1] + t[i][2];
+    y[i][1] = t[i][1] - t[i][2] - t[i][3];
+  }
+}
+
+// Computes U = G W G^T for each input and output channel of a 3x3
+// convolution.
+void TransformWinogradWeights(NativeModel::Conv* conv) {
+  int in = conv->in;
+  int out = conv->out;
+  conv->winograd_weights.resize(16 * in * out);
+  for (int i = 0; i < in; ++i) {
+    for (int o = 0; o < out; ++o) {
+      float w[3][3];
+      for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 3; ++x) {
+          w[y][x] = conv->weights[((y * 3 + x) * in + i) * out + o];
+        }
+      }
+      float t[4][3];
+      for (int x = 0; x < 3; ++x) {
+        t[0][x] = w[0][x];
+        t[1][x] = 0.5f * (w[0][x] + w[1][x] + w[2][x]);
+        t[2][x] = 0.5f * (w[0][x] - w[1][x] + w[2][x]);
+        t[3][x] = w[2][x];
+      }
+      float u[4][4];
+      for (int y = 0; y < 4; ++y) {
+        u[y][0] = t[y][0];
+        u[y][1] = 0.5f * (t[y][0] + t[y][1] + t[y][2]);
+        u[y][2] = 0.5f * (t[y][0] - t[y][1] + t[y][2]);
+        u[y][3] = t[y][2];
+      }
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          conv->winograd_weights[((y * 4 + x) * in + i) * out + o] = u[y][x];
+        }
+      }
+    }
+  }
+}
+
+// Calls `f` on each of the model's weight and bias arrays, in file order.
+// `Model` is either NativeModel or const NativeModel.
+template <typename Model, typename F>
+void ForEachArray(Model* model, const F& f) {
+  auto layer = [&f](auto* layer) {
+    f(&layer->weights);
+    f(&layer->bias);
+  };
+  layer(&model->input);
+  for (auto& block : model->res_blocks) {
+    layer(&block.conv1);
+    layer(&block.conv2);
+  }
+  layer(&model->policy_conv);
+  layer(&model->policy_fc);
+  layer(&model->value_conv);
+  layer(&model->value_fc1);
+  layer(&model->value_fc2);
+}
+
+}  // namespace
+
+namespace internal {
+
+void Gemm(int m, int n, int k, const float* a, int lda, const float* b,
+          int ldb, float* c, int ldc) {
+  for (int n0 = 0; n0 < n; n0 += kBlockN) {
+    int nb = std::min(kBlockN, n - n0);
+    int n_tiles = nb / kTileN * kTileN;
+    for (int k0 = 0; k0 < k; k0 += kBlockK) {
+      int kb = std::min(kBlockK, k - k0);
+      const auto* a_block = a + k0;
+      const auto* b_block = b + k0 * ldb + n0;
+      auto* c_block = c + n0;
+      int i = 0;
+      for (; i + kTileM <= m; i += kTileM) {
+        for (int j = 0; j < n_tiles; j += kTileN) {
+          GemmTile(kb, a_block + i * lda, lda, b_block + j, ldb,
+                   c_block + i * ldc + j, ldc);
+        }
+        GemmEdge(kTileM, nb - n_tiles, kb, a_block + i * lda, lda,
+                 b_block + n_tiles, ldb, c_block + i * ldc + n_tiles, ldc);
+      }
+      GemmEdge(m - i, nb, kb, a_block + i * lda, lda, b_block, ldb,
+               c_block + i * ldc, ldc);
+    }
+  }
+}
+
+void Conv(const NativeModel::Conv& conv, int num_boards, const float* input,
+          float* output) {
+  MG_CHECK(conv.size == 1 || conv.size == 3);
+  int num_rows = num_boards * kPaddedSize;
+  FillBias(num_rows, conv.bias, output);
+
+  // In the padded layout, the input rows that a 3x3 kernel reads for output
+  // row r are r + dy * (kN + 2) + dx for dy, dx in [-1, 1]. So rather than
+  // expanding the input with im2col, each of the kernel's taps is applied as a
+  // GEMM of the input shifted by the tap's offset with that tap's weights.
+  // Output rows on the border read past their board (and the first and last
+  // rows aren't computed at all), but the border is zeroed afterwards anyway.
+  // Rows are processed in blocks, so that the block's outputs stay in cache
+  // while all the taps are accumulated into them.
+  constexpr int kBlockRows = 64;
+  int radius = conv.size / 2;
+  int margin = radius * (kN + 2) + radius;
+  int tap_size = conv.in * conv.out;
+  for (int r0 = margin; r0 < num_rows - margin; r0 += kBlockRows) {
+    int rows = std::min(kBlockRows, num_rows - margin - r0);
+    for (int dy = -radius; dy <= radius; ++dy) {
+      for (int dx = -radius; dx <= radius; ++dx) {
+        int tap = (dy + radius) * conv.size + dx + radius;
+        int offset = dy * (kN + 2) + dx;
+        Gemm(rows, conv.out, conv.in, input + (r0 + offset) * conv.in,
+             conv.in, conv.weights.data() + tap * tap_size, conv.out,
+             output + r0 * conv.out, conv.out);
+      }
+    }
+  }
+}
+
+void WinogradConv(const NativeModel::Conv& conv, int num_boards,
+                  const float* input, float* output,
+                  std::vector<float>* buffer) {
+  int in = conv.in;
+  int out = conv.out;
+  MG_CHECK(conv.size == 3);
+  MG_CHECK(conv.winograd_weights.size() == static_cast<size_t>(16 * in * out))
+      << "NativeModel::Prepare hasn't been called";
+
+  // The buffer holds the transformed inputs V as [16, kWinogradBlock, in],
+  // their products with the transformed weights M as [16, kWinogradBlock, out]
+  // and a row of zeros to read in place of the points past the padded board.
+  buffer->resize(16 * kWinogradBlock * (in + out) + in);
+  auto* v = buffer->data();
+  auto* m = v + 16 * kWinogradBlock * in;
+  auto* zeros = m + 16 * kWinogradBlock * out;
+  std::fill(zeros, zeros + in, 0.0f);
+
+  constexpr int kStride = kN + 2;
+  int num_tiles = num_boards * kTilesPerBoard;
+  for (int t0 = 0; t0 < num_tiles; t0 += kWinogradBlock) {
+    int tiles = std::min(kWinogradBlock, num_tiles - t0);
+
+    // Transform the input tiles. Output tile (y0, x0) reads the 4x4 inputs
+    // starting at (y0 - 1, x0 - 1), which is (y0, x0) in the padded layout.
+    for (int t = 0; t < tiles; ++t) {
+      int board = (t0 + t) / kTilesPerBoard;
+      int tile = (t0 + t) % kTilesPerBoard;
+      int y0 = tile / kWinogradTiles * 2;
+      int x0 = tile % kWinogradTiles * 2;
+      const float* src[4][4];
+      for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+          int y = y0 + i;
+          int x = x0 + j;
+          src[i][j] = y < kStride && x < kStride
+                          ? input + (board * kPaddedSize + y * kStride + x) * in
+                          : zeros;
+        }
+      }
+      auto* dst = v + t * in;
+      int c = 0;
+      for (; c + 8 <= in; c += 8) {
+        Float8 d[4][4], tv[4][4];
+        for (int i = 0; i < 16; ++i) {
+          d[i / 4][i % 4] = Load8(src[i / 4][i % 4] + c);
+        }
+        WinogradInputTransform(d, tv);
+        for (int i = 0; i < 16; ++i) {
+          Store8(dst + i * kWinogradBlock * in + c, tv[i / 4][i % 4]);
+        }
+      }
+      for (; c < in; ++c) {
+        float d[4][4], tv[4][4];
+        for (int i = 0; i < 16; ++i) {
+          d[i / 4][i % 4] = src[i / 4][i % 4][c];
+        }
+        WinogradInputTransform(d, tv);
+        for (int i = 0; i < 16; ++i) {
+          dst[i * kWinogradBlock * in + c] = tv[i / 4][i % 4];
+        }
+      }
+    }
+
+    // Multiply the transformed inputs and weights: one GEMM for each of the
+    // 16 elements of a transformed tile, batched over all the tiles.
+    for (int i = 0; i < 16; ++i) {
+      auto* mi = m + i * kWinogradBlock * out;
+      std::fill(mi, mi + tiles * out, 0.0f);
+      Gemm(tiles, out, in, v + i * kWinogradBlock * in, in,
+           conv.winograd_weights.data() + i * in * out, out, mi, out);
+    }
+
+    // Transform the products back into output tiles, dropping the outputs of
+    // the overhanging tiles that fall outside the board.
+    for (int t = 0; t < tiles; ++t) {
+      int board = (t0 + t) / kTilesPerBoard;
+      int tile = (t0 + t) % kTilesPerBoard;
+      int y0 = tile / kWinogradTiles * 2;
+      int x0 = tile % kWinogradTiles * 2;
+      const auto* src = m + t * out;
+      float* dst[2][2];
+      for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < 2; ++j) {
+          int y = y0 + i;
+          int x = x0 + j;
+          dst[i][j] =
+              y < kN && x < kN
+                  ? output +
+                        (board * kPaddedSize + (y + 1) * kStride + x + 1) * out
+                  : nullptr;
+        }
+      }
+      int c = 0;
+      for (; c + 8 <= out; c += 8) {
+        Float8 mt[4][4], y[2][2];
+        for (int i = 0; i < 16; ++i) {
+          mt[i / 4][i % 4] = Load8(src + i * kWinogradBlock * out + c);
+        }
+        WinogradOutputTransform(mt, y);
+        auto bias = Load8(conv.bias.data() + c);
+        for (int i = 0; i < 4; ++i) {
+          if (dst[i / 2][i % 2] != nullptr) {
+            Store8(dst[i / 2][i % 2] + c, y[i / 2][i % 2] + bias);
+          }
+        }
+      }
+      for (; c < out; ++c) {
+        float mt[4][4], y[2][2];
+        for (int i = 0; i < 16; ++i) {
+          mt[i / 4][i % 4] = src[i * kWinogradBlock * out + c];
+        }
+        WinogradOutputTransform(mt, y);
+        for (int i = 0; i < 4; ++i) {
+          if (dst[i / 2][i % 2] != nullptr) {
+            dst[i / 2][i % 2][c] = y[i / 2][i % 2] + conv.bias[c];
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace internal
+
+std::unique_ptr<NativeModel> NativeModel::Create(int conv_width, int fc_width,
+                                                 int num_res_blocks) {
+  auto model = absl::make_unique<NativeModel>();
+  model->conv_width = conv_width;
+  model->fc_width = fc_width;
+  InitConv(3, DualNet::kNumStoneFeatures, conv_width, &model->input);
+  model->res_blocks.resize(num_res_blocks);
+  for (auto& block : model->res_blocks) {
+    InitConv(3, conv_width, conv_width, &block.conv1);
+    InitConv(3, conv_width, conv_width, &block.conv2);
+  }
+  InitConv(1, conv_width, 2, &model->policy_conv);
+  InitDense(2 * kN * kN, kNumMoves, &model->policy_fc);
+  InitConv(1, conv_width, 1, &model->value_conv);
+  InitDense(kN * kN, fc_width, &model->value_fc1);
+  InitDense(fc_width, 1, &model->value_fc2);
+  return model;
+}
+
+std::unique_ptr<NativeModel> NativeModel::Load(const std::string& path) {
+  std::string error;
+  auto model = TryLoad(path, &error);
+  MG_CHECK(model != nullptr) << error;
+  return model;
+}
+
+std::unique_ptr<NativeModel> NativeModel::TryLoad(const std::string& path,
+                                                  std::string* error) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if (f == nullptr) {
+    *error = absl::StrCat("Couldn't open ", path);
+    return nullptr;
+  }
+  auto fail = [f, error](std::string message) {
+    fclose(f);
+    *error = std::move(message);
+    return nullptr;
+  };
+
+  uint32_t header[7];
+  if (fread(header, sizeof(header), 1, f) != 1) {
+    return fail(absl::StrCat("Couldn't read ", path));
+  }
+  if (header[0] != kMagic) {
+    return fail(absl::StrCat(path, " isn't a native model"));
+  }
+  if (header[1] != kVersion) {
+    return fail(absl::StrCat(path, " has version ", header[1], ", expected ",
+                             kVersion));
+  }
+  if (header[2] != static_cast<uint32_t>(kN)) {
+    return fail(absl::StrCat("Board size mismatch: model=", header[2],
+                             ", binary=", kN));
+  }
+  if (header[3] != static_cast<uint32_t>(DualNet::kNumStoneFeatures)) {
+    return fail(absl::StrCat("Feature planes mismatch: model=", header[3],
+                             ", binary=", DualNet::kNumStoneFeatures));
+  }
+
+  // Check the dimensions against the file's size before allocating the model,
+  // so that a corrupt header can't ask for an arbitrary amount of memory.
+  constexpr uint32_t kMaxDimension = 1 << 16;
+  if (header[4] > kMaxDimension || header[5] > kMaxDimension ||
+      header[6] > kMaxDimension) {
+    return fail(absl::StrCat(path, " has an invalid header"));
+  }
+  uint64_t expected_size =
+      sizeof(header) +
+      sizeof(float) * NumSavedFloats(header[4], header[5], header[6]);
+  if (fseek(f, 0, SEEK_END) != 0) {
+    return fail(absl::StrCat("Couldn't read ", path));
+  }
+  uint64_t size = ftell(f);
+  if (size < expected_size) {
+    return fail(absl::StrCat(path, " is truncated"));
+  }
+  if (size > expected_size) {
+    return fail(absl::StrCat(path, " has trailing data"));
+  }
+  fseek(f, sizeof(header), SEEK_SET);
+
+  auto model = Create(header[4], header[5], header[6]);
+  bool ok = true;
+  ForEachArray(model.get(), [f, &ok](std::vector<float>* array) {
+    ok = ok &&
+         fread(array->data(), sizeof(float), array->size(), f) == array->size();
+  });
+  if (!ok) {
+    return fail(absl::StrCat("Couldn't read ", path));
+  }
+  fclose(f);
+  model->Prepare();
+  return model;
+}
+
+void NativeModel::Prepare() {
+  TransformWinogradWeights(&input);
+  for (auto& block : res_blocks) {
+    TransformWinogradWeights(&block.conv1);
+    TransformWinogradWeights(&block.conv2);
+  }
+}
+
+void NativeModel::Save(const std::string& path) const {
+  FILE* f = fopen(path.c_str(), "wb");
+  MG_CHECK(f != nullptr) << "Couldn't open " << path;
+  uint32_t header[7] = {kMagic,
+                        kVersion,
+                        kN,
+                        DualNet::kNumStoneFeatures,
+                        static_cast<uint32_t>(conv_width),
+                        static_cast<uint32_t>(fc_width),
+                        static_cast<uint32_t>(res_blocks.size())};
+  MG_CHECK(fwrite(header, sizeof(header), 1, f) == 1);
+  ForEachArray(this, [f](const std::vector<float>* array) {
+    MG_CHECK(fwrite(array->data(), sizeof(float), array->size(), f) ==
+             array->size());
+  });
+  MG_CHECK(fclose(f) == 0);
+}
+
+std::string FindNativeModel(const std::string& model_path) {
+  // If we can't find the specified model, try adding a .native extension.
+  FILE* f = fopen(model_path.c_str(), "rb");
+  if (f != nullptr) {
+    fclose(f);
+    return model_path;
+  }
+  auto alt_path = absl::StrCat(model_path, ".native");
+  f = fopen(alt_path.c_str(), "rb");
+  if (f != nullptr) {
+    fclose(f);
+    std::cerr << model_path << " doesn't exist, using " << alt_path
+              << std::endl;
+    return alt_path;
+  }
+  return model_path;
+}
+
+NativeDualNet::NativeDualNet(const std::string& model_path)
+    : NativeDualNet(NativeModel::Load(FindNativeModel(model_path)),
+                    model_path) {}
+
+NativeDualNet::NativeDualNet(std::shared_ptr<const NativeModel> model,
+                             std::string model_path)
+    : model_(std::move(model)), model_path_(std::move(model_path)) {}
+
+void NativeDualNet::RunMany(absl::Span<const BoardFeatures> features,
+                            absl::Span<Output> outputs, std::string* model) {
+  MG_DCHECK(features.size() == outputs.size());
+  using internal::kPaddedSize;
+  const auto& m = *model_;
+  int batch_size = static_cast<int>(features.size());
+  int num_rows = batch_size * kPaddedSize;
+  int width = m.conv_width;
+
+  // All convolutions operate on activations laid out as
+  // [batch_size, kN + 2, kN + 2, channels] with a border of zeros, so that the
+  // 3x3 convolutions don't need any special cases at the edges of the board.
+  input_.assign(num_rows * kNumStoneFeatures, 0);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int y = 0; y < kN; ++y) {
+      const auto* src = features[i].data() + y * kN * kNumStoneFeatures;
+      auto* dst =
+          input_.data() +
+          (i * kPaddedSize + (y + 1) * (kN + 2) + 1) * kNumStoneFeatures;
+      std::copy(src, src + kN * kNumStoneFeatures, dst);
+    }
+  }
+  trunk_.resize(num_rows * width);
+  scratch_.resize(num_rows * width);
+  residual_.resize(num_rows * width);
+
+  internal::WinogradConv(m.input, batch_size, input_.data(), trunk_.data(),
+                         &winograd_);
+  Relu(trunk_.data(), trunk_.data() + trunk_.size());
+  ZeroBorders(batch_size, width, trunk_.data());
+
+  for (const auto& block : m.res_blocks) {
+    internal::WinogradConv(block.conv1, batch_size, trunk_.data(),
+                           scratch_.data(), &winograd_);
+    Relu(scratch_.data(), scratch_.data() + scratch_.size());
+    ZeroBorders(batch_size, width, scratch_.data());
+
+    internal::WinogradConv(block.conv2, batch_size, scratch_.data(),
+                           residual_.data(), &winograd_);
+    for (size_t i = 0; i < trunk_.size(); ++i) {
+      trunk_[i] = std::max(trunk_[i] + residual_[i], 0.0f);
+    }
+    ZeroBorders(batch_size, width, trunk_.data());
+  }
+
+  // Policy head.
+  head_.resize(num_rows * 2);
+  internal::Conv(m.policy_conv, batch_size, trunk_.data(), head_.data());
+  Relu(head_.data(), head_.data() + head_.size());
+  policy_fc_input_.resize(batch_size * kN * kN * 2);
+  CopyInterior(batch_size, 2, head_.data(), policy_fc_input_.data());
+  logits_.resize(batch_size * kNumMoves);
+  Dense(m.policy_fc, batch_size, policy_fc_input_.data(), logits_.data());
+
+  // Value head.
+  head_.resize(num_rows);
+  internal::Conv(m.value_conv, batch_size, trunk_.data(), head_.data());
+  Relu(head_.data(), head_.data() + head_.size());
+  value_fc_input_.resize(batch_size * kN * kN);
+  CopyInterior(batch_size, 1, head_.data(), value_fc_input_.data());
+  value_hidden_.resize(batch_size * m.fc_width);
+  Dense(m.value_fc1, batch_size, value_fc_input_.data(), value_hidden_.data());
+  Relu(value_hidden_.data(), value_hidden_.data() + value_hidden_.size());
+  value_.resize(batch_size);
+  Dense(m.value_fc2, batch_size, value_hidden_.data(), value_.data());
+
+  for (int i = 0; i < batch_size; ++i) {
+    const auto* logits = logits_.data() + i * kNumMoves;
+    auto& policy = outputs[i].policy;
+    float max_logit = *std::max_element(logits, logits + kNumMoves);
+    float sum = 0;
+    for (int j = 0; j < kNumMoves; ++j) {
+      policy[j] = std::exp(logits[j] - max_logit);
+      sum += policy[j];
+    }
+    for (auto& p : policy) {
+      p /= sum;
+    }
+    outputs[i].value = std::tanh(value_[i]);
+  }
+
+  if (model != nullptr) {
+    *model = model_path_;
+  }
+}
+
+}  // namespace minigo
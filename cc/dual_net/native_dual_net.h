@@ -0,0 +1,165 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_NATIVE_DUAL_NET_H_
+#define CC_DUAL_NET_NATIVE_DUAL_NET_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "cc/constants.h"
+#include "cc/dual_net/dual_net.h"
+
+namespace minigo {
+
+// The weights of the dual-head residual network built by model_inference_fn in
+// dual_net.py, with each batch normalization folded into the convolution that
+// precedes it.
+//
+// NativeModels are written by `python main.py export_native_model` as a flat
+// little-endian binary file: seven uint32 header fields
+//   magic ('MGNN'), version, board_size, num_input_planes, conv_width,
+//   fc_width, num_res_blocks
+// followed by the float32 weights and biases of each layer, in the order they
+// are declared below.
+struct NativeModel {
+  // A convolution with a square kernel and "same" padding. The weights are
+  // laid out as [size, size, in, out], as in TensorFlow.
+  struct Conv {
+    int size = 0;
+    int in = 0;
+    int out = 0;
+    std::vector<float> weights;
+    std::vector<float> bias;
+
+    // For 3x3 convolutions, the weights transformed for Winograd F(2x2, 3x3),
+    // laid out as [16, in, out]. Computed by Prepare and not saved.
+    std::vector<float> winograd_weights;
+  };
+
+  // A fully connected layer. The weights are laid out as [in, out].
+  struct Dense {
+    int in = 0;
+    int out = 0;
+    std::vector<float> weights;
+    std::vector<float> bias;
+  };
+
+  struct ResBlock {
+    Conv conv1;
+    Conv conv2;
+  };
+
+  // Returns a model with the given dimensions and all weights set to zero.
+  static std::unique_ptr<NativeModel> Create(int conv_width, int fc_width,
+                                             int num_res_blocks);
+
+  // Loads a model exported by main.py and prepares it. Dies if the file can't
+  // be read or was exported for a different board size.
+  static std::unique_ptr<NativeModel> Load(const std::string& path);
+
+  // Like Load, but returns null and sets `error` instead of dying.
+  static std::unique_ptr<NativeModel> TryLoad(const std::string& path,
+                                              std::string* error);
+
+  // Precomputes the data NativeDualNet derives from the weights. Models
+  // returned by Create must be prepared after their weights are set.
+  void Prepare();
+
+  // Writes the model in the format read by Load.
+  void Save(const std::string& path) const;
+
+  int conv_width = 0;
+  int fc_width = 0;
+
+  Conv input;
+  std::vector<ResBlock> res_blocks;
+
+  Conv policy_conv;
+  Dense policy_fc;
+
+  Conv value_conv;
+  Dense value_fc1;
+  Dense value_fc2;
+};
+
+// A self-contained DualNet engine for CPUs that doesn't depend on TensorFlow.
+// Each instance runs inference on the calling thread, which suits selfplay
+// where every game thread has its own DualNet. Instances created by the same
+// factory share one copy of the weights.
+class NativeDualNet : public DualNet {
+ public:
+  explicit NativeDualNet(const std::string& model_path);
+  NativeDualNet(std::shared_ptr<const NativeModel> model,
+                std::string model_path);
+
+  void RunMany(absl::Span<const BoardFeatures> features,
+               absl::Span<Output> outputs, std::string* model) override;
+
+ private:
+  std::shared_ptr<const NativeModel> model_;
+  std::string model_path_;
+
+  // Activations for the current batch. See native_dual_net.cc for the layout.
+  std::vector<float> input_;
+  std::vector<float> trunk_;
+  std::vector<float> scratch_;
+  std::vector<float> residual_;
+  std::vector<float> head_;
+  std::vector<float> policy_fc_input_;
+  std::vector<float> value_fc_input_;
+  std::vector<float> value_hidden_;
+  std::vector<float> logits_;
+  std::vector<float> value_;
+  std::vector<float> winograd_;
+};
+
+// Returns the path of the NativeModel that NativeDualNet would load for
+// `model_path`: either `model_path` itself or, if that doesn't exist,
+// `model_path` with a ".native" extension.
+std::string FindNativeModel(const std::string& model_path);
+
+namespace internal {
+
+// Computes C += A * B, where A is m x k, B is k x n and C is m x n, all stored
+// row-major with the given row strides.
+void Gemm(int m, int n, int k, const float* a, int lda, const float* b,
+          int ldb, float* c, int ldc);
+
+// Number of rows of a board's activations in the padded layout used by
+// NativeDualNet: one row per point of a (kN + 2) x (kN + 2) grid whose border
+// is always zero.
+constexpr int kPaddedSize = (kN + 2) * (kN + 2);
+
+// Applies `conv` (which must be 3x3 or 1x1) to a batch of boards in the padded
+// layout and writes the result, including bias, to `output`. The border rows
+// of `output` are left undefined.
+void Conv(const NativeModel::Conv& conv, int num_boards, const float* input,
+          float* output);
+
+// Same as Conv for a prepared 3x3 convolution, but computed with Winograd's
+// minimal filtering algorithm F(2x2, 3x3): each 2x2 tile of outputs takes 16
+// multiplies per input and output channel instead of 36. `buffer` holds the
+// transformed tiles.
+void WinogradConv(const NativeModel::Conv& conv, int num_boards,
+                  const float* input, float* output,
+                  std::vector<float>* buffer);
+
+}  // namespace internal
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_NATIVE_DUAL_NET_H_
@@ -0,0 +1,90 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the 3x3 convolutions of the native inference engine on one layer
+// of the residual tower, at batch sizes typical of selfplay. Build with
+// -c opt --copt=-march=native for representative results.
+
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "cc/constants.h"
+#include "cc/dual_net/native_dual_net.h"
+#include "cc/random.h"
+
+namespace minigo {
+namespace {
+
+constexpr int kConvWidth = 256;
+
+struct ConvFixture {
+  explicit ConvFixture(int num_boards) : num_boards(num_boards) {
+    model = NativeModel::Create(kConvWidth, 1, 1);
+    Random rnd(1);
+    for (auto& w : model->res_blocks[0].conv1.weights) {
+      w = rnd() - 0.5f;
+    }
+    model->Prepare();
+    int num_rows = num_boards * internal::kPaddedSize;
+    input.resize(num_rows * kConvWidth);
+    for (auto& x : input) {
+      x = rnd();
+    }
+    output.resize(num_rows * kConvWidth);
+  }
+
+  const NativeModel::Conv& conv() const { return model->res_blocks[0].conv1; }
+
+  void Report(benchmark::State& state) {  // NOLINT(runtime/references)
+    // Count the multiply-adds of the direct convolution for both algorithms,
+    // so that their rates are directly comparable.
+    double macs = 9.0 * kN * kN * kConvWidth * kConvWidth * num_boards;
+    state.counters["GMACs"] = benchmark::Counter(
+        macs * state.iterations() / 1e9, benchmark::Counter::kIsRate);
+    state.counters["boards/s"] = benchmark::Counter(
+        num_boards * state.iterations(), benchmark::Counter::kIsRate);
+  }
+
+  int num_boards;
+  std::unique_ptr<NativeModel> model;
+  std::vector<float> input;
+  std::vector<float> output;
+  std::vector<float> buffer;
+};
+
+void BM_DirectConv(benchmark::State& state) {  // NOLINT(runtime/references)
+  ConvFixture f(state.range(0));
+  for (auto _ : state) {
+    internal::Conv(f.conv(), f.num_boards, f.input.data(), f.output.data());
+  }
+  f.Report(state);
+}
+
+void BM_WinogradConv(benchmark::State& state) {  // NOLINT(runtime/references)
+  ConvFixture f(state.range(0));
+  for (auto _ : state) {
+    internal::WinogradConv(f.conv(), f.num_boards, f.input.data(),
+                           f.output.data(), &f.buffer);
+  }
+  f.Report(state);
+}
+
+BENCHMARK(BM_DirectConv)->Arg(8)->Arg(64)->Arg(256);
+BENCHMARK(BM_WinogradConv)->Arg(8)->Arg(64)->Arg(256);
+
+}  // namespace
+}  // namespace minigo
+
+BENCHMARK_MAIN();
@@ -0,0 +1,349 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/native_dual_net.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "cc/constants.h"
+#include "cc/random.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+void Randomize(Random* rnd, float scale, std::vector<float>* v) {
+  for (auto& x : *v) {
+    x = scale * (2 * (*rnd)() - 1);
+  }
+}
+
+// Returns a model with random weights, scaled so that the activations stay
+// roughly the same magnitude throughout the network.
+std::unique_ptr<NativeModel> RandomModel(Random* rnd, int conv_width,
+                                         int fc_width, int num_res_blocks) {
+  auto model = NativeModel::Create(conv_width, fc_width, num_res_blocks);
+  auto conv = [rnd](NativeModel::Conv* conv) {
+    Randomize(rnd, 1.5 / std::sqrt(conv->size * conv->size * conv->in),
+              &conv->weights);
+    Randomize(rnd, 0.1, &conv->bias);
+  };
+  auto dense = [rnd](NativeModel::Dense* dense) {
+    Randomize(rnd, 1.5 / std::sqrt(dense->in), &dense->weights);
+    Randomize(rnd, 0.1, &dense->bias);
+  };
+  conv(&model->input);
+  for (auto& block : model->res_blocks) {
+    conv(&block.conv1);
+    conv(&block.conv2);
+  }
+  conv(&model->policy_conv);
+  dense(&model->policy_fc);
+  conv(&model->value_conv);
+  dense(&model->value_fc1);
+  dense(&model->value_fc2);
+  model->Prepare();
+  return model;
+}
+
+// Straightforward implementations of the layers, on [kN, kN, channels]
+// activations.
+std::vector<float> RefConv(const NativeModel::Conv& conv,
+                           const std::vector<float>& input) {
+  std::vector<float> output(kN * kN * conv.out);
+  int r = conv.size / 2;
+  for (int y = 0; y < kN; ++y) {
+    for (int x = 0; x < kN; ++x) {
+      for (int o = 0; o < conv.out; ++o) {
+        double sum = conv.bias[o];
+        for (int dy = -r; dy <= r; ++dy) {
+          for (int dx = -r; dx <= r; ++dx) {
+            int yy = y + dy;
+            int xx = x + dx;
+            if (yy < 0 || yy >= kN || xx < 0 || xx >= kN) {
+              continue;
+            }
+            for (int i = 0; i < conv.in; ++i) {
+              int w = (((dy + r) * conv.size + dx + r) * conv.in + i) *
+                          conv.out +
+                      o;
+              sum += input[(yy * kN + xx) * conv.in + i] * conv.weights[w];
+            }
+          }
+        }
+        output[(y * kN + x) * conv.out + o] = sum;
+      }
+    }
+  }
+  return output;
+}
+
+std::vector<float> RefDense(const NativeModel::Dense& dense,
+                            const std::vector<float>& input) {
+  std::vector<float> output(dense.out);
+  for (int o = 0; o < dense.out; ++o) {
+    double sum = dense.bias[o];
+    for (int i = 0; i < dense.in; ++i) {
+      sum += input[i] * dense.weights[i * dense.out + o];
+    }
+    output[o] = sum;
+  }
+  return output;
+}
+
+std::vector<float> RefRelu(std::vector<float> v) {
+  for (auto& x : v) {
+    x = std::max(x, 0.0f);
+  }
+  return v;
+}
+
+DualNet::Output RefRun(const NativeModel& model,
+                       const DualNet::BoardFeatures& features) {
+  std::vector<float> x(features.begin(), features.end());
+  x = RefRelu(RefConv(model.input, x));
+  for (const auto& block : model.res_blocks) {
+    auto y = RefRelu(RefConv(block.conv1, x));
+    y = RefConv(block.conv2, y);
+    for (size_t i = 0; i < x.size(); ++i) {
+      x[i] += y[i];
+    }
+    x = RefRelu(x);
+  }
+
+  DualNet::Output output;
+  auto logits = RefDense(model.policy_fc,
+                         RefRelu(RefConv(model.policy_conv, x)));
+  double max_logit = *std::max_element(logits.begin(), logits.end());
+  double sum = 0;
+  for (auto logit : logits) {
+    sum += std::exp(logit - max_logit);
+  }
+  for (int i = 0; i < kNumMoves; ++i) {
+    output.policy[i] = std::exp(logits[i] - max_logit) / sum;
+  }
+
+  auto hidden = RefRelu(
+      RefDense(model.value_fc1, RefRelu(RefConv(model.value_conv, x))));
+  output.value = std::tanh(RefDense(model.value_fc2, hidden)[0]);
+  return output;
+}
+
+std::vector<DualNet::BoardFeatures> RandomFeatures(Random* rnd, int n) {
+  std::vector<DualNet::BoardFeatures> features(n);
+  for (auto& board : features) {
+    for (auto& x : board) {
+      x = (*rnd)() < 0.3 ? 1 : 0;
+    }
+  }
+  return features;
+}
+
+TEST(NativeDualNetTest, Gemm) {
+  Random rnd(1);
+  // Sizes that exercise the full tiles, the edges and the blocking over k and
+  // n.
+  for (int m : {1, 4, 7, 33}) {
+    for (int n : {1, 16, 21, 150}) {
+      for (int k : {1, 17, 200}) {
+        int lda = k + 3;
+        int ldb = n + 2;
+        int ldc = n + 1;
+        std::vector<float> a(m * lda), b(k * ldb), c(m * ldc);
+        Randomize(&rnd, 1, &a);
+        Randomize(&rnd, 1, &b);
+        Randomize(&rnd, 1, &c);
+        auto expected = c;
+        for (int i = 0; i < m; ++i) {
+          for (int j = 0; j < n; ++j) {
+            double sum = expected[i * ldc + j];
+            for (int p = 0; p < k; ++p) {
+              sum += a[i * lda + p] * b[p * ldb + j];
+            }
+            expected[i * ldc + j] = sum;
+          }
+        }
+        internal::Gemm(m, n, k, a.data(), lda, b.data(), ldb, c.data(), ldc);
+        for (int i = 0; i < m; ++i) {
+          for (int j = 0; j < ldc; ++j) {
+            ASSERT_NEAR(expected[i * ldc + j], c[i * ldc + j], 1e-4)
+                << "m=" << m << " n=" << n << " k=" << k << " i=" << i
+                << " j=" << j;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Compares WinogradConv against the direct convolution for layer widths that
+// are and aren't multiples of the SIMD width, and for batches that span more
+// than one block of tiles.
+TEST(NativeDualNetTest, WinogradConv) {
+  Random rnd(4);
+  for (int in : {3, 17, 32}) {
+    for (int out : {8, 21}) {
+      for (int num_boards : {1, 2, 7}) {
+        auto model = NativeModel::Create(out, 1, 1);
+        auto& conv = model->res_blocks[0].conv1;
+        conv.in = in;
+        conv.weights.resize(9 * in * out);
+        Randomize(&rnd, 1, &conv.weights);
+        Randomize(&rnd, 1, &conv.bias);
+        model->Prepare();
+
+        int num_rows = num_boards * internal::kPaddedSize;
+        std::vector<float> input(num_rows * in);
+        Randomize(&rnd, 1, &input);
+        // Both convolutions expect the border of the input to be zero.
+        for (int i = 0; i < num_rows; ++i) {
+          int y = i % internal::kPaddedSize / (kN + 2);
+          int x = i % (kN + 2);
+          if (y == 0 || y == kN + 1 || x == 0 || x == kN + 1) {
+            std::fill(input.begin() + i * in, input.begin() + (i + 1) * in,
+                      0.0f);
+          }
+        }
+
+        std::vector<float> expected(num_rows * out);
+        std::vector<float> actual(num_rows * out);
+        std::vector<float> buffer;
+        internal::Conv(conv, num_boards, input.data(), expected.data());
+        internal::WinogradConv(conv, num_boards, input.data(), actual.data(),
+                               &buffer);
+        for (int i = 0; i < num_rows; ++i) {
+          int y = i % internal::kPaddedSize / (kN + 2);
+          int x = i % (kN + 2);
+          if (y == 0 || y == kN + 1 || x == 0 || x == kN + 1) {
+            continue;
+          }
+          for (int j = 0; j < out; ++j) {
+            ASSERT_NEAR(expected[i * out + j], actual[i * out + j], 1e-4)
+                << "in=" << in << " out=" << out << " boards=" << num_boards
+                << " row=" << i << " channel=" << j;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(NativeDualNetTest, MatchesReference) {
+  Random rnd(2);
+  std::shared_ptr<const NativeModel> model = RandomModel(&rnd, 24, 16, 3);
+  NativeDualNet dual_net(model, "random_model");
+
+  // Run a batch of several boards, so that the 3x3 convolutions read across
+  // the borders between boards.
+  auto features = RandomFeatures(&rnd, 5);
+  std::vector<DualNet::Output> outputs(features.size());
+  std::string model_name;
+  dual_net.RunMany(features, absl::MakeSpan(outputs), &model_name);
+  EXPECT_EQ("random_model", model_name);
+
+  for (size_t i = 0; i < features.size(); ++i) {
+    auto expected = RefRun(*model, features[i]);
+    EXPECT_NEAR(expected.value, outputs[i].value, 1e-4);
+    float sum = 0;
+    for (int j = 0; j < kNumMoves; ++j) {
+      ASSERT_NEAR(expected.policy[j], outputs[i].policy[j], 1e-5);
+      sum += outputs[i].policy[j];
+    }
+    EXPECT_NEAR(1, sum, 1e-4);
+  }
+
+  // The results shouldn't depend on the batch size.
+  auto single = dual_net.Run(features[3], nullptr);
+  EXPECT_NEAR(outputs[3].value, single.value, 1e-5);
+  for (int j = 0; j < kNumMoves; ++j) {
+    ASSERT_NEAR(outputs[3].policy[j], single.policy[j], 1e-6);
+  }
+}
+
+TEST(NativeDualNetTest, SaveAndLoad) {
+  Random rnd(3);
+  auto model = RandomModel(&rnd, 8, 4, 2);
+  auto path = absl::StrCat(testing::TempDir(), "/native_dual_net_test_",
+                           getpid(), ".native");
+  model->Save(path);
+
+  // NativeDualNet should find the model without the extension too.
+  auto base_path = path.substr(0, path.size() - 7);
+  NativeDualNet loaded(base_path);
+  NativeDualNet original(std::move(model), base_path);
+  auto features = RandomFeatures(&rnd, 2);
+  std::vector<DualNet::Output> expected(2), actual(2);
+  original.RunMany(features, absl::MakeSpan(expected), nullptr);
+  loaded.RunMany(features, absl::MakeSpan(actual), nullptr);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(expected[i].value, actual[i].value);
+    EXPECT_EQ(expected[i].policy, actual[i].policy);
+  }
+  remove(path.c_str());
+}
+
+TEST(NativeDualNetTest, TryLoadReportsErrors) {
+  Random rnd(4);
+  auto path = absl::StrCat(testing::TempDir(), "/native_dual_net_test_",
+                           getpid(), ".native");
+  RandomModel(&rnd, 8, 4, 2)->Save(path);
+  std::string contents;
+  FILE* f = fopen(path.c_str(), "rb");
+  for (int c; (c = fgetc(f)) != EOF;) {
+    contents += static_cast<char>(c);
+  }
+  fclose(f);
+
+  auto try_load = [&path](const std::string& contents) {
+    FILE* f = fopen(path.c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+    std::string error;
+    auto model = NativeModel::TryLoad(path, &error);
+    EXPECT_EQ(model == nullptr, !error.empty());
+    return error;
+  };
+
+  EXPECT_EQ("", try_load(contents));
+  EXPECT_THAT(try_load(contents.substr(0, contents.size() - 4)),
+              ::testing::HasSubstr("is truncated"));
+  EXPECT_THAT(try_load(contents + "x"),
+              ::testing::HasSubstr("has trailing data"));
+  EXPECT_THAT(try_load(contents.substr(0, 10)),
+              ::testing::HasSubstr("Couldn't read"));
+  EXPECT_THAT(try_load("x" + contents.substr(1)),
+              ::testing::HasSubstr("isn't a native model"));
+
+  // A corrupt header mustn't make TryLoad allocate a huge model.
+  auto huge = contents;
+  huge[4 * 4 + 3] = 0x7f;
+  EXPECT_THAT(try_load(huge), ::testing::HasSubstr("invalid header"));
+
+  remove(path.c_str());
+  std::string error;
+  EXPECT_EQ(nullptr, NativeModel::TryLoad(path, &error));
+  EXPECT_THAT(error, ::testing::HasSubstr("Couldn't open"));
+}
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,67 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Verifies that NativeDualNet produces the same outputs as TfDualNet for a
+// model exported both as a frozen graph and as a native model:
+//
+//   python main.py freeze_graph $MODEL
+//   python main.py export_native_model $MODEL
+//   bazel test --define=board_size=9 \
+//       //cc/dual_net:native_dual_net_tf_test \
+//       --test_arg=--model=$MODEL
+//
+// Tagged manual since it needs TensorFlow and a trained model.
+
+#include <vector>
+
+#include "cc/dual_net/dual_net_test_utils.h"
+#include "cc/dual_net/native_dual_net.h"
+#include "cc/dual_net/tf_dual_net.h"
+#include "cc/init.h"
+#include "cc/random.h"
+#include "gflags/gflags.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+DEFINE_string(model, "",
+              "Path to the model, without extension. Both $model.pb and "
+              "$model.native must exist.");
+DEFINE_int32(num_boards, 64, "Number of random boards to compare.");
+
+namespace minigo {
+namespace {
+
+TEST(NativeDualNetTfTest, MatchesTfDualNet) {
+  ASSERT_FALSE(FLAGS_model.empty()) << "--model must be set";
+
+  Random rnd(1);
+  auto features = RandomBoardFeatures(FLAGS_num_boards, &rnd);
+
+  std::vector<DualNet::Output> expected(features.size());
+  std::vector<DualNet::Output> actual(features.size());
+  TfDualNet(FLAGS_model + ".pb")
+      .RunMany(features, absl::MakeSpan(expected), nullptr);
+  NativeDualNet(FLAGS_model).RunMany(features, absl::MakeSpan(actual), nullptr);
+
+  ExpectOutputsNear(expected, actual, 1e-3);
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  minigo::Init(&argc, &argv);
+  return RUN_ALL_TESTS();
+}
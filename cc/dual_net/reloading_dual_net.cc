@@ -0,0 +1,161 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/reloading_dual_net.h"
+
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/time/clock.h"
+#include "cc/check.h"
+#include "cc/file/filesystem.h"
+#include "cc/file/path.h"
+
+namespace minigo {
+
+namespace {
+
+class ReloadingDualNet : public DualNet {
+ public:
+  explicit ReloadingDualNet(const ReloadingDualNetFactory* factory)
+      : factory_(factory) {}
+
+  void RunMany(absl::Span<const BoardFeatures> features,
+               absl::Span<Output> outputs, std::string* model) override {
+    auto current = factory_->current();
+    if (current != model_factory_) {
+      // Replace the DualNet before releasing the factory that created it.
+      dual_net_ = current->New();
+      model_factory_ = std::move(current);
+    }
+    dual_net_->RunMany(features, outputs, model);
+  }
+
+ private:
+  const ReloadingDualNetFactory* factory_;
+  std::shared_ptr<DualNetFactory> model_factory_;
+  std::unique_ptr<DualNet> dual_net_;
+};
+
+}  // namespace
+
+ReloadingDualNetFactory::ReloadingDualNetFactory(std::string model_path,
+                                                 std::string directory,
+                                                 std::string extension,
+                                                 NewFactoryFn new_factory,
+                                                 absl::Duration poll_interval)
+    : DualNetFactory(std::move(model_path)),
+      directory_(std::move(directory)),
+      extension_(std::move(extension)),
+      new_factory_(std::move(new_factory)),
+      poll_interval_(poll_interval) {
+  if (model().empty()) {
+    std::cerr << "Waiting for a model in " << directory_ << std::endl;
+    while (!Poll()) {
+      absl::SleepFor(poll_interval_);
+    }
+  } else {
+    std::string error;
+    current_ = new_factory_(model(), &error);
+    MG_CHECK(current_ != nullptr) << error;
+    // The engines accept model paths without the extension.
+    current_path_ = model();
+    if (!absl::EndsWith(current_path_, extension_)) {
+      current_path_ += extension_;
+    }
+  }
+
+  thread_ = std::thread([this]() {
+    while (!stop_.WaitForNotificationWithTimeout(poll_interval_)) {
+      Poll();
+    }
+  });
+}
+
+ReloadingDualNetFactory::~ReloadingDualNetFactory() {
+  stop_.Notify();
+  thread_.join();
+}
+
+std::unique_ptr<DualNet> ReloadingDualNetFactory::New() {
+  return absl::make_unique<ReloadingDualNet>(this);
+}
+
+std::shared_ptr<DualNetFactory> ReloadingDualNetFactory::current() const {
+  absl::MutexLock lock(&mutex_);
+  return current_;
+}
+
+bool ReloadingDualNetFactory::Poll() {
+  absl::MutexLock lock(&poll_mutex_);
+  std::vector<std::string> files;
+  if (!file::ListDir(directory_, &files)) {
+    std::cerr << "Couldn't list " << directory_ << std::endl;
+    return false;
+  }
+
+  std::string newest;
+  for (const auto& name : files) {
+    if (absl::EndsWith(name, extension_) && name > newest) {
+      newest = name;
+    }
+  }
+  if (newest.empty()) {
+    return false;
+  }
+
+  auto path = file::JoinPath(directory_, newest);
+  if (path == current_path_) {
+    return false;
+  }
+
+  // Wait until the file's size has been stable for a poll interval.
+  uint64_t size;
+  if (!file::GetFileSize(path, &size)) {
+    return false;
+  }
+  if (path == failed_path_ && size == failed_size_) {
+    return false;
+  }
+  if (path != pending_path_ || size != pending_size_) {
+    pending_path_ = path;
+    pending_size_ = size;
+    return false;
+  }
+
+  std::cerr << "Loading model " << path << std::endl;
+  std::string error;
+  std::shared_ptr<DualNetFactory> factory = new_factory_(path, &error);
+  pending_path_.clear();
+  if (factory == nullptr) {
+    std::cerr << error << std::endl;
+    if (!current_path_.empty()) {
+      std::cerr << "Keeping model " << current_path_ << std::endl;
+    }
+    failed_path_ = std::move(path);
+    failed_size_ = size;
+    return false;
+  }
+  {
+    absl::MutexLock lock(&mutex_);
+    current_ = std::move(factory);
+  }
+  current_path_ = std::move(path);
+  return true;
+}
+
+}  // namespace minigo
@@ -0,0 +1,101 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_RELOADING_DUAL_NET_H_
+#define CC_DUAL_NET_RELOADING_DUAL_NET_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/dual_net/factory.h"
+
+namespace minigo {
+
+// A DualNetFactory that watches a local directory for new models and switches
+// the DualNets it has created to the newest one.
+//
+// Models are files in the directory whose names end with the engine's
+// extension, ordered by name: the generation numbers that prefix the names of
+// models written by rl_loop.py make the newest model the last one. A new file
+// is only loaded once its size is unchanged between two polls, so that models
+// that are still being written aren't read. If a new model can't be loaded
+// anyway (for example because a copy stalled for longer than a poll interval,
+// or the file is corrupt), the error is logged and the current model is kept.
+// The file is tried again if its size changes, and newer files replace it as
+// usual.
+//
+// New models are loaded into a new engine factory on a background thread.
+// Each DualNet switches to it at the start of its next RunMany call, including
+// DualNets used by games that are in progress, and reports the new model's
+// path through RunMany's `model` argument.
+class ReloadingDualNetFactory : public DualNetFactory {
+ public:
+  // Creates an engine factory for the model at the given path, or returns
+  // null and sets the error if the model can't be loaded.
+  using NewFactoryFn = std::function<std::unique_ptr<DualNetFactory>(
+      const std::string&, std::string*)>;
+
+  // Starts with the model at `model_path`, which must load. If `model_path` is
+  // empty, blocks until a model in `directory` loads.
+  ReloadingDualNetFactory(std::string model_path, std::string directory,
+                          std::string extension, NewFactoryFn new_factory,
+                          absl::Duration poll_interval);
+  ~ReloadingDualNetFactory() override;
+
+  // The returned DualNet must not outlive the factory.
+  std::unique_ptr<DualNet> New() override;
+
+  // Returns the engine factory for the newest loaded model.
+  std::shared_ptr<DualNetFactory> current() const LOCKS_EXCLUDED(&mutex_);
+
+  // Checks the directory once, and loads the newest model if it is different
+  // from the current one and ready to be read. Returns true if a new model was
+  // loaded. The background thread calls this every poll interval; tests that
+  // use a long interval may call it directly. Concurrent calls are
+  // serialized.
+  bool Poll() LOCKS_EXCLUDED(&poll_mutex_);
+
+ private:
+  const std::string directory_;
+  const std::string extension_;
+  const NewFactoryFn new_factory_;
+  const absl::Duration poll_interval_;
+
+  // Held for the whole of each Poll call, which loads models with it held, so
+  // it is separate from mutex_ to not block current() meanwhile. Acquired
+  // before mutex_.
+  absl::Mutex poll_mutex_;
+  std::string current_path_ GUARDED_BY(&poll_mutex_);
+  std::string pending_path_ GUARDED_BY(&poll_mutex_);
+  uint64_t pending_size_ GUARDED_BY(&poll_mutex_) = 0;
+  std::string failed_path_ GUARDED_BY(&poll_mutex_);
+  uint64_t failed_size_ GUARDED_BY(&poll_mutex_) = 0;
+
+  mutable absl::Mutex mutex_;
+  std::shared_ptr<DualNetFactory> current_ GUARDED_BY(&mutex_);
+
+  absl::Notification stop_;
+  std::thread thread_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_RELOADING_DUAL_NET_H_
@@ -0,0 +1,222 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/reloading_dual_net.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/file/filesystem.h"
+#include "cc/file/path.h"
+#include "gflags/gflags.h"
+#include "gtest/gtest.h"
+
+// Required by the remote inference engine.
+DEFINE_int32(virtual_losses, 8, "Unused.");
+
+namespace minigo {
+namespace {
+
+// A DualNet that reports the path of its model.
+class PathDualNet : public DualNet {
+ public:
+  explicit PathDualNet(std::string path) : path_(std::move(path)) {}
+
+  void RunMany(absl::Span<const BoardFeatures> features,
+               absl::Span<Output> outputs, std::string* model) override {
+    if (model != nullptr) {
+      *model = path_;
+    }
+  }
+
+ private:
+  std::string path_;
+};
+
+class PathDualNetFactory : public DualNetFactory {
+ public:
+  explicit PathDualNetFactory(std::string path)
+      : DualNetFactory(std::move(path)) {}
+
+  std::unique_ptr<DualNet> New() override {
+    return absl::make_unique<PathDualNet>(model());
+  }
+};
+
+class ReloadingDualNetTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const auto* info = testing::UnitTest::GetInstance()->current_test_info();
+    directory_ = file::JoinPath(testing::TempDir(),
+                                absl::StrCat("reloading_", info->name()));
+    ASSERT_TRUE(file::RecursivelyCreateDir(directory_));
+    std::vector<std::string> files;
+    ASSERT_TRUE(file::ListDir(directory_, &files));
+    for (const auto& name : files) {
+      std::remove(file::JoinPath(directory_, name).c_str());
+    }
+  }
+
+  std::string WriteModel(const std::string& name,
+                         const std::string& contents = "model") {
+    auto path = file::JoinPath(directory_, name);
+    std::ofstream(path) << contents;
+    return path;
+  }
+
+  std::unique_ptr<ReloadingDualNetFactory> NewFactory(
+      const std::string& model_path, absl::Duration poll_interval) {
+    return absl::make_unique<ReloadingDualNetFactory>(
+        model_path, directory_, ".pb",
+        [this](const std::string& path, std::string* error) {
+          ++num_loads_;
+          std::string contents;
+          std::getline(std::ifstream(path), contents);
+          std::unique_ptr<DualNetFactory> factory;
+          if (contents == "corrupt") {
+            *error = "corrupt model";
+          } else {
+            factory = absl::make_unique<PathDualNetFactory>(path);
+          }
+          return factory;
+        },
+        poll_interval);
+  }
+
+  static std::string RunModel(DualNet* dual_net) {
+    DualNet::BoardFeatures features;
+    DualNet::Output output;
+    std::string model;
+    dual_net->RunMany({&features, 1}, {&output, 1}, &model);
+    return model;
+  }
+
+  std::string directory_;
+  std::atomic<int> num_loads_{0};
+};
+
+TEST_F(ReloadingDualNetTest, SwitchesToNewestModel) {
+  auto initial = WriteModel("000001-first.pb");
+  auto factory = NewFactory(initial, absl::Hours(1));
+  auto dual_net = factory->New();
+  EXPECT_EQ(initial, RunModel(dual_net.get()));
+
+  // The initial model is found in the directory, so isn't reloaded.
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_FALSE(factory->Poll());
+
+  // A new model is only loaded once it's been seen with the same size twice.
+  auto second = WriteModel("000002-second.pb", "partial");
+  EXPECT_FALSE(factory->Poll());
+  WriteModel("000002-second.pb", "partial model");
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_EQ(initial, RunModel(dual_net.get()));
+  EXPECT_TRUE(factory->Poll());
+  EXPECT_EQ(second, RunModel(dual_net.get()));
+
+  // Existing and new DualNets both use the new model.
+  EXPECT_EQ(second, RunModel(factory->New().get()));
+
+  // Older models and files with other extensions are ignored.
+  WriteModel("000000-zero.pb");
+  WriteModel("000003-third.tflite");
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_EQ(second, RunModel(dual_net.get()));
+}
+
+TEST_F(ReloadingDualNetTest, KeepsModelIfNewOneFailsToLoad) {
+  auto initial = WriteModel("000001-first.pb");
+  auto factory = NewFactory(initial, absl::Hours(1));
+  auto dual_net = factory->New();
+  EXPECT_EQ(1, num_loads_);
+
+  // A model that fails to load is only tried once while its size is
+  // unchanged, and the current model is kept.
+  WriteModel("000002-second.pb", "corrupt");
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_EQ(2, num_loads_);
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_EQ(2, num_loads_);
+  EXPECT_EQ(initial, RunModel(dual_net.get()));
+
+  // It's tried again once it's been rewritten.
+  auto second = WriteModel("000002-second.pb", "complete");
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_TRUE(factory->Poll());
+  EXPECT_EQ(3, num_loads_);
+  EXPECT_EQ(second, RunModel(dual_net.get()));
+
+  // A newer model replaces a broken one.
+  WriteModel("000003-third.pb", "corrupt");
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_FALSE(factory->Poll());
+  auto fourth = WriteModel("000004-fourth.pb");
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_TRUE(factory->Poll());
+  EXPECT_EQ(fourth, RunModel(dual_net.get()));
+}
+
+TEST_F(ReloadingDualNetTest, InitialModelWithoutExtension) {
+  WriteModel("000001-first.pb");
+  auto factory =
+      NewFactory(file::JoinPath(directory_, "000001-first"), absl::Hours(1));
+  EXPECT_FALSE(factory->Poll());
+  EXPECT_FALSE(factory->Poll());
+}
+
+TEST_F(ReloadingDualNetTest, WaitsForFirstModel) {
+  auto path = WriteModel("000001-first.pb");
+  auto factory = NewFactory("", absl::Milliseconds(1));
+  EXPECT_EQ(path, RunModel(factory->New().get()));
+}
+
+TEST_F(ReloadingDualNetTest, PollsInBackground) {
+  auto initial = WriteModel("000001-first.pb");
+  auto factory = NewFactory(initial, absl::Milliseconds(1));
+  auto dual_net = factory->New();
+  EXPECT_EQ(initial, RunModel(dual_net.get()));
+
+  auto second = WriteModel("000002-second.pb");
+  while (RunModel(dual_net.get()) != second) {
+    absl::SleepFor(absl::Milliseconds(1));
+  }
+}
+
+// Verifies that Poll can be called while the background thread polls too.
+TEST_F(ReloadingDualNetTest, PollsConcurrentlyWithBackground) {
+  auto initial = WriteModel("000001-first.pb");
+  auto factory = NewFactory(initial, absl::Milliseconds(1));
+  auto dual_net = factory->New();
+
+  auto second = WriteModel("000002-second.pb");
+  for (int i = 0; i < 1000 || RunModel(dual_net.get()) != second; ++i) {
+    factory->Poll();
+  }
+  // Only one of the two pollers loads the model.
+  EXPECT_EQ(2, num_loads_);
+}
+
+}  // namespace
+}  // namespace minigo
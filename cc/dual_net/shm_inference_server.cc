@@ -0,0 +1,414 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/shm_inference_server.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include "absl/time/clock.h"
+#include "cc/check.h"
+#include "cc/constants.h"
+
+namespace minigo {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4d53474d;  // "MGSM" in little-endian order.
+constexpr uint32_t kVersion = 3;
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kSlotHeaderSize = 256;
+constexpr size_t kAlignment = 64;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t board_size;
+  uint32_t num_planes;
+  uint32_t virtual_losses;
+  uint32_t games_per_inference;
+  uint32_t num_slots;
+  uint32_t slot_size;
+  std::atomic<uint32_t> features_seq;
+  std::atomic<uint32_t> shutdown;
+};
+
+struct SlotHeader {
+  std::atomic<uint32_t> state;
+  std::atomic<uint32_t> heartbeat;
+  uint32_t model_path_length;
+  char model_path[kSlotHeaderSize - 12];
+};
+
+// The futexes are the raw uint32 values in shared memory, so the atomics must
+// be plain 32 bit words.
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "std::atomic<uint32_t> must be 32 bits");
+static_assert(sizeof(Header) <= kHeaderSize, "Header too large");
+static_assert(sizeof(SlotHeader) == kSlotHeaderSize, "Unexpected SlotHeader");
+
+constexpr uint32_t kStateMask = (1 << kShmStateBits) - 1;
+
+// Returns the state word of a slot holding batch `batch_id` in `state`.
+constexpr uint32_t MakeStateWord(uint32_t batch_id, ShmSlotState state) {
+  return (batch_id << kShmStateBits) | static_cast<uint32_t>(state);
+}
+
+ShmSlotState GetState(uint32_t word) {
+  return static_cast<ShmSlotState>(word & kStateMask);
+}
+
+uint32_t GetBatchId(uint32_t word) { return word >> kShmStateBits; }
+
+size_t Align(size_t size) {
+  return (size + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// Byte offsets of a slot's features, policy and value arrays relative to the
+// start of the slot, and the total size of the slot.
+struct SlotLayout {
+  explicit SlotLayout(size_t batch_size) {
+    features = kSlotHeaderSize;
+    policy = Align(features + batch_size * DualNet::kNumBoardFeatures);
+    value = Align(policy + batch_size * kNumMoves * sizeof(float));
+    size = Align(value + batch_size * sizeof(float));
+  }
+
+  size_t features;
+  size_t policy;
+  size_t value;
+  size_t size;
+};
+
+Header* GetHeader(uint8_t* region) {
+  return reinterpret_cast<Header*>(region);
+}
+
+uint8_t* GetSlot(uint8_t* region, int slot) {
+  return region + kHeaderSize + slot * GetHeader(region)->slot_size;
+}
+
+SlotHeader* GetSlotHeader(uint8_t* region, int slot) {
+  return reinterpret_cast<SlotHeader*>(GetSlot(region, slot));
+}
+
+// The futexes are shared between processes, so we can't use the
+// FUTEX_PRIVATE_FLAG variants of the futex operations.
+void FutexWait(std::atomic<uint32_t>* word, uint32_t expected,
+               absl::Duration timeout) {
+  struct timespec ts = absl::ToTimespec(timeout);
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+          &ts, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word, int count) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, count,
+          nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+ShmInferenceServer::ShmInferenceServer(int virtual_losses,
+                                       int games_per_inference,
+                                       const std::string& name, int num_slots,
+                                       absl::Duration worker_timeout)
+    : batcher_(virtual_losses, games_per_inference),
+      name_(name),
+      worker_timeout_(worker_timeout) {
+  MG_CHECK(num_slots > 0);
+  SlotLayout layout(batcher_.batch_size());
+  size_ = kHeaderSize + num_slots * layout.size;
+
+  // Remove any region left behind by a process that didn't exit cleanly.
+  shm_unlink(name_.c_str());
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  MG_CHECK(fd != -1) << "shm_open(\"" << name_
+                     << "\") failed: " << strerror(errno);
+  MG_CHECK(ftruncate(fd, size_) == 0)
+      << "ftruncate failed: " << strerror(errno);
+  void* ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  MG_CHECK(ptr != MAP_FAILED) << "mmap failed: " << strerror(errno);
+  close(fd);
+  region_ = static_cast<uint8_t*>(ptr);
+
+  // The region is zero-filled by ftruncate, so every slot starts out empty.
+  auto* header = new (region_) Header();
+  header->version = kVersion;
+  header->board_size = kN;
+  header->num_planes = DualNet::kNumStoneFeatures;
+  header->virtual_losses = virtual_losses;
+  header->games_per_inference = games_per_inference;
+  header->num_slots = num_slots;
+  header->slot_size = layout.size;
+  for (int i = 0; i < num_slots; ++i) {
+    new (GetSlot(region_, i)) SlotHeader();
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = kMagic;
+
+  for (int i = 0; i < num_slots; ++i) {
+    threads_.emplace_back(&ShmInferenceServer::SlotThread, this, i);
+  }
+  std::cerr << "Inference server listening on " << name_ << std::endl;
+}
+
+ShmInferenceServer::~ShmInferenceServer() {
+  running_ = false;
+  auto* header = GetHeader(region_);
+  header->shutdown = 1;
+  header->features_seq++;
+  FutexWake(&header->features_seq, INT_MAX);
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+  munmap(region_, size_);
+  shm_unlink(name_.c_str());
+}
+
+std::unique_ptr<DualNet> ShmInferenceServer::NewDualNet() {
+  return batcher_.NewDualNet();
+}
+
+void ShmInferenceServer::SlotThread(int slot) {
+  auto* header = GetHeader(region_);
+  auto* slot_header = GetSlotHeader(region_, slot);
+  auto* data = GetSlot(region_, slot);
+  SlotLayout layout(batcher_.batch_size());
+  size_t num_features = batcher_.batch_size() * DualNet::kNumBoardFeatures;
+  auto features = absl::MakeSpan(data + layout.features, num_features);
+  const auto* policy = reinterpret_cast<const float*>(data + layout.policy);
+  const auto* value = reinterpret_cast<const float*>(data + layout.value);
+
+  auto* worker_latency =
+      batcher_.metrics()->GetHistogram("inference/worker_latency_us");
+  auto* num_requeued_batches =
+      batcher_.metrics()->GetCounter("inference/num_requeued_batches");
+
+  // Publishes the features in the slot under a new batch ID, if the slot's
+  // state word is still `word`.
+  uint32_t batch_id = 0;
+  auto publish = [&](uint32_t word) {
+    if (!slot_header->state.compare_exchange_strong(
+            word, MakeStateWord(batch_id + 1, ShmSlotState::kFeaturesReady),
+            std::memory_order_acq_rel)) {
+      return false;
+    }
+    batch_id += 1;
+    header->features_seq.fetch_add(1, std::memory_order_release);
+    FutexWake(&header->features_seq, INT_MAX);
+    return true;
+  };
+
+  std::vector<RemoteInference> inferences;
+  auto is_cancelled = [this]() { return !running_; };
+  while (batcher_.GetBatch(is_cancelled, &inferences)) {
+    InferenceBatcher::CopyFeatures(inferences, features);
+    auto dispatch_time = absl::Now();
+    // No worker changes the state of an empty slot.
+    MG_CHECK(publish(MakeStateWord(batch_id, ShmSlotState::kEmpty)));
+
+    // Wait for a worker to write the outputs, periodically checking whether
+    // the server is being shut down and whether the worker that claimed the
+    // batch is still alive.
+    uint32_t heartbeat = slot_header->heartbeat.load();
+    auto heartbeat_time = absl::Now();
+    for (;;) {
+      uint32_t word = slot_header->state.load(std::memory_order_acquire);
+      auto state = GetState(word);
+      if (state == ShmSlotState::kOutputsReady) {
+        break;
+      }
+      if (!running_) {
+        return;
+      }
+
+      // Each claim times out on its own, starting when it is first seen.
+      auto now = absl::Now();
+      if (state != ShmSlotState::kRunning ||
+          slot_header->heartbeat.load() != heartbeat) {
+        heartbeat = slot_header->heartbeat.load();
+        heartbeat_time = now;
+      } else if (now - heartbeat_time > worker_timeout_) {
+        // The worker that claimed the batch has died. Its features are still
+        // in the slot, so publish them again for the next worker to claim.
+        // The new batch ID stops the lost worker from writing outputs if it's
+        // merely stalled. If the worker has just started writing its outputs,
+        // publishing fails and we keep waiting for them.
+        if (publish(word)) {
+          std::cerr << "Inference worker hasn't responded for "
+                    << worker_timeout_ << ", requeuing slot " << slot
+                    << std::endl;
+          num_requeued_batches->Increment();
+        }
+        heartbeat_time = now;
+        continue;
+      }
+      FutexWait(&slot_header->state, word, absl::Milliseconds(50));
+    }
+
+    worker_latency->RecordDuration(absl::Now() - dispatch_time);
+
+    std::string model(slot_header->model_path,
+                      slot_header->model_path_length);
+    batcher_.SetOutputs(policy, value, model, absl::MakeSpan(inferences));
+    slot_header->state.store(MakeStateWord(batch_id, ShmSlotState::kEmpty),
+                             std::memory_order_release);
+  }
+}
+
+ShmInferenceWorker::ShmInferenceWorker(const std::string& name) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  MG_CHECK(fd != -1) << "shm_open(\"" << name
+                     << "\") failed: " << strerror(errno);
+  struct stat st;
+  MG_CHECK(fstat(fd, &st) == 0) << "fstat failed: " << strerror(errno);
+  size_ = st.st_size;
+  void* ptr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  MG_CHECK(ptr != MAP_FAILED) << "mmap failed: " << strerror(errno);
+  close(fd);
+  region_ = static_cast<uint8_t*>(ptr);
+
+  auto* header = GetHeader(region_);
+  MG_CHECK(header->magic == kMagic);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  MG_CHECK(header->version == kVersion);
+  MG_CHECK(header->board_size == kN)
+      << "Board size mismatch: server=" << header->board_size
+      << ", worker=" << kN;
+  MG_CHECK(header->num_planes == DualNet::kNumStoneFeatures);
+}
+
+ShmInferenceWorker::~ShmInferenceWorker() { munmap(region_, size_); }
+
+int ShmInferenceWorker::board_size() const {
+  return GetHeader(region_)->board_size;
+}
+
+int ShmInferenceWorker::virtual_losses() const {
+  return GetHeader(region_)->virtual_losses;
+}
+
+int ShmInferenceWorker::games_per_inference() const {
+  return GetHeader(region_)->games_per_inference;
+}
+
+void ShmInferenceWorker::Heartbeat() {
+  absl::MutexLock lock(&mutex_);
+  for (const auto& claim : claims_) {
+    // Only keep a claim alive while the batch is still ours.
+    auto* slot_header = GetSlotHeader(region_, claim.first);
+    if (slot_header->state.load(std::memory_order_acquire) ==
+        MakeStateWord(claim.second, ShmSlotState::kRunning)) {
+      slot_header->heartbeat.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool ShmInferenceWorker::GetFeatures(absl::Duration timeout, Batch* batch) {
+  auto* header = GetHeader(region_);
+  size_t batch_size = header->virtual_losses * header->games_per_inference;
+  SlotLayout layout(batch_size);
+  auto deadline = absl::Now() + timeout;
+  for (;;) {
+    // Read features_seq before looking at the slots: if the server publishes
+    // a new batch after we've checked the slots, features_seq will no longer
+    // match and FutexWait will return immediately.
+    uint32_t seq = header->features_seq.load(std::memory_order_acquire);
+    if (header->shutdown.load(std::memory_order_acquire)) {
+      return false;
+    }
+    for (int i = 0; i < static_cast<int>(header->num_slots); ++i) {
+      auto* slot_header = GetSlotHeader(region_, i);
+      uint32_t word = slot_header->state.load(std::memory_order_acquire);
+      if (GetState(word) != ShmSlotState::kFeaturesReady) {
+        continue;
+      }
+      uint32_t batch_id = GetBatchId(word);
+      if (slot_header->state.compare_exchange_strong(
+              word, MakeStateWord(batch_id, ShmSlotState::kRunning),
+              std::memory_order_acq_rel)) {
+        slot_header->heartbeat.fetch_add(1, std::memory_order_relaxed);
+        {
+          absl::MutexLock lock(&mutex_);
+          claims_[i] = batch_id;
+        }
+        batch->slot = i;
+        batch->batch_id = batch_id;
+        batch->features =
+            absl::MakeConstSpan(GetSlot(region_, i) + layout.features,
+                                batch_size * DualNet::kNumBoardFeatures);
+        return true;
+      }
+    }
+    auto remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) {
+      return false;
+    }
+    FutexWait(&header->features_seq, seq, remaining);
+  }
+}
+
+bool ShmInferenceWorker::PutOutputs(const Batch& batch,
+                                    absl::Span<const float> policy,
+                                    absl::Span<const float> value,
+                                    const std::string& model_path) {
+  auto* header = GetHeader(region_);
+  size_t batch_size = header->virtual_losses * header->games_per_inference;
+  MG_CHECK(policy.size() == batch_size * kNumMoves);
+  MG_CHECK(value.size() == batch_size);
+  auto* slot_header = GetSlotHeader(region_, batch.slot);
+  MG_CHECK(model_path.size() <= sizeof(slot_header->model_path))
+      << "Model path \"" << model_path << "\" is too long";
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = claims_.find(batch.slot);
+    if (it != claims_.end() && it->second == batch.batch_id) {
+      claims_.erase(it);
+    }
+  }
+
+  // Take ownership of the slot before writing anything to it, so that the
+  // outputs of a batch that has been handed out again are never written.
+  auto expected = MakeStateWord(batch.batch_id, ShmSlotState::kRunning);
+  if (!slot_header->state.compare_exchange_strong(
+          expected,
+          MakeStateWord(batch.batch_id, ShmSlotState::kWritingOutputs),
+          std::memory_order_acq_rel)) {
+    return false;
+  }
+
+  auto* data = GetSlot(region_, batch.slot);
+  SlotLayout layout(batch_size);
+  memcpy(data + layout.policy, policy.data(), policy.size() * sizeof(float));
+  memcpy(data + layout.value, value.data(), value.size() * sizeof(float));
+  memcpy(slot_header->model_path, model_path.data(), model_path.size());
+  slot_header->model_path_length = model_path.size();
+  slot_header->state.store(
+      MakeStateWord(batch.batch_id, ShmSlotState::kOutputsReady),
+      std::memory_order_release);
+  FutexWake(&slot_header->state, 1);
+  return true;
+}
+
+}  // namespace minigo
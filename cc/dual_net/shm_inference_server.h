@@ -0,0 +1,163 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_DUAL_NET_SHM_INFERENCE_SERVER_H_
+#define CC_DUAL_NET_SHM_INFERENCE_SERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/dual_net/inference_batcher.h"
+#include "cc/metrics.h"
+
+namespace minigo {
+
+// Remote inference transport for an inference worker running on the same host.
+// Instead of serving batches over gRPC, features and outputs are exchanged
+// through a POSIX shared memory region, and the two processes signal each
+// other using futexes stored in that region.
+//
+// The region begins with a 64 byte header of uint32 fields:
+//   [0] magic ('MGSM'), [1] version, [2] board_size, [3] num_planes,
+//   [4] virtual_losses, [5] games_per_inference, [6] num_slots,
+//   [7] slot_size, [8] features_seq, [9] shutdown.
+// The header is followed by num_slots slots of slot_size bytes each. Each slot
+// holds one batch:
+//   [0, 4) state word, [4, 8) heartbeat, [8, 12) model_path length,
+//   [12, 256) model_path, [256, ...) features as one uint8 per feature laid
+//   out as [batch_size, board_size, board_size, num_planes], then float32
+//   policy [batch_size, kNumMoves] and float32 value [batch_size], each
+//   aligned to 64 bytes.
+// The state word holds the slot's ShmSlotState in its low kShmStateBits bits
+// and the ID of the batch in the slot in the rest, so that a worker can check
+// that a batch is still its own and change the slot's state in one atomic
+// compare-and-swap.
+//
+// The server moves a slot from kEmpty to kFeaturesReady under a new batch ID,
+// then increments features_seq and wakes any workers waiting on it. A worker
+// claims the slot by moving it to kRunning. To hand back the outputs, it moves
+// the slot from kRunning to kWritingOutputs, writes the outputs, then moves it
+// to kOutputsReady and wakes the server thread that waits on the state word.
+// The outputs are only written once the worker owns the slot, so a worker
+// whose batch was handed out again never touches the slot.
+//
+// While it holds a claim, a worker increments the slot's heartbeat at least
+// once a second. If a slot's heartbeat doesn't change for the server's worker
+// timeout while it is kRunning, the worker that claimed it is assumed dead and
+// the slot is moved back to kFeaturesReady under a new batch ID, so that
+// another worker can pick it up. Each claim times out on its own, whether or
+// not other workers are alive. A slot in kWritingOutputs is never handed out
+// again: copying the outputs takes microseconds.
+constexpr int kShmStateBits = 3;
+
+enum class ShmSlotState : uint32_t {
+  kEmpty = 0,
+  kFeaturesReady = 1,
+  kRunning = 2,
+  kOutputsReady = 3,
+  kWritingOutputs = 4,
+};
+
+class ShmInferenceServer {
+ public:
+  // Creates the shared memory region `name` (which must start with a '/') with
+  // `num_slots` slots. Using more than one slot allows the next batch to be
+  // assembled while the worker is running inference on the current one.
+  // A batch whose heartbeat stops for `worker_timeout` while a worker has it
+  // claimed is handed out again.
+  ShmInferenceServer(int virtual_losses, int games_per_inference,
+                     const std::string& name, int num_slots,
+                     absl::Duration worker_timeout);
+  ~ShmInferenceServer();
+
+  // Return a new DualNet instance whose inference requests are performed
+  // by this ShmInferenceServer.
+  std::unique_ptr<DualNet> NewDualNet();
+
+  MetricsRegistry* metrics() { return batcher_.metrics(); }
+
+ private:
+  // Fills slot `slot` with batches from batcher_ and copies the outputs back
+  // to the clients, until the server is shut down.
+  void SlotThread(int slot);
+
+  InferenceBatcher batcher_;
+  std::string name_;
+  const absl::Duration worker_timeout_;
+  size_t size_;
+  uint8_t* region_;
+  std::atomic<bool> running_{true};
+  std::vector<std::thread> threads_;
+};
+
+// Inference worker side of the shared memory transport. The real inference
+// worker is inference_worker.py; this class is used by the C++ tests and
+// benchmarks. It is thread safe.
+class ShmInferenceWorker {
+ public:
+  struct Batch {
+    int slot;
+    uint32_t batch_id;
+    absl::Span<const uint8_t> features;
+  };
+
+  // Attaches to an existing shared memory region created by a
+  // ShmInferenceServer.
+  explicit ShmInferenceWorker(const std::string& name);
+  ~ShmInferenceWorker();
+
+  int board_size() const;
+  int virtual_losses() const;
+  int games_per_inference() const;
+
+  // Tells the server that the worker is still running the batches it has
+  // claimed. GetFeatures counts as a heartbeat for the batch it claims; a
+  // worker that may spend longer than the server's worker timeout running a
+  // batch must call this periodically.
+  void Heartbeat();
+
+  // Waits up to `timeout` for a batch of features. Returns false if the
+  // timeout expires or the server is shut down.
+  bool GetFeatures(absl::Duration timeout, Batch* batch);
+
+  // Hands the batch's outputs back to the server: `policy` holds kNumMoves
+  // values per position and `value` one. Returns false if the server has
+  // already handed the batch out to another worker, in which case the outputs
+  // are discarded.
+  bool PutOutputs(const Batch& batch, absl::Span<const float> policy,
+                  absl::Span<const float> value,
+                  const std::string& model_path);
+
+ private:
+  size_t size_;
+  uint8_t* region_;
+
+  absl::Mutex mutex_;
+  // The batch ID of each slot that the worker has claimed.
+  std::map<int, uint32_t> claims_ GUARDED_BY(&mutex_);
+};
+
+}  // namespace minigo
+
+#endif  // CC_DUAL_NET_SHM_INFERENCE_SERVER_H_
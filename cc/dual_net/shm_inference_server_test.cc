@@ -0,0 +1,280 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/dual_net/shm_inference_server.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "cc/constants.h"
+#include "cc/dual_net/fake_net.h"
+#include "cc/random.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+class ShmInferenceServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Random rnd;
+    for (int i = 0; i < kNumMoves; ++i) {
+      priors_.push_back(rnd());
+    }
+    value_ = 0.1;
+    dual_net_ = absl::make_unique<FakeNet>(priors_, value_);
+
+    name_ = absl::StrCat("/minigo_shm_inference_server_test_", getpid());
+    StartServer(absl::Seconds(30));
+  }
+
+  // (Re)starts the server and creates games_per_inference_ clients.
+  void StartServer(absl::Duration worker_timeout) {
+    clients_.clear();
+    server_.reset();
+    server_ = absl::make_unique<ShmInferenceServer>(
+        virtual_losses_, games_per_inference_, name_, num_slots_,
+        worker_timeout);
+    for (int i = 0; i < games_per_inference_; ++i) {
+      clients_.push_back(server_->NewDualNet());
+    }
+  }
+
+  // Stand-in for inference_worker.py: runs FakeNet on batches of features
+  // until `running` becomes false.
+  void RunFakeWorker(const std::atomic<bool>* running);
+
+  // Runs FakeNet on the batch and hands the outputs to `worker`. Returns the
+  // result of PutOutputs.
+  bool RunBatch(ShmInferenceWorker* worker,
+                const ShmInferenceWorker::Batch& batch,
+                const std::string& model);
+
+  // Runs inference on all clients in parallel and verifies the outputs.
+  void RunClients();
+
+  int virtual_losses_ = 8;
+  int games_per_inference_ = 2;
+  int num_slots_ = 2;
+
+  std::vector<float> priors_;
+  float value_;
+
+  std::string name_;
+  std::unique_ptr<DualNet> dual_net_;
+  std::unique_ptr<ShmInferenceServer> server_;
+  std::vector<std::unique_ptr<DualNet>> clients_;
+};
+
+void ShmInferenceServerTest::RunFakeWorker(const std::atomic<bool>* running) {
+  ShmInferenceWorker worker(name_);
+  ASSERT_EQ(kN, worker.board_size());
+  ASSERT_EQ(virtual_losses_, worker.virtual_losses());
+  ASSERT_EQ(games_per_inference_, worker.games_per_inference());
+
+  ShmInferenceWorker::Batch batch;
+  while (*running) {
+    if (!worker.GetFeatures(absl::Milliseconds(10), &batch)) {
+      continue;
+    }
+    EXPECT_TRUE(RunBatch(&worker, batch, "fake_model"));
+  }
+}
+
+bool ShmInferenceServerTest::RunBatch(ShmInferenceWorker* worker,
+                                      const ShmInferenceWorker::Batch& batch,
+                                      const std::string& model) {
+  int batch_size = virtual_losses_ * games_per_inference_;
+  EXPECT_EQ(batch_size * DualNet::kNumBoardFeatures, batch.features.size());
+  std::vector<DualNet::BoardFeatures> features(batch_size);
+  std::vector<DualNet::Output> outputs(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    for (int j = 0; j < DualNet::kNumBoardFeatures; ++j) {
+      features[i][j] = static_cast<float>(
+          batch.features[i * DualNet::kNumBoardFeatures + j]);
+    }
+  }
+  dual_net_->RunMany(features, absl::MakeSpan(outputs), nullptr);
+  std::vector<float> policy(batch_size * kNumMoves);
+  std::vector<float> value(batch_size);
+  for (int i = 0; i < batch_size; ++i) {
+    std::copy(outputs[i].policy.begin(), outputs[i].policy.end(),
+              policy.begin() + i * kNumMoves);
+    value[i] = outputs[i].value;
+  }
+  return worker->PutOutputs(batch, policy, value, model);
+}
+
+void ShmInferenceServerTest::RunClients() {
+  int vlosses = virtual_losses_;
+  std::vector<DualNet::BoardFeatures> features(vlosses * clients_.size());
+  std::vector<DualNet::Output> outputs(vlosses * clients_.size());
+  std::vector<std::string> models(clients_.size());
+  std::vector<std::thread> client_threads;
+  for (size_t i = 0; i < clients_.size(); ++i) {
+    auto* client = clients_[i].get();
+    auto* client_features = &features[i * vlosses];
+    auto* client_output = &outputs[i * vlosses];
+    auto* model = &models[i];
+    client_threads.emplace_back([=]() {
+      auto size = static_cast<size_t>(vlosses);
+      client->RunMany({client_features, size}, {client_output, size}, model);
+    });
+  }
+  for (auto& thread : client_threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < clients_.size(); ++i) {
+    EXPECT_EQ("fake_model", models[i]);
+    for (int vloss = 0; vloss < vlosses; ++vloss) {
+      const auto& output = outputs[i * vlosses + vloss];
+      ASSERT_EQ(value_, output.value);
+      for (int i = 0; i < kNumMoves; ++i) {
+        ASSERT_EQ(priors_[i], output.policy[i]);
+      }
+    }
+  }
+}
+
+TEST_F(ShmInferenceServerTest, Test) {
+  std::atomic<bool> running{true};
+  std::thread worker_thread([&]() { RunFakeWorker(&running); });
+  RunClients();
+  running = false;
+  worker_thread.join();
+}
+
+TEST_F(ShmInferenceServerTest, TestManyBatches) {
+  // Run two workers, like inference_worker.py does.
+  std::atomic<bool> running{true};
+  std::thread worker_thread_a([&]() { RunFakeWorker(&running); });
+  std::thread worker_thread_b([&]() { RunFakeWorker(&running); });
+  for (int i = 0; i < 100; ++i) {
+    RunClients();
+  }
+  running = false;
+  worker_thread_a.join();
+  worker_thread_b.join();
+}
+
+TEST_F(ShmInferenceServerTest, TestRequeueLostBatch) {
+  StartServer(absl::Milliseconds(200));
+  auto* num_requeued_batches =
+      server_->metrics()->GetCounter("inference/num_requeued_batches");
+
+  std::thread worker_thread([&]() {
+    // The first worker claims a batch then stops, as if it had died.
+    ShmInferenceWorker lost_worker(name_);
+    ShmInferenceWorker::Batch lost;
+    ASSERT_TRUE(lost_worker.GetFeatures(absl::Seconds(10), &lost));
+    while (num_requeued_batches->value() == 0) {
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+
+    // The batch is picked up by a replacement worker, and the first worker's
+    // outputs are rejected when they eventually arrive.
+    ShmInferenceWorker::Batch requeued;
+    ShmInferenceWorker worker(name_);
+    ASSERT_TRUE(worker.GetFeatures(absl::Seconds(10), &requeued));
+    EXPECT_EQ(lost.slot, requeued.slot);
+    EXPECT_NE(lost.batch_id, requeued.batch_id);
+    EXPECT_FALSE(RunBatch(&lost_worker, lost, "lost_model"));
+    EXPECT_TRUE(RunBatch(&worker, requeued, "fake_model"));
+  });
+  RunClients();
+  worker_thread.join();
+  EXPECT_EQ(1, num_requeued_batches->value());
+}
+
+// Verifies that a batch claimed by a dead worker is requeued even while
+// another worker is alive.
+TEST_F(ShmInferenceServerTest, TestRequeueWhileOtherWorkerAlive) {
+  StartServer(absl::Milliseconds(200));
+  auto* num_requeued_batches =
+      server_->metrics()->GetCounter("inference/num_requeued_batches");
+
+  std::atomic<bool> running{true};
+  std::thread worker_thread([&]() {
+    // The lost worker claims the only batch and dies. The other worker keeps
+    // polling for features, and picks up the batch once it is requeued.
+    ShmInferenceWorker lost_worker(name_);
+    ShmInferenceWorker::Batch lost;
+    ASSERT_TRUE(lost_worker.GetFeatures(absl::Seconds(10), &lost));
+    RunFakeWorker(&running);
+  });
+  RunClients();
+  running = false;
+  worker_thread.join();
+  EXPECT_EQ(1, num_requeued_batches->value());
+}
+
+// Verifies that a stalled worker can't overwrite the outputs of the worker
+// that its batch was handed out to, however their writes interleave.
+TEST_F(ShmInferenceServerTest, TestStaleWorkerRacesRequeuedBatch) {
+  StartServer(absl::Milliseconds(200));
+  auto* num_requeued_batches =
+      server_->metrics()->GetCounter("inference/num_requeued_batches");
+
+  std::thread worker_thread([&]() {
+    ShmInferenceWorker lost_worker(name_);
+    ShmInferenceWorker::Batch lost;
+    ASSERT_TRUE(lost_worker.GetFeatures(absl::Seconds(10), &lost));
+    while (num_requeued_batches->value() == 0) {
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+    ShmInferenceWorker worker(name_);
+    ShmInferenceWorker::Batch requeued;
+    ASSERT_TRUE(worker.GetFeatures(absl::Seconds(10), &requeued));
+    ASSERT_EQ(lost.slot, requeued.slot);
+
+    // The stalled worker resumes and keeps trying to write garbage outputs
+    // while the new worker writes the real ones.
+    int batch_size = virtual_losses_ * games_per_inference_;
+    std::vector<float> garbage_policy(batch_size * kNumMoves, -1);
+    std::vector<float> garbage_value(batch_size, -1);
+    std::atomic<bool> done{false};
+    std::thread stale_thread([&]() {
+      while (!done) {
+        EXPECT_FALSE(lost_worker.PutOutputs(lost, garbage_policy,
+                                            garbage_value, "lost_model"));
+      }
+    });
+    EXPECT_TRUE(RunBatch(&worker, requeued, "fake_model"));
+    done = true;
+    stale_thread.join();
+  });
+  // RunClients verifies that the clients got the real outputs.
+  RunClients();
+  worker_thread.join();
+  EXPECT_EQ(1, num_requeued_batches->value());
+}
+
+TEST_F(ShmInferenceServerTest, TestNoFeatures) {
+  ShmInferenceWorker worker(name_);
+  ShmInferenceWorker::Batch batch;
+  EXPECT_FALSE(worker.GetFeatures(absl::Milliseconds(10), &batch));
+}
+
+}  // namespace
+}  // namespace minigo
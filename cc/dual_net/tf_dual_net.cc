@@ -14,6 +14,11 @@
 
 #include "cc/dual_net/tf_dual_net.h"
 
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
 #include "absl/strings/str_cat.h"
 #include "cc/check.h"
 #include "cc/constants.h"
@@ -22,90 +27,151 @@
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/platform/env.h"
 
+using tensorflow::CallableOptions;
 using tensorflow::DT_FLOAT;
 using tensorflow::Env;
 using tensorflow::GraphDef;
 using tensorflow::NewSession;
 using tensorflow::ReadBinaryProto;
+using tensorflow::Session;
 using tensorflow::SessionOptions;
 using tensorflow::Tensor;
 using tensorflow::TensorShape;
 
 namespace minigo {
 
-TfDualNet::TfDualNet(const std::string& graph_path) : graph_path_(graph_path) {
-  GraphDef graph_def;
+TfDualNet::Model::Model(std::unique_ptr<Session> session,
+                        std::string graph_path)
+    : session_(std::move(session)), graph_path_(std::move(graph_path)) {
+  CallableOptions options;
+  options.add_feed("pos_tensor");
+  options.add_fetch("policy_output");
+  options.add_fetch("value_output");
+  TF_CHECK_OK(session_->MakeCallable(options, &callable_));
+}
 
+TfDualNet::Model::~Model() {
+  TF_CHECK_OK(session_->ReleaseCallable(callable_));
+  TF_CHECK_OK(session_->Close());
+}
+
+void TfDualNet::Model::Run(const std::vector<Tensor>& inputs,
+                           std::vector<Tensor>* outputs) const {
+  TF_CHECK_OK(session_->RunCallable(callable_, inputs, outputs, nullptr));
+}
+
+std::shared_ptr<const TfDualNet::Model> TfDualNet::LoadModel(
+    const std::string& graph_path, int intra_op_threads,
+    int inter_op_threads) {
+  std::string error;
+  auto model =
+      TryLoadModel(graph_path, intra_op_threads, inter_op_threads, &error);
+  MG_CHECK(model != nullptr) << error;
+  return model;
+}
+
+std::shared_ptr<const TfDualNet::Model> TfDualNet::TryLoadModel(
+    const std::string& graph_path, int intra_op_threads, int inter_op_threads,
+    std::string* error) {
   // If we can't find the specified graph, try adding a .pb extension.
   auto* env = Env::Default();
-  if (!env->FileExists(graph_path_).ok()) {
-    auto alt_path = absl::StrCat(graph_path_, ".pb");
+  std::string path = graph_path;
+  if (!env->FileExists(path).ok()) {
+    auto alt_path = absl::StrCat(path, ".pb");
     if (env->FileExists(alt_path).ok()) {
-      std::cerr << graph_path << " doesn't exist, using " << alt_path
-                << std::endl;
-      graph_path_ = alt_path;
+      std::cerr << path << " doesn't exist, using " << alt_path << std::endl;
+      path = alt_path;
     }
   }
 
-  TF_CHECK_OK(ReadBinaryProto(env, graph_path_, &graph_def));
+  GraphDef graph_def;
+  auto status = ReadBinaryProto(env, path, &graph_def);
+  if (!status.ok()) {
+    *error = absl::StrCat("Couldn't load ", path, ": ", status.ToString());
+    return nullptr;
+  }
 
   SessionOptions options;
   options.config.mutable_gpu_options()->set_allow_growth(true);
-  session_.reset(NewSession(options));
-  TF_CHECK_OK(session_->Create(graph_def));
-
-  inputs_.clear();
-  inputs_.emplace_back(
-      "pos_tensor",
-      Tensor(DT_FLOAT, TensorShape({1, kN, kN, kNumStoneFeatures})));
+  options.config.set_intra_op_parallelism_threads(intra_op_threads);
+  options.config.set_inter_op_parallelism_threads(inter_op_threads);
+  std::unique_ptr<Session> session(NewSession(options));
+  status = session->Create(graph_def);
+  if (!status.ok()) {
+    *error = absl::StrCat("Couldn't load ", path, ": ", status.ToString());
+    return nullptr;
+  }
 
-  output_names_.clear();
-  output_names_.push_back("policy_output");
-  output_names_.push_back("value_output");
+  auto model = std::make_shared<const Model>(std::move(session), path);
 
-  // Tensorflow lazily initializes the first time Session::Run is called, which
-  // can take hundreds of milliseconds. This intefers with time control, so
-  // explicitly run inference once during construction.
+  // Run the model once, so that later runs by any TfDualNet find it
+  // initialized.
   Output output;
   BoardFeatures features;
-  RunMany({&features, 1}, {&output, 1}, nullptr);
+  TfDualNet(model).RunMany({&features, 1}, {&output, 1}, nullptr);
+
+  return model;
 }
 
-TfDualNet::~TfDualNet() {
-  if (session_ != nullptr) {
-    TF_CHECK_OK(session_->Close());
+TfDualNet::TfDualNet(const std::string& graph_path)
+    : TfDualNet(LoadModel(graph_path, 0, 0)) {}
+
+TfDualNet::TfDualNet(std::shared_ptr<const Model> model)
+    : model_(std::move(model)) {}
+
+TfDualNet::~TfDualNet() = default;
+
+std::vector<Tensor>* TfDualNet::GetInputs(int batch_size) {
+  ++lru_clock_;
+  for (auto& cached : cached_inputs_) {
+    if (cached.batch_size == batch_size) {
+      cached.last_used = lru_clock_;
+      return &cached.tensors;
+    }
+  }
+
+  if (cached_inputs_.size() < kMaxCachedBatchSizes) {
+    cached_inputs_.push_back({batch_size, {}, 0});
   }
+  auto& cached = *std::min_element(
+      cached_inputs_.begin(), cached_inputs_.end(),
+      [](const CachedInput& a, const CachedInput& b) {
+        return a.last_used < b.last_used;
+      });
+  cached.batch_size = batch_size;
+  cached.tensors = {
+      Tensor(DT_FLOAT, TensorShape({batch_size, kN, kN, kNumStoneFeatures}))};
+  cached.last_used = lru_clock_;
+  return &cached.tensors;
 }
 
 void TfDualNet::RunMany(absl::Span<const BoardFeatures> features,
                         absl::Span<Output> outputs, std::string* model) {
   MG_DCHECK(features.size() == outputs.size());
 
+  // Copy the features into the input tensor. The tensor is only read by the
+  // run, and we keep a reference to it, so TensorFlow never forwards its
+  // buffer to an output and it can be reused by the next run.
   int batch_size = static_cast<int>(features.size());
-  auto& feature_tensor = inputs_[0].second;
-  if (feature_tensor.dim_size(0) != batch_size) {
-    feature_tensor =
-        Tensor(DT_FLOAT, TensorShape({batch_size, kN, kN, kNumStoneFeatures}));
-  }
-
-  // Copy the features into the input tensor.
-  memcpy(feature_tensor.flat<float>().data(), features.data(),
+  auto* inputs = GetInputs(batch_size);
+  memcpy((*inputs)[0].flat<float>().data(), features.data(),
          features.size() * sizeof(BoardFeatures));
 
   // Run the model.
-  TF_CHECK_OK(session_->Run(inputs_, output_names_, {}, &outputs_));
+  model_->Run(*inputs, &outputs_);
 
-  // Copy the policy and value out of the output tensors.
-  const auto& policy_tensor = outputs_[0].flat<float>();
-  const auto& value_tensor = outputs_[1].flat<float>();
+  // Copy the policy and value out of the output tensors. TensorFlow allocates
+  // the fetched tensors itself, so they can't alias `outputs`.
+  const float* policy = outputs_[0].flat<float>().data();
+  const float* value = outputs_[1].flat<float>().data();
   for (int i = 0; i < batch_size; ++i) {
-    memcpy(outputs[i].policy.data(), policy_tensor.data() + i * kNumMoves,
+    memcpy(outputs[i].policy.data(), policy + i * kNumMoves,
            sizeof(outputs[i].policy));
-    outputs[i].value = value_tensor.data()[i];
+    outputs[i].value = value[i];
   }
 
   if (model != nullptr) {
-    *model = graph_path_;
+    *model = model_->graph_path();
   }
 }
 
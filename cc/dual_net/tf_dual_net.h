@@ -15,9 +15,9 @@
 #ifndef CC_DUAL_NET_TF_DUAL_NET_H_
 #define CC_DUAL_NET_TF_DUAL_NET_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "absl/types/span.h"
@@ -28,20 +28,82 @@
 
 namespace minigo {
 
+// Runs inference with a frozen TensorFlow graph. Session::RunCallable is
+// thread safe, so TfDualNets can share a Model, and with it the graph, its
+// weights and the executors that run it.
 class TfDualNet : public DualNet {
  public:
+  // A frozen graph loaded into a session, along with a callable that feeds it
+  // the features and fetches the policy and value. Running a callable skips
+  // the lookup of the feeds and fetches by name that Session::Run does on
+  // every call.
+  class Model {
+   public:
+    Model(std::unique_ptr<tensorflow::Session> session,
+          std::string graph_path);
+    ~Model();
+
+    // `inputs` holds the feature tensor, `outputs` receives the policy and
+    // value tensors.
+    void Run(const std::vector<tensorflow::Tensor>& inputs,
+             std::vector<tensorflow::Tensor>* outputs) const;
+
+    tensorflow::Session* session() const { return session_.get(); }
+    const std::string& graph_path() const { return graph_path_; }
+
+   private:
+    std::unique_ptr<tensorflow::Session> session_;
+    tensorflow::Session::CallableHandle callable_;
+    std::string graph_path_;
+  };
+
+  // Loads the frozen graph at `graph_path`, or at `graph_path` + ".pb" if
+  // that doesn't exist. The model is run once before it is returned, because
+  // TensorFlow lazily initializes the callable on the first run, which can
+  // take hundreds of milliseconds and would interfere with time control.
+  //
+  // The thread counts size TensorFlow's intra-op and inter-op thread pools.
+  // These pools are shared by all sessions in the process and are created
+  // along with the first session, so only the first session's thread counts
+  // take effect. Zero lets TensorFlow choose.
+  static std::shared_ptr<const Model> LoadModel(const std::string& graph_path,
+                                                int intra_op_threads,
+                                                int inter_op_threads);
+
+  // Like LoadModel, but returns null and sets `error` if the graph can't be
+  // read or imported, instead of dying.
+  static std::shared_ptr<const Model> TryLoadModel(
+      const std::string& graph_path, int intra_op_threads,
+      int inter_op_threads, std::string* error);
+
+  // Creates a DualNet with a model of its own.
   explicit TfDualNet(const std::string& graph_path);
+
+  explicit TfDualNet(std::shared_ptr<const Model> model);
+
   ~TfDualNet() override;
 
   void RunMany(absl::Span<const BoardFeatures> features,
                absl::Span<Output> outputs, std::string* model) override;
 
  private:
-  std::unique_ptr<tensorflow::Session> session_;
-  std::vector<std::pair<std::string, tensorflow::Tensor>> inputs_;
-  std::vector<std::string> output_names_;
+  // Feature tensors are cached for this many batch sizes.
+  static constexpr int kMaxCachedBatchSizes = 8;
+
+  struct CachedInput {
+    int batch_size;
+    std::vector<tensorflow::Tensor> tensors;
+    int64_t last_used;
+  };
+
+  // Returns the inputs to feed for `batch_size` features, allocating them
+  // only the first time a batch size is seen.
+  std::vector<tensorflow::Tensor>* GetInputs(int batch_size);
+
+  std::shared_ptr<const Model> model_;
+  std::vector<CachedInput> cached_inputs_;
+  int64_t lru_clock_ = 0;
   std::vector<tensorflow::Tensor> outputs_;
-  std::string graph_path_;
 };
 
 }  // namespace minigo
@@ -0,0 +1,116 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the per-call overhead of TfDualNet at selfplay's batch size, by
+// comparing RunMany, which runs a callable on preallocated inputs, with a
+// Session::Run that looks up the feeds and fetches by name and allocates a new
+// input tensor every call, e.g.:
+//
+//   tf_dual_net_benchmark --model=model.pb --benchmark_repetitions=5
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "cc/check.h"
+#include "cc/constants.h"
+#include "cc/dual_net/tf_dual_net.h"
+#include "cc/init.h"
+#include "cc/random.h"
+#include "gflags/gflags.h"
+#include "tensorflow/core/lib/core/status.h"
+
+using tensorflow::DT_FLOAT;
+using tensorflow::Tensor;
+using tensorflow::TensorShape;
+
+DEFINE_string(model, "", "Path to the frozen graph to benchmark.");
+
+namespace minigo {
+namespace {
+
+// Loaded once in main and shared by all benchmarks, as selfplay shares it
+// between games.
+std::shared_ptr<const TfDualNet::Model> shared_model;
+
+std::vector<DualNet::BoardFeatures> RandomFeatures(int batch_size) {
+  Random rnd(1);
+  std::vector<DualNet::BoardFeatures> features(batch_size);
+  for (auto& board : features) {
+    for (auto& x : board) {
+      x = rnd() < 0.5 ? 1 : 0;
+    }
+  }
+  return features;
+}
+
+void BM_SessionRun(benchmark::State& state) {  // NOLINT(runtime/references)
+  int batch_size = state.range(0);
+  auto features = RandomFeatures(batch_size);
+  std::vector<DualNet::Output> outputs(batch_size);
+  std::vector<std::string> output_names = {"policy_output", "value_output"};
+  std::vector<Tensor> output_tensors;
+  auto* session = shared_model->session();
+  for (auto _ : state) {
+    std::vector<std::pair<std::string, Tensor>> inputs = {
+        {"pos_tensor",
+         Tensor(DT_FLOAT, TensorShape({batch_size, kN, kN,
+                                       DualNet::kNumStoneFeatures}))}};
+    memcpy(inputs[0].second.flat<float>().data(), features.data(),
+           features.size() * sizeof(DualNet::BoardFeatures));
+    TF_CHECK_OK(session->Run(inputs, output_names, {}, &output_tensors));
+    const float* policy = output_tensors[0].flat<float>().data();
+    const float* value = output_tensors[1].flat<float>().data();
+    for (int i = 0; i < batch_size; ++i) {
+      memcpy(outputs[i].policy.data(), policy + i * kNumMoves,
+             sizeof(outputs[i].policy));
+      outputs[i].value = value[i];
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+void BM_RunMany(benchmark::State& state) {  // NOLINT(runtime/references)
+  int batch_size = state.range(0);
+  auto features = RandomFeatures(batch_size);
+  std::vector<DualNet::Output> outputs(batch_size);
+  TfDualNet dual_net(shared_model);
+  for (auto _ : state) {
+    dual_net.RunMany(features, absl::MakeSpan(outputs), nullptr);
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+BENCHMARK(BM_SessionRun)->Arg(8);
+BENCHMARK(BM_RunMany)->Arg(8);
+
+void RunBenchmarks() {
+  MG_CHECK(!FLAGS_model.empty()) << "--model must be set";
+  shared_model = TfDualNet::LoadModel(FLAGS_model, 0, 0);
+  benchmark::RunSpecifiedBenchmarks();
+  shared_model.reset();
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  benchmark::Initialize(&argc, argv);
+  minigo::Init(&argc, &argv);
+  minigo::RunBenchmarks();
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/eval_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+#include "absl/strings/str_cat.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+namespace {
+
+// Returns e.g. "58.0% (48.2% - 67.2%)".
+std::string FormatWinRate(double wins, int games) {
+  if (games == 0) {
+    return "-";
+  }
+  auto interval = WilsonInterval(wins, games);
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1) << 100 * wins / games << "% ("
+      << 100 * interval.lower << "% - " << 100 * interval.upper << "%)";
+  return oss.str();
+}
+
+}  // namespace
+
+Interval WilsonInterval(double wins, int games, double z) {
+  if (games == 0) {
+    return {0, 1};
+  }
+  double n = games;
+  double p = wins / n;
+  double z2 = z * z;
+  double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+  double half_width =
+      z * std::sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+  return {std::max(0.0, center - half_width),
+          std::min(1.0, center + half_width)};
+}
+
+void MatchResults::AddGame(bool a_is_black, float result) {
+  int i = a_is_black ? 0 : 1;
+  black_games_[i] += 1;
+  if (result > 0) {
+    black_wins_[i] += 1;
+  } else if (result == 0) {
+    black_wins_[i] += 0.5;
+  }
+}
+
+std::string MatchResults::ToString(const std::string& a_name,
+                                   const std::string& b_name) const {
+  return absl::StrCat(
+      a_name, " vs ", b_name, ": ", num_games(), " games\n",
+      a_name, " wins ", FormatWinRate(a_wins(), num_games()), "\n",
+      "  as black ", a_black_wins(), "/", a_black_games(), " ",
+      FormatWinRate(a_black_wins(), a_black_games()), "\n",
+      "  as white ", a_white_wins(), "/", a_white_games(), " ",
+      FormatWinRate(a_white_wins(), a_white_games()), "\n",
+      "black wins ", FormatWinRate(black_wins(), num_games()), "\n");
+}
+
+std::vector<double> FitBradleyTerry(
+    const std::vector<std::vector<double>>& wins) {
+  // The minorization-maximization algorithm of Hunter, "MM algorithms for
+  // generalized Bradley-Terry models", 2004: each model's strength is
+  // repeatedly set to its number of wins divided by the number of games it
+  // would have been expected to win against each opponent, per unit of its
+  // own strength. The virtual draw against an opponent of strength 1 adds
+  // half a win and one game.
+  int n = static_cast<int>(wins.size());
+  std::vector<double> total_wins(n);
+  for (int i = 0; i < n; ++i) {
+    MG_CHECK(static_cast<int>(wins[i].size()) == n);
+    total_wins[i] = std::accumulate(wins[i].begin(), wins[i].end(), 0.5);
+  }
+
+  std::vector<double> strengths(n, 1.0);
+  std::vector<double> next(n);
+  for (int iteration = 0; iteration < 10000; ++iteration) {
+    double max_change = 0;
+    for (int i = 0; i < n; ++i) {
+      double expected = 1 / (strengths[i] + 1);
+      for (int j = 0; j < n; ++j) {
+        if (j != i) {
+          expected += (wins[i][j] + wins[j][i]) / (strengths[i] + strengths[j]);
+        }
+      }
+      next[i] = total_wins[i] / expected;
+      max_change =
+          std::max(max_change, std::abs(std::log(next[i] / strengths[i])));
+    }
+    strengths.swap(next);
+    if (max_change < 1e-10) {
+      break;
+    }
+  }
+
+  std::vector<double> ratings(n);
+  for (int i = 0; i < n; ++i) {
+    ratings[i] = 400 * std::log10(strengths[i]);
+  }
+  double mean = std::accumulate(ratings.begin(), ratings.end(), 0.0) / n;
+  for (auto& rating : ratings) {
+    rating -= mean;
+  }
+  return ratings;
+}
+
+TournamentResults::TournamentResults(int num_models)
+    : wins_(num_models, std::vector<double>(num_models, 0)) {}
+
+void TournamentResults::AddGame(int black, int white, float result) {
+  MG_CHECK(black != white);
+  num_games_ += 1;
+  if (result > 0) {
+    wins_[black][white] += 1;
+  } else if (result < 0) {
+    wins_[white][black] += 1;
+  } else {
+    wins_[black][white] += 0.5;
+    wins_[white][black] += 0.5;
+  }
+}
+
+std::string TournamentResults::ToString(
+    const std::vector<std::string>& names) const {
+  MG_CHECK(static_cast<int>(names.size()) == num_models());
+  auto ratings = EloRatings();
+  std::vector<int> order(num_models());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int a, int b) { return ratings[a] > ratings[b]; });
+  size_t width = 6;
+  for (const auto& name : names) {
+    width = std::max(width, name.size());
+  }
+
+  std::ostringstream oss;
+  oss << num_models() << " models, " << num_games() << " games\n";
+  oss << std::setw(4) << "rank" << std::setw(8) << "elo" << std::setw(7)
+      << "games" << "  " << std::setw(26) << std::left << "win rate"
+      << "model\n"
+      << std::right;
+  for (int rank = 0; rank < num_models(); ++rank) {
+    int i = order[rank];
+    double num_wins = 0;
+    int num_games = 0;
+    for (int j = 0; j < num_models(); ++j) {
+      num_wins += wins_[i][j];
+      num_games += static_cast<int>(std::round(wins_[i][j] + wins_[j][i]));
+    }
+    oss << std::setw(4) << rank + 1 << std::setw(8) << std::showpos
+        << static_cast<int>(std::round(ratings[i])) << std::noshowpos
+        << std::setw(7) << num_games << "  " << std::setw(26) << std::left
+        << FormatWinRate(num_wins, num_games) << names[i] << "\n"
+        << std::right;
+  }
+
+  // The wins of each row's model against each column's model.
+  oss << "\n" << std::setw(width) << "";
+  for (int i : order) {
+    oss << " " << std::setw(width) << names[i];
+  }
+  oss << "\n";
+  for (int i : order) {
+    oss << std::setw(width) << names[i];
+    for (int j : order) {
+      if (i == j) {
+        oss << " " << std::setw(width) << "-";
+      } else {
+        oss << " " << std::setw(width)
+            << absl::StrCat(wins_[i][j], "/", wins_[i][j] + wins_[j][i]);
+      }
+    }
+    oss << "\n";
+  }
+  return oss.str();
+}
+
+}  // namespace minigo
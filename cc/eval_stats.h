@@ -0,0 +1,115 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_EVAL_STATS_H_
+#define CC_EVAL_STATS_H_
+
+#include <string>
+#include <vector>
+
+namespace minigo {
+
+// A confidence interval for a win rate.
+struct Interval {
+  double lower;
+  double upper;
+};
+
+// Returns the Wilson score interval for the win rate of `wins` wins in `games`
+// games, where `z` is the number of standard deviations for the desired
+// confidence: 1.96 for 95%. Unlike the normal approximation, the interval
+// stays within [0, 1] and is sensible for small numbers of games and win
+// rates close to 0 or 1. Draws may be counted as half a win.
+Interval WilsonInterval(double wins, int games, double z = 1.96);
+
+// The results of games between two models, A and B.
+class MatchResults {
+ public:
+  // Records a game that A played as black if `a_is_black`. `result` is the
+  // result from black's perspective, as returned by MctsPlayer::result(): +1
+  // if black won, -1 if white won, and 0 for a draw, which counts as half a
+  // win for each side.
+  void AddGame(bool a_is_black, float result);
+
+  int num_games() const { return black_games_[0] + black_games_[1]; }
+
+  // The number of wins of A: overall, as black and as white.
+  double a_wins() const { return a_black_wins() + a_white_wins(); }
+  double a_black_wins() const { return black_wins_[0]; }
+  double a_white_wins() const { return black_games_[1] - black_wins_[1]; }
+
+  // The number of games that A played as black and as white.
+  int a_black_games() const { return black_games_[0]; }
+  int a_white_games() const { return black_games_[1]; }
+
+  // The number of wins of black, whichever model played it.
+  double black_wins() const { return black_wins_[0] + black_wins_[1]; }
+
+  // Returns a summary of the win rates with 95% confidence intervals, e.g.:
+  //   000010 vs 000009: 100 games
+  //   000010 wins 58.0% (48.2% - 67.2%)
+  //     as black 30/50 60.0% (46.2% - 72.4%)
+  //     as white 28/50 56.0% (42.3% - 68.8%)
+  //   black wins 55.0% (45.2% - 64.4%)
+  std::string ToString(const std::string& a_name,
+                       const std::string& b_name) const;
+
+ private:
+  // Indexed by whether B played black: the number of games, and the number
+  // of games that black won.
+  int black_games_[2] = {0, 0};
+  double black_wins_[2] = {0, 0};
+};
+
+// Fits a Bradley-Terry model to the results of games between a set of models
+// and returns each model's rating on the Elo scale, where a difference of 400
+// means 10:1 odds of winning. `wins[i][j]` is the number of games that model i
+// won against model j, where a draw counts as half a win for each side. The
+// fit is regularized by one virtual draw of each model against an opponent
+// rated 0, so that the ratings of models that won all or none of their games
+// are finite. The ratings are shifted to average 0.
+std::vector<double> FitBradleyTerry(
+    const std::vector<std::vector<double>>& wins);
+
+// The results of games between each pair of a set of models.
+class TournamentResults {
+ public:
+  explicit TournamentResults(int num_models);
+
+  // Records a game between models `black` and `white`, where `result` is the
+  // result as for MatchResults::AddGame.
+  void AddGame(int black, int white, float result);
+
+  int num_models() const { return static_cast<int>(wins_.size()); }
+  int num_games() const { return num_games_; }
+
+  // The number of games that model `a` won against model `b`.
+  double wins(int a, int b) const { return wins_[a][b]; }
+
+  // Returns the models' ratings, fit by FitBradleyTerry.
+  std::vector<double> EloRatings() const { return FitBradleyTerry(wins_); }
+
+  // Returns a table of the models, best first, with their ratings and win
+  // rates, followed by a cross table of the wins of each model against each
+  // other model. `names` are the names of the models.
+  std::string ToString(const std::vector<std::string>& names) const;
+
+ private:
+  std::vector<std::vector<double>> wins_;
+  int num_games_ = 0;
+};
+
+}  // namespace minigo
+
+#endif  // CC_EVAL_STATS_H_
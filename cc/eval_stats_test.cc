@@ -0,0 +1,114 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/eval_stats.h"
+
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(EvalStatsTest, WilsonInterval) {
+  // Known values for 95% confidence.
+  auto interval = WilsonInterval(58, 100);
+  EXPECT_NEAR(0.4821, interval.lower, 1e-4);
+  EXPECT_NEAR(0.6720, interval.upper, 1e-4);
+
+  // The interval is sensible at the extremes.
+  interval = WilsonInterval(0, 10);
+  EXPECT_EQ(0, interval.lower);
+  EXPECT_NEAR(0.2775, interval.upper, 1e-4);
+  interval = WilsonInterval(10, 10);
+  EXPECT_NEAR(0.7225, interval.lower, 1e-4);
+  EXPECT_EQ(1, interval.upper);
+
+  // Without games, nothing is known.
+  interval = WilsonInterval(0, 0);
+  EXPECT_EQ(0, interval.lower);
+  EXPECT_EQ(1, interval.upper);
+}
+
+TEST(EvalStatsTest, MatchResults) {
+  MatchResults results;
+  results.AddGame(true, 1);    // A wins as black.
+  results.AddGame(true, -1);   // A loses as black.
+  results.AddGame(false, -1);  // A wins as white.
+  results.AddGame(false, -1);  // A wins as white.
+  results.AddGame(false, 0);   // Draw.
+
+  EXPECT_EQ(5, results.num_games());
+  EXPECT_EQ(2, results.a_black_games());
+  EXPECT_EQ(3, results.a_white_games());
+  EXPECT_EQ(1, results.a_black_wins());
+  EXPECT_EQ(2.5, results.a_white_wins());
+  EXPECT_EQ(3.5, results.a_wins());
+  EXPECT_EQ(1.5, results.black_wins());
+
+  auto str = results.ToString("a", "b");
+  EXPECT_EQ(0u, str.find("a vs b: 5 games\na wins 70.0% ("));
+  EXPECT_NE(std::string::npos, str.find("  as black 1/2 50.0% ("));
+  EXPECT_NE(std::string::npos, str.find("  as white 2.5/3 83.3% ("));
+  EXPECT_NE(std::string::npos, str.find("black wins 30.0% ("));
+}
+
+TEST(EvalStatsTest, FitBradleyTerry) {
+  // Winning 3 games in 4 is a difference of 400 * log10(3) = 190.8 Elo. With
+  // many games, the virtual draws barely change that.
+  auto ratings = FitBradleyTerry({{0, 7500}, {2500, 0}});
+  ASSERT_EQ(2, ratings.size());
+  EXPECT_NEAR(190.8, ratings[0] - ratings[1], 0.5);
+  EXPECT_NEAR(0, ratings[0] + ratings[1], 1e-6);
+
+  // Evenly matched models are rated the same.
+  ratings = FitBradleyTerry({{0, 5, 5}, {5, 0, 5}, {5, 5, 0}});
+  for (double rating : ratings) {
+    EXPECT_NEAR(0, rating, 1e-6);
+  }
+
+  // Ratings are finite even for models that won all or none of their games,
+  // and ordered by strength.
+  ratings = FitBradleyTerry({{0, 10, 10}, {0, 0, 6}, {0, 4, 0}});
+  EXPECT_GT(ratings[0], ratings[1]);
+  EXPECT_GT(ratings[1], ratings[2]);
+  EXPECT_LT(ratings[0], 1000);
+  EXPECT_GT(ratings[2], -1000);
+}
+
+TEST(EvalStatsTest, TournamentResults) {
+  TournamentResults results(3);
+  results.AddGame(0, 1, 1);   // 0 beats 1.
+  results.AddGame(1, 0, 1);   // 1 beats 0.
+  results.AddGame(2, 0, -1);  // 0 beats 2.
+  results.AddGame(1, 2, 0);   // Draw.
+
+  EXPECT_EQ(4, results.num_games());
+  EXPECT_EQ(2, results.wins(0, 1) + results.wins(1, 0));
+  EXPECT_EQ(1, results.wins(0, 2));
+  EXPECT_EQ(0, results.wins(2, 0));
+  EXPECT_EQ(0.5, results.wins(1, 2));
+  EXPECT_EQ(0.5, results.wins(2, 1));
+
+  auto ratings = results.EloRatings();
+  EXPECT_GT(ratings[0], ratings[1]);
+  EXPECT_GT(ratings[1], ratings[2]);
+
+  auto str = results.ToString({"a", "b", "c"});
+  EXPECT_EQ(0u, str.find("3 models, 4 games\n"));
+  EXPECT_NE(std::string::npos, str.find("   1     +75      3  66.7% ("));
+  EXPECT_NE(std::string::npos, str.find("   3     -91      2  25.0% ("));
+  EXPECT_NE(std::string::npos, str.find("     b    1/2      -  0.5/1\n"));
+}
+
+}  // namespace
+}  // namespace minigo
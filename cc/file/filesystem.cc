@@ -14,9 +14,12 @@
 
 #include "cc/file/filesystem.h"
 
+#include <dirent.h>
 #include <sys/stat.h>
 #include <cerrno>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/strings/match.h"
 #include "cc/file/path.h"
@@ -71,5 +74,32 @@ bool RecursivelyCreateDir(absl::string_view path) {
   return MaybeCreateDir(path_str);
 }
 
+bool ListDir(absl::string_view path, std::vector<std::string>* files) {
+  std::string path_str(path);
+  DIR* dir = opendir(path_str.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  files->clear();
+  while (struct dirent* entry = readdir(dir)) {
+    std::string name(entry->d_name);
+    if (name != "." && name != "..") {
+      files->push_back(std::move(name));
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+bool GetFileSize(absl::string_view path, uint64_t* size) {
+  std::string path_str(path);
+  struct stat st;
+  if (stat(path_str.c_str(), &st) != 0) {
+    return false;
+  }
+  *size = st.st_size;
+  return true;
+}
+
 }  // namespace file
 }  // namespace minigo
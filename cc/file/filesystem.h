@@ -15,6 +15,10 @@
 #ifndef CC_FILE_FILESYSTEM_H_
 #define CC_FILE_FILESYSTEM_H_
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "absl/strings/string_view.h"
 
 namespace minigo {
@@ -23,6 +27,15 @@ namespace file {
 __attribute__((warn_unused_result)) bool RecursivelyCreateDir(
     absl::string_view path);
 
+// Lists the names of the entries in the local directory `path`, excluding "."
+// and "..".
+__attribute__((warn_unused_result)) bool ListDir(
+    absl::string_view path, std::vector<std::string>* files);
+
+// Gets the size in bytes of the local file `path`.
+__attribute__((warn_unused_result)) bool GetFileSize(absl::string_view path,
+                                                     uint64_t* size);
+
 }  // namespace file
 }  // namespace minigo
 
@@ -0,0 +1,245 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/game_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+class GameScheduler::ScheduledDualNet : public DualNet {
+ public:
+  ScheduledDualNet(std::unique_ptr<DualNet> impl, GameScheduler* scheduler)
+      : impl_(std::move(impl)), scheduler_(scheduler) {}
+
+  void RunMany(absl::Span<const BoardFeatures> features,
+               absl::Span<Output> outputs, std::string* model) override {
+    scheduler_->BeginInference();
+    impl_->RunMany(features, outputs, model);
+    scheduler_->EndInference(features.size());
+  }
+
+ private:
+  std::unique_ptr<DualNet> impl_;
+  GameScheduler* scheduler_;
+};
+
+GameScheduler::GameScheduler(const Options& options)
+    : options_(options),
+      target_(options.min_games),
+      previous_target_(options.min_games),
+      saturated_target_(options.max_games + 1) {
+  MG_CHECK(options_.min_games > 0);
+  MG_CHECK(options_.min_games <= options_.max_games);
+
+  interval_start_ = absl::Now();
+  last_update_ = interval_start_;
+
+  target_games_ = metrics_.GetGauge("scheduler/target_games");
+  running_games_ = metrics_.GetGauge("scheduler/running_games");
+  utilization_ = metrics_.GetGauge("scheduler/inference_utilization");
+  batch_fill_ = metrics_.GetGauge("scheduler/batch_fill_pct");
+  target_games_->Set(target_);
+
+  if (options_.engine_metrics != nullptr) {
+    engine_queue_depth_ =
+        options_.engine_metrics->GetGauge("inference/queue_depth");
+    engine_batch_fill_ =
+        options_.engine_metrics->GetHistogram("inference/batch_fill_pct");
+    batch_fill_count_ = engine_batch_fill_->count();
+    batch_fill_sum_ = engine_batch_fill_->sum();
+  }
+
+  if (options_.interval > absl::ZeroDuration()) {
+    thread_ = std::thread(&GameScheduler::ThreadRun, this);
+  }
+}
+
+GameScheduler::~GameScheduler() {
+  stop_.Notify();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::unique_ptr<DualNet> GameScheduler::WrapDualNet(
+    std::unique_ptr<DualNet> dual_net) {
+  return absl::make_unique<ScheduledDualNet>(std::move(dual_net), this);
+}
+
+void GameScheduler::StartGame() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(this, &GameScheduler::can_start));
+  num_running_ += 1;
+  running_games_->Set(num_running_);
+}
+
+bool GameScheduler::TryStartGame() {
+  absl::MutexLock lock(&mutex_);
+  if (!can_start()) {
+    return false;
+  }
+  num_running_ += 1;
+  running_games_->Set(num_running_);
+  return true;
+}
+
+void GameScheduler::FinishGame() {
+  absl::MutexLock lock(&mutex_);
+  MG_CHECK(num_running_ > 0);
+  num_running_ -= 1;
+  running_games_->Set(num_running_);
+}
+
+int GameScheduler::target_games() const {
+  absl::MutexLock lock(&mutex_);
+  return target_;
+}
+
+void GameScheduler::Adjust(const Stats& stats) {
+  absl::MutexLock lock(&mutex_);
+  utilization_->Set(std::lround(100 * stats.utilization));
+  if (stats.batch_fill >= 0) {
+    batch_fill_->Set(std::lround(100 * stats.batch_fill));
+  }
+
+  if (saturated_intervals_ > 0) {
+    saturated_intervals_ -= 1;
+  }
+
+  // Inference has room for more games if it's idle too often, or if the
+  // engine runs batches that are less full than they could be.
+  bool underused =
+      stats.utilization < options_.target_utilization ||
+      (stats.batch_fill >= 0 && stats.batch_fill < options_.target_batch_fill);
+
+  int target = target_;
+  int step = std::max(1, target_ / 4);
+  if (added_games_ && stats.positions_per_second <
+                          previous_rate_ * (1 + options_.min_gain)) {
+    // The games added by the last adjustment didn't help: inference is as
+    // fast as it gets.
+    saturated_target_ = target_;
+    saturated_intervals_ = kSaturatedIntervals;
+    target = previous_target_;
+  } else if (options_.max_queue_depth > 0 &&
+             stats.queue_depth > options_.max_queue_depth) {
+    target -= step;
+  } else if (underused) {
+    target += step;
+    if (saturated_intervals_ > 0) {
+      target = std::min(target, saturated_target_ - 1);
+    }
+  }
+  target = std::max(options_.min_games, std::min(options_.max_games, target));
+
+  added_games_ = target > target_;
+  previous_target_ = target_;
+  previous_rate_ = stats.positions_per_second;
+  target_ = target;
+  target_games_->Set(target_);
+}
+
+GameScheduler::Stats GameScheduler::CollectStats() {
+  absl::MutexLock lock(&inference_mutex_);
+  auto now = absl::Now();
+  AdvanceClock(now);
+
+  Stats stats;
+  auto elapsed = now - interval_start_;
+  if (elapsed > absl::ZeroDuration()) {
+    stats.utilization = absl::FDivDuration(busy_time_, elapsed);
+    stats.queue_depth = absl::FDivDuration(
+        engine_queue_depth_ != nullptr ? engine_queue_time_ : inference_time_,
+        elapsed);
+    stats.positions_per_second =
+        num_positions_ / absl::ToDoubleSeconds(elapsed);
+  }
+  if (num_inferences_ > 0) {
+    stats.batch_size = static_cast<double>(num_positions_) / num_inferences_;
+  }
+  if (engine_batch_fill_ != nullptr) {
+    int64_t count = engine_batch_fill_->count();
+    int64_t sum = engine_batch_fill_->sum();
+    if (count > batch_fill_count_) {
+      stats.batch_fill =
+          (sum - batch_fill_sum_) / (100.0 * (count - batch_fill_count_));
+    }
+    batch_fill_count_ = count;
+    batch_fill_sum_ = sum;
+  }
+
+  interval_start_ = now;
+  busy_time_ = absl::ZeroDuration();
+  inference_time_ = absl::ZeroDuration();
+  engine_queue_time_ = absl::ZeroDuration();
+  num_inferences_ = 0;
+  num_positions_ = 0;
+  return stats;
+}
+
+void GameScheduler::BeginInference() {
+  absl::MutexLock lock(&inference_mutex_);
+  AdvanceClock(absl::Now());
+  num_inferences_running_ += 1;
+}
+
+void GameScheduler::EndInference(int num_positions) {
+  absl::MutexLock lock(&inference_mutex_);
+  AdvanceClock(absl::Now());
+  num_inferences_running_ -= 1;
+  num_inferences_ += 1;
+  num_positions_ += num_positions;
+}
+
+void GameScheduler::AdvanceClock(absl::Time now) {
+  auto elapsed = now - last_update_;
+  if (num_inferences_running_ > 0) {
+    busy_time_ += elapsed;
+    inference_time_ += elapsed * num_inferences_running_;
+  }
+  if (engine_queue_depth_ != nullptr) {
+    // Sampled whenever an inference starts or ends, which is often enough to
+    // average the batcher's queue depth over the interval.
+    engine_queue_time_ += elapsed * engine_queue_depth_->value();
+  }
+  last_update_ = now;
+}
+
+void GameScheduler::ThreadRun() {
+  while (!stop_.WaitForNotificationWithTimeout(options_.interval)) {
+    auto stats = CollectStats();
+    int old_target = target_games();
+    Adjust(stats);
+    std::cerr << "Game scheduler: inference utilization "
+              << std::lround(100 * stats.utilization) << "%, queue depth "
+              << stats.queue_depth << ", batch size " << stats.batch_size;
+    if (stats.batch_fill >= 0) {
+      std::cerr << ", batch fill " << std::lround(100 * stats.batch_fill)
+                << "%";
+    }
+    std::cerr << ", " << std::lround(stats.positions_per_second)
+              << " positions/s, games " << old_target << " -> "
+              << target_games() << std::endl;
+  }
+}
+
+}  // namespace minigo
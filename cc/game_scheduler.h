@@ -0,0 +1,204 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_GAME_SCHEDULER_H_
+#define CC_GAME_SCHEDULER_H_
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/metrics.h"
+
+namespace minigo {
+
+// Decides how many selfplay games to play at once, so that there are enough
+// games to keep the inference engine busy but no more than it can keep up
+// with.
+//
+// The scheduler measures the inferences of the DualNets it wraps. Every
+// interval, it compares how busy inference was with the target utilization:
+// while inference is idle too often, it raises the number of games. Engines
+// that batch the inferences of many DualNets together (the remote engine) keep
+// their clients waiting for a batch even when the engine itself is idle, so
+// that utilization is always close to 100%. For those, the scheduler also
+// reads how full the engine's batches were from its inference batcher's
+// metrics, and raises the number of games while the batches aren't full
+// enough. If raising it didn't raise the number of positions evaluated per
+// second, the engine is saturated, so it goes back to the previous number and
+// doesn't try to raise it again for a while. If inferences queue up behind
+// each other, it lowers the number of games.
+//
+// Game threads call StartGame before and FinishGame after each game; games
+// over the target wait for a running game to finish.
+class GameScheduler {
+ public:
+  struct Options {
+    // Bounds on the number of games played at once. The scheduler starts at
+    // min_games.
+    int min_games = 1;
+    int max_games = 1;
+
+    // Games are added while inference runs for less than this fraction of the
+    // time.
+    float target_utilization = 0.95;
+
+    // The metrics of the engine's inference batcher, as returned by
+    // DualNetFactory::metrics, or null if the engine doesn't batch the
+    // inferences of its DualNets.
+    MetricsRegistry* engine_metrics = nullptr;
+
+    // If engine_metrics is set, games are also added while the engine's
+    // batches are filled to less than this fraction of their size on average.
+    float target_batch_fill = 0.9;
+
+    // If non-zero, games are removed while more than this many inferences
+    // run at once on average. If engine_metrics is set, the inferences
+    // waiting to be batched are counted instead, since all the inferences of
+    // a batch always run at once.
+    float max_queue_depth = 0;
+
+    // Games that were added are removed again unless the number of positions
+    // evaluated per second rose by at least this fraction.
+    float min_gain = 0.05;
+
+    // How often the number of games is adjusted. If zero, it is only
+    // adjusted by calls to Adjust.
+    absl::Duration interval = absl::Seconds(10);
+  };
+
+  // Inference statistics over one interval.
+  struct Stats {
+    // Fraction of the time that at least one inference was running.
+    double utilization = 0;
+
+    // Average number of inferences running at once, or waiting to be batched
+    // if the engine reports its metrics.
+    double queue_depth = 0;
+
+    // Average number of positions per inference.
+    double batch_size = 0;
+
+    // Average fraction of the engine's batch size that its batches filled, or
+    // -1 if the engine doesn't report it or ran no batches.
+    double batch_fill = -1;
+
+    double positions_per_second = 0;
+  };
+
+  // The number of intervals that the scheduler waits after finding that the
+  // engine is saturated before trying to add games again.
+  static constexpr int kSaturatedIntervals = 10;
+
+  explicit GameScheduler(const Options& options);
+  ~GameScheduler();
+
+  // Returns a DualNet that forwards to `dual_net` and measures its
+  // inferences. The returned DualNet must not outlive the scheduler.
+  std::unique_ptr<DualNet> WrapDualNet(std::unique_ptr<DualNet> dual_net);
+
+  // Blocks until fewer games than the target are running, then counts a new
+  // game as running.
+  void StartGame();
+
+  // Counts a new game as running if fewer games than the target are running
+  // and returns true. Otherwise returns false.
+  bool TryStartGame();
+
+  // Counts a game started by StartGame or TryStartGame as finished.
+  void FinishGame();
+
+  // The target number of games to run at once.
+  int target_games() const LOCKS_EXCLUDED(&mutex_);
+
+  // Updates the target number of games from the inference statistics of the
+  // last interval. Called every interval by a background thread.
+  void Adjust(const Stats& stats) LOCKS_EXCLUDED(&mutex_);
+
+  // Returns the inference statistics since the last call and starts a new
+  // interval.
+  Stats CollectStats() LOCKS_EXCLUDED(&inference_mutex_);
+
+  // Gauges of the target and running number of games, and of the inference
+  // utilization and batch fill in percent.
+  MetricsRegistry* metrics() { return &metrics_; }
+
+ private:
+  class ScheduledDualNet;
+
+  // Called by ScheduledDualNet around each inference.
+  void BeginInference() LOCKS_EXCLUDED(&inference_mutex_);
+  void EndInference(int num_positions) LOCKS_EXCLUDED(&inference_mutex_);
+
+  // Accumulates the busy time up to `now`.
+  void AdvanceClock(absl::Time now) EXCLUSIVE_LOCKS_REQUIRED(&inference_mutex_);
+
+  void ThreadRun();
+
+  bool can_start() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return num_running_ < target_;
+  }
+
+  const Options options_;
+
+  mutable absl::Mutex mutex_;
+  int target_ GUARDED_BY(&mutex_);
+  int num_running_ GUARDED_BY(&mutex_) = 0;
+
+  // The target before the last adjustment, whether the last adjustment added
+  // games, and the throughput before the last adjustment.
+  int previous_target_ GUARDED_BY(&mutex_);
+  bool added_games_ GUARDED_BY(&mutex_) = false;
+  double previous_rate_ GUARDED_BY(&mutex_) = 0;
+
+  // Once adding games is found not to help, the target stays below
+  // `saturated_target_` for kSaturatedIntervals intervals.
+  int saturated_target_ GUARDED_BY(&mutex_);
+  int saturated_intervals_ GUARDED_BY(&mutex_) = 0;
+
+  absl::Mutex inference_mutex_;
+  absl::Time interval_start_ GUARDED_BY(&inference_mutex_);
+  absl::Time last_update_ GUARDED_BY(&inference_mutex_);
+  int num_inferences_running_ GUARDED_BY(&inference_mutex_) = 0;
+  absl::Duration busy_time_ GUARDED_BY(&inference_mutex_);
+  absl::Duration inference_time_ GUARDED_BY(&inference_mutex_);
+  int64_t num_inferences_ GUARDED_BY(&inference_mutex_) = 0;
+  int64_t num_positions_ GUARDED_BY(&inference_mutex_) = 0;
+
+  // The engine's batcher metrics, if it reports them, and the batch fill
+  // histogram's count and sum at the start of the interval.
+  Gauge* engine_queue_depth_ = nullptr;
+  Histogram* engine_batch_fill_ = nullptr;
+  absl::Duration engine_queue_time_ GUARDED_BY(&inference_mutex_);
+  int64_t batch_fill_count_ GUARDED_BY(&inference_mutex_) = 0;
+  int64_t batch_fill_sum_ GUARDED_BY(&inference_mutex_) = 0;
+
+  MetricsRegistry metrics_;
+  Gauge* target_games_;
+  Gauge* running_games_;
+  Gauge* utilization_;
+  Gauge* batch_fill_;
+
+  absl::Notification stop_;
+  std::thread thread_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_GAME_SCHEDULER_H_
@@ -0,0 +1,198 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/game_scheduler.h"
+
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/notification.h"
+#include "cc/dual_net/fake_net.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+GameScheduler::Options MakeOptions(int min_games, int max_games) {
+  GameScheduler::Options options;
+  options.min_games = min_games;
+  options.max_games = max_games;
+  options.max_queue_depth = 2;
+  options.interval = absl::ZeroDuration();
+  return options;
+}
+
+GameScheduler::Stats MakeStats(double utilization, double queue_depth,
+                               double positions_per_second,
+                               double batch_fill = -1) {
+  GameScheduler::Stats stats;
+  stats.utilization = utilization;
+  stats.queue_depth = queue_depth;
+  stats.positions_per_second = positions_per_second;
+  stats.batch_fill = batch_fill;
+  return stats;
+}
+
+TEST(GameSchedulerTest, LimitsRunningGames) {
+  GameScheduler scheduler(MakeOptions(2, 8));
+  EXPECT_TRUE(scheduler.TryStartGame());
+  EXPECT_TRUE(scheduler.TryStartGame());
+  EXPECT_FALSE(scheduler.TryStartGame());
+
+  absl::Notification started;
+  std::thread thread([&]() {
+    scheduler.StartGame();
+    started.Notify();
+  });
+  EXPECT_FALSE(started.WaitForNotificationWithTimeout(absl::Milliseconds(50)));
+  scheduler.FinishGame();
+  thread.join();
+  EXPECT_TRUE(started.HasBeenNotified());
+  EXPECT_FALSE(scheduler.TryStartGame());
+  EXPECT_EQ(2, scheduler.metrics()->GetGauge("scheduler/running_games")
+                   ->value());
+}
+
+TEST(GameSchedulerTest, AddsGamesWhileInferenceIsIdle) {
+  GameScheduler scheduler(MakeOptions(4, 6));
+  EXPECT_EQ(4, scheduler.target_games());
+
+  scheduler.Adjust(MakeStats(0.5, 0.5, 100));
+  EXPECT_EQ(5, scheduler.target_games());
+  scheduler.Adjust(MakeStats(0.6, 0.6, 120));
+  EXPECT_EQ(6, scheduler.target_games());
+
+  // The number of games is capped at max_games.
+  scheduler.Adjust(MakeStats(0.7, 0.7, 140));
+  EXPECT_EQ(6, scheduler.target_games());
+
+  // Inference is busy enough.
+  scheduler.Adjust(MakeStats(0.98, 0.98, 140));
+  EXPECT_EQ(6, scheduler.target_games());
+}
+
+// Verify that games are added while the engine's batches aren't full enough,
+// even though its clients keep inference busy all the time.
+TEST(GameSchedulerTest, AddsGamesWhileBatchesAreUnderfilled) {
+  GameScheduler scheduler(MakeOptions(4, 16));
+  scheduler.Adjust(MakeStats(1, 1, 100, 0.25));
+  EXPECT_EQ(5, scheduler.target_games());
+  scheduler.Adjust(MakeStats(1, 1, 125, 0.3));
+  EXPECT_EQ(6, scheduler.target_games());
+  scheduler.Adjust(MakeStats(1, 1, 150, 0.4));
+  EXPECT_EQ(7, scheduler.target_games());
+
+  // The batches are full enough.
+  scheduler.Adjust(MakeStats(1, 1, 175, 0.95));
+  EXPECT_EQ(7, scheduler.target_games());
+
+  // Without a batch fill, saturated utilization means there are enough games.
+  scheduler.Adjust(MakeStats(1, 1, 175));
+  EXPECT_EQ(7, scheduler.target_games());
+}
+
+// Verify that games that don't raise the throughput are removed again, and
+// that the scheduler waits before adding them again.
+TEST(GameSchedulerTest, BacksOffWhenSaturated) {
+  GameScheduler scheduler(MakeOptions(1, 100));
+  scheduler.Adjust(MakeStats(0.5, 0.5, 100));
+  EXPECT_EQ(2, scheduler.target_games());
+  scheduler.Adjust(MakeStats(0.5, 0.5, 200));
+  EXPECT_EQ(3, scheduler.target_games());
+  scheduler.Adjust(MakeStats(0.5, 0.5, 202));
+  EXPECT_EQ(2, scheduler.target_games());
+
+  for (int i = 1; i < GameScheduler::kSaturatedIntervals; ++i) {
+    scheduler.Adjust(MakeStats(0.5, 0.5, 200));
+    EXPECT_EQ(2, scheduler.target_games());
+  }
+  scheduler.Adjust(MakeStats(0.5, 0.5, 200));
+  EXPECT_EQ(3, scheduler.target_games());
+}
+
+TEST(GameSchedulerTest, RemovesGamesWhileInferencesQueue) {
+  GameScheduler scheduler(MakeOptions(4, 16));
+  for (int i = 0; i < 4; ++i) {
+    scheduler.Adjust(MakeStats(0.5, 0.5, 100 * (i + 1)));
+  }
+  EXPECT_EQ(8, scheduler.target_games());
+
+  scheduler.Adjust(MakeStats(1, 3, 1000));
+  EXPECT_EQ(6, scheduler.target_games());
+  scheduler.Adjust(MakeStats(1, 3, 1000));
+  EXPECT_EQ(5, scheduler.target_games());
+  scheduler.Adjust(MakeStats(1, 3, 1000));
+  EXPECT_EQ(4, scheduler.target_games());
+  scheduler.Adjust(MakeStats(1, 3, 1000));
+  EXPECT_EQ(4, scheduler.target_games());
+}
+
+TEST(GameSchedulerTest, CollectStats) {
+  GameScheduler scheduler(MakeOptions(1, 1));
+  auto dual_net = scheduler.WrapDualNet(absl::make_unique<FakeNet>());
+  std::vector<DualNet::BoardFeatures> features(3);
+  std::vector<DualNet::Output> outputs(3);
+  for (int i = 0; i < 2; ++i) {
+    dual_net->RunMany(features, absl::MakeSpan(outputs), nullptr);
+  }
+
+  auto stats = scheduler.CollectStats();
+  EXPECT_EQ(3, stats.batch_size);
+  EXPECT_GT(stats.positions_per_second, 0);
+  EXPECT_GT(stats.utilization, 0);
+  EXPECT_LE(stats.utilization, 1);
+  EXPECT_LE(stats.queue_depth, 1);
+
+  EXPECT_EQ(-1, stats.batch_fill);
+
+  // Each call starts a new interval.
+  stats = scheduler.CollectStats();
+  EXPECT_EQ(0, stats.batch_size);
+  EXPECT_EQ(0, stats.positions_per_second);
+}
+
+TEST(GameSchedulerTest, CollectsEngineStats) {
+  MetricsRegistry engine_metrics;
+  auto* batch_fill = engine_metrics.GetHistogram("inference/batch_fill_pct");
+  auto* queue_depth = engine_metrics.GetGauge("inference/queue_depth");
+  // Batches run before the scheduler was created aren't counted.
+  batch_fill->Record(10);
+
+  auto options = MakeOptions(1, 1);
+  options.engine_metrics = &engine_metrics;
+  GameScheduler scheduler(options);
+  auto dual_net = scheduler.WrapDualNet(absl::make_unique<FakeNet>());
+  std::vector<DualNet::BoardFeatures> features(3);
+  std::vector<DualNet::Output> outputs(3);
+  queue_depth->Set(4);
+  dual_net->RunMany(features, absl::MakeSpan(outputs), nullptr);
+  batch_fill->Record(50);
+  batch_fill->Record(100);
+
+  auto stats = scheduler.CollectStats();
+  EXPECT_DOUBLE_EQ(0.75, stats.batch_fill);
+  EXPECT_GT(stats.queue_depth, 0);
+  EXPECT_LE(stats.queue_depth, 4);
+  scheduler.Adjust(stats);
+  EXPECT_EQ(75, scheduler.metrics()->GetGauge("scheduler/batch_fill_pct")
+                    ->value());
+
+  // No batches ran in the next interval.
+  stats = scheduler.CollectStats();
+  EXPECT_EQ(-1, stats.batch_fill);
+}
+
+}  // namespace
+}  // namespace minigo
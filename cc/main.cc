@@ -14,9 +14,11 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <thread>
 #include <utility>
@@ -34,21 +36,34 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "cc/async_writer.h"
 #include "cc/check.h"
+#include "cc/compact_game.h"
+#include "cc/compression.h"
 #include "cc/constants.h"
 #include "cc/dual_net/factory.h"
+#include "cc/eval_stats.h"
 #include "cc/file/filesystem.h"
 #include "cc/file/path.h"
+#include "cc/game_scheduler.h"
 #include "cc/gtp_player.h"
 #include "cc/init.h"
 #include "cc/mcts_player.h"
+#include "cc/metrics.h"
+#include "cc/position.h"
 #include "cc/random.h"
+#include "cc/search_executor.h"
+#include "cc/search_visits.h"
 #include "cc/sgf.h"
+#include "cc/sharded_example_writer.h"
 #include "cc/tf_utils.h"
+#include "cc/thread_affinity.h"
 #include "gflags/gflags.h"
 
 // Game options flags.
-DEFINE_string(mode, "", "Mode to run in: \"selfplay\", \"eval\" or \"gtp\"");
+DEFINE_string(mode, "",
+              "Mode to run in: \"selfplay\", \"eval\", \"tournament\" or "
+              "\"gtp\"");
 DEFINE_int32(
     ponder_limit, 0,
     "If non-zero and in GTP mode, the number times of times to perform tree "
@@ -110,7 +125,70 @@ DEFINE_string(model, "",
 DEFINE_string(model_two, "",
               "When running 'eval' mode, provide a path to a second minigo "
               "model, also serialized as a GraphDef proto.");
+DEFINE_string(tournament_models, "",
+              "When running 'tournament' mode, a comma separated list of "
+              "paths to the models to rate.");
+DEFINE_int32(eval_games, 1,
+             "When running 'eval' mode, the number of games to play. --model "
+             "plays black in the even games and white in the odd ones. When "
+             "running 'tournament' mode, the number of games that each pair "
+             "of models plays. Up to --parallel_games games are played at a "
+             "time.");
+DEFINE_string(eval_summary, "",
+              "When running 'eval' or 'tournament' mode, if non-empty, the "
+              "path to write a summary of the results to.");
+DEFINE_string(model_dir, "",
+              "When running 'selfplay' mode with the tf, lite or native "
+              "engine, a directory to watch for new models. Whenever a newer "
+              "model is written, it is loaded in the background and all "
+              "games, including those in progress, switch to it. Models are "
+              "ordered by file name. If --model isn't set, selfplay waits for "
+              "the first model to be written.");
 DEFINE_int32(parallel_games, 32, "Number of games to play in parallel.");
+DEFINE_int32(selfplay_threads, 0,
+             "If non-zero, the number of threads to play the parallel games "
+             "on. Each thread searches its games in turn and evaluates the "
+             "leaves of all of them with a single inference, of up to "
+             "virtual_losses positions per game. If zero, each game is "
+             "played on its own thread. Not supported by the remote engine, "
+             "which already batches inferences across games.");
+DEFINE_int32(selfplay_batches, 2,
+             "If --selfplay_threads is set, the number of batches that each "
+             "thread splits its games into. While one batch is evaluated on "
+             "an inference thread, the selfplay thread searches the games of "
+             "the others.");
+DEFINE_bool(pin_threads, false,
+            "If true, pin each selfplay thread, along with any inference "
+            "threads that its engine starts, to its own group of CPUs. CPUs "
+            "are grouped by physical package and core.");
+DEFINE_bool(schedule_games, false,
+            "If true, vary the number of games played at once between "
+            "--min_parallel_games and --parallel_games to keep inference "
+            "busy. Games are added while inference runs less than "
+            "--target_inference_utilization of the time, or, with the "
+            "remote engine, while its batches are filled less than "
+            "--target_batch_fill, as long as adding them raises the number "
+            "of positions evaluated per second.");
+DEFINE_int32(min_parallel_games, 1,
+             "If --schedule_games is set, the minimum number of games to "
+             "play at once, and the number to start with.");
+DEFINE_double(target_inference_utilization, 0.95,
+              "If --schedule_games is set, add games while inference runs "
+              "for less than this fraction of the time.");
+DEFINE_double(target_batch_fill, 0.9,
+              "If --schedule_games is set and the engine batches inferences "
+              "(the remote engine), add games while its batches are filled to "
+              "less than this fraction of their size on average.");
+DEFINE_double(max_inference_queue_depth, 0,
+              "If --schedule_games is set and this is non-zero, remove games "
+              "while more than this many inferences run at once on average, "
+              "or with the remote engine, while more than this many "
+              "inferences wait to be batched.");
+DEFINE_int32(schedule_interval, 10,
+             "If --schedule_games is set, the number of seconds between "
+             "adjustments of the number of games.");
+
+DECLARE_string(engine);
 
 // Output flags.
 DEFINE_string(output_dir, "",
@@ -120,6 +198,48 @@ DEFINE_string(holdout_dir, "",
 DEFINE_string(sgf_dir, "", "SGF directory. If empty, no SGF is written.");
 DEFINE_double(holdout_pct, 0.03,
               "Fraction of games to hold out for validation.");
+DEFINE_string(example_format, "tfrecord",
+              "Format to write selfplay examples in. \"tfrecord\" writes a "
+              "tf.Example for every move. \"compact\" writes each game's "
+              "moves, sparse search probabilities and outcome to a .game "
+              "file, or with --example_shard_mb to a .games shard. The "
+              "training pipeline doesn't read these: run replay_games on "
+              "them offline to write the tf.Examples before training.");
+DEFINE_int32(example_shard_mb, 0,
+             "If non-zero, append the examples of finished selfplay games "
+             "to shared, uncompressed TFRecord shards of about this many "
+             "megabytes, each with an index of its games, instead of writing "
+             "a compressed file per game.");
+DEFINE_int32(example_shard_minutes, 60,
+             "If --example_shard_mb is set, the maximum number of minutes "
+             "that examples are appended to a shard.");
+DEFINE_int32(example_shard_flush_seconds, 0,
+             "If --example_shard_mb is set, flush a shard and its index "
+             "after a game if they haven't been for this many seconds. With "
+             "the default of zero, every game is flushed, so only the games "
+             "being written are lost if the process dies. Each flush uploads "
+             "a gs:// shard again, so shards written there may want a longer "
+             "interval.");
+DEFINE_string(example_compression, "zlib",
+              "Compression of the per-game TFRecord files: \"none\", "
+              "\"zlib\" or \"zlib:<level>\", where level 1 is fastest and 9 "
+              "compresses best. Uncompressed files are named .tfrecord "
+              "instead of .tfrecord.zz.");
+DEFINE_int32(compression_threads, 0,
+             "If non-zero, compress the TFRecord files of finished games in "
+             "blocks on a pool of this many threads instead of on the "
+             "thread writing the file. The files can be read as usual.");
+DEFINE_int32(writer_threads, 1,
+             "Number of threads that write the examples and SGFs of finished "
+             "selfplay games in the background. If zero, each game thread "
+             "writes the outputs of its game before starting the next one.");
+DEFINE_int32(writer_queue_size, 16,
+             "Maximum number of finished games waiting to be written. Game "
+             "threads block while the queue is full.");
+DEFINE_int32(writer_stats_interval, 0,
+             "If non-zero, write the queue depth and latency metrics of the "
+             "background writer to stderr every writer_stats_interval "
+             "seconds.");
 
 // Self play flags:
 //   --inject_noise=true
@@ -149,76 +269,140 @@ std::string GetOutputDir(absl::Time now, const std::string& root_dir) {
   return file::JoinPath(root_dir, sub_dirs);
 }
 
-void WriteExample(const std::string& output_dir, const std::string& output_name,
-                  const MctsPlayer& player) {
-  MG_CHECK(file::RecursivelyCreateDir(output_dir));
+// The outputs of a finished game. Unlike the MctsPlayers that played it, a
+// CompletedGame doesn't reference their search trees, so it can be written on a
+// background thread while the game thread starts its next game.
+struct CompletedGame {
+  CompletedGame(const MctsPlayer& player_b, const MctsPlayer& player_w);
 
-  // Write the TensorFlow examples.
-  std::vector<tensorflow::Example> examples;
-  examples.reserve(player.history().size());
-  DualNet::BoardFeatures features;
-  std::vector<const Position::Stones*> recent_positions;
-  for (const auto& h : player.history()) {
-    h.node->GetMoveHistory(DualNet::kMoveHistory, &recent_positions);
-    DualNet::SetFeatures(recent_positions, h.node->position.to_play(),
-                         &features);
-    examples.push_back(
-        tf_utils::MakeTfExample(features, h.search_pi, player.result()));
-  }
+  // The moves played, with the comments written to the full SGF.
+  std::vector<sgf::MoveWithComment> moves;
 
-  auto output_path = file::JoinPath(output_dir, output_name + ".tfrecord.zz");
-  tf_utils::WriteTfExamples(output_path, examples);
-}
+  // The stones on the board and the search visit counts before each move.
+  std::vector<Position::Stones> stones;
+  std::vector<SearchVisits> search_visits;
 
-void WriteSgf(const std::string& output_dir, const std::string& output_name,
-              const MctsPlayer& player_b, const MctsPlayer& player_w,
-              bool write_comments) {
-  MG_CHECK(file::RecursivelyCreateDir(output_dir));
+  float result;
+  sgf::CreateSgfOptions sgf_options;
+};
+
+CompletedGame::CompletedGame(const MctsPlayer& player_b,
+                             const MctsPlayer& player_w) {
   MG_CHECK(player_b.history().size() == player_w.history().size());
 
   bool log_names = player_b.name() != player_w.name();
 
-  std::vector<sgf::MoveWithComment> moves;
   moves.reserve(player_b.history().size());
-
+  stones.reserve(player_b.history().size());
+  search_visits.reserve(player_b.history().size());
   for (size_t i = 0; i < player_b.history().size(); ++i) {
     const auto& h = i % 2 == 0 ? player_b.history()[i] : player_w.history()[i];
-    const auto& color = h.node->position.to_play();
+    const auto& position = h.node->position;
     std::string comment;
-    if (write_comments) {
-      if (i == 0) {
-        comment = absl::StrCat(
-            "Resign Threshold: ", player_b.options().resign_threshold, "\n",
-            h.comment);
-      } else {
-        if (log_names) {
-          comment = absl::StrCat(i % 2 == 0 ? player_b.name() : player_w.name(),
-                                 "\n", h.comment);
-        } else {
-          comment = h.comment;
-        }
-      }
-      moves.emplace_back(color, h.c, std::move(comment));
+    if (i == 0) {
+      comment = absl::StrCat("Resign Threshold: ",
+                             player_b.options().resign_threshold, "\n",
+                             h.comment);
+    } else if (log_names) {
+      comment = absl::StrCat(i % 2 == 0 ? player_b.name() : player_w.name(),
+                             "\n", h.comment);
     } else {
-      moves.emplace_back(color, h.c, "");
+      comment = h.comment;
     }
+    moves.emplace_back(position.to_play(), h.c, std::move(comment));
+    stones.push_back(position.stones());
+    search_visits.push_back(h.search_visits);
   }
 
-  std::string player_name(file::Basename(FLAGS_model));
-  sgf::CreateSgfOptions options;
-  options.komi = player_b.options().komi;
-  options.result = player_b.result_string();
-  options.black_name = player_b.name();
-  options.white_name = player_w.name();
-  auto sgf_str = sgf::CreateSgfString(moves, options);
+  result = player_b.result();
+  sgf_options.komi = player_b.options().komi;
+  sgf_options.result = player_b.result_string();
+  sgf_options.black_name = player_b.name();
+  sgf_options.white_name = player_w.name();
+}
 
-  auto output_path = file::JoinPath(output_dir, output_name + ".sgf");
-  TF_CHECK_OK(tf_utils::WriteFile(output_path, sgf_str));
+// Writes the examples of `game` to a file of their own in `output_dir`,
+// compressed as `compression` specifies, or if `shard_writer` is non-null,
+// appends them to its shard in `output_dir`. If `compressor` is non-null, the
+// file is compressed on its threads.
+void WriteExample(const std::string& output_dir, const std::string& output_name,
+                  const CompletedGame& game,
+                  const CompressionOptions& compression,
+                  ParallelZlibCompressor* compressor,
+                  ShardedExampleWriter* shard_writer) {
+  // Write the TensorFlow examples.
+  std::vector<tensorflow::Example> examples;
+  examples.reserve(game.moves.size());
+  DualNet::BoardFeatures features;
+  std::vector<const Position::Stones*> recent_positions;
+  for (size_t i = 0; i < game.moves.size(); ++i) {
+    recent_positions.clear();
+    for (size_t j = 0; j < DualNet::kMoveHistory && j <= i; ++j) {
+      recent_positions.push_back(&game.stones[i - j]);
+    }
+    DualNet::SetFeatures(recent_positions, game.moves[i].move.color,
+                         &features);
+    examples.push_back(
+        tf_utils::MakeTfExample(features, game.search_visits[i].ToSearchPi(),
+                                game.result));
+  }
+
+  if (shard_writer != nullptr) {
+    shard_writer->Write(output_dir, output_name, examples);
+    return;
+  }
+
+  MG_CHECK(file::RecursivelyCreateDir(output_dir));
+  bool zlib = compression.codec == CompressionOptions::Codec::kZlib;
+  auto output_path = file::JoinPath(
+      output_dir, output_name + (zlib ? ".tfrecord.zz" : ".tfrecord"));
+  tf_utils::WriteTfExamples(output_path, examples, compression, compressor);
+}
+
+// Writes `game` in the compact format to a .game file of its own in
+// `output_dir`, or if `shard_writer` is non-null, appends it as a single record
+// to its shard in `output_dir`.
+void WriteCompactGame(const std::string& output_dir,
+                      const std::string& output_name, const CompletedGame& game,
+                      ShardedExampleWriter* shard_writer) {
+  CompactGame compact_game;
+  compact_game.komi = game.sgf_options.komi;
+  compact_game.result = game.result;
+  compact_game.moves.resize(game.moves.size());
+  for (size_t i = 0; i < game.moves.size(); ++i) {
+    compact_game.moves[i].c = game.moves[i].move.c;
+    compact_game.moves[i].search_visits = game.search_visits[i];
+  }
+  std::vector<std::string> records = {EncodeCompactGame(compact_game)};
+
+  if (shard_writer != nullptr) {
+    shard_writer->Write(output_dir, output_name, records);
+    return;
+  }
+
+  MG_CHECK(file::RecursivelyCreateDir(output_dir));
+  auto output_path = file::JoinPath(output_dir, output_name + ".game");
+  TF_CHECK_OK(tf_utils::WriteFile(output_path, records[0]));
 }
 
 void WriteSgf(const std::string& output_dir, const std::string& output_name,
-              const MctsPlayer& player, bool write_comments) {
-  WriteSgf(output_dir, output_name, player, player, write_comments);
+              const CompletedGame& game, bool write_comments) {
+  MG_CHECK(file::RecursivelyCreateDir(output_dir));
+
+  std::string sgf_str;
+  if (write_comments) {
+    sgf_str = sgf::CreateSgfString(game.moves, game.sgf_options);
+  } else {
+    std::vector<sgf::MoveWithComment> moves;
+    moves.reserve(game.moves.size());
+    for (const auto& move : game.moves) {
+      moves.emplace_back(move.move, "");
+    }
+    sgf_str = sgf::CreateSgfString(moves, game.sgf_options);
+  }
+
+  auto output_path = file::JoinPath(output_dir, output_name + ".sgf");
+  TF_CHECK_OK(tf_utils::WriteFile(output_path, sgf_str));
 }
 
 void ParseMctsPlayerOptionsFromFlags(MctsPlayer::Options* options) {
@@ -238,16 +422,91 @@ void ParseMctsPlayerOptionsFromFlags(MctsPlayer::Options* options) {
 class SelfPlayer {
  public:
   void Run() {
-    {
-      absl::MutexLock lock(&mutex_);
-      dual_net_factory_ = NewDualNetFactory(FLAGS_model, FLAGS_parallel_games);
+    int num_threads = FLAGS_parallel_games;
+    int num_dual_nets = FLAGS_parallel_games;
+    if (FLAGS_selfplay_threads > 0) {
+      MG_CHECK(FLAGS_engine != "remote")
+          << "--selfplay_threads isn't supported by the remote engine";
+      MG_CHECK(FLAGS_selfplay_batches > 0);
+      num_threads = std::min(FLAGS_selfplay_threads, FLAGS_parallel_games);
+      num_dual_nets = num_threads * FLAGS_selfplay_batches;
+    }
+
+    // Engines size their thread pools by the number of DualNets running
+    // inferences in parallel.
+    if (FLAGS_model_dir.empty()) {
+      dual_net_factory_ = NewDualNetFactory(FLAGS_model, num_dual_nets);
+    } else {
+      dual_net_factory_ = NewReloadingDualNetFactory(
+          FLAGS_model, FLAGS_model_dir, num_dual_nets);
+    }
+    MG_CHECK(FLAGS_example_format == "tfrecord" ||
+             FLAGS_example_format == "compact")
+        << "Unrecognized --example_format \"" << FLAGS_example_format << "\"";
+    MG_CHECK(ParseCompressionOptions(FLAGS_example_compression, &compression_))
+        << "Unrecognized --example_compression \""
+        << FLAGS_example_compression << "\"";
+    if (FLAGS_compression_threads > 0) {
+      compressor_ =
+          absl::make_unique<ParallelZlibCompressor>(FLAGS_compression_threads);
     }
-    for (int i = 0; i < FLAGS_parallel_games; ++i) {
-      threads_.emplace_back(std::bind(&SelfPlayer::ThreadRun, this, i));
+    if (FLAGS_schedule_games) {
+      GameScheduler::Options options;
+      options.min_games =
+          std::min(FLAGS_min_parallel_games, FLAGS_parallel_games);
+      options.max_games = FLAGS_parallel_games;
+      options.target_utilization = FLAGS_target_inference_utilization;
+      options.engine_metrics = dual_net_factory_->metrics();
+      options.target_batch_fill = FLAGS_target_batch_fill;
+      options.max_queue_depth = FLAGS_max_inference_queue_depth;
+      options.interval = absl::Seconds(FLAGS_schedule_interval);
+      scheduler_ = absl::make_unique<GameScheduler>(options);
+    }
+    if (FLAGS_example_shard_mb > 0) {
+      ShardedExampleWriter::Options options;
+      options.max_shard_bytes = int64_t(FLAGS_example_shard_mb) << 20;
+      options.max_shard_age = absl::Minutes(FLAGS_example_shard_minutes);
+      options.flush_interval = absl::Seconds(FLAGS_example_shard_flush_seconds);
+      if (FLAGS_example_format == "compact") {
+        options.extension = ".games";
+      }
+      shard_writer_ = absl::make_unique<ShardedExampleWriter>(options);
+    }
+    if (FLAGS_writer_threads > 0) {
+      writer_ = absl::make_unique<AsyncWriter>(FLAGS_writer_threads,
+                                               FLAGS_writer_queue_size);
+      if (FLAGS_writer_stats_interval > 0) {
+        writer_metrics_dumper_ = absl::make_unique<MetricsDumper>(
+            writer_->metrics(), absl::Seconds(FLAGS_writer_stats_interval));
+      }
+    }
+    cpus_ = GetAllowedCpus();
+    start_time_ = absl::Now();
+    for (int i = 0; i < num_threads; ++i) {
+      if (FLAGS_selfplay_threads > 0) {
+        int begin = i * FLAGS_parallel_games / num_threads;
+        int end = (i + 1) * FLAGS_parallel_games / num_threads;
+        threads_.emplace_back(std::bind(&SelfPlayer::MultiplexedThreadRun,
+                                        this, i, num_threads, begin,
+                                        end - begin));
+      } else {
+        threads_.emplace_back(std::bind(&SelfPlayer::ThreadRun, this, i));
+      }
     }
     for (auto& t : threads_) {
       t.join();
     }
+    scheduler_.reset();
+
+    // Wait for the outputs of the last games to be written.
+    if (writer_ != nullptr) {
+      writer_metrics_dumper_.reset();
+      writer_->Flush();
+      std::cerr << "== Writer metrics\n" << writer_->metrics()->ToString();
+      writer_.reset();
+    }
+    shard_writer_.reset();
+    compressor_.reset();
   }
 
  private:
@@ -256,13 +515,13 @@ class SelfPlayer {
   // held. This allows us to safely update the command line arguments from a
   // flag file without causing any race conditions.
   struct GameOptions {
-    void Init(int thread_id, Random* rnd) {
+    void Init(int game_id, Random* rnd) {
       ParseMctsPlayerOptionsFromFlags(&player_options);
-      player_options.verbose = thread_id == 0;
+      player_options.verbose = game_id == 0;
       // If an random seed was explicitly specified, make sure we use a
-      // different seed for each thread.
+      // different seed for each game.
       if (player_options.random_seed != 0) {
-        player_options.random_seed += 1299283 * thread_id;
+        player_options.random_seed += 1299283 * game_id;
       }
       player_options.resign_enabled = (*rnd)() >= FLAGS_disable_resign_pct;
 
@@ -271,6 +530,7 @@ class SelfPlayer {
       output_dir = FLAGS_output_dir;
       holdout_dir = FLAGS_holdout_dir;
       sgf_dir = FLAGS_sgf_dir;
+      compact_examples = FLAGS_example_format == "compact";
     }
 
     MctsPlayer::Options player_options;
@@ -279,22 +539,24 @@ class SelfPlayer {
     std::string output_dir;
     std::string holdout_dir;
     std::string sgf_dir;
+    bool compact_examples;
   };
 
-  void LogEndGameInfo(MctsPlayer* player, absl::Duration game_time) {
-    std::cout << player->result_string() << std::endl;
+  void LogEndGameInfo(const MctsPlayer& player, absl::Duration game_time)
+      EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    std::cout << player.result_string() << std::endl;
     std::cout << "Playing game: " << absl::ToDoubleSeconds(game_time)
               << std::endl;
-    std::cout << "Played moves: " << player->root()->position.n() << std::endl;
+    std::cout << "Played moves: " << player.root()->position.n() << std::endl;
 
-    const auto& history = player->history();
+    const auto& history = player.history();
     if (history.empty()) {
       return;
     }
 
     // Find the move at which the game looked the bleakest from the perspective
     // of the winner.
-    float result = player->result();
+    float result = player.result();
     float bleakest_eval = history[0].node->Q() * result;
     float bleakest_move = 0;
     for (size_t i = 1; i < history.size(); ++i) {
@@ -314,10 +576,10 @@ class SelfPlayer {
     // resigned on an earlier move, this is not counted as a bad resignation for
     // the winner (since the game would have ended after the loser's initial
     // resignation).
-    if (!player->options().resign_enabled) {
+    if (!player.options().resign_enabled) {
       for (size_t i = 0; i < history.size(); ++i) {
         if (history[i].node->Q_perspective() <
-            player->options().resign_threshold) {
+            player.options().resign_threshold) {
           if ((history[i].node->Q() < 0) != (result < 0)) {
             std::cout << "Bad resign: move=" << i
                       << " Q=" << history[i].node->Q() << std::endl;
@@ -328,74 +590,236 @@ class SelfPlayer {
     }
   }
 
+  void PinThread(int thread_id, int num_threads) {
+    if (!FLAGS_pin_threads) {
+      return;
+    }
+    auto cpus = GetCpuGroup(cpus_, num_threads, thread_id);
+    if (!PinCurrentThread(cpus)) {
+      std::cerr << "Couldn't pin thread " << thread_id << " to CPUs "
+                << absl::StrJoin(cpus, ",") << std::endl;
+    }
+  }
+
+  void InitGameOptions(int game_id, GameOptions* game_options) {
+    absl::MutexLock lock(&mutex_);
+    auto old_model = FLAGS_model;
+    MaybeReloadFlags();
+    MG_CHECK(old_model == FLAGS_model)
+        << "Manually changing the model during selfplay is not supported. "
+           "Use --model_dir, or --checkpoint_dir and --engine=remote, to "
+           "perform inference using the most recent model from training.";
+    game_options->Init(game_id, &rnd_);
+  }
+
+  // Returns a new DualNet, whose inferences are measured by the scheduler if
+  // --schedule_games is set.
+  std::unique_ptr<DualNet> NewDualNet() {
+    auto dual_net = dual_net_factory_->New();
+    if (scheduler_ != nullptr) {
+      dual_net = scheduler_->WrapDualNet(std::move(dual_net));
+    }
+    return dual_net;
+  }
+
+  void LogMove(const MctsPlayer& player, bool use_ansi_colors) {
+    if (!player.options().verbose) {
+      return;
+    }
+    const auto& position = player.root()->position;
+    std::cerr << position.ToPrettyString(use_ansi_colors);
+    std::cerr << "Move: " << position.n()
+              << " Captures X: " << position.num_captures()[0]
+              << " O: " << position.num_captures()[1] << std::endl;
+    std::cerr << player.root()->Describe() << std::endl;
+  }
+
+  void FinishGame(int game_id, const GameOptions& game_options,
+                  const MctsPlayer& player, absl::Duration game_time) {
+    {
+      // Log the end game info with the shared mutex held to prevent the
+      // outputs from multiple threads being interleaved.
+      absl::MutexLock lock(&mutex_);
+      LogEndGameInfo(player, game_time);
+      num_games_finished_ += 1;
+      std::cout << "Games per hour: "
+                << num_games_finished_ /
+                       absl::ToDoubleHours(absl::Now() - start_time_)
+                << std::endl;
+    }
+
+    // Write the outputs.
+    auto now = absl::Now();
+    auto output_name = GetOutputName(now, game_id);
+
+    bool is_holdout;
+    {
+      absl::MutexLock lock(&mutex_);
+      is_holdout = rnd_() < game_options.holdout_pct;
+    }
+    auto example_dir =
+        is_holdout ? game_options.holdout_dir : game_options.output_dir;
+    auto sgf_dir = game_options.sgf_dir;
+    bool compact_examples = game_options.compact_examples;
+    if (example_dir.empty() && sgf_dir.empty()) {
+      return;
+    }
+
+    // std::function must be copyable, so the game is held by a shared_ptr.
+    auto game = std::make_shared<const CompletedGame>(player, player);
+    auto* shard_writer = shard_writer_.get();
+    auto* compressor = compressor_.get();
+    auto compression = compression_;
+    auto write = [game, now, output_name, example_dir, sgf_dir,
+                  compact_examples, compression, compressor, shard_writer]() {
+      if (!example_dir.empty()) {
+        auto output_dir = GetOutputDir(now, example_dir);
+        if (compact_examples) {
+          WriteCompactGame(output_dir, output_name, *game, shard_writer);
+        } else {
+          WriteExample(output_dir, output_name, *game, compression,
+                       compressor, shard_writer);
+        }
+      }
+      if (!sgf_dir.empty()) {
+        WriteSgf(GetOutputDir(now, file::JoinPath(sgf_dir, "clean")),
+                 output_name, *game, false);
+        WriteSgf(GetOutputDir(now, file::JoinPath(sgf_dir, "full")),
+                 output_name, *game, true);
+      }
+    };
+    if (writer_ != nullptr) {
+      writer_->Write(std::move(write));
+    } else {
+      write();
+    }
+  }
+
+  // Plays one game at a time on the calling thread.
   void ThreadRun(int thread_id) {
+    PinThread(thread_id, FLAGS_parallel_games);
+
     // Only print the board using ANSI colors if stderr is sent to the
     // terminal.
     const bool use_ansi_colors = isatty(fileno(stderr));
 
     GameOptions game_options;
     do {
-      std::unique_ptr<MctsPlayer> player;
-
-      {
-        absl::MutexLock lock(&mutex_);
-        auto old_model = FLAGS_model;
-        MaybeReloadFlags();
-        MG_CHECK(old_model == FLAGS_model)
-            << "Manually changing the model during selfplay is not supported. "
-               "Use --checkpoint_dir and --engine=remote to perform inference "
-               "using the most recent checkpoint from training.";
-        game_options.Init(thread_id, &rnd_);
-        player = absl::make_unique<MctsPlayer>(dual_net_factory_->New(),
-                                               game_options.player_options);
+      // Wait until the scheduler has room for another game.
+      if (scheduler_ != nullptr) {
+        scheduler_->StartGame();
       }
+      InitGameOptions(thread_id, &game_options);
+
+      // Create the DualNet without holding the lock, so that the threads
+      // initialize their engines in parallel when they start.
+      auto player = absl::make_unique<MctsPlayer>(NewDualNet(),
+                                                  game_options.player_options);
 
       // Play the game.
       auto start_time = absl::Now();
       while (!player->game_over()) {
         auto move = player->SuggestMove();
-        if (player->options().verbose) {
-          const auto& position = player->root()->position;
-          std::cerr << player->root()->position.ToPrettyString(use_ansi_colors);
-          std::cerr << "Move: " << position.n()
-                    << " Captures X: " << position.num_captures()[0]
-                    << " O: " << position.num_captures()[1] << std::endl;
-          std::cerr << player->root()->Describe() << std::endl;
-        }
+        LogMove(*player, use_ansi_colors);
         player->PlayMove(move);
       }
 
-      {
-        // Log the end game info with the shared mutex held to prevent the
-        // outputs from multiple threads being interleaved.
-        absl::MutexLock lock(&mutex_);
-        LogEndGameInfo(player.get(), absl::Now() - start_time);
+      FinishGame(thread_id, game_options, *player, absl::Now() - start_time);
+      if (scheduler_ != nullptr) {
+        scheduler_->FinishGame();
       }
+    } while (game_options.run_forever);
 
-      // Write the outputs.
-      auto now = absl::Now();
-      auto output_name = GetOutputName(now, thread_id);
+    std::cerr << "Thread " << thread_id << " stopping" << std::endl;
+  }
+
+  // Plays games [first_game, first_game + num_games) on the calling thread,
+  // searching them with a SearchExecutor that evaluates them in
+  // --selfplay_batches batches. If --schedule_games is set, only the games
+  // that the scheduler has room for are played at once.
+  void MultiplexedThreadRun(int thread_id, int num_threads, int first_game,
+                            int num_games) {
+    PinThread(thread_id, num_threads);
+
+    const bool use_ansi_colors = isatty(fileno(stderr));
+
+    struct Game {
+      int game_id;
+      GameOptions options;
+      std::unique_ptr<MctsPlayer> player;
+      absl::Time start_time;
+    };
+
+    // Create the executor after pinning the thread, so that its inference
+    // threads inherit the affinity.
+    std::vector<std::unique_ptr<DualNet>> dual_nets;
+    for (int i = 0; i < FLAGS_selfplay_batches; ++i) {
+      dual_nets.push_back(NewDualNet());
+    }
+    SearchExecutor executor(std::move(dual_nets));
+
+    // The indices of the games that are waiting to start, last first.
+    std::vector<int> idle;
+    std::vector<Game> games(num_games);
+    for (int i = num_games - 1; i >= 0; --i) {
+      games[i].game_id = first_game + i;
+      idle.push_back(i);
+    }
 
-      bool is_holdout;
-      {
-        absl::MutexLock lock(&mutex_);
-        is_holdout = rnd_() < game_options.holdout_pct;
+    // Starts idle games and adds them to the executor, for as long as the
+    // scheduler has room for them. If `wait` is true, waits until the
+    // scheduler has room for at least one. The games share the executor's
+    // DualNets, so their players don't need one.
+    auto start_games = [&](bool wait) {
+      while (!idle.empty()) {
+        if (scheduler_ != nullptr) {
+          if (wait) {
+            scheduler_->StartGame();
+            wait = false;
+          } else if (!scheduler_->TryStartGame()) {
+            break;
+          }
+        }
+        auto* game = &games[idle.back()];
+        idle.pop_back();
+        InitGameOptions(game->game_id, &game->options);
+        game->player = absl::make_unique<MctsPlayer>(
+            nullptr, game->options.player_options);
+        game->start_time = absl::Now();
+        game->player->StartSearch();
+        executor.Add(game - games.data(), game->player.get());
       }
-      auto example_dir =
-          is_holdout ? game_options.holdout_dir : game_options.output_dir;
-      if (!example_dir.empty()) {
-        WriteExample(GetOutputDir(now, example_dir), output_name, *player);
+    };
+
+    auto search_done = [&](int index, MctsPlayer* player) -> MctsPlayer* {
+      auto* game = &games[index];
+      auto move = player->FinishSearch();
+      LogMove(*player, use_ansi_colors);
+      player->PlayMove(move);
+      if (!player->game_over()) {
+        player->StartSearch();
+        start_games(false);
+        return player;
       }
 
-      if (!game_options.sgf_dir.empty()) {
-        WriteSgf(
-            GetOutputDir(now, file::JoinPath(game_options.sgf_dir, "clean")),
-            output_name, *player, false);
-        WriteSgf(
-            GetOutputDir(now, file::JoinPath(game_options.sgf_dir, "full")),
-            output_name, *player, true);
+      FinishGame(game->game_id, game->options, *player,
+                 absl::Now() - game->start_time);
+      if (scheduler_ != nullptr) {
+        scheduler_->FinishGame();
       }
-    } while (game_options.run_forever);
+      if (game->options.run_forever) {
+        idle.push_back(index);
+      }
+      start_games(false);
+      return nullptr;
+    };
+
+    // Run returns once none of this thread's games are running, which with
+    // --schedule_games may happen before all of them are done.
+    while (!idle.empty()) {
+      start_games(true);
+      executor.Run({}, search_done);
+    }
 
     std::cerr << "Thread " << thread_id << " stopping" << std::endl;
   }
@@ -441,10 +865,36 @@ class SelfPlayer {
   }
 
   absl::Mutex mutex_;
-  std::unique_ptr<DualNetFactory> dual_net_factory_ GUARDED_BY(&mutex_);
+  // Created before the game threads are started and not modified afterwards.
+  std::unique_ptr<DualNetFactory> dual_net_factory_;
   Random rnd_ GUARDED_BY(&mutex_);
+  int num_games_finished_ GUARDED_BY(&mutex_) = 0;
+  absl::Time start_time_;
   std::vector<std::thread> threads_;
   uint64_t flags_timestamp_ = 0;
+
+  // Writes the outputs of finished games if --writer_threads is non-zero.
+  // Created before the game threads are started.
+  std::unique_ptr<AsyncWriter> writer_;
+  std::unique_ptr<MetricsDumper> writer_metrics_dumper_;
+
+  // Appends the examples of finished games to shards if --example_shard_mb is
+  // set. Created before the game threads are started.
+  std::unique_ptr<ShardedExampleWriter> shard_writer_;
+
+  // How to compress the examples of finished games, and if
+  // --compression_threads is set, the threads to compress them on. Created
+  // before the game threads are started.
+  CompressionOptions compression_;
+  std::unique_ptr<ParallelZlibCompressor> compressor_;
+
+  // Limits the number of games played at once if --schedule_games is set.
+  // Created before the game threads are started.
+  std::unique_ptr<GameScheduler> scheduler_;
+
+  // The CPUs that the selfplay threads are pinned to if --pin_threads is set.
+  // Written before the threads are started.
+  std::vector<int> cpus_;
 };
 
 void SelfPlay() {
@@ -452,41 +902,199 @@ void SelfPlay() {
   player.Run();
 }
 
-void Eval() {
+// A game between two models, given by their positions in PlayGames's
+// `models`.
+struct Pairing {
+  int black;
+  int white;
+};
+
+// Plays the games in `pairings` between `models`, `parallel_games` of them at
+// a time, and returns the result of each game from black's perspective, as
+// returned by MctsPlayer::result(). Each model is loaded once. All the games
+// are searched on the calling thread by a SearchExecutor with one group per
+// model, so each model evaluates the leaves of all the games it is to move in
+// with one inference. To keep every model's inferences full, each game that
+// finishes is replaced by the next pairing of the models that are playing the
+// fewest games.
+std::vector<float> PlayGames(const std::vector<std::string>& models,
+                             const std::vector<Pairing>& pairings,
+                             int parallel_games) {
+  MG_CHECK(!pairings.empty());
+  MG_CHECK(parallel_games > 0);
+  parallel_games = std::min(static_cast<int>(pairings.size()), parallel_games);
+  // Remote DualNets accept at most --virtual_losses positions per inference,
+  // which is one game's worth of leaves.
+  MG_CHECK(FLAGS_engine != "remote" || parallel_games == 1)
+      << "The remote engine can only play one game at a time in eval and "
+      << "tournament modes, set --parallel_games=1";
+
   MctsPlayer::Options options;
   ParseMctsPlayerOptionsFromFlags(&options);
   options.inject_noise = false;
   options.soft_pick = false;
   options.random_symmetry = true;
 
-  options.name = std::string(file::Stem(FLAGS_model));
-  auto black_factory = NewDualNetFactory(FLAGS_model, 1);
-  auto black = absl::make_unique<MctsPlayer>(black_factory->New(), options);
-
-  options.name = std::string(file::Stem(FLAGS_model_two));
-  auto white_factory = NewDualNetFactory(FLAGS_model_two, 1);
-  auto white = absl::make_unique<MctsPlayer>(white_factory->New(), options);
-
-  auto* player = black.get();
-  auto* other_player = white.get();
-  while (!player->game_over()) {
-    auto move = player->SuggestMove();
-    std::cerr << player->root()->Describe() << "\n";
-    player->PlayMove(move);
-    other_player->PlayMove(move);
-    std::cerr << player->root()->position.ToPrettyString();
-    std::swap(player, other_player);
+  std::vector<std::string> names;
+  std::vector<std::unique_ptr<DualNetFactory>> factories;
+  std::vector<std::unique_ptr<DualNet>> dual_nets;
+  for (const auto& model : models) {
+    names.emplace_back(file::Stem(model));
+    factories.push_back(NewDualNetFactory(model, 1));
+    dual_nets.push_back(factories.back()->New());
   }
-  std::cerr << player->result_string() << "\n";
-  std::cerr << "Black was: " << black->name() << "\n";
+  SearchExecutor executor(std::move(dual_nets));
+
+  // A single game logs its moves, as SuggestMove does for one player.
+  bool log_moves = pairings.size() == 1;
+
+  struct Game {
+    int game_id;
+    // Indexed by color: black and white.
+    int models[2];
+    std::unique_ptr<MctsPlayer> players[2];
+  };
+  std::vector<Game> games(parallel_games);
+
+  // The games that haven't started yet, and the number of running games that
+  // each model plays in.
+  std::vector<int> pending(pairings.size());
+  std::iota(pending.begin(), pending.end(), 0);
+  std::vector<int> num_running(models.size(), 0);
 
-  std::string output_name = absl::StrCat(GetOutputName(absl::Now(), 0), "-",
-                                         black->name(), "-", white->name());
+  // Starts the next game in `slot`, if any games are left to play.
+  auto start_game = [&](int slot) {
+    if (pending.empty()) {
+      return;
+    }
+    auto it = std::min_element(pending.begin(), pending.end(),
+                               [&](int a, int b) {
+                                 return num_running[pairings[a].black] +
+                                            num_running[pairings[a].white] <
+                                        num_running[pairings[b].black] +
+                                            num_running[pairings[b].white];
+                               });
+    auto& game = games[slot];
+    game.game_id = *it;
+    pending.erase(it);
+    game.models[0] = pairings[game.game_id].black;
+    game.models[1] = pairings[game.game_id].white;
+    auto game_options = options;
+    if (game_options.random_seed != 0) {
+      game_options.random_seed += 1299283 * game.game_id;
+    }
+    game_options.verbose = log_moves;
+    for (int i = 0; i < 2; ++i) {
+      num_running[game.models[i]] += 1;
+      game_options.name = names[game.models[i]];
+      game.players[i] = absl::make_unique<MctsPlayer>(nullptr, game_options);
+    }
+    game.players[0]->StartSearch();
+    executor.Add(slot, game.players[0].get(), game.models[0]);
+  };
 
-  // Write SGF.
-  if (!FLAGS_sgf_dir.empty()) {
-    WriteSgf(FLAGS_sgf_dir, output_name, *black, *white, true);
+  std::vector<float> results(pairings.size());
+  for (size_t slot = 0; slot < games.size(); ++slot) {
+    start_game(static_cast<int>(slot));
+  }
+  executor.Run({}, [&](int slot, MctsPlayer* player) -> MctsPlayer* {
+    auto& game = games[slot];
+    auto move = player->FinishSearch();
+    if (log_moves) {
+      std::cerr << player->root()->Describe() << "\n";
+    }
+    for (auto& p : game.players) {
+      p->PlayMove(move);
+    }
+    if (log_moves) {
+      std::cerr << player->root()->position.ToPrettyString();
+    }
+
+    if (!player->game_over()) {
+      // The search of the player to move next runs on its own model's group.
+      int next = player == game.players[0].get() ? 1 : 0;
+      game.players[next]->StartSearch();
+      executor.Add(slot, game.players[next].get(), game.models[next]);
+      return nullptr;
+    }
+
+    const auto& black = *game.players[0];
+    const auto& white = *game.players[1];
+    results[game.game_id] = black.result();
+    std::cerr << "Game " << game.game_id << ": " << black.name() << " (B) vs "
+              << white.name() << " (W): " << black.result_string()
+              << std::endl;
+    if (!FLAGS_sgf_dir.empty()) {
+      std::string output_name =
+          absl::StrCat(GetOutputName(absl::Now(), game.game_id), "-",
+                       black.name(), "-", white.name());
+      WriteSgf(FLAGS_sgf_dir, output_name, CompletedGame(black, white), true);
+    }
+    for (int model : game.models) {
+      num_running[model] -= 1;
+    }
+    start_game(slot);
+    return nullptr;
+  });
+  return results;
+}
+
+void WriteSummary(const std::string& summary) {
+  std::cerr << summary;
+  if (!FLAGS_eval_summary.empty()) {
+    TF_CHECK_OK(tf_utils::WriteFile(FLAGS_eval_summary, summary));
+  }
+}
+
+// Plays --eval_games games between --model and --model_two. --model plays
+// black in the even games and white in the odd ones.
+void Eval() {
+  MG_CHECK(FLAGS_eval_games > 0);
+  std::vector<Pairing> pairings;
+  for (int i = 0; i < FLAGS_eval_games; ++i) {
+    pairings.push_back(i % 2 == 0 ? Pairing{0, 1} : Pairing{1, 0});
+  }
+  auto game_results = PlayGames({FLAGS_model, FLAGS_model_two}, pairings,
+                                FLAGS_parallel_games);
+
+  MatchResults results;
+  for (size_t i = 0; i < pairings.size(); ++i) {
+    results.AddGame(pairings[i].black == 0, game_results[i]);
+  }
+  WriteSummary(results.ToString(std::string(file::Stem(FLAGS_model)),
+                                std::string(file::Stem(FLAGS_model_two))));
+}
+
+// Plays --eval_games games between each pair of --tournament_models and rates
+// the models.
+void Tournament() {
+  MG_CHECK(FLAGS_eval_games > 0);
+  std::vector<std::string> models =
+      absl::StrSplit(FLAGS_tournament_models, ',', absl::SkipEmpty());
+  MG_CHECK(models.size() >= 2)
+      << "--tournament_models must list at least two models";
+
+  // Play the games in rounds, so that each pair of models has played about as
+  // many games as any other whenever the tournament is stopped.
+  std::vector<Pairing> pairings;
+  for (int round = 0; round < FLAGS_eval_games; ++round) {
+    for (int i = 0; i < static_cast<int>(models.size()); ++i) {
+      for (int j = i + 1; j < static_cast<int>(models.size()); ++j) {
+        pairings.push_back(round % 2 == 0 ? Pairing{i, j} : Pairing{j, i});
+      }
+    }
+  }
+  auto game_results = PlayGames(models, pairings, FLAGS_parallel_games);
+
+  TournamentResults results(static_cast<int>(models.size()));
+  for (size_t i = 0; i < pairings.size(); ++i) {
+    results.AddGame(pairings[i].black, pairings[i].white, game_results[i]);
+  }
+  std::vector<std::string> names;
+  for (const auto& model : models) {
+    names.emplace_back(file::Stem(model));
   }
+  WriteSummary(results.ToString(names));
 }
 
 void Gtp() {
@@ -512,6 +1120,8 @@ int main(int argc, char* argv[]) {
     minigo::SelfPlay();
   } else if (FLAGS_mode == "eval") {
     minigo::Eval();
+  } else if (FLAGS_mode == "tournament") {
+    minigo::Tournament();
   } else if (FLAGS_mode == "gtp") {
     minigo::Gtp();
   } else {
@@ -113,43 +113,94 @@ void MctsPlayer::NewGame() {
 }
 
 Coord MctsPlayer::SuggestMove() {
-  auto start = absl::Now();
+  StartSearch();
+  if (expanding_root_) {
+    auto* first_node = root_->SelectLeaf();
+    ProcessLeaves({&first_node, 1});
+    expanding_root_ = false;
+    StartReadouts();
+  }
+  while (!SearchDone()) {
+    TreeSearch(options_.batch_size);
+  }
+  return FinishSearch();
+}
+
+void MctsPlayer::StartSearch() {
+  search_start_ = absl::Now();
+  search_time_ = absl::ZeroDuration();
+  if (options_.seconds_per_move > 0) {
+    // Use time to limit the number of reads.
+    float seconds_per_move = options_.seconds_per_move;
+    if (options_.time_limit > 0) {
+      seconds_per_move =
+          TimeRecommendation(root_->position.n(), seconds_per_move,
+                             options_.time_limit, options_.decay_factor);
+    }
+    search_time_ = absl::Seconds(seconds_per_move);
+  }
 
   // In order to correctly count the number of reads performed, the root node
   // must be expanded. The root will always be expanded unless this is the first
   // time SuggestMove has been called for a game, or PlayMove was called without
   // a prior call to SuggestMove.
-  if (!root_->is_expanded) {
-    auto* first_node = root_->SelectLeaf();
-    ProcessLeaves({&first_node, 1});
+  expanding_root_ = !root_->is_expanded;
+  if (!expanding_root_) {
+    StartReadouts();
   }
+}
 
+void MctsPlayer::StartReadouts() {
   if (options_.inject_noise) {
     std::array<float, kNumMoves> noise;
     rnd_.Dirichlet(kDirichletAlpha, &noise);
     root_->InjectNoise(noise);
   }
-  int current_readouts = root_->N();
+  search_start_readouts_ = root_->N();
+}
 
+bool MctsPlayer::SearchDone() const {
+  if (expanding_root_) {
+    return false;
+  }
   if (options_.seconds_per_move > 0) {
-    // Use time to limit the number of reads.
-    float seconds_per_move = options_.seconds_per_move;
-    if (options_.time_limit > 0) {
-      seconds_per_move =
-          TimeRecommendation(root_->position.n(), seconds_per_move,
-                             options_.time_limit, options_.decay_factor);
-    }
-    while (absl::Now() - start < absl::Seconds(seconds_per_move)) {
-      TreeSearch(options_.batch_size);
-    }
+    return absl::Now() - search_start_ >= search_time_;
+  }
+  // Use a fixed number of reads.
+  return root_->N() >= search_start_readouts_ + options_.num_readouts;
+}
+
+int MctsPlayer::PrepareInference(
+    std::vector<DualNet::BoardFeatures>* features) {
+  if (expanding_root_) {
+    leaves_.clear();
+    leaves_.push_back(root_->SelectLeaf());
   } else {
-    // Use a fixed number of reads.
-    while (root_->N() < current_readouts + options_.num_readouts) {
-      TreeSearch(options_.batch_size);
-    }
+    SelectLeaves(options_.batch_size);
+  }
+  size_t begin = features->size();
+  features->resize(begin + leaves_.size());
+  GetLeafFeatures(leaves_, absl::MakeSpan(*features).subspan(begin));
+  return static_cast<int>(leaves_.size());
+}
+
+void MctsPlayer::ProcessInference(absl::Span<const DualNet::Output> outputs,
+                                  const std::string& model) {
+  MG_CHECK(outputs.size() == leaves_.size());
+  IncorporateOutputs(leaves_, outputs, model);
+  if (expanding_root_) {
+    expanding_root_ = false;
+    StartReadouts();
+    return;
+  }
+  for (auto* leaf : leaves_) {
+    leaf->RevertVirtualLoss(root_);
   }
-  int num_readouts = root_->N() - current_readouts;
-  auto elapsed = absl::Now() - start;
+}
+
+Coord MctsPlayer::FinishSearch() {
+  int num_readouts = root_->N() - search_start_readouts_;
+  auto elapsed = absl::Now() - search_start_;
   elapsed = elapsed * 100 / num_readouts;
   if (options_.verbose) {
     std::cerr << "Milliseconds per 100 reads: "
@@ -198,6 +249,18 @@ Coord MctsPlayer::PickMove() {
 }
 
 absl::Span<MctsNode* const> MctsPlayer::TreeSearch(int batch_size) {
+  SelectLeaves(batch_size);
+  if (!leaves_.empty()) {
+    ProcessLeaves(absl::MakeSpan(leaves_));
+    for (auto* leaf : leaves_) {
+      leaf->RevertVirtualLoss(root_);
+    }
+  }
+
+  return absl::MakeConstSpan(leaves_);
+}
+
+void MctsPlayer::SelectLeaves(int batch_size) {
   int max_iterations = batch_size * 2;
 
   leaves_.clear();
@@ -218,15 +281,6 @@ absl::Span<MctsNode* const> MctsPlayer::TreeSearch(int batch_size) {
       }
     }
   }
-
-  if (!leaves_.empty()) {
-    ProcessLeaves(absl::MakeSpan(leaves_));
-    for (auto* leaf : leaves_) {
-      leaf->RevertVirtualLoss(root_);
-    }
-  }
-
-  return absl::MakeConstSpan(leaves_);
 }
 
 bool MctsPlayer::ShouldResign() const {
@@ -312,28 +366,33 @@ void MctsPlayer::PushHistory(Coord c) {
     }
   }
 
-  // Convert child visit counts to a probability distribution, pi.
-  if (root_->position.n() < temperature_cutoff_) {
-    // Squash counts before normalizing to match softpick behavior in PickMove.
-    for (int i = 0; i < kNumMoves; ++i) {
-      history.search_pi[i] = std::pow(root_->child_N(i), kVisitCountSquash);
-    }
-  } else {
-    for (int i = 0; i < kNumMoves; ++i) {
-      history.search_pi[i] = root_->child_N(i);
-    }
-  }
-  // Normalize counts.
-  float sum = 0;
+  // Record the child visit counts that the probability distribution pi is
+  // computed from. Squash counts before normalizing to match softpick behavior
+  // in PickMove.
+  auto& visits = history.search_visits;
+  visits.squash = root_->position.n() < temperature_cutoff_;
   for (int i = 0; i < kNumMoves; ++i) {
-    sum += history.search_pi[i];
-  }
-  for (int i = 0; i < kNumMoves; ++i) {
-    history.search_pi[i] /= sum;
+    float n = root_->child_N(i);
+    if (n != 0) {
+      visits.counts.push_back(
+          {static_cast<uint16_t>(i), static_cast<uint32_t>(n)});
+    }
   }
 }
 
 void MctsPlayer::ProcessLeaves(absl::Span<MctsNode*> leaves) {
+  features_.resize(leaves.size());
+  GetLeafFeatures(leaves, absl::MakeSpan(features_));
+
+  // Run inference.
+  outputs_.resize(leaves.size());
+  network_->RunMany(features_, absl::MakeSpan(outputs_), &model_);
+
+  IncorporateOutputs(leaves, outputs_, model_);
+}
+
+void MctsPlayer::GetLeafFeatures(absl::Span<MctsNode* const> leaves,
+                                 absl::Span<DualNet::BoardFeatures> features) {
   // Select symmetry operations to apply.
   symmetries_used_.clear();
   if (options_.random_symmetry) {
@@ -349,23 +408,22 @@ void MctsPlayer::ProcessLeaves(absl::Span<MctsNode*> leaves) {
   // Build input features for each leaf, applying random symmetries if
   // requested.
   DualNet::BoardFeatures raw_features;
-  features_.resize(leaves.size());
   for (size_t i = 0; i < leaves.size(); ++i) {
     leaves[i]->GetMoveHistory(DualNet::kMoveHistory, &recent_positions_);
     DualNet::SetFeatures(recent_positions_, leaves[i]->position.to_play(),
                          &raw_features);
     symmetry::ApplySymmetry<float, kN, DualNet::kNumStoneFeatures>(
-        symmetries_used_[i], raw_features.data(), features_[i].data());
+        symmetries_used_[i], raw_features.data(), features[i].data());
   }
+}
 
-  // Run inference.
-  outputs_.resize(leaves.size());
-  network_->RunMany(features_, absl::MakeSpan(outputs_), &model_);
-
+void MctsPlayer::IncorporateOutputs(absl::Span<MctsNode* const> leaves,
+                                    absl::Span<const DualNet::Output> outputs,
+                                    const std::string& model) {
   // Record some information about the inference.
-  if (!model_.empty()) {
-    if (inferences_.empty() || model_ != inferences_.back().model) {
-      inferences_.emplace_back(model_, root_->position.n());
+  if (!model.empty()) {
+    if (inferences_.empty() || model != inferences_.back().model) {
+      inferences_.emplace_back(model, root_->position.n());
     }
     inferences_.back().last_move = root_->position.n();
     inferences_.back().total_count += leaves.size();
@@ -376,7 +434,7 @@ void MctsPlayer::ProcessLeaves(absl::Span<MctsNode*> leaves) {
   std::array<float, kNumMoves> raw_policy;
   for (size_t i = 0; i < leaves.size(); ++i) {
     MctsNode* leaf = leaves[i];
-    const auto& output = outputs_[i];
+    const auto& output = outputs[i];
     symmetry::ApplySymmetry<float, kN, 1>(
         symmetry::Inverse(symmetries_used_[i]), output.policy.data(),
         raw_policy.data());
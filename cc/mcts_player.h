@@ -31,6 +31,7 @@
 #include "cc/mcts_node.h"
 #include "cc/position.h"
 #include "cc/random.h"
+#include "cc/search_visits.h"
 #include "cc/symmetries.h"
 
 namespace minigo {
@@ -85,7 +86,12 @@ class MctsPlayer {
   };
 
   struct History {
-    std::array<float, kNumMoves> search_pi;
+    // Returns the search probabilities pi for the move.
+    std::array<float, kNumMoves> search_pi() const {
+      return search_visits.ToSearchPi();
+    }
+
+    SearchVisits search_visits;
     Coord c = Coord::kPass;
     std::string comment;
     const MctsNode* node = nullptr;
@@ -94,6 +100,8 @@ class MctsPlayer {
   // If position is non-null, the player will be initilized with that board
   // state. Otherwise, the player is initialized with an empty board with black
   // to play.
+  // `network` may be null if the player only searches with PrepareInference
+  // and ProcessInference.
   MctsPlayer(std::unique_ptr<DualNet> network, const Options& options);
 
   virtual ~MctsPlayer();
@@ -104,6 +112,32 @@ class MctsPlayer {
 
   virtual Coord SuggestMove();
 
+  // SuggestMove split into steps that never block on inference, so that a
+  // caller can play many games on one thread and evaluate the leaves of all of
+  // them in a single RunMany call:
+  //
+  //   player->StartSearch();
+  //   while (!player->SearchDone()) {
+  //     int n = player->PrepareInference(&features);
+  //     ... run inference on the last n features ...
+  //     player->ProcessInference(outputs, model);
+  //   }
+  //   player->PlayMove(player->FinishSearch());
+  void StartSearch();
+  bool SearchDone() const;
+
+  // Selects the leaves to evaluate next and appends their features to
+  // `features`. Returns the number of features appended, which may be zero.
+  int PrepareInference(std::vector<DualNet::BoardFeatures>* features);
+
+  // Incorporates the inference outputs for the leaves selected by the last
+  // call to PrepareInference.
+  void ProcessInference(absl::Span<const DualNet::Output> outputs,
+                        const std::string& model);
+
+  // Returns the move to play once the search is done.
+  Coord FinishSearch();
+
   void PlayMove(Coord c);
 
   bool ShouldResign() const;
@@ -165,6 +199,25 @@ class MctsPlayer {
  private:
   void PushHistory(Coord c);
 
+  // Injects noise into the root and starts counting readouts. Called once the
+  // root has been expanded.
+  void StartReadouts();
+
+  // Selects up to `batch_size` leaves that need inference into leaves_,
+  // adding virtual losses to them.
+  void SelectLeaves(int batch_size);
+
+  // Writes the features of `leaves` to `features`, applying a random symmetry
+  // to each of them if requested.
+  void GetLeafFeatures(absl::Span<MctsNode* const> leaves,
+                       absl::Span<DualNet::BoardFeatures> features);
+
+  // Incorporates the inference `outputs` for `leaves`, undoing the symmetries
+  // applied by GetLeafFeatures.
+  void IncorporateOutputs(absl::Span<MctsNode* const> leaves,
+                          absl::Span<const DualNet::Output> outputs,
+                          const std::string& model);
+
   std::unique_ptr<DualNet> network_;
   int temperature_cutoff_;
 
@@ -186,6 +239,12 @@ class MctsPlayer {
 
   std::vector<History> history_;
 
+  // State of the current search, see StartSearch.
+  absl::Time search_start_;
+  absl::Duration search_time_;
+  int search_start_readouts_ = 0;
+  bool expanding_root_ = false;
+
   // State that tracks which model is used for each inference.
   struct InferenceInfo {
     InferenceInfo(std::string model, int first_move)
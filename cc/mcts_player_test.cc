@@ -465,5 +465,40 @@ TEST(MctsPlayerTest, SymmetriesTest) {
   }
 }
 
+// Verifies that searching with PrepareInference and ProcessInference plays
+// the same moves as SuggestMove.
+TEST(MctsPlayerTest, InferenceStepsMatchSuggestMove) {
+  MctsPlayer::Options options;
+  options.random_seed = 17;
+  options.num_readouts = 32;
+  options.batch_size = 4;
+  options.verbose = false;
+  TestablePlayer player(absl::make_unique<MergeFeaturesNet>(), options);
+  TestablePlayer step_player(nullptr, options);
+
+  MergeFeaturesNet network;
+  std::vector<DualNet::BoardFeatures> features;
+  std::vector<DualNet::Output> outputs;
+  std::string model;
+  for (int i = 0; i < 10; ++i) {
+    auto expected = player.SuggestMove();
+
+    step_player.StartSearch();
+    while (!step_player.SearchDone()) {
+      features.clear();
+      step_player.PrepareInference(&features);
+      outputs.resize(features.size());
+      network.RunMany(features, absl::MakeSpan(outputs), &model);
+      step_player.ProcessInference(outputs, model);
+    }
+    auto actual = step_player.FinishSearch();
+
+    ASSERT_EQ(expected, actual);
+    ASSERT_EQ(player.root()->N(), step_player.root()->N());
+    player.PlayMove(expected);
+    step_player.PlayMove(actual);
+  }
+}
+
 }  // namespace
 }  // namespace minigo
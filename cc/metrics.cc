@@ -0,0 +1,155 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+
+namespace minigo {
+
+namespace {
+
+// Returns the index of the most significant set bit of x, which must be > 0.
+int MostSignificantBit(uint64_t x) { return 63 - __builtin_clzll(x); }
+
+template <typename T>
+T* GetOrCreate(const std::string& name,
+               std::map<std::string, std::unique_ptr<T>>* metrics) {
+  auto& ptr = (*metrics)[name];
+  if (ptr == nullptr) {
+    ptr = absl::make_unique<T>();
+  }
+  return ptr.get();
+}
+
+}  // namespace
+
+constexpr int Histogram::kSubBucketBits;
+constexpr int Histogram::kNumSubBuckets;
+constexpr int Histogram::kMaxValueBits;
+constexpr int64_t Histogram::kMaxValue;
+constexpr int Histogram::kNumBuckets;
+
+int Histogram::BucketIndex(int64_t value) {
+  value = std::max<int64_t>(0, std::min(value, kMaxValue));
+  if (value < 2 * kNumSubBuckets) {
+    return static_cast<int>(value);
+  }
+  // Values in [2^msb, 2^(msb+1)) are split into kNumSubBuckets buckets, indexed
+  // by the kSubBucketBits bits that follow the most significant bit.
+  int msb = MostSignificantBit(value);
+  int shift = msb - kSubBucketBits;
+  int sub_bucket = static_cast<int>(value >> shift) - kNumSubBuckets;
+  return (shift + 1) * kNumSubBuckets + sub_bucket;
+}
+
+int64_t Histogram::BucketUpperBound(int index) {
+  if (index < 2 * kNumSubBuckets) {
+    return index;
+  }
+  int shift = index / kNumSubBuckets - 1;
+  int64_t sub_bucket = index % kNumSubBuckets;
+  return ((kNumSubBuckets + sub_bucket + 1) << shift) - 1;
+}
+
+void Histogram::Record(int64_t value) {
+  value = std::max<int64_t>(0, std::min(value, kMaxValue));
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  int64_t prev_max = max_.load(std::memory_order_relaxed);
+  while (value > prev_max &&
+         !max_.compare_exchange_weak(prev_max, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+double Histogram::mean() const {
+  int64_t n = count();
+  return n == 0 ? 0 : static_cast<double>(sum()) / n;
+}
+
+int64_t Histogram::Percentile(double q) const {
+  int64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  // The rank of the value we're looking for, in the range [1, n].
+  auto rank = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(q * n)));
+  int64_t total = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    total += buckets_[i].load(std::memory_order_relaxed);
+    if (total >= rank) {
+      return std::min(BucketUpperBound(i), max());
+    }
+  }
+  // Only reachable if values were recorded while we were iterating.
+  return max();
+}
+
+std::string Histogram::ToString() const {
+  return absl::StrCat("count=", count(), " mean=", mean(),
+                      " p50=", Percentile(0.5), " p90=", Percentile(0.9),
+                      " p99=", Percentile(0.99), " p999=", Percentile(0.999),
+                      " max=", max());
+}
+
+Counter* MetricsRegistry::GetCounter(const std::string& name) {
+  absl::MutexLock lock(&mutex_);
+  return GetOrCreate(name, &counters_);
+}
+
+Gauge* MetricsRegistry::GetGauge(const std::string& name) {
+  absl::MutexLock lock(&mutex_);
+  return GetOrCreate(name, &gauges_);
+}
+
+Histogram* MetricsRegistry::GetHistogram(const std::string& name) {
+  absl::MutexLock lock(&mutex_);
+  return GetOrCreate(name, &histograms_);
+}
+
+std::string MetricsRegistry::ToString() const {
+  std::string result;
+  auto append_value = [&result](const std::string& name, const auto& metric) {
+    absl::StrAppend(&result, name, " ", metric.value(), "\n");
+  };
+  Visit(append_value, append_value,
+        [&result](const std::string& name, const Histogram& histogram) {
+          absl::StrAppend(&result, name, " ", histogram.ToString(), "\n");
+        });
+  return result;
+}
+
+MetricsDumper::MetricsDumper(const MetricsRegistry* registry,
+                             absl::Duration interval)
+    : registry_(registry), interval_(interval) {
+  thread_ = std::thread([this]() {
+    while (!stop_.WaitForNotificationWithTimeout(interval_)) {
+      std::cerr << "== Metrics\n" << registry_->ToString() << std::flush;
+    }
+  });
+}
+
+MetricsDumper::~MetricsDumper() {
+  stop_.Notify();
+  thread_.join();
+}
+
+}  // namespace minigo
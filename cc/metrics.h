@@ -0,0 +1,155 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_METRICS_H_
+#define CC_METRICS_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+
+namespace minigo {
+
+// A monotonically increasing count of events.
+class Counter {
+ public:
+  void Increment(int64_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+// A value that can go up and down, e.g. a queue depth.
+class Gauge {
+ public:
+  void Set(int64_t x) { value_.store(x, std::memory_order_relaxed); }
+  void Add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+  int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64_t> value_{0};
+};
+
+// A histogram of non-negative integer values (typically latencies in
+// microseconds) with a bounded relative error, in the style of HdrHistogram.
+// Values less than 2 * kNumSubBuckets are recorded exactly. Larger values are
+// recorded in buckets whose width is 1/kNumSubBuckets of their power of two
+// range, so percentiles are accurate to within about 3%. Values larger than
+// kMaxValue are clamped.
+// Recording is lock-free and safe to call from multiple threads.
+class Histogram {
+ public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kNumSubBuckets = 1 << kSubBucketBits;
+  static constexpr int kMaxValueBits = 40;
+  static constexpr int64_t kMaxValue = (int64_t(1) << kMaxValueBits) - 1;
+  static constexpr int kNumBuckets =
+      (kMaxValueBits - kSubBucketBits + 1) * kNumSubBuckets;
+
+  void Record(int64_t value);
+
+  // Records a duration in microseconds.
+  void RecordDuration(absl::Duration d) {
+    Record(absl::ToInt64Microseconds(d));
+  }
+
+  int64_t count() const { return count_.load(std::memory_order_relaxed); }
+  int64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+  int64_t max() const { return max_.load(std::memory_order_relaxed); }
+  double mean() const;
+
+  // Returns an upper bound on the value at quantile `q`, where 0 <= q <= 1.
+  // Returns 0 if no values have been recorded.
+  int64_t Percentile(double q) const;
+
+  // Returns a one line summary of the histogram.
+  std::string ToString() const;
+
+  // Exposed for testing.
+  static int BucketIndex(int64_t value);
+  static int64_t BucketUpperBound(int index);
+
+ private:
+  std::array<std::atomic<int64_t>, kNumBuckets> buckets_{};
+  std::atomic<int64_t> count_{0};
+  std::atomic<int64_t> sum_{0};
+  std::atomic<int64_t> max_{0};
+};
+
+// A collection of named metrics. The metrics are created on first use and live
+// as long as the registry, so callers can cache the returned pointers.
+// Metric names should be lower_case with '/' separating components, e.g.
+// "inference/batch_fill".
+class MetricsRegistry {
+ public:
+  Counter* GetCounter(const std::string& name);
+  Gauge* GetGauge(const std::string& name);
+  Histogram* GetHistogram(const std::string& name);
+
+  // Calls the given functions for every metric in the registry, in name order.
+  template <typename CounterFn, typename GaugeFn, typename HistogramFn>
+  void Visit(const CounterFn& counter_fn, const GaugeFn& gauge_fn,
+             const HistogramFn& histogram_fn) const {
+    absl::MutexLock lock(&mutex_);
+    for (const auto& kv : counters_) {
+      counter_fn(kv.first, *kv.second);
+    }
+    for (const auto& kv : gauges_) {
+      gauge_fn(kv.first, *kv.second);
+    }
+    for (const auto& kv : histograms_) {
+      histogram_fn(kv.first, *kv.second);
+    }
+  }
+
+  // Returns a human readable dump of all metrics, one per line.
+  std::string ToString() const;
+
+ private:
+  mutable absl::Mutex mutex_;
+  std::map<std::string, std::unique_ptr<Counter>> counters_
+      GUARDED_BY(&mutex_);
+  std::map<std::string, std::unique_ptr<Gauge>> gauges_ GUARDED_BY(&mutex_);
+  std::map<std::string, std::unique_ptr<Histogram>> histograms_
+      GUARDED_BY(&mutex_);
+};
+
+// Writes the contents of a MetricsRegistry to stderr every `interval` on a
+// background thread, until destroyed.
+class MetricsDumper {
+ public:
+  MetricsDumper(const MetricsRegistry* registry, absl::Duration interval);
+  ~MetricsDumper();
+
+ private:
+  const MetricsRegistry* registry_;
+  const absl::Duration interval_;
+  absl::Notification stop_;
+  std::thread thread_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_METRICS_H_
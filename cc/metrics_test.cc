@@ -0,0 +1,119 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/metrics.h"
+
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(MetricsTest, Counter) {
+  Counter counter;
+  EXPECT_EQ(0, counter.value());
+  counter.Increment();
+  counter.Increment(4);
+  EXPECT_EQ(5, counter.value());
+}
+
+TEST(MetricsTest, Gauge) {
+  Gauge gauge;
+  gauge.Set(3);
+  gauge.Add(2);
+  gauge.Add(-4);
+  EXPECT_EQ(1, gauge.value());
+}
+
+// Verify that every value falls inside its bucket, and that the buckets are
+// contiguous.
+TEST(MetricsTest, HistogramBuckets) {
+  EXPECT_EQ(0, Histogram::BucketIndex(0));
+  EXPECT_EQ(0, Histogram::BucketIndex(-5));
+  EXPECT_EQ(Histogram::kNumBuckets - 1,
+            Histogram::BucketIndex(Histogram::kMaxValue));
+  EXPECT_EQ(Histogram::kNumBuckets - 1,
+            Histogram::BucketIndex(Histogram::kMaxValue + 1));
+  EXPECT_EQ(Histogram::kMaxValue,
+            Histogram::BucketUpperBound(Histogram::kNumBuckets - 1));
+
+  for (int i = 1; i < Histogram::kNumBuckets; ++i) {
+    int64_t lower = Histogram::BucketUpperBound(i - 1) + 1;
+    int64_t upper = Histogram::BucketUpperBound(i);
+    ASSERT_LE(lower, upper);
+    ASSERT_EQ(i, Histogram::BucketIndex(lower));
+    ASSERT_EQ(i, Histogram::BucketIndex(upper));
+
+    // The relative width of each bucket is bounded.
+    ASSERT_LE(upper - lower, lower / Histogram::kNumSubBuckets);
+  }
+}
+
+TEST(MetricsTest, HistogramPercentiles) {
+  Histogram histogram;
+  EXPECT_EQ(0, histogram.Percentile(0.5));
+
+  for (int i = 1; i <= 10000; ++i) {
+    histogram.Record(i);
+  }
+  EXPECT_EQ(10000, histogram.count());
+  EXPECT_EQ(10000, histogram.max());
+  EXPECT_DOUBLE_EQ(5000.5, histogram.mean());
+
+  for (double q : {0.01, 0.1, 0.5, 0.9, 0.99}) {
+    double expected = q * 10000;
+    auto actual = histogram.Percentile(q);
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected * (1 + 1.0 / Histogram::kNumSubBuckets));
+  }
+  EXPECT_EQ(10000, histogram.Percentile(1));
+}
+
+TEST(MetricsTest, HistogramThreads) {
+  Histogram histogram;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&histogram, i]() {
+      for (int j = 0; j < 1000; ++j) {
+        histogram.Record(i * 1000 + j);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_EQ(4000, histogram.count());
+  EXPECT_EQ(3999, histogram.max());
+}
+
+TEST(MetricsTest, Registry) {
+  MetricsRegistry registry;
+  auto* counter = registry.GetCounter("b/counter");
+  EXPECT_EQ(counter, registry.GetCounter("b/counter"));
+  counter->Increment(2);
+  registry.GetGauge("a/gauge")->Set(7);
+  registry.GetHistogram("c/latency")->Record(5);
+
+  EXPECT_EQ(
+      "b/counter 2\n"
+      "a/gauge 7\n"
+      "c/latency count=1 mean=5 p50=5 p90=5 p99=5 p999=5 max=5\n",
+      registry.ToString());
+}
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,131 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Reconstructs the training examples of selfplay games written with
+// --example_format=compact, and writes them to a zlib compressed TFRecord file
+// in the same format as selfplay's --example_format=tfrecord, e.g.:
+//
+//   replay_games --output=examples.tfrecord.zz --samples_per_game=4
+//       games/*.game games/*.games
+//
+// The inputs may be .game files, or .games shards written with
+// --example_shard_mb, which hold a game per record.
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "cc/check.h"
+#include "cc/compact_game.h"
+#include "cc/init.h"
+#include "cc/random.h"
+#include "cc/tf_utils.h"
+#include "gflags/gflags.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/platform/env.h"
+
+DEFINE_string(output, "", "Path of the TFRecord file to write.");
+DEFINE_int32(samples_per_game, 0,
+             "Number of moves to sample from each game. If zero, write an "
+             "example for every move.");
+DEFINE_uint64(seed, 0, "Random seed for sampling moves.");
+
+namespace minigo {
+namespace {
+
+// Returns the encoded games in `path`.
+std::vector<std::string> ReadGames(const std::string& path) {
+  if (!absl::EndsWith(path, ".games")) {
+    std::string contents;
+    TF_CHECK_OK(tf_utils::ReadFile(path, &contents));
+    return {std::move(contents)};
+  }
+
+  std::unique_ptr<tensorflow::RandomAccessFile> file;
+  TF_CHECK_OK(tensorflow::Env::Default()->NewRandomAccessFile(path, &file));
+  tensorflow::io::RecordReader reader(file.get());
+  std::vector<std::string> games;
+  tensorflow::uint64 offset = 0;
+  for (;;) {
+    std::string record;
+    auto status = reader.ReadRecord(&offset, &record);
+    if (tensorflow::errors::IsOutOfRange(status)) {
+      break;
+    }
+    TF_CHECK_OK(status);
+    games.push_back(std::move(record));
+  }
+  return games;
+}
+
+// Returns the sorted indices of the moves to write examples for.
+std::vector<int> SampleMoves(int num_moves, Random* rnd) {
+  std::vector<int> indices(num_moves);
+  std::iota(indices.begin(), indices.end(), 0);
+  if (FLAGS_samples_per_game > 0 && FLAGS_samples_per_game < num_moves) {
+    // Partial Fisher-Yates shuffle.
+    for (int i = 0; i < FLAGS_samples_per_game; ++i) {
+      std::swap(indices[i], indices[rnd->UniformInt(i, num_moves - 1)]);
+    }
+    indices.resize(FLAGS_samples_per_game);
+    std::sort(indices.begin(), indices.end());
+  }
+  return indices;
+}
+
+void ReplayGames(const std::vector<std::string>& paths) {
+  MG_CHECK(!FLAGS_output.empty()) << "--output must be set";
+  MG_CHECK(FLAGS_samples_per_game >= 0);
+  MG_CHECK(!paths.empty()) << "No games given";
+
+  Random rnd(FLAGS_seed);
+  std::vector<tensorflow::Example> examples;
+  int num_games = 0;
+  for (const auto& path : paths) {
+    for (const auto& data : ReadGames(path)) {
+      CompactGame game;
+      MG_CHECK(DecodeCompactGame(data, &game)) << "Couldn't decode " << path;
+      auto indices = SampleMoves(game.moves.size(), &rnd);
+      ReplayCompactGame(
+          game, indices,
+          [&examples](int move_index, const DualNet::BoardFeatures& features,
+                      const std::array<float, kNumMoves>& search_pi,
+                      float outcome) {
+            examples.push_back(
+                tf_utils::MakeTfExample(features, search_pi, outcome));
+          });
+      num_games += 1;
+    }
+  }
+
+  tf_utils::WriteTfExamples(FLAGS_output, examples);
+  std::cerr << "Wrote " << examples.size() << " examples from " << num_games
+            << " games to " << FLAGS_output << std::endl;
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::ReplayGames({argv + 1, argv + argc});
+  return 0;
+}
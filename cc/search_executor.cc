@@ -0,0 +1,198 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/search_executor.h"
+
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "cc/check.h"
+
+namespace minigo {
+
+// A group of players whose leaves are evaluated together by one DualNet, on
+// an inference thread owned by the group.
+class SearchExecutor::Group {
+ public:
+  struct Slot {
+    int index;
+    MctsPlayer* player;
+    int num_features;
+  };
+
+  explicit Group(std::unique_ptr<DualNet> dual_net)
+      : dual_net_(std::move(dual_net)), thread_([this]() { ThreadRun(); }) {}
+
+  ~Group() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    thread_.join();
+  }
+
+  // Selects the next leaves of every player and starts evaluating them on
+  // the inference thread.
+  void PrepareInference() {
+    features_.clear();
+    for (auto& slot : slots) {
+      slot.num_features = slot.player->PrepareInference(&features_);
+    }
+    outputs_.resize(features_.size());
+    if (!features_.empty()) {
+      absl::MutexLock lock(&mutex_);
+      pending_ = true;
+    }
+  }
+
+  // Waits for the inference started by PrepareInference and passes the
+  // outputs to the players. Calls `search_done` for each player whose search
+  // is done, replacing or removing it.
+  void ProcessInference(const SearchDoneFn& search_done) {
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &Group::inference_done));
+    }
+
+    size_t begin = 0;
+    for (auto it = slots.begin(); it != slots.end();) {
+      it->player->ProcessInference(
+          absl::MakeConstSpan(outputs_).subspan(begin, it->num_features),
+          model_);
+      begin += it->num_features;
+      if (it->player->SearchDone()) {
+        it->player = search_done(it->index, it->player);
+        if (it->player == nullptr) {
+          it = slots.erase(it);
+          continue;
+        }
+      }
+      ++it;
+    }
+  }
+
+  std::vector<Slot> slots;
+
+ private:
+  void ThreadRun() {
+    for (;;) {
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(this, &Group::has_work));
+        if (stopping_) {
+          return;
+        }
+      }
+
+      // The calling thread doesn't touch the features, outputs or model while
+      // the inference is pending.
+      dual_net_->RunMany(features_, absl::MakeSpan(outputs_), &model_);
+
+      absl::MutexLock lock(&mutex_);
+      pending_ = false;
+    }
+  }
+
+  bool has_work() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return pending_ || stopping_;
+  }
+
+  bool inference_done() const EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    return !pending_;
+  }
+
+  std::unique_ptr<DualNet> dual_net_;
+  std::vector<DualNet::BoardFeatures> features_;
+  std::vector<DualNet::Output> outputs_;
+  std::string model_;
+
+  absl::Mutex mutex_;
+  bool pending_ GUARDED_BY(&mutex_) = false;
+  bool stopping_ GUARDED_BY(&mutex_) = false;
+
+  // Started last, once the members it uses have been initialized.
+  std::thread thread_;
+};
+
+SearchExecutor::SearchExecutor(
+    std::vector<std::unique_ptr<DualNet>> dual_nets) {
+  MG_CHECK(!dual_nets.empty());
+  for (auto& dual_net : dual_nets) {
+    groups_.push_back(absl::make_unique<Group>(std::move(dual_net)));
+  }
+}
+
+SearchExecutor::~SearchExecutor() = default;
+
+void SearchExecutor::Run(absl::Span<MctsPlayer* const> players,
+                         const SearchDoneFn& search_done) {
+  for (size_t i = 0; i < players.size(); ++i) {
+    Add(static_cast<int>(i), players[i]);
+  }
+  int next_group = 0;
+  for (auto& p : added_) {
+    if (p.group == -1) {
+      p.group = next_group;
+      next_group = (next_group + 1) % static_cast<int>(groups_.size());
+    }
+  }
+  for (size_t i = 0; i < groups_.size(); ++i) {
+    TakeAdded(static_cast<int>(i));
+    groups_[i]->PrepareInference();
+  }
+
+  // Visit the groups in turn, so that every other group's inference has had
+  // as long as possible to finish by the time its turn comes.
+  bool searching = true;
+  while (searching) {
+    searching = false;
+    for (size_t i = 0; i < groups_.size(); ++i) {
+      auto& group = groups_[i];
+      if (group->slots.empty() && added_.empty()) {
+        continue;
+      }
+      if (!group->slots.empty()) {
+        group->ProcessInference(search_done);
+      }
+      // Players added while searching join the group that is about to
+      // prepare its next inference, unless they were added for another one.
+      TakeAdded(static_cast<int>(i));
+      group->PrepareInference();
+      searching = true;
+    }
+  }
+}
+
+void SearchExecutor::Add(int index, MctsPlayer* player, int group) {
+  MG_CHECK(group >= -1 && group < static_cast<int>(groups_.size())) << group;
+  added_.push_back({index, player, group});
+}
+
+void SearchExecutor::TakeAdded(int group) {
+  size_t num_kept = 0;
+  for (const auto& p : added_) {
+    if (p.group == -1 || p.group == group) {
+      groups_[group]->slots.push_back({p.index, p.player, 0});
+    } else {
+      added_[num_kept++] = p;
+    }
+  }
+  added_.resize(num_kept);
+}
+
+}  // namespace minigo
@@ -0,0 +1,84 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_SEARCH_EXECUTOR_H_
+#define CC_SEARCH_EXECUTOR_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "cc/dual_net/dual_net.h"
+#include "cc/mcts_player.h"
+
+namespace minigo {
+
+// Runs the tree searches of many MctsPlayers on the calling thread, using the
+// steps of MctsPlayer::SuggestMove that never block on inference. Each search
+// is suspended while its leaves are evaluated and resumed once the outputs
+// arrive, so thousands of games can be searched without a thread each.
+//
+// The players are dealt into one group per DualNet. Each group's inference
+// runs on a thread of its own: while one group's leaves are being evaluated,
+// the calling thread searches the other groups, so neither the tree search nor
+// the inference engine waits on the other.
+class SearchExecutor {
+ public:
+  // Called on the calling thread of Run when the search of `player` is done.
+  // `index` is the position in Run's `players` of the player that `player`
+  // took over from, or of `player` itself. Typically plays the move returned
+  // by player->FinishSearch(). Returns the player to search next in its place:
+  // `player` after starting its next search, another player whose search has
+  // been started, or null to stop.
+  using SearchDoneFn = std::function<MctsPlayer*(int index, MctsPlayer*)>;
+
+  explicit SearchExecutor(std::vector<std::unique_ptr<DualNet>> dual_nets);
+  ~SearchExecutor();
+
+  // Searches with `players`, which must have started their searches, until
+  // `search_done` has returned null for all of them and for any players added
+  // by Add.
+  void Run(absl::Span<MctsPlayer* const> players,
+           const SearchDoneFn& search_done);
+
+  // Adds `player`, which must have started its search, to the players
+  // searched by Run. Run passes `index` to `search_done` for it. May be called
+  // from `search_done`, or before Run on the thread that calls Run. If `group`
+  // isn't -1, the player's leaves are evaluated by the DualNet at that
+  // position in the constructor's `dual_nets`, e.g. when the players of a
+  // game use different models.
+  void Add(int index, MctsPlayer* player, int group = -1);
+
+ private:
+  class Group;
+
+  std::vector<std::unique_ptr<Group>> groups_;
+
+  struct AddedPlayer {
+    int index;
+    MctsPlayer* player;
+    int group;
+  };
+
+  // Takes the players added for `group`, or for any group, into its slots.
+  void TakeAdded(int group);
+
+  // Players added by Add that haven't been dealt into a group yet.
+  std::vector<AddedPlayer> added_;
+};
+
+}  // namespace minigo
+
+#endif  // CC_SEARCH_EXECUTOR_H_
@@ -0,0 +1,201 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/search_executor.h"
+
+#include <memory>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "cc/constants.h"
+#include "cc/dual_net/fake_net.h"
+#include "cc/mcts_player.h"
+#include "cc/random.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+constexpr int kNumPlayers = 7;
+constexpr int kMovesPerGame = 10;
+
+MctsPlayer::Options GetOptions(int i) {
+  MctsPlayer::Options options;
+  options.random_seed = 17 + i;
+  options.num_readouts = 32;
+  options.batch_size = 4;
+  options.verbose = false;
+  return options;
+}
+
+// Verifies that searching with the SearchExecutor builds the same trees as
+// SuggestMove, for players split between several groups.
+TEST(SearchExecutorTest, MatchesSuggestMove) {
+  // Use priors that aren't uniform, so that the searches depend on the
+  // random symmetries being undone correctly.
+  Random rnd(1);
+  std::vector<float> priors(kNumMoves);
+  rnd.Uniform(0, 1, absl::MakeSpan(priors));
+  float sum = 0;
+  for (float p : priors) {
+    sum += p;
+  }
+  for (auto& p : priors) {
+    p /= sum;
+  }
+
+  std::vector<std::unique_ptr<MctsPlayer>> expected;
+  for (int i = 0; i < kNumPlayers; ++i) {
+    expected.push_back(absl::make_unique<MctsPlayer>(
+        absl::make_unique<FakeNet>(priors, 0.1), GetOptions(i)));
+    auto* player = expected.back().get();
+    while (!player->game_over() &&
+           player->history().size() < kMovesPerGame) {
+      player->PlayMove(player->SuggestMove());
+    }
+  }
+
+  std::vector<std::unique_ptr<MctsPlayer>> actual;
+  std::vector<MctsPlayer*> players;
+  for (int i = 0; i < kNumPlayers; ++i) {
+    actual.push_back(absl::make_unique<MctsPlayer>(nullptr, GetOptions(i)));
+    players.push_back(actual.back().get());
+    players.back()->StartSearch();
+  }
+
+  std::vector<std::unique_ptr<DualNet>> dual_nets;
+  for (int i = 0; i < 3; ++i) {
+    dual_nets.push_back(absl::make_unique<FakeNet>(priors, 0.1));
+  }
+  SearchExecutor executor(std::move(dual_nets));
+  executor.Run(players, [&](int index, MctsPlayer* player) -> MctsPlayer* {
+    EXPECT_EQ(players[index], player);
+    player->PlayMove(player->FinishSearch());
+    if (player->game_over() || player->history().size() >= kMovesPerGame) {
+      return nullptr;
+    }
+    player->StartSearch();
+    return player;
+  });
+
+  for (int i = 0; i < kNumPlayers; ++i) {
+    const auto& expected_history = expected[i]->history();
+    const auto& actual_history = actual[i]->history();
+    ASSERT_EQ(expected_history.size(), actual_history.size());
+    for (size_t j = 0; j < expected_history.size(); ++j) {
+      EXPECT_EQ(expected_history[j].c, actual_history[j].c);
+      EXPECT_EQ(expected_history[j].search_pi(),
+                actual_history[j].search_pi());
+      EXPECT_EQ(expected_history[j].node->N(), actual_history[j].node->N());
+    }
+  }
+}
+
+// Verifies that players can be replaced when their search is done.
+TEST(SearchExecutorTest, ReplacesPlayers) {
+  std::vector<std::unique_ptr<MctsPlayer>> owned;
+  std::vector<MctsPlayer*> players;
+  for (int i = 0; i < 2; ++i) {
+    owned.push_back(absl::make_unique<MctsPlayer>(nullptr, GetOptions(i)));
+    players.push_back(owned.back().get());
+    players.back()->StartSearch();
+  }
+
+  std::vector<std::unique_ptr<DualNet>> dual_nets;
+  dual_nets.push_back(absl::make_unique<FakeNet>());
+  SearchExecutor executor(std::move(dual_nets));
+  std::vector<int> num_searches(players.size());
+  executor.Run(players, [&](int index, MctsPlayer* player) -> MctsPlayer* {
+    player->FinishSearch();
+    if (++num_searches[index] == 3) {
+      return nullptr;
+    }
+    owned.push_back(absl::make_unique<MctsPlayer>(nullptr, GetOptions(0)));
+    owned.back()->StartSearch();
+    return owned.back().get();
+  });
+
+  EXPECT_EQ(std::vector<int>({3, 3}), num_searches);
+  EXPECT_EQ(6, owned.size());
+}
+
+// Verifies that players can be added before and during Run.
+TEST(SearchExecutorTest, AddsPlayers) {
+  std::vector<std::unique_ptr<MctsPlayer>> owned;
+  auto new_player = [&owned]() {
+    owned.push_back(absl::make_unique<MctsPlayer>(nullptr, GetOptions(0)));
+    owned.back()->StartSearch();
+    return owned.back().get();
+  };
+
+  std::vector<std::unique_ptr<DualNet>> dual_nets;
+  for (int i = 0; i < 2; ++i) {
+    dual_nets.push_back(absl::make_unique<FakeNet>());
+  }
+  SearchExecutor executor(std::move(dual_nets));
+  executor.Add(5, new_player());
+  std::vector<int> num_searches(8);
+  executor.Run({}, [&](int index, MctsPlayer* player) -> MctsPlayer* {
+    player->FinishSearch();
+    num_searches[index] += 1;
+    // The first player adds players 6 and 7, one at a time.
+    if (index == 5 && num_searches[index] <= 2) {
+      executor.Add(5 + num_searches[index], new_player());
+    }
+    if (num_searches[index] == 2) {
+      return nullptr;
+    }
+    player->StartSearch();
+    return player;
+  });
+
+  EXPECT_EQ(std::vector<int>({0, 0, 0, 0, 0, 2, 2, 2}), num_searches);
+  EXPECT_EQ(3, owned.size());
+}
+
+// Verifies that players added for a group are evaluated by its DualNet.
+TEST(SearchExecutorTest, AddsPlayersToGroups) {
+  // The DualNets' values tell which one evaluated a player's leaves.
+  std::vector<std::unique_ptr<DualNet>> dual_nets;
+  dual_nets.push_back(absl::make_unique<FakeNet>(absl::Span<const float>(), 1));
+  dual_nets.push_back(
+      absl::make_unique<FakeNet>(absl::Span<const float>(), -1));
+  SearchExecutor executor(std::move(dual_nets));
+
+  std::vector<std::unique_ptr<MctsPlayer>> owned;
+  for (int i = 0; i < 3; ++i) {
+    owned.push_back(absl::make_unique<MctsPlayer>(nullptr, GetOptions(i)));
+    owned.back()->StartSearch();
+  }
+  // Players 0 and 1 are both added for group 1 before Run, player 2 for group
+  // 0 during Run.
+  executor.Add(0, owned[0].get(), 1);
+  executor.Add(1, owned[1].get(), 1);
+  std::vector<float> q(owned.size());
+  executor.Run({}, [&](int index, MctsPlayer* player) -> MctsPlayer* {
+    q[index] = player->root()->Q();
+    player->FinishSearch();
+    if (index == 0) {
+      executor.Add(2, owned[2].get(), 0);
+    }
+    return nullptr;
+  });
+
+  EXPECT_LT(q[0], 0);
+  EXPECT_LT(q[1], 0);
+  EXPECT_GT(q[2], 0);
+}
+
+}  // namespace
+}  // namespace minigo
@@ -0,0 +1,36 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/search_visits.h"
+
+#include <cmath>
+
+namespace minigo {
+
+std::array<float, kNumMoves> SearchVisits::ToSearchPi() const {
+  std::array<float, kNumMoves> pi;
+  pi.fill(0);
+  float sum = 0;
+  for (const auto& count : counts) {
+    float n = count.n;
+    pi[count.c] = squash ? std::pow(n, kVisitCountSquash) : n;
+    sum += pi[count.c];
+  }
+  for (const auto& count : counts) {
+    pi[count.c] /= sum;
+  }
+  return pi;
+}
+
+}  // namespace minigo
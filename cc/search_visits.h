@@ -0,0 +1,48 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_SEARCH_VISITS_H_
+#define CC_SEARCH_VISITS_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "cc/constants.h"
+
+namespace minigo {
+
+// The visit counts of the root's children at the end of a tree search, from
+// which the search probabilities pi used as the policy training target are
+// computed. Only the visited children are stored, which is typically a few
+// dozen entries instead of a dense array of kNumMoves probabilities.
+struct SearchVisits {
+  struct Count {
+    uint16_t c;
+    uint32_t n;
+  };
+
+  // Returns pi: the visit counts normalized to sum to one. If `squash` is
+  // true, the counts are raised to the power kVisitCountSquash first, to match
+  // the soft pick of moves before the temperature cutoff.
+  std::array<float, kNumMoves> ToSearchPi() const;
+
+  // The nonzero visit counts, in increasing order of move.
+  std::vector<Count> counts;
+  bool squash = false;
+};
+
+}  // namespace minigo
+
+#endif  // CC_SEARCH_VISITS_H_
@@ -0,0 +1,63 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/search_visits.h"
+
+#include <cmath>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(SearchVisitsTest, ToSearchPi) {
+  SearchVisits visits;
+  visits.counts = {{0, 1}, {3, 3}, {kNumMoves - 1, 4}};
+  auto pi = visits.ToSearchPi();
+  for (int i = 0; i < kNumMoves; ++i) {
+    switch (i) {
+      case 0:
+        EXPECT_EQ(0.125, pi[i]);
+        break;
+      case 3:
+        EXPECT_EQ(0.375, pi[i]);
+        break;
+      case kNumMoves - 1:
+        EXPECT_EQ(0.5, pi[i]);
+        break;
+      default:
+        EXPECT_EQ(0, pi[i]);
+        break;
+    }
+  }
+}
+
+TEST(SearchVisitsTest, Squash) {
+  SearchVisits visits;
+  visits.counts = {{1, 1}, {2, 9}};
+  visits.squash = true;
+  auto pi = visits.ToSearchPi();
+  float n1 = std::pow(1.0f, kVisitCountSquash);
+  float n2 = std::pow(9.0f, kVisitCountSquash);
+  EXPECT_FLOAT_EQ(n1 / (n1 + n2), pi[1]);
+  EXPECT_FLOAT_EQ(n2 / (n1 + n2), pi[2]);
+
+  // Squashing moves probability towards the less visited moves.
+  EXPECT_LT(0.1, pi[1]);
+  EXPECT_GT(0.9, pi[2]);
+}
+
+}  // namespace
+}  // namespace minigo
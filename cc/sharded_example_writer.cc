@@ -0,0 +1,196 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/sharded_example_writer.h"
+
+#include <unistd.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "cc/check.h"
+#include "cc/file/filesystem.h"
+#include "cc/file/path.h"
+#include "cc/tf_utils.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
+
+using tensorflow::io::RecordWriter;
+using tensorflow::io::RecordWriterOptions;
+
+namespace minigo {
+
+namespace {
+
+// The TFRecord framing around each record: a uint64 length and the masked
+// CRC32C of the length before the data, and the masked CRC32C of the data
+// after it.
+constexpr int64_t kRecordOverhead = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+}  // namespace
+
+class ShardedExampleWriter::Shard {
+ public:
+  Shard(std::string path, absl::Duration flush_interval)
+      : path_(std::move(path)), flush_interval_(flush_interval) {}
+
+  // Closes the shard.
+  ~Shard() {
+    absl::MutexLock lock(&mutex_);
+    if (file_ == nullptr) {
+      return;
+    }
+    Flush();
+    TF_CHECK_OK(writer_->Close());
+    TF_CHECK_OK(file_->Close());
+    TF_CHECK_OK(index_file_->Close());
+    TF_CHECK_OK(tf_utils::WriteFile(path_ + ".done", ""));
+  }
+
+  void Write(const std::string& output_dir, const std::string& game_name,
+             absl::Span<const std::string> records) {
+    absl::MutexLock lock(&mutex_);
+    auto* env = tensorflow::Env::Default();
+    if (file_ == nullptr) {
+      // Open the files here rather than in the constructor, so that creating
+      // them doesn't hold up writes to other directories.
+      MG_CHECK(file::RecursivelyCreateDir(output_dir));
+      TF_CHECK_OK(env->NewWritableFile(path_, &file_));
+      TF_CHECK_OK(env->NewWritableFile(path_ + ".index", &index_file_));
+      writer_ =
+          absl::make_unique<RecordWriter>(file_.get(), RecordWriterOptions());
+      last_flush_time_ = absl::Now();
+    }
+
+    int64_t offset = num_bytes_;
+    for (const auto& record : records) {
+      TF_CHECK_OK(writer_->WriteRecord(record));
+      num_bytes_ += kRecordOverhead + record.size();
+    }
+    absl::StrAppend(&pending_index_, game_name, " ", num_records_, " ",
+                    records.size(), " ", offset, " ", num_bytes_ - offset,
+                    "\n");
+    num_records_ += records.size();
+
+    auto now = absl::Now();
+    if (now - last_flush_time_ >= flush_interval_) {
+      Flush();
+      last_flush_time_ = now;
+    }
+  }
+
+ private:
+  // Flushes the shard, then appends the index lines of the games it flushed.
+  void Flush() EXCLUSIVE_LOCKS_REQUIRED(&mutex_) {
+    TF_CHECK_OK(writer_->Flush());
+    TF_CHECK_OK(index_file_->Append(pending_index_));
+    TF_CHECK_OK(index_file_->Flush());
+    pending_index_.clear();
+  }
+
+  const std::string path_;
+  const absl::Duration flush_interval_;
+
+  absl::Mutex mutex_;
+  std::unique_ptr<tensorflow::WritableFile> file_ GUARDED_BY(&mutex_);
+  std::unique_ptr<RecordWriter> writer_ GUARDED_BY(&mutex_);
+  std::unique_ptr<tensorflow::WritableFile> index_file_ GUARDED_BY(&mutex_);
+  int64_t num_bytes_ GUARDED_BY(&mutex_) = 0;
+  int64_t num_records_ GUARDED_BY(&mutex_) = 0;
+  // The index lines of the games written since the last flush.
+  std::string pending_index_ GUARDED_BY(&mutex_);
+  absl::Time last_flush_time_ GUARDED_BY(&mutex_);
+};
+
+ShardedExampleWriter::ShardedExampleWriter(const Options& options)
+    : options_(options) {
+  char hostname[64];
+  if (gethostname(hostname, sizeof(hostname)) != 0) {
+    hostname_ = "unknown";
+  } else {
+    hostname_ = hostname;
+  }
+}
+
+ShardedExampleWriter::~ShardedExampleWriter() { Close(); }
+
+void ShardedExampleWriter::Write(
+    const std::string& output_dir, const std::string& game_name,
+    absl::Span<const tensorflow::Example> examples) {
+  // Serialize the examples before taking the lock.
+  std::vector<std::string> records(examples.size());
+  for (size_t i = 0; i < examples.size(); ++i) {
+    examples[i].SerializeToString(&records[i]);
+  }
+  Write(output_dir, game_name, records);
+}
+
+void ShardedExampleWriter::Write(const std::string& output_dir,
+                                 const std::string& game_name,
+                                 absl::Span<const std::string> records) {
+  int64_t num_bytes = 0;
+  for (const auto& record : records) {
+    num_bytes += kRecordOverhead + record.size();
+  }
+
+  // Pick the shard to write to, and close it to later games if this one takes
+  // it over max_shard_bytes. Shards removed from shards_ are closed when the
+  // last reference to them is dropped, outside the lock.
+  auto now = absl::Now();
+  std::vector<std::shared_ptr<Shard>> closed;
+  std::shared_ptr<Shard> shard;
+  {
+    absl::MutexLock lock(&mutex_);
+    RemoveShardsOlderThan(now - options_.max_shard_age, &closed);
+
+    auto& open_shard = shards_[output_dir];
+    if (open_shard.shard == nullptr) {
+      auto name = absl::StrCat(absl::ToUnixSeconds(now), "-", hostname_,
+                               "-shard-", num_shards_++, options_.extension);
+      open_shard.shard = std::make_shared<Shard>(
+          file::JoinPath(output_dir, name), options_.flush_interval);
+      open_shard.open_time = now;
+    }
+    shard = open_shard.shard;
+    open_shard.num_bytes += num_bytes;
+    if (open_shard.num_bytes >= options_.max_shard_bytes) {
+      shards_.erase(output_dir);
+    }
+  }
+
+  shard->Write(output_dir, game_name, records);
+}
+
+void ShardedExampleWriter::Close() {
+  std::vector<std::shared_ptr<Shard>> closed;
+  absl::MutexLock lock(&mutex_);
+  RemoveShardsOlderThan(absl::InfiniteFuture(), &closed);
+}
+
+void ShardedExampleWriter::RemoveShardsOlderThan(
+    absl::Time time, std::vector<std::shared_ptr<Shard>>* closed) {
+  for (auto it = shards_.begin(); it != shards_.end();) {
+    if (it->second.open_time < time) {
+      closed->push_back(std::move(it->second.shard));
+      it = shards_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace minigo
@@ -0,0 +1,120 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_SHARDED_EXAMPLE_WRITER_H_
+#define CC_SHARDED_EXAMPLE_WRITER_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/example/example.pb.h"
+
+namespace minigo {
+
+// Appends the training examples of many games to large TFRecord shards,
+// instead of writing a small file per game. Games in the compact format are
+// written as a single record each.
+//
+// Each output directory has at most one open shard. A shard is closed, and
+// the next game written to its directory starts a new one, once it is larger
+// than `max_shard_bytes` or older than `max_shard_age`. Shards are named
+// "<timestamp>-<hostname>-shard-<n><extension>".
+//
+// Each shard has an index next to it, at the same path with ".index"
+// appended. The index has one line per game:
+//   <game name> <first record> <num records> <byte offset> <num bytes>
+// The byte range covers the game's records, so samplers can read a game's
+// examples without reading the rest of the shard. This is also why shards
+// aren't compressed. A game's line is appended to the index once its records
+// have been flushed to the shard, so the games listed in the index of a shard
+// that is still open, or that was left open by a crash, can be read. When a
+// shard is closed, an empty file is written to its path with ".done"
+// appended, to mark it complete.
+//
+// Write may be called from multiple threads. Writes to different directories
+// don't wait for each other.
+class ShardedExampleWriter {
+ public:
+  struct Options {
+    int64_t max_shard_bytes = int64_t(256) << 20;
+    absl::Duration max_shard_age = absl::Hours(1);
+    // Shards and their indexes are flushed after a game is written if they
+    // haven't been for this long, so by default after every game. A flush
+    // uploads a gs:// file again from the start, so shards written there may
+    // want a longer interval, at the cost of losing the games since the last
+    // flush if the process dies.
+    absl::Duration flush_interval = absl::ZeroDuration();
+    // Shards of compact games use a different extension, so that readers of
+    // tf.Example shards don't pick them up.
+    std::string extension = ".tfrecord";
+  };
+
+  explicit ShardedExampleWriter(const Options& options);
+
+  // Closes all open shards.
+  ~ShardedExampleWriter();
+
+  // Appends the examples of the game `game_name` to the open shard in
+  // `output_dir`. Also closes any shard that has been open for longer than
+  // `max_shard_age`, so that shards in directories that are no longer written
+  // to, e.g. the previous hour's, are closed promptly.
+  void Write(const std::string& output_dir, const std::string& game_name,
+             absl::Span<const tensorflow::Example> examples);
+
+  // Appends already serialized records, e.g. a game in the compact format.
+  void Write(const std::string& output_dir, const std::string& game_name,
+             absl::Span<const std::string> records);
+
+  // Closes all open shards. A shard that another thread is still writing to is
+  // closed when that write finishes.
+  void Close();
+
+ private:
+  class Shard;
+
+  struct OpenShard {
+    // Shared with the threads writing to the shard, the last of which closes
+    // it.
+    std::shared_ptr<Shard> shard;
+    absl::Time open_time;
+    // Includes the games that are still being written.
+    int64_t num_bytes = 0;
+  };
+
+  // Moves the shards opened before `time` out of `shards_` into `closed`.
+  void RemoveShardsOlderThan(absl::Time time,
+                             std::vector<std::shared_ptr<Shard>>* closed)
+      EXCLUSIVE_LOCKS_REQUIRED(&mutex_);
+
+  const Options options_;
+  std::string hostname_;
+
+  // Only guards the map of open shards: each shard has its own mutex for the
+  // writes to it.
+  absl::Mutex mutex_;
+  // Open shards, keyed by output directory.
+  std::map<std::string, OpenShard> shards_ GUARDED_BY(&mutex_);
+  int num_shards_ GUARDED_BY(&mutex_) = 0;
+};
+
+}  // namespace minigo
+
+#endif  // CC_SHARDED_EXAMPLE_WRITER_H_
@@ -0,0 +1,318 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cc/sharded_example_writer.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "cc/file/filesystem.h"
+#include "cc/file/path.h"
+#include "cc/tf_utils.h"
+#include "gtest/gtest.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/platform/env.h"
+
+namespace minigo {
+namespace {
+
+// The size of a record in a shard, including the TFRecord framing.
+int64_t RecordBytes(const std::string& record) { return 16 + record.size(); }
+
+struct IndexEntry {
+  std::string game_name;
+  int64_t first_record;
+  int64_t num_records;
+  int64_t offset;
+  int64_t num_bytes;
+};
+
+class ShardedExampleWriterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    const auto* info = testing::UnitTest::GetInstance()->current_test_info();
+    directory_ = file::JoinPath(
+        testing::TempDir(),
+        absl::StrCat("sharded_example_writer_", getpid(), "_", info->name()));
+  }
+
+  // Returns the sorted names of the files in `dir` that end with `suffix`.
+  static std::vector<std::string> ListFiles(const std::string& dir,
+                                            const std::string& suffix) {
+    std::vector<std::string> files, matches;
+    if (file::ListDir(dir, &files)) {
+      for (const auto& name : files) {
+        if (absl::EndsWith(name, suffix)) {
+          matches.push_back(file::JoinPath(dir, name));
+        }
+      }
+    }
+    std::sort(matches.begin(), matches.end());
+    return matches;
+  }
+
+  static std::vector<IndexEntry> ReadIndex(const std::string& shard_path) {
+    std::string contents;
+    TF_CHECK_OK(tf_utils::ReadFile(shard_path + ".index", &contents));
+    std::istringstream lines(contents);
+    std::vector<IndexEntry> entries;
+    IndexEntry e;
+    while (lines >> e.game_name >> e.first_record >> e.num_records >>
+           e.offset >> e.num_bytes) {
+      entries.push_back(e);
+    }
+    return entries;
+  }
+
+  // Reads a game's records from its shard, starting at the byte offset in its
+  // index entry.
+  static std::vector<std::string> ReadGame(const std::string& shard_path,
+                                           const IndexEntry& entry) {
+    std::unique_ptr<tensorflow::RandomAccessFile> file;
+    TF_CHECK_OK(
+        tensorflow::Env::Default()->NewRandomAccessFile(shard_path, &file));
+    tensorflow::io::RecordReader reader(file.get());
+    tensorflow::uint64 offset = entry.offset;
+    std::vector<std::string> records;
+    for (int64_t i = 0; i < entry.num_records; ++i) {
+      std::string record;
+      TF_CHECK_OK(reader.ReadRecord(&offset, &record));
+      records.push_back(std::move(record));
+    }
+    // The game's records end exactly at the end of its byte range.
+    EXPECT_EQ(entry.offset + entry.num_bytes, offset);
+    return records;
+  }
+
+  std::string directory_;
+};
+
+TEST_F(ShardedExampleWriterTest, RotatesBySize) {
+  ShardedExampleWriter::Options options;
+  options.max_shard_bytes = 100;
+  ShardedExampleWriter writer(options);
+
+  std::vector<std::string> a = {std::string(30, 'a'), std::string(30, 'b')};
+  std::vector<std::string> b = {std::string(30, 'c')};
+  std::vector<std::string> c = {std::string(10, 'd')};
+  writer.Write(directory_, "a", a);
+  EXPECT_EQ(1, ListFiles(directory_, ".tfrecord").size());
+  EXPECT_EQ(1, ListFiles(directory_, ".index").size());
+  EXPECT_EQ(0, ListFiles(directory_, ".done").size());
+
+  // Game b takes the shard over max_shard_bytes, so game c starts a new one.
+  writer.Write(directory_, "b", b);
+  EXPECT_EQ(1, ListFiles(directory_, ".done").size());
+  writer.Write(directory_, "c", c);
+  EXPECT_EQ(2, ListFiles(directory_, ".tfrecord").size());
+  EXPECT_EQ(2, ListFiles(directory_, ".index").size());
+  EXPECT_EQ(1, ListFiles(directory_, ".done").size());
+  writer.Close();
+
+  auto shards = ListFiles(directory_, ".tfrecord");
+  ASSERT_EQ(2, shards.size());
+  EXPECT_EQ(2, ListFiles(directory_, ".done").size());
+  for (const auto& shard : shards) {
+    EXPECT_TRUE(absl::StrContains(shard, "-shard-")) << shard;
+  }
+
+  auto index = ReadIndex(shards[0]);
+  ASSERT_EQ(2, index.size());
+  int64_t a_bytes = RecordBytes(a[0]) + RecordBytes(a[1]);
+  EXPECT_EQ("a", index[0].game_name);
+  EXPECT_EQ(0, index[0].first_record);
+  EXPECT_EQ(2, index[0].num_records);
+  EXPECT_EQ(0, index[0].offset);
+  EXPECT_EQ(a_bytes, index[0].num_bytes);
+  EXPECT_EQ("b", index[1].game_name);
+  EXPECT_EQ(2, index[1].first_record);
+  EXPECT_EQ(1, index[1].num_records);
+  EXPECT_EQ(a_bytes, index[1].offset);
+  EXPECT_EQ(RecordBytes(b[0]), index[1].num_bytes);
+
+  uint64_t size;
+  ASSERT_TRUE(file::GetFileSize(shards[0], &size));
+  EXPECT_EQ(index[1].offset + index[1].num_bytes, size);
+
+  index = ReadIndex(shards[1]);
+  ASSERT_EQ(1, index.size());
+  EXPECT_EQ("c", index[0].game_name);
+  EXPECT_EQ(0, index[0].first_record);
+  EXPECT_EQ(0, index[0].offset);
+}
+
+TEST_F(ShardedExampleWriterTest, RotatesByAge) {
+  ShardedExampleWriter::Options options;
+  options.max_shard_age = absl::Milliseconds(10);
+  ShardedExampleWriter writer(options);
+  auto dir1 = file::JoinPath(directory_, "1");
+  auto dir2 = file::JoinPath(directory_, "2");
+
+  writer.Write(dir1, "a", {std::string("a")});
+  writer.Write(dir1, "b", {std::string("b")});
+  EXPECT_EQ(1, ListFiles(dir1, ".tfrecord").size());
+  EXPECT_EQ(0, ListFiles(dir1, ".done").size());
+
+  // Writing to any directory closes the shards that are too old, so a
+  // directory that is no longer written to doesn't keep its shard open.
+  absl::SleepFor(absl::Milliseconds(20));
+  writer.Write(dir2, "c", {std::string("c")});
+  EXPECT_EQ(1, ListFiles(dir1, ".done").size());
+  EXPECT_EQ(0, ListFiles(dir2, ".done").size());
+
+  absl::SleepFor(absl::Milliseconds(20));
+  writer.Write(dir2, "d", {std::string("d")});
+  EXPECT_EQ(2, ListFiles(dir2, ".tfrecord").size());
+  EXPECT_EQ(1, ListFiles(dir2, ".done").size());
+
+  auto shards = ListFiles(dir1, ".tfrecord");
+  ASSERT_EQ(1, shards.size());
+  auto index = ReadIndex(shards[0]);
+  ASSERT_EQ(2, index.size());
+  EXPECT_EQ("a", index[0].game_name);
+  EXPECT_EQ("b", index[1].game_name);
+}
+
+TEST_F(ShardedExampleWriterTest, ReadsGameThroughIndex) {
+  std::vector<std::vector<std::string>> games = {
+      {"first", "second", "third"},
+      {"fourth"},
+      {"fifth", std::string(1000, 'x')},
+  };
+  {
+    ShardedExampleWriter writer(ShardedExampleWriter::Options{});
+    for (size_t i = 0; i < games.size(); ++i) {
+      writer.Write(directory_, absl::StrCat("game", i), games[i]);
+    }
+  }
+
+  auto shards = ListFiles(directory_, ".tfrecord");
+  ASSERT_EQ(1, shards.size());
+  auto index = ReadIndex(shards[0]);
+  ASSERT_EQ(games.size(), index.size());
+  // Read the games out of order, each through its own index entry.
+  for (int i : {2, 0, 1}) {
+    EXPECT_EQ(absl::StrCat("game", i), index[i].game_name);
+    EXPECT_EQ(games[i], ReadGame(shards[0], index[i]));
+  }
+}
+
+// Verifies that the games in a shard can be read through its index before
+// the shard is closed, e.g. if the process dies.
+TEST_F(ShardedExampleWriterTest, IndexesGamesBeforeClose) {
+  ShardedExampleWriter writer(ShardedExampleWriter::Options{});
+  std::vector<std::string> a = {"a0", "a1"};
+  std::vector<std::string> b = {"b0"};
+  writer.Write(directory_, "a", a);
+  writer.Write(directory_, "b", b);
+
+  auto shards = ListFiles(directory_, ".tfrecord");
+  ASSERT_EQ(1, shards.size());
+  EXPECT_EQ(0, ListFiles(directory_, ".done").size());
+  auto index = ReadIndex(shards[0]);
+  ASSERT_EQ(2, index.size());
+  EXPECT_EQ(a, ReadGame(shards[0], index[0]));
+  EXPECT_EQ(b, ReadGame(shards[0], index[1]));
+}
+
+TEST_F(ShardedExampleWriterTest, FlushesAfterInterval) {
+  ShardedExampleWriter::Options options;
+  options.flush_interval = absl::Hours(1);
+  ShardedExampleWriter writer(options);
+  writer.Write(directory_, "a", {std::string("a")});
+
+  auto shards = ListFiles(directory_, ".tfrecord");
+  ASSERT_EQ(1, shards.size());
+  EXPECT_EQ(0, ReadIndex(shards[0]).size());
+
+  // Closing the shard flushes the games written since the last flush.
+  writer.Close();
+  auto index = ReadIndex(shards[0]);
+  ASSERT_EQ(1, index.size());
+  EXPECT_EQ("a", index[0].game_name);
+}
+
+// Verifies that games written from many threads to many directories are all
+// indexed once.
+TEST_F(ShardedExampleWriterTest, WritesFromManyThreads) {
+  constexpr int kNumThreads = 4;
+  constexpr int kNumDirs = 3;
+  constexpr int kGamesPerThread = 50;
+  ShardedExampleWriter::Options options;
+  options.max_shard_bytes = 1000;
+  {
+    ShardedExampleWriter writer(options);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+      threads.emplace_back([&writer, i, this]() {
+        for (int j = 0; j < kGamesPerThread; ++j) {
+          auto dir = file::JoinPath(directory_, absl::StrCat(j % kNumDirs));
+          auto name = absl::StrCat(i, "_", j);
+          writer.Write(dir, name, {name, std::string(j, 'x')});
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::set<std::string> names;
+  for (int i = 0; i < kNumDirs; ++i) {
+    auto dir = file::JoinPath(directory_, absl::StrCat(i));
+    auto shards = ListFiles(dir, ".tfrecord");
+    EXPECT_EQ(shards.size(), ListFiles(dir, ".done").size());
+    for (const auto& shard : shards) {
+      for (const auto& entry : ReadIndex(shard)) {
+        auto records = ReadGame(shard, entry);
+        ASSERT_EQ(2, records.size());
+        EXPECT_EQ(entry.game_name, records[0]);
+        EXPECT_TRUE(names.insert(entry.game_name).second) << entry.game_name;
+      }
+    }
+  }
+  EXPECT_EQ(kNumThreads * kGamesPerThread, names.size());
+}
+
+TEST_F(ShardedExampleWriterTest, UsesExtension) {
+  ShardedExampleWriter::Options options;
+  options.extension = ".games";
+  {
+    ShardedExampleWriter writer(options);
+    writer.Write(directory_, "game", std::vector<std::string>{"compact"});
+  }
+
+  EXPECT_TRUE(ListFiles(directory_, ".tfrecord").empty());
+  auto shards = ListFiles(directory_, ".games");
+  ASSERT_EQ(1, shards.size());
+  auto index = ReadIndex(shards[0]);
+  ASSERT_EQ(1, index.size());
+  EXPECT_EQ(std::vector<std::string>{"compact"}, ReadGame(shards[0], index[0]));
+}
+
+}  // namespace
+}  // namespace minigo
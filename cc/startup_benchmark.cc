@@ -0,0 +1,93 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how long selfplay takes to start: the time to load the model, to
+// create a DualNet for each of --parallel_games game threads, and for each
+// game to play its first move, e.g.:
+//
+//   startup_benchmark --engine=tf --model=model.pb --parallel_games=32
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/check.h"
+#include "cc/dual_net/factory.h"
+#include "cc/init.h"
+#include "cc/mcts_player.h"
+#include "gflags/gflags.h"
+
+DEFINE_string(model, "", "Path to the model to load.");
+DEFINE_int32(parallel_games, 32, "Number of games to start in parallel.");
+DEFINE_int32(num_readouts, 100,
+             "Number of readouts to make during tree search for each move.");
+DEFINE_int32(virtual_losses, 8,
+             "Number of virtual losses when running tree search.");
+
+namespace minigo {
+namespace {
+
+void PrintTimes(const char* name, std::vector<absl::Duration> times) {
+  std::sort(times.begin(), times.end());
+  std::cout << name << ": min " << times.front() << ", median "
+            << times[times.size() / 2] << ", max " << times.back()
+            << std::endl;
+}
+
+void Benchmark() {
+  MG_CHECK(!FLAGS_model.empty()) << "--model must be set";
+  MG_CHECK(FLAGS_parallel_games > 0);
+
+  auto start_time = absl::Now();
+  auto factory = NewDualNetFactory(FLAGS_model, FLAGS_parallel_games);
+  std::cout << "Load model: " << absl::Now() - start_time << std::endl;
+
+  MctsPlayer::Options options;
+  options.batch_size = FLAGS_virtual_losses;
+  options.num_readouts = FLAGS_num_readouts;
+  options.verbose = false;
+
+  // Like selfplay, each thread creates its own DualNet.
+  std::vector<absl::Duration> dual_net_times(FLAGS_parallel_games);
+  std::vector<absl::Duration> first_move_times(FLAGS_parallel_games);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < FLAGS_parallel_games; ++i) {
+    threads.emplace_back([&, i]() {
+      auto player = absl::make_unique<MctsPlayer>(factory->New(), options);
+      dual_net_times[i] = absl::Now() - start_time;
+      player->PlayMove(player->SuggestMove());
+      first_move_times[i] = absl::Now() - start_time;
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  PrintTimes("Create DualNet", dual_net_times);
+  PrintTimes("First move", first_move_times);
+}
+
+}  // namespace
+}  // namespace minigo
+
+int main(int argc, char* argv[]) {
+  minigo::Init(&argc, &argv);
+  minigo::Benchmark();
+  return 0;
+}
@@ -16,6 +16,8 @@
 
 #include <memory>
 #include "absl/types/span.h"
+#include "tensorflow/core/lib/core/coding.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
 #include "tensorflow/core/lib/io/record_writer.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/file_system.h"
@@ -46,6 +48,25 @@ tensorflow::Feature MakeBytesFeature(const T& data) {
   return feature;
 }
 
+// Appends `data` to `records` as a TFRecord: its length, the masked CRC32C of
+// the length, the data and the masked CRC32C of the data.
+void AppendRecord(const std::string& data, std::string* records) {
+  char header[sizeof(uint64_t) + sizeof(uint32_t)];
+  tensorflow::core::EncodeFixed64(header, data.size());
+  tensorflow::core::EncodeFixed32(
+      header + sizeof(uint64_t),
+      tensorflow::crc32c::Mask(
+          tensorflow::crc32c::Value(header, sizeof(uint64_t))));
+  char footer[sizeof(uint32_t)];
+  tensorflow::core::EncodeFixed32(
+      footer, tensorflow::crc32c::Mask(
+                  tensorflow::crc32c::Value(data.data(), data.size())));
+
+  records->append(header, sizeof(header));
+  records->append(data);
+  records->append(footer, sizeof(footer));
+}
+
 }  // namespace
 
 tensorflow::Example MakeTfExample(const DualNet::BoardFeatures& features,
@@ -68,12 +89,36 @@ tensorflow::Example MakeTfExample(const DualNet::BoardFeatures& features,
 
 void WriteTfExamples(const std::string& path,
                      absl::Span<const tensorflow::Example> examples) {
+  WriteTfExamples(path, examples, CompressionOptions(), nullptr);
+}
+
+void WriteTfExamples(const std::string& path,
+                     absl::Span<const tensorflow::Example> examples,
+                     const CompressionOptions& options,
+                     ParallelZlibCompressor* compressor) {
+  bool zlib = options.codec == CompressionOptions::Codec::kZlib;
+  if (zlib && compressor != nullptr) {
+    // Frame the records in memory, so that the whole file can be compressed
+    // in parallel.
+    std::string records;
+    std::string data;
+    for (const auto& example : examples) {
+      example.SerializeToString(&data);
+      AppendRecord(data, &records);
+    }
+    TF_CHECK_OK(WriteFile(path, compressor->Compress(records, options.level)));
+    return;
+  }
+
   std::unique_ptr<tensorflow::WritableFile> file;
   TF_CHECK_OK(tensorflow::Env::Default()->NewWritableFile(path, &file));
 
-  RecordWriterOptions options;
-  options.compression_type = RecordWriterOptions::ZLIB_COMPRESSION;
-  RecordWriter writer(file.get(), options);
+  RecordWriterOptions record_options;
+  if (zlib) {
+    record_options.compression_type = RecordWriterOptions::ZLIB_COMPRESSION;
+    record_options.zlib_options.compression_level = options.level;
+  }
+  RecordWriter writer(file.get(), record_options);
 
   std::string data;
   for (const auto& example : examples) {
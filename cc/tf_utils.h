@@ -18,6 +18,7 @@
 #include <array>
 #include <string>
 
+#include "cc/compression.h"
 #include "cc/constants.h"
 #include "cc/dual_net/dual_net.h"
 
@@ -38,6 +39,15 @@ tensorflow::Example MakeTfExample(const DualNet::BoardFeatures& features,
 void WriteTfExamples(const std::string& path,
                      absl::Span<const tensorflow::Example> examples);
 
+// Writes a list of tensorflow Example protos to a TFRecord file compressed as
+// `options` specifies. If `compressor` is non-null, zlib compression runs on
+// its worker threads instead of the calling thread. The file is a regular
+// ZLIB TFRecord file either way.
+void WriteTfExamples(const std::string& path,
+                     absl::Span<const tensorflow::Example> examples,
+                     const CompressionOptions& options,
+                     ParallelZlibCompressor* compressor);
+
 // Uses Tensorflow to write a file in one shot. This allows writing to GCS, etc
 // when Tensorflow is compiled with that support.
 __attribute__((warn_unused_result)) tensorflow::Status WriteFile(
@@ -0,0 +1,94 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/thread_affinity.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <tuple>
+
+#include "absl/strings/str_cat.h"
+
+namespace minigo {
+
+namespace {
+
+// Reads an integer topology attribute of `cpu` from sysfs, returning -1 if it
+// isn't available (e.g. in some containers).
+int ReadTopology(int cpu, const char* name) {
+  std::ifstream f(
+      absl::StrCat("/sys/devices/system/cpu/cpu", cpu, "/topology/", name));
+  int value = -1;
+  if (!(f >> value)) {
+    return -1;
+  }
+  return value;
+}
+
+}  // namespace
+
+std::vector<int> GetAllowedCpus() {
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+    return {};
+  }
+
+  // Sort by (package, core, cpu).
+  std::vector<std::tuple<int, int, int>> topology;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &mask)) {
+      topology.emplace_back(ReadTopology(cpu, "physical_package_id"),
+                            ReadTopology(cpu, "core_id"), cpu);
+    }
+  }
+  std::sort(topology.begin(), topology.end());
+
+  std::vector<int> cpus;
+  for (const auto& t : topology) {
+    cpus.push_back(std::get<2>(t));
+  }
+  return cpus;
+}
+
+std::vector<int> GetCpuGroup(const std::vector<int>& cpus, int num_groups,
+                             int index) {
+  int n = static_cast<int>(cpus.size());
+  if (n == 0 || num_groups <= 0) {
+    return {};
+  }
+  if (num_groups >= n) {
+    return {cpus[index % n]};
+  }
+  index %= num_groups;
+  return {cpus.begin() + index * n / num_groups,
+          cpus.begin() + (index + 1) * n / num_groups};
+}
+
+bool PinCurrentThread(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return false;
+  }
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &mask);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+}  // namespace minigo
@@ -0,0 +1,40 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CC_THREAD_AFFINITY_H_
+#define CC_THREAD_AFFINITY_H_
+
+#include <vector>
+
+namespace minigo {
+
+// Returns the CPUs that the calling thread is allowed to run on, ordered by
+// physical package and then by core, so that hyperthreads of the same core are
+// adjacent. Contiguous ranges of the result share as much cache as possible.
+std::vector<int> GetAllowedCpus();
+
+// Splits `cpus` into `num_groups` contiguous groups of near equal size and
+// returns group `index`. If there are more groups than CPUs, each group is a
+// single CPU, assigned round robin.
+std::vector<int> GetCpuGroup(const std::vector<int>& cpus, int num_groups,
+                             int index);
+
+// Restricts the calling thread to the given CPUs. Threads that it starts
+// afterwards inherit the restriction. Returns false if the affinity couldn't
+// be set.
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+}  // namespace minigo
+
+#endif  // CC_THREAD_AFFINITY_H_
@@ -0,0 +1,58 @@
+// Copyright 2018 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/thread_affinity.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace minigo {
+namespace {
+
+TEST(ThreadAffinityTest, GetCpuGroup) {
+  std::vector<int> cpus = {0, 4, 1, 5, 2, 6, 3, 7};
+  EXPECT_EQ(std::vector<int>({0, 4, 1, 5}), GetCpuGroup(cpus, 2, 0));
+  EXPECT_EQ(std::vector<int>({2, 6, 3, 7}), GetCpuGroup(cpus, 2, 1));
+
+  // Groups that don't divide the CPUs evenly.
+  EXPECT_EQ(std::vector<int>({0, 4}), GetCpuGroup(cpus, 3, 0));
+  EXPECT_EQ(std::vector<int>({1, 5, 2}), GetCpuGroup(cpus, 3, 1));
+  EXPECT_EQ(std::vector<int>({6, 3, 7}), GetCpuGroup(cpus, 3, 2));
+
+  // More groups than CPUs.
+  EXPECT_EQ(std::vector<int>({4}), GetCpuGroup(cpus, 10, 1));
+  EXPECT_EQ(std::vector<int>({1}), GetCpuGroup(cpus, 10, 10));
+
+  EXPECT_TRUE(GetCpuGroup({}, 2, 0).empty());
+}
+
+TEST(ThreadAffinityTest, PinCurrentThread) {
+  auto cpus = GetAllowedCpus();
+  ASSERT_FALSE(cpus.empty());
+
+  // Pin a new thread, so that the test thread's affinity is left untouched.
+  // Threads started by the pinned thread inherit its affinity.
+  std::vector<int> inherited;
+  std::thread([&]() {
+    ASSERT_TRUE(PinCurrentThread({cpus.back()}));
+    std::thread([&]() { inherited = GetAllowedCpus(); }).join();
+  }).join();
+  EXPECT_EQ(std::vector<int>({cpus.back()}), inherited);
+  EXPECT_EQ(cpus, GetAllowedCpus());
+}
+
+}  // namespace
+}  // namespace minigo
@@ -386,6 +386,62 @@ def model_inference_fn(features, training):
     return policy_output, value_output, logits
 
 
+# Header of the model files read by cc/dual_net/native_dual_net.cc.
+NATIVE_MODEL_MAGIC = 0x4e4e474d  # 'MGNN'
+NATIVE_MODEL_VERSION = 1
+
+
+def export_native_model(sess, path):
+    """Writes the weights of the model in sess for the C++ native engine.
+
+    Each batch normalization is folded into the convolution that precedes it,
+    so the file holds just the weights and biases of each layer, in the order
+    they are applied. See NativeModel in cc/dual_net/native_dual_net.h for the
+    format.
+
+    Args:
+        sess: a session whose graph was built by model_inference_fn with
+            training=False and whose variables have been restored.
+        path: the file to write.
+    """
+    values = {v.op.name: v for v in tf.global_variables()}
+
+    def layer_name(name, index):
+        return name if index == 0 else '{}_{}'.format(name, index)
+
+    def get(name):
+        return sess.run(values[name])
+
+    def folded_conv(index):
+        conv = layer_name('conv2d', index)
+        bn = layer_name('batch_normalization', index)
+        weights = get(conv + '/kernel')
+        mean = get(bn + '/moving_mean')
+        variance = get(bn + '/moving_variance')
+        gamma = get(bn + '/gamma') if bn + '/gamma' in values else 1
+        beta = get(bn + '/beta') if bn + '/beta' in values else 0
+        scale = gamma / np.sqrt(variance + 1e-5)
+        return [weights * scale, beta - mean * scale]
+
+    def dense(index):
+        name = layer_name('dense', index)
+        return [get(name + '/kernel'), get(name + '/bias')]
+
+    arrays = folded_conv(0)
+    for i in range(FLAGS.trunk_layers):
+        arrays += folded_conv(2 * i + 1) + folded_conv(2 * i + 2)
+    arrays += folded_conv(2 * FLAGS.trunk_layers + 1) + dense(0)
+    arrays += folded_conv(2 * FLAGS.trunk_layers + 2) + dense(1) + dense(2)
+
+    header = np.array([NATIVE_MODEL_MAGIC, NATIVE_MODEL_VERSION, go.N,
+                       features_lib.NEW_FEATURES_PLANES, FLAGS.conv_width,
+                       FLAGS.fc_width, FLAGS.trunk_layers], dtype='<u4')
+    with tf.gfile.GFile(path, 'wb') as f:
+        f.write(header.tobytes())
+        for array in arrays:
+            f.write(np.asarray(array, dtype='<f4').tobytes())
+
+
 def get_estimator(working_dir):
     if FLAGS.use_tpu:
         return get_tpu_estimator(working_dir)
@@ -6,9 +6,10 @@ import itertools
 import multiprocessing as mp
 import os
 import random
+import struct
 import subprocess
 import time
-from collections import deque
+from collections import deque, namedtuple
 
 from absl import flags
 import tensorflow as tf
@@ -28,8 +29,62 @@ MINIMUM_NEW_GAMES = 12000
 AVG_GAMES_PER_MODEL = 20000
 
 
-def pick_examples_from_tfrecord(filename, samples_per_game=4):
-    protos = list(tf.python_io.tf_record_iterator(filename, READ_OPTS))
+# A game in a shard, located through the shard's index: `name` is the name
+# the game's own file would have had, and its records take up `num_bytes`
+# bytes of `shard`, starting at `offset`.
+ShardGame = namedtuple('ShardGame', ['name', 'shard', 'offset', 'num_bytes'])
+
+
+def game_name(game):
+    """ game is a game file or a ShardGame. """
+    if isinstance(game, ShardGame):
+        return game.name
+    return os.path.basename(game)
+
+
+def _split_records(data):
+    """ Yields the records in data, a run of whole uncompressed TFRecords. """
+    pos = 0
+    while pos < len(data):
+        length, = struct.unpack_from('<Q', data, pos)
+        pos += 12  # The length and its CRC.
+        yield data[pos:pos + length]
+        pos += length + 4  # The record and its CRC.
+
+
+def read_game(game):
+    """ Returns the serialized examples of a game file or ShardGame. """
+    if isinstance(game, ShardGame):
+        with tf.gfile.GFile(game.shard, 'rb') as f:
+            f.seek(game.offset)
+            return list(_split_records(f.read(game.num_bytes)))
+    options = READ_OPTS if game.endswith('.zz') else None
+    return list(tf.python_io.tf_record_iterator(game, options))
+
+
+def find_games(directory):
+    """ Returns the games in directory: the files of games written to their own
+    file, and a ShardGame for each game in the index of a shard, including the
+    shards that are still being written or were left open by a crash. """
+    games = []
+    for filename in preprocessing.find_tf_records(directory,
+                                                  incomplete_shards=True):
+        if not preprocessing.is_shard(filename):
+            games.append(filename)
+            continue
+        index = filename + preprocessing.SHARD_INDEX_SUFFIX
+        with tf.gfile.GFile(index) as f:
+            for line in f:
+                if not line.endswith('\n'):
+                    break  # The line is still being written.
+                name, _, _, offset, num_bytes = line.split()
+                games.append(
+                    ShardGame(name, filename, int(offset), int(num_bytes)))
+    return games
+
+
+def pick_examples_from_tfrecord(game, samples_per_game=4):
+    protos = read_game(game)
     if len(protos) < 50:  # Filter games with less than 20 moves
         return []
     choices = random.sample(protos, min(len(protos), samples_per_game))
@@ -43,12 +98,12 @@ def pick_examples_from_tfrecord(filename, samples_per_game=4):
 
 def choose(game, samples_per_game=4):
     examples = pick_examples_from_tfrecord(game, samples_per_game)
-    timestamp = file_timestamp(game)
+    timestamp = game_timestamp(game)
     return [(timestamp, ex) for ex in examples]
 
 
-def file_timestamp(filename):
-    return int(os.path.basename(filename).split('-')[0])
+def game_timestamp(game):
+    return int(game_name(game).split('-')[0])
 
 
 def _ts_to_str(timestamp):
@@ -65,8 +120,8 @@ class ExampleBuffer():
         self.total_updates = 0
 
     def parallel_fill(self, games, threads=8):
-        """ games is a list of .tfrecord.zz game records. """
-        games.sort(key=os.path.basename)
+        """ games is a list of games, as returned by find_games. """
+        games.sort(key=game_name)
         # A couple extra in case parsing fails
         max_games = (self.max_size // self.samples_per_game) + 480
         if len(games) > max_games:
@@ -78,11 +133,11 @@ class ExampleBuffer():
         print("Got", len(self.examples), "examples")
 
     def update(self, new_games):
-        """ new_games is a list of .tfrecord.zz new game records. """
-        new_games.sort(key=os.path.basename)
+        """ new_games is a list of new games, as returned by find_games. """
+        new_games.sort(key=game_name)
         first_new_game = None
         for idx, game in enumerate(new_games):
-            timestamp = file_timestamp(game)
+            timestamp = game_timestamp(game)
             if timestamp <= self.examples[-1][0]:
                 continue
             elif first_new_game is None:
@@ -93,7 +148,7 @@ class ExampleBuffer():
                 self.total_updates += num_new_games
             self.examples.extend(self.func(game))
         if first_new_game is None:
-            print("No new games", file_timestamp(new_games[-1]), self.examples[-1][0])
+            print("No new games", game_timestamp(new_games[-1]), self.examples[-1][0])
 
     def flush(self, path):
         # random.shuffle on deque is O(n^2) convert to list for O(n)
@@ -119,7 +174,7 @@ class ExampleBuffer():
 
 
 def files_for_model(model):
-    return tf.gfile.Glob(os.path.join(LOCAL_DIR, model[1], '*.zz'))
+    return find_games(os.path.join(LOCAL_DIR, model[1]))
 
 
 def smart_rsync(
@@ -205,7 +260,7 @@ def fill_and_wait_time(bufsize=dual_net.EXAMPLES_PER_GENERATION,
         start_from = dt.datetime.utcnow()
 
     hours = fsdb.get_hour_dirs()
-    files = (tf.gfile.Glob(os.path.join(LOCAL_DIR, d, "*.zz"))
+    files = (find_games(os.path.join(LOCAL_DIR, d))
              for d in reversed(hours) if tf.gfile.Exists(os.path.join(LOCAL_DIR, d)))
     files = itertools.islice(files, get_window_size(chunk_to_make))
 
@@ -218,8 +273,8 @@ def fill_and_wait_time(bufsize=dual_net.EXAMPLES_PER_GENERATION,
             time_rsync(start_from - dt.timedelta(minutes=60))
         start_from = dt.datetime.utcnow()
         hours = sorted(fsdb.get_hour_dirs(LOCAL_DIR))
-        new_files = list(map(lambda d: tf.gfile.Glob(
-            os.path.join(LOCAL_DIR, d, '*.zz')), hours[-2:]))
+        new_files = list(map(lambda d: find_games(
+            os.path.join(LOCAL_DIR, d)), hours[-2:]))
         buf.update(list(itertools.chain.from_iterable(new_files)))
         if fast_write:
             break
@@ -290,7 +345,7 @@ def make_chunk_for(output_dir=LOCAL_DIR,
         if not tf.gfile.Exists(local_model_dir):
             print("Rsyncing", model)
             _rsync_dir(os.path.join(game_dir, model), local_model_dir)
-        files.extend(tf.gfile.Glob(os.path.join(local_model_dir, '*.zz')))
+        files.extend(find_games(local_model_dir))
         print("{}: {} games".format(model, len(files)))
         if len(files) * samples_per_game > positions:
             break
@@ -21,6 +21,11 @@ at the bottom (again, via RPC).
 
 import abc
 from contextlib import contextmanager
+import ctypes
+import mmap
+import os
+import platform
+import struct
 import sys
 import time
 import threading
@@ -50,6 +55,11 @@ flags.DEFINE_string("checkpoint_dir", "",
 flags.DEFINE_string("server_address", "localhost:50051",
                     "Inference server local address.")
 
+flags.DEFINE_string("shm_name", "",
+                    "If set, exchange features and outputs with the inference "
+                    "server through the POSIX shared memory region with this "
+                    "name instead of over gRPC.")
+
 flags.DEFINE_string("descriptor",
                     "proto/inference_service_py_pb2.pb.descriptor_set",
                     "Path to the InferenceService proto descriptor.")
@@ -116,6 +126,220 @@ class RwMutex(object):
                 self._resource_lock.release()
 
 
+class StaleBatchError(Exception):
+    """Raised by ShmInferenceStub.PutOutputs for a requeued batch."""
+    pass
+
+
+class ShmInferenceStub(object):
+    """Stand-in for InferenceServiceStub that talks to a ShmInferenceServer.
+
+    Features and outputs are exchanged through a shared memory region whose
+    layout is documented in cc/dual_net/shm_inference_server.h. The methods
+    mirror the subset of the InferenceService RPCs used by the Worker. The
+    batch IDs they return are local to the stub, and identify both the slot
+    and the server's batch ID for the slot at the time it was claimed.
+
+    Like the C++ ShmInferenceWorker, the stub claims slots and takes ownership
+    of them before writing outputs with atomic compare-and-swaps on the slots'
+    state words, which it calls through libatomic.
+    """
+
+    _MAGIC = 0x4d53474d
+    _VERSION = 3
+    _HEADER_SIZE = 64
+    _SLOT_HEADER_SIZE = 256
+    _ALIGNMENT = 64
+
+    # Byte offsets of the header's futex words.
+    _FEATURES_SEQ = 32
+    _SHUTDOWN = 36
+
+    # Byte offsets of the slot header fields. The state word holds the slot
+    # state in its low _STATE_BITS bits and the batch ID in the rest.
+    _STATE = 0
+    _HEARTBEAT = 4
+    _MODEL_PATH_LENGTH = 8
+    _MODEL_PATH = 12
+    _STATE_BITS = 3
+
+    # Slot states.
+    _FEATURES_READY = 1
+    _RUNNING = 2
+    _OUTPUTS_READY = 3
+    _WRITING_OUTPUTS = 4
+
+    _SEQ_CST = 5
+
+    _FUTEX_WAIT = 0
+    _FUTEX_WAKE = 1
+    _SYS_FUTEX = {"x86_64": 202, "aarch64": 98, "ppc64le": 221}
+
+    class _Timespec(ctypes.Structure):
+        _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+    def __init__(self, name):
+        fd = os.open("/dev/shm" + name, os.O_RDWR)
+        try:
+            self._mm = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+
+        (magic, version, self.board_size, num_planes, self.virtual_losses,
+         self.games_per_inference, self._num_slots,
+         self._slot_size) = struct.unpack_from("<8I", self._mm, 0)
+        if magic != self._MAGIC or version != self._VERSION:
+            raise RuntimeError("%s isn't a version %d inference region" % (
+                name, self._VERSION))
+        if num_planes != features_lib.NEW_FEATURES_PLANES:
+            raise RuntimeError("Feature planes mismatch: server=%d, "
+                               "worker=%d" % (
+                                   num_planes,
+                                   features_lib.NEW_FEATURES_PLANES))
+
+        batch_size = self.virtual_losses * self.games_per_inference
+        self._num_features = batch_size * self.board_size ** 2 * num_planes
+        self._features = self._SLOT_HEADER_SIZE
+        self._policy = self._align(self._features + self._num_features)
+        self._value = self._align(
+            self._policy + batch_size * (self.board_size ** 2 + 1) * 4)
+
+        self._base = ctypes.addressof(ctypes.c_char.from_buffer(self._mm))
+        self._libc = ctypes.CDLL(None, use_errno=True)
+        # The names are looked up with getattr, because Python would mangle
+        # them if they were written as attributes inside the class.
+        atomic = ctypes.CDLL("libatomic.so.1")
+        self._atomic_cas = getattr(atomic, "__atomic_compare_exchange_4")
+        self._atomic_cas.restype = ctypes.c_bool
+        self._atomic_fetch_add = getattr(atomic, "__atomic_fetch_add_4")
+        self._atomic_store = getattr(atomic, "__atomic_store_4")
+        self._sys_futex = self._SYS_FUTEX[platform.machine()]
+        self._lock = threading.Lock()
+
+        # Maps the batch IDs returned by GetFeatures to (slot, the server's
+        # batch ID for the slot when it was claimed), for the batches whose
+        # outputs haven't been written yet.
+        self._claims = {}
+        self._next_claim = 0
+
+    def GetConfig(self, request):
+        return inference_service_pb2.GetConfigResponse(
+            board_size=self.board_size,
+            virtual_losses=self.virtual_losses,
+            games_per_inference=self.games_per_inference)
+
+    def Heartbeat(self, request):
+        with self._lock:
+            for slot, batch_id in self._claims.values():
+                # Only keep a claim alive while the batch is still ours.
+                offset = self._slot_offset(slot)
+                if self._load(offset + self._STATE) == self._state_word(
+                        batch_id, self._RUNNING):
+                    self._fetch_add(offset + self._HEARTBEAT, 1)
+        return inference_service_pb2.HeartbeatResponse()
+
+    def GetFeatures(self, request):
+        while True:
+            # Read features_seq before looking at the slots, so that we don't
+            # miss the wake up if the server publishes a batch in between.
+            seq = self._load(self._FEATURES_SEQ)
+            if self._load(self._SHUTDOWN):
+                raise RuntimeError("Inference server shut down")
+            for slot in range(self._num_slots):
+                offset = self._slot_offset(slot)
+                word = self._load(offset + self._STATE)
+                if word & ((1 << self._STATE_BITS) - 1) != self._FEATURES_READY:
+                    continue
+                batch_id = word >> self._STATE_BITS
+                if not self._compare_exchange(
+                        offset + self._STATE, word,
+                        self._state_word(batch_id, self._RUNNING)):
+                    continue
+                self._fetch_add(offset + self._HEARTBEAT, 1)
+                with self._lock:
+                    claim = self._next_claim
+                    self._next_claim = (claim + 1) % 2**31
+                    self._claims[claim] = (slot, batch_id)
+                begin = offset + self._features
+                features = self._mm[begin:begin + self._num_features]
+                return inference_service_pb2.GetFeaturesResponse(
+                    batch_id=claim, features=features)
+            self._futex_wait(self._FEATURES_SEQ, seq, 1)
+
+    def PutOutputs(self, request):
+        """Writes the outputs back to the slot.
+
+        Raises StaleBatchError if the server handed the batch out again because
+        this worker took too long.
+        """
+        with self._lock:
+            slot, batch_id = self._claims.pop(request.batch_id)
+        offset = self._slot_offset(slot)
+        model_path = request.model_path.encode("utf-8")
+        if len(model_path) > self._SLOT_HEADER_SIZE - self._MODEL_PATH:
+            raise RuntimeError("Model path too long: %s" % request.model_path)
+        # Take ownership of the slot before writing anything to it, so that
+        # the outputs of a requeued batch never overwrite those of the worker
+        # it was handed out to.
+        if not self._compare_exchange(
+                offset + self._STATE,
+                self._state_word(batch_id, self._RUNNING),
+                self._state_word(batch_id, self._WRITING_OUTPUTS)):
+            raise StaleBatchError("Slot %d was requeued" % slot)
+        self._write(offset + self._policy, request.packed_policy)
+        self._write(offset + self._value, request.packed_value)
+        self._store(offset + self._MODEL_PATH_LENGTH, len(model_path))
+        self._write(offset + self._MODEL_PATH, model_path)
+        self._atomic_store(
+            self._address(offset + self._STATE),
+            ctypes.c_uint32(self._state_word(batch_id, self._OUTPUTS_READY)),
+            self._SEQ_CST)
+        self._futex_wake(offset + self._STATE, 1)
+        return inference_service_pb2.PutOutputsResponse()
+
+    def _state_word(self, batch_id, state):
+        return ((batch_id << self._STATE_BITS) | state) & 0xffffffff
+
+    def _address(self, offset):
+        return ctypes.c_void_p(self._base + offset)
+
+    def _compare_exchange(self, offset, expected, desired):
+        expected = ctypes.c_uint32(expected)
+        return self._atomic_cas(
+            self._address(offset), ctypes.byref(expected),
+            ctypes.c_uint32(desired), self._SEQ_CST, self._SEQ_CST)
+
+    def _fetch_add(self, offset, value):
+        self._atomic_fetch_add(
+            self._address(offset), ctypes.c_uint32(value), self._SEQ_CST)
+
+    def _align(self, size):
+        return (size + self._ALIGNMENT - 1) // self._ALIGNMENT * self._ALIGNMENT
+
+    def _slot_offset(self, slot):
+        return self._HEADER_SIZE + slot * self._slot_size
+
+    def _write(self, offset, data):
+        self._mm[offset:offset + len(data)] = data
+
+    def _load(self, offset):
+        return struct.unpack_from("<I", self._mm, offset)[0]
+
+    def _store(self, offset, value):
+        struct.pack_into("<I", self._mm, offset, value)
+
+    def _futex_wait(self, offset, expected, timeout_secs):
+        ts = self._Timespec(int(timeout_secs),
+                            int((timeout_secs % 1) * 1e9))
+        self._libc.syscall(self._sys_futex, self._address(offset),
+                           self._FUTEX_WAIT, ctypes.c_uint32(expected),
+                           ctypes.byref(ts), None, 0)
+
+    def _futex_wake(self, offset, count):
+        self._libc.syscall(self._sys_futex, self._address(offset),
+                           self._FUTEX_WAKE, count, None, None, 0)
+
+
 def const_model_inference_fn(features):
     """Builds the model graph with weights marked as constant.
 
@@ -343,17 +567,14 @@ class Worker(object):
             dbg("all done!")
 
     def _get_server_config(self):
-        while True:
-            try:
-                channel = grpc.insecure_channel(FLAGS.server_address)
-                self.stub = inference_service_pb2_grpc.InferenceServiceStub(
-                    channel)
-                config = self.stub.GetConfig(
-                    inference_service_pb2.GetConfigRequest())
-                break
-            except grpc.RpcError:
-                dbg("Waiting for server")
-                time.sleep(1)
+        if FLAGS.shm_name:
+            # The server creates the shared memory region before starting the
+            # worker, so there's no need to wait for it.
+            self.stub = ShmInferenceStub(FLAGS.shm_name)
+            config = self.stub.GetConfig(
+                inference_service_pb2.GetConfigRequest())
+        else:
+            config = self._connect_to_server()
 
         if config.board_size != go.N:
             raise RuntimeError("Board size mismatch: server=%d, worker=%d" % (
@@ -373,6 +594,18 @@ class Worker(object):
         dbg("positions_per_inference = %d" % positions_per_inference)
         dbg("batch_size = %d" % self.batch_size)
 
+    def _connect_to_server(self):
+        while True:
+            try:
+                channel = grpc.insecure_channel(FLAGS.server_address)
+                self.stub = inference_service_pb2_grpc.InferenceServiceStub(
+                    channel)
+                return self.stub.GetConfig(
+                    inference_service_pb2.GetConfigRequest())
+            except grpc.RpcError:
+                dbg("Waiting for server")
+                time.sleep(1)
+
     def _run_threads(self):
         """Run inference threads and optionally a thread that updates the model.
 
@@ -386,10 +619,11 @@ class Worker(object):
         # Start the worker threads before the checkpoint thread: if the parent
         # process dies, the worker thread RPCs will fail and the thread will
         # exit. This gives us a chance below to set self._running to False,
-        # telling the checkpoint thread to exit.
+        # telling the heartbeat and checkpoint threads to exit.
         for i in range(NUM_WORKER_THREADS):
             threads.append(threading.Thread(
                 target=self._worker_thread, args=[i]))
+        threads.append(threading.Thread(target=self._heartbeat_thread))
         if FLAGS.checkpoint_dir:
             threads.append(threading.Thread(target=self._checkpoint_thread))
 
@@ -410,6 +644,13 @@ class Worker(object):
             # Wait a few seconds before checking again.
             time.sleep(5)
 
+    def _heartbeat_thread(self):
+        # Tell the server we're still alive, even while both worker threads
+        # are busy running a slow batch or waiting for a new model to load.
+        while self._running:
+            self.stub.Heartbeat(inference_service_pb2.HeartbeatRequest())
+            time.sleep(1)
+
     def _worker_thread(self, thread_id):
         dbg("waiting for model")
         while self._running and not self.sess.model_available.wait(1):
@@ -423,12 +664,23 @@ class Worker(object):
             policy, value, model_path = self.sess.run(
                 features_response.features)
 
+            # Send the outputs as packed little-endian float32 bytes: building
+            # the repeated float fields one element at a time is very slow in
+            # Python.
             put_outputs_request = inference_service_pb2.PutOutputsRequest(
                 batch_id=features_response.batch_id,
-                policy=np.concatenate(policy), value=value,
+                packed_policy=np.concatenate(policy).astype('<f4').tobytes(),
+                packed_value=np.asarray(value, dtype='<f4').tobytes(),
                 model_path=model_path)
 
-            self.stub.PutOutputs(put_outputs_request)
+            try:
+                self.stub.PutOutputs(put_outputs_request)
+            except StaleBatchError:
+                dbg("batch %d was requeued" % features_response.batch_id)
+            except grpc.RpcError as e:
+                if e.code() != grpc.StatusCode.NOT_FOUND:
+                    raise
+                dbg("batch %d was requeued" % features_response.batch_id)
 
         dbg("stopping worker", thread_id)
 
@@ -20,6 +20,7 @@ import tempfile
 
 import dual_net
 import evaluation
+import preprocessing
 import utils
 
 import cloud_logging
@@ -79,7 +80,7 @@ def validate(
     tf_records = []
     with utils.logged_timer("Building lists of holdout files"):
         for record_dir in tf_record_dirs:
-            tf_records.extend(gfile.Glob(os.path.join(record_dir, '*.zz')))
+            tf_records.extend(preprocessing.find_tf_records(record_dir))
 
     first_record = os.path.basename(tf_records[0])
     last_record = os.path.basename(tf_records[-1])
@@ -145,9 +146,15 @@ def freeze_graph(load_file):
         f.write(out_graph.SerializeToString())
 
 
+def export_native_model(load_file):
+    """ Loads a network and writes its weights for the C++ native engine """
+    n = dual_net.DualNetwork(load_file)
+    dual_net.export_native_model(n.sess, load_file + '.native')
+
+
 parser = argparse.ArgumentParser()
 argh.add_commands(parser, [bootstrap, train, train_dir, freeze_graph,
-                           evaluate, validate, convert])
+                           export_native_model, evaluate, validate, convert])
 
 if __name__ == '__main__':
     cloud_logging.configure()
@@ -14,6 +14,7 @@
 
 '''Utilities to create, read, write tf.Examples.'''
 import functools
+import os
 import random
 
 import coords
@@ -28,6 +29,44 @@ import tensorflow as tf
 TF_RECORD_CONFIG = tf.python_io.TFRecordOptions(
     tf.python_io.TFRecordCompressionType.ZLIB)
 
+# The C++ selfplay writes each game's examples to a .tfrecord.zz file by
+# default, or to an uncompressed .tfrecord file with --example_compression=none.
+# With --example_shard_mb, it appends the games to uncompressed
+# "<timestamp>-<hostname>-shard-<n>.tfrecord" shards instead. Each shard has an
+# index listing its games next to it, at the shard's path with
+# SHARD_INDEX_SUFFIX appended, to which a game's line is appended once the game
+# has been flushed to the shard. When a shard is complete, an empty file is
+# written to its path with SHARD_DONE_SUFFIX appended. Games written with
+# --example_format=compact (.game files and .games shards) aren't read here:
+# cc/replay_games must turn them into tf.Examples first.
+SHARD_INDEX_SUFFIX = '.index'
+SHARD_DONE_SUFFIX = '.done'
+
+
+def compression_type(filename):
+    '''Returns the TFRecord compression type of a file: ZLIB for .zz files.'''
+    return 'ZLIB' if filename.endswith('.zz') else ''
+
+
+def is_shard(filename):
+    return '-shard-' in os.path.basename(filename)
+
+
+def find_tf_records(directory, incomplete_shards=False):
+    '''Returns the TFRecord files of the games in `directory`, compressed or
+    not.
+
+    Shards are only returned once they are complete, so that they can be read
+    whole, unless incomplete_shards is set. Incomplete shards are those that
+    are still being written, or were left open by a selfplay process that died:
+    only the games listed in their index can be read.'''
+    files = tf.gfile.Glob(os.path.join(directory, '*.tfrecord.zz'))
+    suffix = SHARD_INDEX_SUFFIX if incomplete_shards else SHARD_DONE_SUFFIX
+    for filename in tf.gfile.Glob(os.path.join(directory, '*.tfrecord')):
+        if not is_shard(filename) or tf.gfile.Exists(filename + suffix):
+            files.append(filename)
+    return files
+
 
 def _one_hot(index):
     onehot = np.zeros([go.N * go.N + 1], dtype=np.float32)
@@ -116,9 +155,11 @@ def read_tf_records(batch_size, tf_records, num_repeats=1,
     tf_records = list(tf_records)
     if shuffle_records:
         random.shuffle(tf_records)
-    record_list = tf.data.Dataset.from_tensor_slices(tf_records)
+    record_list = tf.data.Dataset.from_tensor_slices(
+        (tf_records, [compression_type(r) for r in tf_records]))
 
-    # compression_type here must agree with write_tf_examples
+    # Each file is read with the compression its name implies, which for the
+    # files written by write_tf_examples is ZLIB.
     # cycle_length = how many tfrecord files are read in parallel
     # block_length = how many tf.Examples are read from each file before
     #   moving to the next file
@@ -126,14 +167,13 @@ def read_tf_records(batch_size, tf_records, num_repeats=1,
     # and the examples being read from the files.
     if sloppy_interleave:
         dataset = record_list.apply(tf.contrib.data.parallel_interleave(
-            functools.partial(tf.data.TFRecordDataset,
-                              buffer_size=8 * 1024 * 1024,
-                              compression_type='ZLIB'),
+            lambda x, c: tf.data.TFRecordDataset(
+                x, compression_type=c, buffer_size=8 * 1024 * 1024),
             cycle_length=64, sloppy=True))
     else:
-        dataset = record_list.interleave(lambda x:
+        dataset = record_list.interleave(lambda x, c:
                                          tf.data.TFRecordDataset(
-                                             x, compression_type='ZLIB'),
+                                             x, compression_type=c),
                                          cycle_length=64, block_length=16)
     if filter_amount < 1.0:
         dataset = dataset.filter(lambda x: tf.less(
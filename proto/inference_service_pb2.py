@@ -19,7 +19,7 @@ DESCRIPTOR = _descriptor.FileDescriptor(
   name='proto/inference_service.proto',
   package='minigo',
   syntax='proto3',
-  serialized_pb=_b('\n\x1dproto/inference_service.proto\x12\x06minigo\"\x12\n\x10GetConfigRequest\"\\\n\x11GetConfigResponse\x12\x12\n\nboard_size\x18\x01 \x01(\x05\x12\x16\n\x0evirtual_losses\x18\x02 \x01(\x05\x12\x1b\n\x13games_per_inference\x18\x03 \x01(\x05\"\x14\n\x12GetFeaturesRequest\"9\n\x13GetFeaturesResponse\x12\x10\n\x08\x62\x61tch_id\x18\x01 \x01(\x05\x12\x10\n\x08\x66\x65\x61tures\x18\x02 \x01(\x0c\"X\n\x11PutOutputsRequest\x12\x10\n\x08\x62\x61tch_id\x18\x01 \x01(\x05\x12\x0e\n\x06policy\x18\x02 \x03(\x02\x12\r\n\x05value\x18\x03 \x03(\x02\x12\x12\n\nmodel_path\x18\x04 \x01(\t\"\x14\n\x12PutOutputsResponse2\xe7\x01\n\x10InferenceService\x12\x42\n\tGetConfig\x12\x18.minigo.GetConfigRequest\x1a\x19.minigo.GetConfigResponse\"\x00\x12H\n\x0bGetFeatures\x12\x1a.minigo.GetFeaturesRequest\x1a\x1b.minigo.GetFeaturesResponse\"\x00\x12\x45\n\nPutOutputs\x12\x19.minigo.PutOutputsRequest\x1a\x1a.minigo.PutOutputsResponse\"\x00\x62\x06proto3')
+  serialized_pb=_b('\n\x1dproto/inference_service.proto\x12\x06minigo\"\x12\n\x10GetConfigRequest\"\\\n\x11GetConfigResponse\x12\x12\n\nboard_size\x18\x01 \x01(\x05\x12\x16\n\x0evirtual_losses\x18\x02 \x01(\x05\x12\x1b\n\x13games_per_inference\x18\x03 \x01(\x05\"\x14\n\x12GetFeaturesRequest\"9\n\x13GetFeaturesResponse\x12\x10\n\x08\x62\x61tch_id\x18\x01 \x01(\x05\x12\x10\n\x08\x66\x65\x61tures\x18\x02 \x01(\x0c\"\x85\x01\n\x11PutOutputsRequest\x12\x10\n\x08\x62\x61tch_id\x18\x01 \x01(\x05\x12\x0e\n\x06policy\x18\x02 \x03(\x02\x12\r\n\x05value\x18\x03 \x03(\x02\x12\x12\n\nmodel_path\x18\x04 \x01(\t\x12\x15\n\rpacked_policy\x18\x05 \x01(\x0c\x12\x14\n\x0cpacked_value\x18\x06 \x01(\x0c\"\x14\n\x12PutOutputsResponse\"\x12\n\x10HeartbeatRequest\"\x13\n\x11HeartbeatResponse\"\x11\n\x0fGetStatsRequest\"*\n\x0bMetricValue\x12\x0c\n\x04name\x18\x01 \x01(\t\x12\r\n\x05value\x18\x02 \x01(\x03\"\x7f\n\x10HistogramSummary\x12\x0c\n\x04name\x18\x01 \x01(\t\x12\r\n\x05\x63ount\x18\x02 \x01(\x03\x12\x0c\n\x04mean\x18\x03 \x01(\x01\x12\x0b\n\x03p50\x18\x04 \x01(\x03\x12\x0b\n\x03p90\x18\x05 \x01(\x03\x12\x0b\n\x03p99\x18\x06 \x01(\x03\x12\x0c\n\x04p999\x18\x07 \x01(\x03\x12\x0b\n\x03max\x18\x08 \x01(\x03\"c\n\x0bWorkerStats\x12\x0c\n\x04peer\x18\x01 \x01(\t\x12\x13\n\x0bnum_batches\x18\x02 \x01(\x03\x12\x16\n\x0enum_inferences\x18\x03 \x01(\x03\x12\x19\n\x11inference_seconds\x18\x04 \x01(\x01\"\xb2\x01\n\x10GetStatsResponse\x12%\n\x08\x63ounters\x18\x01 \x03(\x0b\x32\x13.minigo.MetricValue\x12#\n\x06gauges\x18\x02 \x03(\x0b\x32\x13.minigo.MetricValue\x12,\n\nhistograms\x18\x03 \x03(\x0b\x32\x18.minigo.HistogramSummary\x12$\n\x07workers\x18\x04 \x03(\x0b\x32\x13.minigo.WorkerStats2\xec\x02\n\x10InferenceService\x12\x42\n\tGetConfig\x12\x18.minigo.GetConfigRequest\x1a\x19.minigo.GetConfigResponse\"\x00\x12H\n\x0bGetFeatures\x12\x1a.minigo.GetFeaturesRequest\x1a\x1b.minigo.GetFeaturesResponse\"\x00\x12\x45\n\nPutOutputs\x12\x19.minigo.PutOutputsRequest\x1a\x1a.minigo.PutOutputsResponse\"\x00\x12\x42\n\tHeartbeat\x12\x18.minigo.HeartbeatRequest\x1a\x19.minigo.HeartbeatResponse\"\x00\x12?\n\x08GetStats\x12\x17.minigo.GetStatsRequest\x1a\x18.minigo.GetStatsResponse\"\x00\x42\x03\xf8\x01\x01\x62\x06proto3')
 )
 
 
@@ -191,6 +191,20 @@ _PUTOUTPUTSREQUEST = _descriptor.Descriptor(
       message_type=None, enum_type=None, containing_type=None,
       is_extension=False, extension_scope=None,
       options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='packed_policy', full_name='minigo.PutOutputsRequest.packed_policy', index=4,
+      number=5, type=12, cpp_type=9, label=1,
+      has_default_value=False, default_value=_b(""),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='packed_value', full_name='minigo.PutOutputsRequest.packed_value', index=5,
+      number=6, type=12, cpp_type=9, label=1,
+      has_default_value=False, default_value=_b(""),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
   ],
   extensions=[
   ],
@@ -203,8 +217,8 @@ _PUTOUTPUTSREQUEST = _descriptor.Descriptor(
   extension_ranges=[],
   oneofs=[
   ],
-  serialized_start=236,
-  serialized_end=324,
+  serialized_start=237,
+  serialized_end=370,
 )
 
 
@@ -227,16 +241,321 @@ _PUTOUTPUTSRESPONSE = _descriptor.Descriptor(
   extension_ranges=[],
   oneofs=[
   ],
-  serialized_start=326,
-  serialized_end=346,
+  serialized_start=372,
+  serialized_end=392,
+)
+
+
+_HEARTBEATREQUEST = _descriptor.Descriptor(
+  name='HeartbeatRequest',
+  full_name='minigo.HeartbeatRequest',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=394,
+  serialized_end=412,
+)
+
+
+_HEARTBEATRESPONSE = _descriptor.Descriptor(
+  name='HeartbeatResponse',
+  full_name='minigo.HeartbeatResponse',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=414,
+  serialized_end=433,
 )
 
+
+_GETSTATSREQUEST = _descriptor.Descriptor(
+  name='GetStatsRequest',
+  full_name='minigo.GetStatsRequest',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=435,
+  serialized_end=452,
+)
+
+
+_METRICVALUE = _descriptor.Descriptor(
+  name='MetricValue',
+  full_name='minigo.MetricValue',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+    _descriptor.FieldDescriptor(
+      name='name', full_name='minigo.MetricValue.name', index=0,
+      number=1, type=9, cpp_type=9, label=1,
+      has_default_value=False, default_value=_b("").decode('utf-8'),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='value', full_name='minigo.MetricValue.value', index=1,
+      number=2, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=454,
+  serialized_end=496,
+)
+
+
+_HISTOGRAMSUMMARY = _descriptor.Descriptor(
+  name='HistogramSummary',
+  full_name='minigo.HistogramSummary',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+    _descriptor.FieldDescriptor(
+      name='name', full_name='minigo.HistogramSummary.name', index=0,
+      number=1, type=9, cpp_type=9, label=1,
+      has_default_value=False, default_value=_b("").decode('utf-8'),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='count', full_name='minigo.HistogramSummary.count', index=1,
+      number=2, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='mean', full_name='minigo.HistogramSummary.mean', index=2,
+      number=3, type=1, cpp_type=5, label=1,
+      has_default_value=False, default_value=float(0),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='p50', full_name='minigo.HistogramSummary.p50', index=3,
+      number=4, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='p90', full_name='minigo.HistogramSummary.p90', index=4,
+      number=5, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='p99', full_name='minigo.HistogramSummary.p99', index=5,
+      number=6, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='p999', full_name='minigo.HistogramSummary.p999', index=6,
+      number=7, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='max', full_name='minigo.HistogramSummary.max', index=7,
+      number=8, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=498,
+  serialized_end=625,
+)
+
+
+_WORKERSTATS = _descriptor.Descriptor(
+  name='WorkerStats',
+  full_name='minigo.WorkerStats',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+    _descriptor.FieldDescriptor(
+      name='peer', full_name='minigo.WorkerStats.peer', index=0,
+      number=1, type=9, cpp_type=9, label=1,
+      has_default_value=False, default_value=_b("").decode('utf-8'),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='num_batches', full_name='minigo.WorkerStats.num_batches', index=1,
+      number=2, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='num_inferences', full_name='minigo.WorkerStats.num_inferences', index=2,
+      number=3, type=3, cpp_type=2, label=1,
+      has_default_value=False, default_value=0,
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='inference_seconds', full_name='minigo.WorkerStats.inference_seconds', index=3,
+      number=4, type=1, cpp_type=5, label=1,
+      has_default_value=False, default_value=float(0),
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=627,
+  serialized_end=726,
+)
+
+
+_GETSTATSRESPONSE = _descriptor.Descriptor(
+  name='GetStatsResponse',
+  full_name='minigo.GetStatsResponse',
+  filename=None,
+  file=DESCRIPTOR,
+  containing_type=None,
+  fields=[
+    _descriptor.FieldDescriptor(
+      name='counters', full_name='minigo.GetStatsResponse.counters', index=0,
+      number=1, type=11, cpp_type=10, label=3,
+      has_default_value=False, default_value=[],
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='gauges', full_name='minigo.GetStatsResponse.gauges', index=1,
+      number=2, type=11, cpp_type=10, label=3,
+      has_default_value=False, default_value=[],
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='histograms', full_name='minigo.GetStatsResponse.histograms', index=2,
+      number=3, type=11, cpp_type=10, label=3,
+      has_default_value=False, default_value=[],
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+    _descriptor.FieldDescriptor(
+      name='workers', full_name='minigo.GetStatsResponse.workers', index=3,
+      number=4, type=11, cpp_type=10, label=3,
+      has_default_value=False, default_value=[],
+      message_type=None, enum_type=None, containing_type=None,
+      is_extension=False, extension_scope=None,
+      options=None, file=DESCRIPTOR),
+  ],
+  extensions=[
+  ],
+  nested_types=[],
+  enum_types=[
+  ],
+  options=None,
+  is_extendable=False,
+  syntax='proto3',
+  extension_ranges=[],
+  oneofs=[
+  ],
+  serialized_start=729,
+  serialized_end=907,
+)
+
+_GETSTATSRESPONSE.fields_by_name['counters'].message_type = _METRICVALUE
+_GETSTATSRESPONSE.fields_by_name['gauges'].message_type = _METRICVALUE
+_GETSTATSRESPONSE.fields_by_name['histograms'].message_type = _HISTOGRAMSUMMARY
+_GETSTATSRESPONSE.fields_by_name['workers'].message_type = _WORKERSTATS
 DESCRIPTOR.message_types_by_name['GetConfigRequest'] = _GETCONFIGREQUEST
 DESCRIPTOR.message_types_by_name['GetConfigResponse'] = _GETCONFIGRESPONSE
 DESCRIPTOR.message_types_by_name['GetFeaturesRequest'] = _GETFEATURESREQUEST
 DESCRIPTOR.message_types_by_name['GetFeaturesResponse'] = _GETFEATURESRESPONSE
 DESCRIPTOR.message_types_by_name['PutOutputsRequest'] = _PUTOUTPUTSREQUEST
 DESCRIPTOR.message_types_by_name['PutOutputsResponse'] = _PUTOUTPUTSRESPONSE
+DESCRIPTOR.message_types_by_name['HeartbeatRequest'] = _HEARTBEATREQUEST
+DESCRIPTOR.message_types_by_name['HeartbeatResponse'] = _HEARTBEATRESPONSE
+DESCRIPTOR.message_types_by_name['GetStatsRequest'] = _GETSTATSREQUEST
+DESCRIPTOR.message_types_by_name['MetricValue'] = _METRICVALUE
+DESCRIPTOR.message_types_by_name['HistogramSummary'] = _HISTOGRAMSUMMARY
+DESCRIPTOR.message_types_by_name['WorkerStats'] = _WORKERSTATS
+DESCRIPTOR.message_types_by_name['GetStatsResponse'] = _GETSTATSRESPONSE
 _sym_db.RegisterFileDescriptor(DESCRIPTOR)
 
 GetConfigRequest = _reflection.GeneratedProtocolMessageType('GetConfigRequest', (_message.Message,), dict(
@@ -281,6 +600,58 @@ PutOutputsResponse = _reflection.GeneratedProtocolMessageType('PutOutputsRespons
   ))
 _sym_db.RegisterMessage(PutOutputsResponse)
 
+HeartbeatRequest = _reflection.GeneratedProtocolMessageType('HeartbeatRequest', (_message.Message,), dict(
+  DESCRIPTOR = _HEARTBEATREQUEST,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.HeartbeatRequest)
+  ))
+_sym_db.RegisterMessage(HeartbeatRequest)
+
+HeartbeatResponse = _reflection.GeneratedProtocolMessageType('HeartbeatResponse', (_message.Message,), dict(
+  DESCRIPTOR = _HEARTBEATRESPONSE,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.HeartbeatResponse)
+  ))
+_sym_db.RegisterMessage(HeartbeatResponse)
+
+GetStatsRequest = _reflection.GeneratedProtocolMessageType('GetStatsRequest', (_message.Message,), dict(
+  DESCRIPTOR = _GETSTATSREQUEST,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.GetStatsRequest)
+  ))
+_sym_db.RegisterMessage(GetStatsRequest)
+
+MetricValue = _reflection.GeneratedProtocolMessageType('MetricValue', (_message.Message,), dict(
+  DESCRIPTOR = _METRICVALUE,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.MetricValue)
+  ))
+_sym_db.RegisterMessage(MetricValue)
+
+HistogramSummary = _reflection.GeneratedProtocolMessageType('HistogramSummary', (_message.Message,), dict(
+  DESCRIPTOR = _HISTOGRAMSUMMARY,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.HistogramSummary)
+  ))
+_sym_db.RegisterMessage(HistogramSummary)
+
+WorkerStats = _reflection.GeneratedProtocolMessageType('WorkerStats', (_message.Message,), dict(
+  DESCRIPTOR = _WORKERSTATS,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.WorkerStats)
+  ))
+_sym_db.RegisterMessage(WorkerStats)
+
+GetStatsResponse = _reflection.GeneratedProtocolMessageType('GetStatsResponse', (_message.Message,), dict(
+  DESCRIPTOR = _GETSTATSRESPONSE,
+  __module__ = 'proto.inference_service_pb2'
+  # @@protoc_insertion_point(class_scope:minigo.GetStatsResponse)
+  ))
+_sym_db.RegisterMessage(GetStatsResponse)
+
+
+DESCRIPTOR.has_options = True
+DESCRIPTOR._options = _descriptor._ParseOptions(descriptor_pb2.FileOptions(), _b('\370\001\001'))
 
 
 _INFERENCESERVICE = _descriptor.ServiceDescriptor(
@@ -289,8 +660,8 @@ _INFERENCESERVICE = _descriptor.ServiceDescriptor(
   file=DESCRIPTOR,
   index=0,
   options=None,
-  serialized_start=349,
-  serialized_end=580,
+  serialized_start=910,
+  serialized_end=1274,
   methods=[
   _descriptor.MethodDescriptor(
     name='GetConfig',
@@ -319,6 +690,24 @@ _INFERENCESERVICE = _descriptor.ServiceDescriptor(
     output_type=_PUTOUTPUTSRESPONSE,
     options=None,
   ),
+  _descriptor.MethodDescriptor(
+    name='Heartbeat',
+    full_name='minigo.InferenceService.Heartbeat',
+    index=3,
+    containing_service=None,
+    input_type=_HEARTBEATREQUEST,
+    output_type=_HEARTBEATRESPONSE,
+    options=None,
+  ),
+  _descriptor.MethodDescriptor(
+    name='GetStats',
+    full_name='minigo.InferenceService.GetStats',
+    index=4,
+    containing_service=None,
+    input_type=_GETSTATSREQUEST,
+    output_type=_GETSTATSRESPONSE,
+    options=None,
+  ),
 ])
 _sym_db.RegisterServiceDescriptor(_INFERENCESERVICE)
 
@@ -5,10 +5,8 @@ from proto import inference_service_pb2 as proto_dot_inference__service__pb2
 
 
 class InferenceServiceStub(object):
-  """TODO(tommadams): Investigate enabling arenas with:
-  option cc_enable_arenas = true;
-
-  """
+  # missing associated documentation comment in .proto file
+  pass
 
   def __init__(self, channel):
     """Constructor.
@@ -31,13 +29,21 @@ class InferenceServiceStub(object):
         request_serializer=proto_dot_inference__service__pb2.PutOutputsRequest.SerializeToString,
         response_deserializer=proto_dot_inference__service__pb2.PutOutputsResponse.FromString,
         )
+    self.Heartbeat = channel.unary_unary(
+        '/minigo.InferenceService/Heartbeat',
+        request_serializer=proto_dot_inference__service__pb2.HeartbeatRequest.SerializeToString,
+        response_deserializer=proto_dot_inference__service__pb2.HeartbeatResponse.FromString,
+        )
+    self.GetStats = channel.unary_unary(
+        '/minigo.InferenceService/GetStats',
+        request_serializer=proto_dot_inference__service__pb2.GetStatsRequest.SerializeToString,
+        response_deserializer=proto_dot_inference__service__pb2.GetStatsResponse.FromString,
+        )
 
 
 class InferenceServiceServicer(object):
-  """TODO(tommadams): Investigate enabling arenas with:
-  option cc_enable_arenas = true;
-
-  """
+  # missing associated documentation comment in .proto file
+  pass
 
   def GetConfig(self, request, context):
     """Called by the inference worker to get the server's configuration.
@@ -63,6 +69,26 @@ class InferenceServiceServicer(object):
     """Called by the inference worker to write back the inference outputs.
     The batch ID in the PutOutputRequest must match the ID from the previous
     call to GetFeaturesRequest.
+    If the batch has already been handed out to another worker (see
+    Heartbeat), fails with NOT_FOUND and the outputs are discarded.
+    """
+    context.set_code(grpc.StatusCode.UNIMPLEMENTED)
+    context.set_details('Method not implemented!')
+    raise NotImplementedError('Method not implemented!')
+
+  def Heartbeat(self, request, context):
+    """Called periodically by the inference worker to tell the server that it's
+    still alive. If the server doesn't hear from a worker for a while, the
+    batches it was sent are assumed lost and handed out to other workers.
+    Every other RPC also counts as a heartbeat.
+    """
+    context.set_code(grpc.StatusCode.UNIMPLEMENTED)
+    context.set_details('Method not implemented!')
+    raise NotImplementedError('Method not implemented!')
+
+  def GetStats(self, request, context):
+    """Returns the server's metrics and per-worker statistics, for monitoring
+    and diagnosing stalls.
     """
     context.set_code(grpc.StatusCode.UNIMPLEMENTED)
     context.set_details('Method not implemented!')
@@ -86,6 +112,16 @@ def add_InferenceServiceServicer_to_server(servicer, server):
           request_deserializer=proto_dot_inference__service__pb2.PutOutputsRequest.FromString,
           response_serializer=proto_dot_inference__service__pb2.PutOutputsResponse.SerializeToString,
       ),
+      'Heartbeat': grpc.unary_unary_rpc_method_handler(
+          servicer.Heartbeat,
+          request_deserializer=proto_dot_inference__service__pb2.HeartbeatRequest.FromString,
+          response_serializer=proto_dot_inference__service__pb2.HeartbeatResponse.SerializeToString,
+      ),
+      'GetStats': grpc.unary_unary_rpc_method_handler(
+          servicer.GetStats,
+          request_deserializer=proto_dot_inference__service__pb2.GetStatsRequest.FromString,
+          response_serializer=proto_dot_inference__service__pb2.GetStatsResponse.SerializeToString,
+      ),
   }
   generic_handler = grpc.method_handlers_generic_handler(
       'minigo.InferenceService', rpc_method_handlers)